@@ -9,75 +9,74 @@
 
 #include "uint256.h"
 #include "amount.h"
+#include "crypto/common.h"
+#include "saltedhasher.h"
 
-struct CMempoolAddressDelta
+#include <vector>
+
+/** Address in the mempool address index */
+struct CMempoolAddressKey
 {
-    int64_t time;
-    CAmount amount;
-    uint256 prevhash;
-    unsigned int prevout;
+    int type;
+    uint160 addressBytes;
 
-    CMempoolAddressDelta(int64_t t, CAmount a, uint256 hash, unsigned int out) {
-        time = t;
-        amount = a;
-        prevhash = hash;
-        prevout = out;
+    CMempoolAddressKey(int addressType, const uint160& addressHash) : type(addressType), addressBytes(addressHash) {}
+
+    friend bool operator==(const CMempoolAddressKey& a, const CMempoolAddressKey& b) {
+        return a.type == b.type && a.addressBytes == b.addressBytes;
     }
+};
 
-    CMempoolAddressDelta(int64_t t, CAmount a) {
-        time = t;
-        amount = a;
-        prevhash.SetNull();
-        prevout = 0;
+/** Address hashes are uniformly distributed, so hashing a prefix of them with the salt suffices */
+template<>
+struct SaltedHasherImpl<CMempoolAddressKey>
+{
+    static std::size_t CalcHash(const CMempoolAddressKey& v, uint64_t k0, uint64_t k1)
+    {
+        return CSipHasher(k0, k1).Write(ReadLE64(v.addressBytes.begin()) ^ (uint64_t)v.type).Finalize();
     }
 };
 
-struct CMempoolAddressDeltaKey
+struct CMempoolAddressTx;
+struct CMempoolAddressDeltas;
+
+/** Change of the balance of an address by an input (spending) or output of a mempool transaction */
+struct CMempoolAddressDelta
 {
-    int type;
-    uint160 addressBytes;
-    uint256 txhash;
+    const CMempoolAddressTx* tx;
+    CMempoolAddressDeltas* list;
+    CMempoolAddressDelta* prev;
+    CMempoolAddressDelta* next;
+
     unsigned int index;
-    int spending;
+    bool spending;
+    CAmount amount;
+    uint256 prevhash;     //!< spending only
+    unsigned int prevout; //!< spending only
 
-    CMempoolAddressDeltaKey(int addressType, uint160 addressHash, uint256 hash, unsigned int i, int s) {
-        type = addressType;
-        addressBytes = addressHash;
-        txhash = hash;
-        index = i;
-        spending = s;
-    }
+    CMempoolAddressDelta(unsigned int i, bool s, CAmount a, const uint256& hash, unsigned int out) :
+        tx(nullptr), list(nullptr), prev(nullptr), next(nullptr),
+        index(i), spending(s), amount(a), prevhash(hash), prevout(out) {}
+};
 
-    CMempoolAddressDeltaKey(int addressType, uint160 addressHash) {
-        type = addressType;
-        addressBytes = addressHash;
-        txhash.SetNull();
-        index = 0;
-        spending = 0;
-    }
+/** A transaction in the mempool address index, owning its deltas */
+struct CMempoolAddressTx
+{
+    uint256 txhash;
+    int64_t time;
+    //! Not resized once the deltas are linked into the lists of their addresses
+    std::vector<CMempoolAddressDelta> deltas;
 };
 
-struct CMempoolAddressDeltaKeyCompare
+/** The deltas of an address, linked in the order their transactions were added to the mempool */
+struct CMempoolAddressDeltas
 {
-    bool operator()(const CMempoolAddressDeltaKey& a, const CMempoolAddressDeltaKey& b) const {
-        if (a.type == b.type) {
-            if (a.addressBytes == b.addressBytes) {
-                if (a.txhash == b.txhash) {
-                    if (a.index == b.index) {
-                        return a.spending < b.spending;
-                    } else {
-                        return a.index < b.index;
-                    }
-                } else {
-                    return a.txhash < b.txhash;
-                }
-            } else {
-                return a.addressBytes < b.addressBytes;
-            }
-        } else {
-            return a.type < b.type;
-        }
-    }
+    CMempoolAddressKey key;
+    CMempoolAddressDelta* first;
+    CMempoolAddressDelta* last;
+    size_t count;
+
+    explicit CMempoolAddressDeltas(const CMempoolAddressKey& k) : key(k), first(nullptr), last(nullptr), count(0) {}
 };
 
 #endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,137 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "fs.h"
+#include "rpc/protocol.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <univalue.h>
+
+// Address index of a hot address with 1000000 entries, 10 per block, in a block tree database in a temporary
+// directory. Reading all entries at once is compared with reading one page through a cursor, and building the
+// getaddressdeltas result as a UniValue with writing it through JSONStreamWriter.
+
+static const int ADDRESS_INDEX_ENTRY_COUNT = 1000000;
+static const int ADDRESS_INDEX_ENTRIES_PER_BLOCK = 10;
+static const int ADDRESS_INDEX_PAGE_SIZE = 1000;
+
+class AddressIndexBenchDB
+{
+public:
+    fs::path dir;
+    std::unique_ptr<CBlockTreeDB> db;
+    const uint160 hash;
+
+    AddressIndexBenchDB() : hash(std::vector<unsigned char>(20, 0x42))
+    {
+        dir = fs::temp_directory_path() / fs::unique_path("ion_bench_addressindex_%%%%-%%%%");
+        fs::create_directories(dir);
+        gArgs.ForceSetArg("-datadir", dir.string());
+        ClearDatadirCache();
+        db.reset(new CBlockTreeDB(64 << 20, false, true));
+
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+        for (int i = 0; i < ADDRESS_INDEX_ENTRY_COUNT; i++) {
+            int nHeight = 1 + i / ADDRESS_INDEX_ENTRIES_PER_BLOCK;
+            int nTxIndex = 1 + i % ADDRESS_INDEX_ENTRIES_PER_BLOCK;
+            bool fSpending = i % 2 == 1;
+            vEntries.emplace_back(CAddressIndexKey(1, hash, nHeight, nTxIndex, ArithToUint256(arith_uint256(i + 1)), 0, fSpending),
+                                  fSpending ? -COIN : COIN);
+            if (vEntries.size() == 10000) {
+                bool fWritten = db->WriteAddressIndex(vEntries);
+                assert(fWritten);
+                vEntries.clear();
+            }
+        }
+    }
+
+    ~AddressIndexBenchDB()
+    {
+        db.reset();
+        fs::remove_all(dir);
+    }
+};
+
+static AddressIndexBenchDB& GetBenchDB()
+{
+    static AddressIndexBenchDB benchDB;
+    return benchDB;
+}
+
+static UniValue DeltaToJSON(const CAddressIndexKey& key, CAmount amount)
+{
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", amount));
+    delta.push_back(Pair("txid", key.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)key.index));
+    delta.push_back(Pair("blockindex", (int)key.txindex));
+    delta.push_back(Pair("height", key.blockHeight));
+    delta.push_back(Pair("address", "idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6"));
+    return delta;
+}
+
+static void AddressIndexReadAll(benchmark::State& state)
+{
+    AddressIndexBenchDB& benchDB = GetBenchDB();
+    while (state.KeepRunning()) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        bool fRead = benchDB.db->ReadAddressIndex(benchDB.hash, 1, addressIndex);
+        assert(fRead && addressIndex.size() == ADDRESS_INDEX_ENTRY_COUNT);
+    }
+}
+
+static void AddressIndexReadPage(benchmark::State& state)
+{
+    AddressIndexBenchDB& benchDB = GetBenchDB();
+    int nHeight = 1;
+    while (state.KeepRunning()) {
+        std::unique_ptr<CAddressIndexCursor> pcursor(benchDB.db->AddressIndexCursor(benchDB.hash, 1, nHeight));
+        int nCount = 0;
+        for (; pcursor->Valid() && nCount < ADDRESS_INDEX_PAGE_SIZE; pcursor->Next()) {
+            nCount++;
+        }
+        assert(nCount > 0);
+        nHeight = (nHeight + 7919) % (ADDRESS_INDEX_ENTRY_COUNT / ADDRESS_INDEX_ENTRIES_PER_BLOCK);
+    }
+}
+
+static void AddressIndexDeltasUniValue(benchmark::State& state)
+{
+    AddressIndexBenchDB& benchDB = GetBenchDB();
+    while (state.KeepRunning()) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        benchDB.db->ReadAddressIndex(benchDB.hash, 1, addressIndex);
+        UniValue result(UniValue::VARR);
+        for (const auto& entry : addressIndex) {
+            result.push_back(DeltaToJSON(entry.first, entry.second));
+        }
+        std::string str = result.write();
+        assert(!str.empty());
+    }
+}
+
+static void AddressIndexDeltasStream(benchmark::State& state)
+{
+    AddressIndexBenchDB& benchDB = GetBenchDB();
+    while (state.KeepRunning()) {
+        size_t nWritten = 0;
+        JSONStreamWriter stream([&nWritten](const std::string& str) { nWritten += str.size(); });
+        stream.BeginArray();
+        std::unique_ptr<CAddressIndexCursor> pcursor(benchDB.db->AddressIndexCursor(benchDB.hash, 1, 0));
+        for (; pcursor->Valid(); pcursor->Next()) {
+            stream.Value(DeltaToJSON(pcursor->GetKey(), pcursor->GetValue()));
+        }
+        stream.EndArray();
+        stream.Flush();
+        assert(nWritten > 0);
+    }
+}
+
+BENCHMARK(AddressIndexReadAll);
+BENCHMARK(AddressIndexReadPage);
+BENCHMARK(AddressIndexDeltasUniValue);
+BENCHMARK(AddressIndexDeltasStream);
@@ -109,10 +109,81 @@ struct DKG
             memberIdx = (memberIdx + 1) % members.size();
         }
     }
+
+    // Simulates the phases of a DKG session from the point of view of a single member
+
+    void Bench_PhaseContribute(benchmark::State& state)
+    {
+        while (state.KeepRunning()) {
+            BLSVerificationVectorPtr vvec;
+            BLSSecretKeyVector skShares;
+            blsWorker.GenerateContributions(members.size() / 2 + 1, ids, vvec, skShares);
+        }
+    }
+
+    // Contributions are received one by one, each with its verification vector being verified. The network delay
+    // between them is not modeled, so the streaming variant only shows how much of the share verification overlaps
+    // with the verification of the remaining vvecs.
+    void Bench_PhaseReceiveContributions(benchmark::State& state, bool streaming)
+    {
+        ReceiveVvecs();
+
+        size_t memberIdx = 0;
+        while (state.KeepRunning()) {
+            ReceiveShares(memberIdx);
+
+            std::vector<bool> result;
+            std::vector<std::future<std::vector<bool>>> futures;
+            size_t batchStart = 0;
+            for (size_t i = 0; i < members.size(); i++) {
+                assert(blsWorker.VerifyVerificationVector(*receivedVvecs[i]));
+
+                // contributions are verified in batches of 32 while more contributions arrive
+                if (streaming && (i + 1 - batchStart == 32 || i + 1 == members.size())) {
+                    std::vector<BLSVerificationVectorPtr> batchVvecs(receivedVvecs.begin() + batchStart, receivedVvecs.begin() + i + 1);
+                    BLSSecretKeyVector batchSkShares(receivedSkShares.begin() + batchStart, receivedSkShares.begin() + i + 1);
+                    futures.emplace_back(blsWorker.AsyncVerifyContributionShares(members[memberIdx].id, batchVvecs, batchSkShares, true, true));
+                    batchStart = i + 1;
+                }
+            }
+            if (streaming) {
+                for (auto& f : futures) {
+                    auto r = f.get();
+                    result.insert(result.end(), r.begin(), r.end());
+                }
+            } else {
+                // all contributions are verified at once when the complain phase starts
+                result = blsWorker.VerifyContributionShares(members[memberIdx].id, receivedVvecs, receivedSkShares, true, true);
+            }
+            assert(result.size() == members.size() && std::all_of(result.begin(), result.end(), [](bool v) { return v; }));
+
+            memberIdx = (memberIdx + 1) % members.size();
+        }
+    }
+
+    void Bench_PhaseCommit(benchmark::State& state)
+    {
+        ReceiveVvecs();
+
+        size_t memberIdx = 0;
+        while (state.KeepRunning()) {
+            ReceiveShares(memberIdx);
+
+            BuildQuorumVerificationVector(true);
+            CBLSSecretKey skShare = blsWorker.AggregateSecretKeys(receivedSkShares);
+            CBLSPublicKey pubKeyShare;
+            pubKeyShare.PublicKeyShare(*quorumVvec, members[memberIdx].id);
+            assert(skShare.GetPublicKey() == pubKeyShare);
+
+            memberIdx = (memberIdx + 1) % members.size();
+        }
+    }
 };
 
 std::shared_ptr<DKG> dkg10;
+std::shared_ptr<DKG> dkg50;
 std::shared_ptr<DKG> dkg100;
+std::shared_ptr<DKG> dkg200;
 std::shared_ptr<DKG> dkg400;
 
 void InitIfNeeded()
@@ -128,10 +199,23 @@ void InitIfNeeded()
     }
 }
 
+void InitPhasesIfNeeded()
+{
+    InitIfNeeded();
+    if (dkg50 == nullptr) {
+        dkg50 = std::make_shared<DKG>(50);
+    }
+    if (dkg200 == nullptr) {
+        dkg200 = std::make_shared<DKG>(200);
+    }
+}
+
 void CleanupBLSDkgTests()
 {
     dkg10.reset();
+    dkg50.reset();
     dkg100.reset();
+    dkg200.reset();
     dkg400.reset();
 }
 
@@ -179,3 +263,37 @@ BENCH_VerifyContributionShares(parallel, 400, 5, true, false)
 BENCH_VerifyContributionShares(parallel_aggregated, 10, 5, true, true)
 BENCH_VerifyContributionShares(parallel_aggregated, 100, 5, true, true)
 BENCH_VerifyContributionShares(parallel_aggregated, 400, 5, true, true)
+
+///////////////////////////////
+
+
+
+#define BENCH_Phases(quorumSize) \
+    static void BLSDKG_Phase1_Contribute_##quorumSize(benchmark::State& state) \
+    { \
+        InitPhasesIfNeeded(); \
+        dkg##quorumSize->Bench_PhaseContribute(state); \
+    } \
+    static void BLSDKG_Phase2_ReceiveContributions_batch_##quorumSize(benchmark::State& state) \
+    { \
+        InitPhasesIfNeeded(); \
+        dkg##quorumSize->Bench_PhaseReceiveContributions(state, false); \
+    } \
+    static void BLSDKG_Phase2_ReceiveContributions_streaming_##quorumSize(benchmark::State& state) \
+    { \
+        InitPhasesIfNeeded(); \
+        dkg##quorumSize->Bench_PhaseReceiveContributions(state, true); \
+    } \
+    static void BLSDKG_Phase4_Commit_##quorumSize(benchmark::State& state) \
+    { \
+        InitPhasesIfNeeded(); \
+        dkg##quorumSize->Bench_PhaseCommit(state); \
+    } \
+    BENCHMARK(BLSDKG_Phase1_Contribute_##quorumSize); \
+    BENCHMARK(BLSDKG_Phase2_ReceiveContributions_batch_##quorumSize); \
+    BENCHMARK(BLSDKG_Phase2_ReceiveContributions_streaming_##quorumSize); \
+    BENCHMARK(BLSDKG_Phase4_Commit_##quorumSize)
+
+BENCH_Phases(50)
+BENCH_Phases(200)
+BENCH_Phases(400)
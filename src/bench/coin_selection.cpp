@@ -4,6 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "chain.h"
+#include "key.h"
+#include "validation.h"
 #include "wallet/wallet.h"
 
 #include <set>
@@ -57,4 +60,90 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+static const int LARGE_WALLET_UTXO_COUNT = 100000;
+
+// Wallet with LARGE_WALLET_UTXO_COUNT confirmed UTXOs, every 4th of them with a PrivateSend denominated amount.
+// The UTXOs are in a fake block at the tip of chainActive, which is removed again when the wallet goes out of scope.
+class LargeWalletSetup
+{
+public:
+    CWallet wallet;
+    uint256 blockHash;
+    CBlockIndex blockIndex;
+
+    LargeWalletSetup()
+    {
+        CPrivateSend::InitStandardDenominations();
+        std::vector<CAmount> vecDenominations = CPrivateSend::GetStandardDenominations();
+
+        LOCK2(cs_main, wallet.cs_wallet);
+
+        blockHash = GetRandHash();
+        blockIndex.phashBlock = &blockHash;
+        blockIndex.nHeight = 0;
+        mapBlockIndex.emplace(blockHash, &blockIndex);
+        chainActive.SetTip(&blockIndex);
+
+        CKey key;
+        key.MakeNewKey(true);
+        wallet.LoadKey(key, key.GetPubKey());
+        CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+        for (int i = 0; i < LARGE_WALLET_UTXO_COUNT; i++) {
+            CMutableTransaction tx;
+            tx.nLockTime = i; // so all transactions get different hashes
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            tx.vout[0].nValue = i % 4 == 0 ? vecDenominations[i % vecDenominations.size()] : (i % 1000 + 1) * CENT;
+
+            CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+            wtx.SetMerkleBranch(&blockIndex, i);
+            wallet.LoadToWallet(wtx);
+        }
+        wallet.ScanWalletUTXOs();
+    }
+
+    ~LargeWalletSetup()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(nullptr);
+        mapBlockIndex.erase(blockHash);
+    }
+};
+
+static void CoinSelection_AvailableCoins_100k(benchmark::State& state)
+{
+    LargeWalletSetup setup;
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        setup.wallet.AvailableCoins(vCoins);
+        assert(vCoins.size() == LARGE_WALLET_UTXO_COUNT);
+    }
+}
+
+static void CoinSelection_AvailableCoinsDenominated_100k(benchmark::State& state)
+{
+    LargeWalletSetup setup;
+    CCoinControl coinControl;
+    coinControl.nCoinType = CoinType::ONLY_DENOMINATED;
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        setup.wallet.AvailableCoins(vCoins, true, &coinControl);
+        assert(vCoins.size() == LARGE_WALLET_UTXO_COUNT / 4);
+    }
+}
+
+static void CoinSelection_AvailableCoinsMinAmount_100k(benchmark::State& state)
+{
+    LargeWalletSetup setup;
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        setup.wallet.AvailableCoins(vCoins, true, nullptr, 9 * COIN);
+        assert(!vCoins.empty());
+    }
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelection_AvailableCoins_100k);
+BENCHMARK(CoinSelection_AvailableCoinsDenominated_100k);
+BENCHMARK(CoinSelection_AvailableCoinsMinAmount_100k);
@@ -185,6 +185,17 @@ static void HASH_X11_0080b_single(benchmark::State& state)
         hash = HashX11(in.begin(), in.end());
 }
 
+// X11 of an 80 byte header for consecutive nonces, the way the internal miner scans them
+static void HASH_X11_0080b_nonce(benchmark::State& state)
+{
+    uint256 hash;
+    std::vector<uint8_t> in(80,0);
+    CX11NonceHasher hasher(in, 76);
+    uint32_t nNonce = 0;
+    while (state.KeepRunning())
+        hash = hasher.Hash(nNonce++);
+}
+
 static void HASH_X11_0128b_single(benchmark::State& state)
 {
     uint256 hash;
@@ -237,6 +248,7 @@ BENCHMARK(HASH_DSHA256_1024b_single);
 BENCHMARK(HASH_DSHA256_2048b_single);
 BENCHMARK(HASH_X11_0032b_single);
 BENCHMARK(HASH_X11_0080b_single);
+BENCHMARK(HASH_X11_0080b_nonce);
 BENCHMARK(HASH_X11_0128b_single);
 BENCHMARK(HASH_X11_0512b_single);
 BENCHMARK(HASH_X11_1024b_single);
@@ -0,0 +1,89 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "random.h"
+
+#include "evo/deterministicmns.h"
+
+static const int SYNTHETIC_MN_COUNT = 5000;
+static const int SYNTHETIC_HEIGHT = 100000;
+
+// Builds a list with SYNTHETIC_MN_COUNT MNs, ~5% of them PoSe banned and the rest with random payment heights
+static CDeterministicMNList BuildSyntheticMNList()
+{
+    FastRandomContext ctx(true);
+
+    CDeterministicMNList mnList(uint256(), SYNTHETIC_HEIGHT, 0);
+    for (int i = 0; i < SYNTHETIC_MN_COUNT; i++) {
+        auto state = std::make_shared<CDeterministicMNState>();
+        state->nRegisteredHeight = (int)ctx.randrange(SYNTHETIC_HEIGHT / 2);
+        state->nLastPaidHeight = ctx.randrange(10) == 0 ? 0 : state->nRegisteredHeight + (int)ctx.randrange(SYNTHETIC_HEIGHT / 2);
+        if (ctx.randrange(20) == 0) {
+            state->nPoSeBanHeight = SYNTHETIC_HEIGHT - (int)ctx.randrange(1000);
+        }
+        uint256 owner = ctx.rand256();
+        state->keyIDOwner = CKeyID(uint160(std::vector<unsigned char>(owner.begin(), owner.begin() + 20)));
+
+        auto dmn = std::make_shared<CDeterministicMN>();
+        dmn->proTxHash = ctx.rand256();
+        dmn->internalId = mnList.GetTotalRegisteredCount();
+        dmn->collateralOutpoint = COutPoint(ctx.rand256(), 0);
+        dmn->nOperatorReward = 0;
+        dmn->pdmnState = state;
+        mnList.AddMN(dmn);
+        mnList.SetTotalRegisteredCount(mnList.GetTotalRegisteredCount() + 1);
+    }
+    return mnList;
+}
+
+static void DeterministicMNList_GetMNPayee(benchmark::State& state)
+{
+    auto mnList = BuildSyntheticMNList();
+    while (state.KeepRunning()) {
+        auto dmn = mnList.GetMNPayee();
+        assert(dmn);
+    }
+}
+
+static void DeterministicMNList_GetProjectedMNPayees(benchmark::State& state)
+{
+    auto mnList = BuildSyntheticMNList();
+    while (state.KeepRunning()) {
+        auto payees = mnList.GetProjectedMNPayees(20);
+        assert(payees.size() == 20);
+    }
+}
+
+static void DeterministicMNList_GetProjectedMNPayeesAll(benchmark::State& state)
+{
+    auto mnList = BuildSyntheticMNList();
+    size_t nValid = mnList.GetValidMNsCount();
+    while (state.KeepRunning()) {
+        auto payees = mnList.GetProjectedMNPayees(nValid);
+        assert(payees.size() == nValid);
+    }
+}
+
+// Simulates what BuildNewListFromBlock does for the payee on each block: derive a new list from the previous one
+// and mark the current payee as paid, which moves it to the end of the payment queue
+static void DeterministicMNList_PayNextBlock(benchmark::State& state)
+{
+    auto mnList = BuildSyntheticMNList();
+    int nHeight = mnList.GetHeight();
+    while (state.KeepRunning()) {
+        CDeterministicMNList newList = mnList;
+        newList.SetHeight(++nHeight);
+        auto dmn = newList.GetMNPayee();
+        auto newState = std::make_shared<CDeterministicMNState>(*dmn->pdmnState);
+        newState->nLastPaidHeight = nHeight;
+        newList.UpdateMN(dmn, newState);
+        mnList = std::move(newList);
+    }
+}
+
+BENCHMARK(DeterministicMNList_GetMNPayee);
+BENCHMARK(DeterministicMNList_GetProjectedMNPayees);
+BENCHMARK(DeterministicMNList_GetProjectedMNPayeesAll);
+BENCHMARK(DeterministicMNList_PayNextBlock);
@@ -0,0 +1,79 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "policy/fees.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <boost/thread/thread.hpp>
+
+// Latency of adding 2000 transactions to the mempool and connecting a block including all of them, without a fee
+// estimator, with the estimator updated by the caller, and with the updates queued to its background thread.
+
+static const int BLOCK_TX_COUNT = 2000;
+
+static void AddTx(const CTransactionRef& tx, const CAmount& nFee, unsigned int nHeight, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    bool spendsGenerated = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(
+                                         tx, nFee, nTime, nHeight,
+                                         spendsGenerated, sigOpCost, lp));
+}
+
+static void BlockConnect(benchmark::State& state, CBlockPolicyEstimator* estimator)
+{
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < BLOCK_TX_COUNT; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    CTxMemPool pool(estimator);
+    unsigned int nHeight = 1;
+    pool.removeForBlock(std::vector<CTransactionRef>(), nHeight);
+
+    while (state.KeepRunning()) {
+        // Spread the transactions over the feerate buckets
+        for (int i = 0; i < BLOCK_TX_COUNT; i++) {
+            AddTx(vtx[i], 1000 + (i % 200) * 500, nHeight, pool);
+        }
+        pool.removeForBlock(vtx, ++nHeight);
+    }
+}
+
+static void BlockConnectNoFeeEstimator(benchmark::State& state)
+{
+    BlockConnect(state, nullptr);
+}
+
+static void BlockConnectFeeEstimatorInline(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    BlockConnect(state, &estimator);
+}
+
+static void BlockConnectFeeEstimatorBackground(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    boost::thread thread(&CBlockPolicyEstimator::ThreadProcessEvents, &estimator);
+    BlockConnect(state, &estimator);
+    thread.interrupt();
+    thread.join();
+    estimator.SyncWithQueue();
+}
+
+BENCHMARK(BlockConnectNoFeeEstimator);
+BENCHMARK(BlockConnectFeeEstimatorInline);
+BENCHMARK(BlockConnectFeeEstimatorBackground);
@@ -0,0 +1,104 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "coins.h"
+#include "policy/policy.h"
+#include "script/standard.h"
+#include "txmempool.h"
+
+#include <vector>
+
+// Mempool address index holding 50000 transactions. Every transaction spends a coin of one hot address, pays one
+// of 1000 cold addresses and returns change to the hot address, which therefore has 100000 deltas.
+
+static const int ADDRESS_TX_COUNT = 50000;
+static const int COLD_ADDRESS_COUNT = 1000;
+
+static uint160 AddressHash(int n)
+{
+    uint256 hash = ArithToUint256(arith_uint256(n));
+    return uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20));
+}
+
+static void SetupAddressIndexEntries(CCoinsViewCache& view, std::vector<CTxMemPoolEntry>& vEntries)
+{
+    CScript scriptHot = GetScriptForDestination(CKeyID(AddressHash(1)));
+    LockPoints lp;
+    for (int i = 0; i < ADDRESS_TX_COUNT; i++) {
+        COutPoint prevout(ArithToUint256(arith_uint256(i + 1)), 0);
+        view.AddCoin(prevout, Coin(CTxOut(2 * COIN, scriptHot), 1, false, false), false);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.resize(2);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(CKeyID(AddressHash(2 + i % COLD_ADDRESS_COUNT)));
+        tx.vout[1].nValue = COIN - 1000;
+        tx.vout[1].scriptPubKey = scriptHot;
+        vEntries.emplace_back(MakeTransactionRef(std::move(tx)), 1000, i, 1, false, 1, lp);
+    }
+}
+
+// Index and unindex all transactions
+static void MempoolAddressIndexAddRemove(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<CTxMemPoolEntry> vEntries;
+    SetupAddressIndexEntries(view, vEntries);
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const CTxMemPoolEntry& entry : vEntries) {
+            pool.addAddressIndex(entry, view);
+        }
+        for (const CTxMemPoolEntry& entry : vEntries) {
+            pool.removeAddressIndex(entry.GetTx().GetHash());
+        }
+    }
+}
+
+static void MempoolAddressIndexQuery(benchmark::State& state, const std::vector<std::pair<uint160, int> >& addresses)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<CTxMemPoolEntry> vEntries;
+    SetupAddressIndexEntries(view, vEntries);
+    CTxMemPool pool;
+    for (const CTxMemPoolEntry& entry : vEntries) {
+        pool.addAddressIndex(entry, view);
+    }
+
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        for (const auto& address : addresses) {
+            std::vector<const CMempoolAddressDelta*> vDeltas;
+            pool.getAddressIndex(std::vector<std::pair<uint160, int> >(1, address), vDeltas);
+            assert(!vDeltas.empty());
+        }
+    }
+}
+
+// Query the 100000 deltas of the hot address
+static void MempoolAddressIndexQueryHot(benchmark::State& state)
+{
+    MempoolAddressIndexQuery(state, std::vector<std::pair<uint160, int> >(1, std::make_pair(AddressHash(1), 1)));
+}
+
+// Query each of the cold addresses, holding 50 deltas each
+static void MempoolAddressIndexQueryCold(benchmark::State& state)
+{
+    std::vector<std::pair<uint160, int> > addresses;
+    for (int i = 0; i < COLD_ADDRESS_COUNT; i++) {
+        addresses.emplace_back(AddressHash(2 + i), 1);
+    }
+    MempoolAddressIndexQuery(state, addresses);
+}
+
+BENCHMARK(MempoolAddressIndexAddRemove);
+BENCHMARK(MempoolAddressIndexQueryHot);
+BENCHMARK(MempoolAddressIndexQueryCold);
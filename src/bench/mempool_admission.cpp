@@ -0,0 +1,81 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "keystore.h"
+#include "policy/policy.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/thread/thread.hpp>
+
+// Pre-validation of a batch of 10000 independent transactions as done by AcceptToMemoryPoolBatch, with the input
+// scripts verified inline and on the script check queue. The signature cache is not written, so every iteration
+// verifies all signatures again.
+
+static const int ADMISSION_TX_COUNT = 10000;
+
+static void SetupAdmissionTxs(std::vector<CTransactionRef>& vtx, std::vector<std::vector<CTxOut> >& vSpentOutputs)
+{
+    // CScriptCheck consults the signature cache
+    InitSignatureCache();
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CTxOut spent(1 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+    for (int i = 0; i < ADMISSION_TX_COUNT; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = spent.nValue - 1000;
+        tx.vout[0].scriptPubKey = spent.scriptPubKey;
+        bool fSigned = SignSignature(keystore, spent.scriptPubKey, tx, 0, spent.nValue, SIGHASH_ALL);
+        assert(fSigned);
+        vtx.push_back(MakeTransactionRef(std::move(tx)));
+        vSpentOutputs.push_back(std::vector<CTxOut>(1, spent));
+    }
+}
+
+static void MempoolPreValidation(benchmark::State& state, int nThreads)
+{
+    std::vector<CTransactionRef> vtx;
+    std::vector<std::vector<CTxOut> > vSpentOutputs;
+    SetupAdmissionTxs(vtx, vSpentOutputs);
+
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread(&ThreadScriptCheck);
+    }
+    nScriptCheckThreads = nThreads > 1 ? nThreads : 0;
+
+    while (state.KeepRunning()) {
+        bool fValid = CheckInputScriptsParallel(vtx, vSpentOutputs, STANDARD_SCRIPT_VERIFY_FLAGS, false);
+        assert(fValid);
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+    nScriptCheckThreads = 0;
+}
+
+static void MempoolPreValidationSerial(benchmark::State& state)
+{
+    MempoolPreValidation(state, 1);
+}
+
+static void MempoolPreValidationParallel(benchmark::State& state)
+{
+    MempoolPreValidation(state, std::max(2, GetNumCores()));
+}
+
+BENCHMARK(MempoolPreValidationSerial);
+BENCHMARK(MempoolPreValidationParallel);
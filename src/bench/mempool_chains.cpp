@@ -0,0 +1,94 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <vector>
+
+// Ancestor/descendant bookkeeping of a mempool holding 100000 transactions in 4000 chains of 25 transactions.
+
+static const int CHAIN_COUNT = 4000;
+static const int CHAIN_DEPTH = 25;
+
+static void AddTx(const CTransactionRef& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsGenerated = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(
+                                         tx, nFee, nTime, nHeight,
+                                         spendsGenerated, sigOpCost, lp));
+}
+
+// vChains[i][0] is the root of chain i, every other transaction spends the output of its predecessor
+static std::vector<std::vector<CTransactionRef> > CreateChains()
+{
+    std::vector<std::vector<CTransactionRef> > vChains(CHAIN_COUNT);
+    for (int i = 0; i < CHAIN_COUNT; i++) {
+        COutPoint prevout(ArithToUint256(arith_uint256(i + 1)), 0);
+        for (int j = 0; j < CHAIN_DEPTH; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = prevout;
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[0].nValue = (CHAIN_DEPTH - j) * COIN;
+            vChains[i].push_back(MakeTransactionRef(std::move(tx)));
+            prevout = COutPoint(vChains[i].back()->GetHash(), 0);
+        }
+    }
+    return vChains;
+}
+
+// Build the pool chain by chain; every addition walks the ancestors of the new entry
+static void MempoolChainsAdd(benchmark::State& state)
+{
+    std::vector<std::vector<CTransactionRef> > vChains = CreateChains();
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const auto& vChain : vChains) {
+            for (const CTransactionRef& tx : vChain) {
+                AddTx(tx, 1000, pool);
+            }
+        }
+        pool.clear();
+    }
+}
+
+// Simulate a reorg: the roots of all chains are re-added from a disconnected block after their descendants, then
+// the pool is trimmed to half its size, which walks and removes whole chains.
+static void MempoolChainsReorg(benchmark::State& state)
+{
+    std::vector<std::vector<CTransactionRef> > vChains = CreateChains();
+    std::vector<uint256> vRootHashes;
+    for (const auto& vChain : vChains) {
+        vRootHashes.push_back(vChain[0]->GetHash());
+    }
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const auto& vChain : vChains) {
+            for (size_t j = 1; j < vChain.size(); j++) {
+                AddTx(vChain[j], 1000, pool);
+            }
+        }
+        for (const auto& vChain : vChains) {
+            AddTx(vChain[0], 1000, pool);
+        }
+        pool.UpdateTransactionsFromBlock(vRootHashes);
+        assert(pool.size() == CHAIN_COUNT * CHAIN_DEPTH);
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        pool.clear();
+    }
+}
+
+BENCHMARK(MempoolChainsAdd);
+BENCHMARK(MempoolChainsReorg);
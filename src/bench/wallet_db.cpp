@@ -0,0 +1,100 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fs.h"
+#include "wallet/db.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+// Wallet database write benchmarks. Unlike the unit tests these use a real database environment in a temporary
+// directory, as the cost of the writes is what's measured.
+
+static fs::path OpenBenchDBEnv()
+{
+    fs::path dir = fs::temp_directory_path() / fs::unique_path("ion_bench_walletdb_%%%%-%%%%");
+    fs::create_directories(dir);
+    bool fOpened = bitdb.Open(dir);
+    assert(fOpened);
+    return dir;
+}
+
+static void CloseBenchDBEnv(const fs::path& dir)
+{
+    bitdb.Flush(true);
+    bitdb.Reset();
+    fs::remove_all(dir);
+}
+
+// Top up the keypool of a new HD wallet with 10000 keys (5000 external, 5000 internal)
+static void WalletKeyPoolTopUpHD(benchmark::State& state)
+{
+    fs::path dir = OpenBenchDBEnv();
+    int nWallet = 0;
+
+    while (state.KeepRunning()) {
+        std::string strFile = "wallet_bench_" + std::to_string(nWallet++) + ".dat";
+        CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, strFile)));
+        wallet.SetMinVersion(FEATURE_HD);
+        wallet.GenerateNewHDChain();
+        bool fSuccess = wallet.TopUpKeyPool(5000);
+        assert(fSuccess);
+        assert(wallet.KeypoolCountExternalKeys() == 5000);
+        assert(wallet.KeypoolCountInternalKeys() == 5000);
+    }
+
+    CloseBenchDBEnv(dir);
+}
+
+// Write 1000 wallet transactions the way a rescan does (transaction and order position for each), once with one
+// database transaction per record and once batched
+static void WalletTxWrites(benchmark::State& state, bool fBatch)
+{
+    fs::path dir = OpenBenchDBEnv();
+    CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_bench.dat")));
+
+    std::vector<CWalletTx> vWtx;
+    for (int i = 0; i < 1000; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i; // so all transactions get different hashes
+        tx.vin.resize(1);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 1000 * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1].nValue = 1 * COIN;
+        tx.vout[1].scriptPubKey = tx.vout[0].scriptPubKey;
+        vWtx.emplace_back(&wallet, MakeTransactionRef(std::move(tx)));
+    }
+
+    int64_t nOrderPos = 0;
+    while (state.KeepRunning()) {
+        CWalletDB walletdb(wallet.GetDBHandle(), "r+", false);
+        if (fBatch) {
+            walletdb.BeginBatch();
+        }
+        for (CWalletTx& wtx : vWtx) {
+            wtx.nOrderPos = nOrderPos++;
+            walletdb.WriteOrderPosNext(nOrderPos);
+            walletdb.WriteTx(wtx);
+        }
+        bool fSuccess = walletdb.FlushBatch();
+        assert(fSuccess);
+    }
+
+    CloseBenchDBEnv(dir);
+}
+
+static void WalletTxWritesUnbatched(benchmark::State& state)
+{
+    WalletTxWrites(state, false);
+}
+
+static void WalletTxWritesBatched(benchmark::State& state)
+{
+    WalletTxWrites(state, true);
+}
+
+BENCHMARK(WalletKeyPoolTopUpHD);
+BENCHMARK(WalletTxWritesUnbatched);
+BENCHMARK(WalletTxWritesBatched);
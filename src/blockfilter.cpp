@@ -0,0 +1,303 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+
+#include <algorithm>
+#include <map>
+
+/// SerType used to serialize parameters in GCS filter encoding.
+static constexpr int GCS_SER_TYPE = SER_NETWORK;
+
+/// Protocol version used to serialize parameters in GCS filter encoding.
+static constexpr int GCS_SER_VERSION = 0;
+
+static const std::map<BlockFilterType, std::string> g_filter_types = {
+    {BlockFilterType::BASIC, "basic"},
+};
+
+template <typename OStream>
+static void GolombRiceEncode(CBitStreamWriter<OStream>& bitwriter, uint8_t P, uint64_t x)
+{
+    // Write quotient as unary-encoded: q 1's followed by one 0.
+    uint64_t q = x >> P;
+    while (q > 0) {
+        int nbits = q <= 64 ? static_cast<int>(q) : 64;
+        bitwriter.Write(~0ULL, nbits);
+        q -= nbits;
+    }
+    bitwriter.Write(0, 1);
+
+    // Write the remainder in P bits. Since the remainder is just the bottom
+    // P bits of x, there is no need to mask first.
+    bitwriter.Write(x, P);
+}
+
+template <typename IStream>
+static uint64_t GolombRiceDecode(CBitStreamReader<IStream>& bitreader, uint8_t P)
+{
+    // Read unary-encoded quotient: q 1's followed by one 0.
+    uint64_t q = 0;
+    while (bitreader.Read(1) == 1) {
+        ++q;
+    }
+
+    uint64_t r = bitreader.Read(P);
+
+    return (q << P) + r;
+}
+
+// Map a value x that is uniformly distributed in the range [0, 2^64) to a
+// value uniformly distributed in [0, n) by returning the upper 64 bits of
+// x * n.
+//
+// See: https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    // To perform the calculation on 64-bit numbers without losing the
+    // result to overflow, split the numbers into the most significant and
+    // least significant 32 bits and perform multiplication piece-wise.
+    //
+    // See: https://stackoverflow.com/a/26855440
+    uint64_t x_hi = x >> 32;
+    uint64_t x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32;
+    uint64_t n_lo = n & 0xFFFFFFFF;
+
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    uint64_t upper64 = ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+    return upper64;
+#endif
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(params.nSipHashK0, params.nSipHashK1)
+        .Write(element.data(), element.size())
+        .Finalize();
+    return MapIntoRange(hash, nF);
+}
+
+std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashedElements;
+    vHashedElements.reserve(elements.size());
+    for (const Element& element : elements) {
+        vHashedElements.push_back(HashToRange(element));
+    }
+    std::sort(vHashedElements.begin(), vHashedElements.end());
+    return vHashedElements;
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn)
+    : params(paramsIn), nN(0), nF(0), vchEncoded{0}
+{}
+
+GCSFilter::GCSFilter(const Params& paramsIn, std::vector<unsigned char> vchEncodedIn)
+    : params(paramsIn), vchEncoded(std::move(vchEncodedIn))
+{
+    CVectorReader stream(GCS_SER_TYPE, GCS_SER_VERSION, vchEncoded, 0);
+
+    uint64_t N = ReadCompactSize(stream);
+    nN = static_cast<uint32_t>(N);
+    if (nN != N) {
+        throw std::ios_base::failure("N must be <2^32");
+    }
+    nF = static_cast<uint64_t>(nN) * static_cast<uint64_t>(params.nM);
+
+    // Verify that the encoded filter contains exactly N elements. If it has too much or too little
+    // data, a std::ios_base::failure exception will be raised.
+    CBitStreamReader<CVectorReader> bitreader(stream);
+    for (uint64_t i = 0; i < nN; ++i) {
+        GolombRiceDecode(bitreader, params.nP);
+    }
+    if (!stream.empty()) {
+        throw std::ios_base::failure("encoded_filter contains excess data");
+    }
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn, const ElementSet& elements)
+    : params(paramsIn)
+{
+    size_t N = elements.size();
+    nN = static_cast<uint32_t>(N);
+    if (nN != N) {
+        throw std::invalid_argument("N must be <2^32");
+    }
+    nF = static_cast<uint64_t>(nN) * static_cast<uint64_t>(params.nM);
+
+    CVectorWriter stream(GCS_SER_TYPE, GCS_SER_VERSION, vchEncoded, 0);
+
+    WriteCompactSize(stream, nN);
+
+    if (elements.empty()) {
+        return;
+    }
+
+    CBitStreamWriter<CVectorWriter> bitwriter(stream);
+
+    uint64_t nLastValue = 0;
+    for (uint64_t nValue : BuildHashedSet(elements)) {
+        uint64_t nDelta = nValue - nLastValue;
+        GolombRiceEncode(bitwriter, params.nP, nDelta);
+        nLastValue = nValue;
+    }
+
+    bitwriter.Flush();
+}
+
+bool GCSFilter::MatchInternal(const uint64_t* pElementHashes, size_t nSize) const
+{
+    CVectorReader stream(GCS_SER_TYPE, GCS_SER_VERSION, vchEncoded, 0);
+
+    // Seek forward by size of N
+    uint64_t N = ReadCompactSize(stream);
+    assert(N == nN);
+
+    CBitStreamReader<CVectorReader> bitreader(stream);
+
+    uint64_t nValue = 0;
+    size_t nHashesIndex = 0;
+    for (uint32_t i = 0; i < nN; ++i) {
+        uint64_t nDelta = GolombRiceDecode(bitreader, params.nP);
+        nValue += nDelta;
+
+        while (true) {
+            if (nHashesIndex == nSize) {
+                return false;
+            } else if (pElementHashes[nHashesIndex] == nValue) {
+                return true;
+            } else if (pElementHashes[nHashesIndex] > nValue) {
+                break;
+            }
+
+            nHashesIndex++;
+        }
+    }
+
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    const std::vector<uint64_t> vQueries = BuildHashedSet(elements);
+    return MatchInternal(vQueries.data(), vQueries.size());
+}
+
+const std::string& BlockFilterTypeName(BlockFilterType filterType)
+{
+    static std::string unknownRetval = "";
+    auto it = g_filter_types.find(filterType);
+    return it != g_filter_types.end() ? it->second : unknownRetval;
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterTypeRet)
+{
+    for (const auto& entry : g_filter_types) {
+        if (entry.second == name) {
+            filterTypeRet = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+GCSFilter::ElementSet BlockFilter::BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo)
+{
+    GCSFilter::ElementSet elements;
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& txout : tx->vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN) continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    for (const CTxUndo& txUndo : blockUndo.vtxundo) {
+        for (const Coin& prevout : txUndo.vprevout) {
+            const CScript& script = prevout.out.scriptPubKey;
+            if (script.empty()) continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    return elements;
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, std::vector<unsigned char> vchFilter)
+    : filterType(filterTypeIn), blockHash(blockHashIn)
+{
+    GCSFilter::Params params;
+    if (!BuildParams(params)) {
+        throw std::invalid_argument("unknown filter_type");
+    }
+    filter = GCSFilter(params, std::move(vchFilter));
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo)
+    : filterType(filterTypeIn), blockHash(block.GetHash())
+{
+    GCSFilter::Params params;
+    if (!BuildParams(params)) {
+        throw std::invalid_argument("unknown filter_type");
+    }
+    filter = GCSFilter(params, BasicFilterElements(block, blockUndo));
+}
+
+bool BlockFilter::BuildParams(GCSFilter::Params& paramsRet) const
+{
+    switch (filterType) {
+    case BlockFilterType::BASIC:
+        paramsRet.nSipHashK0 = blockHash.GetUint64(0);
+        paramsRet.nSipHashK1 = blockHash.GetUint64(1);
+        paramsRet.nP = BASIC_FILTER_P;
+        paramsRet.nM = BASIC_FILTER_M;
+        return true;
+    case BlockFilterType::INVALID:
+        return false;
+    }
+
+    return false;
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& data = GetEncodedFilter();
+    return Hash(data.begin(), data.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    const uint256& filterHash = GetHash();
+
+    uint256 result;
+    CHash256()
+        .Write(filterHash.begin(), filterHash.size())
+        .Write(prevHeader.begin(), prevHeader.size())
+        .Finalize(result.begin());
+    return result;
+}
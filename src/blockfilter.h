@@ -0,0 +1,169 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * This implements a Golomb-coded set as defined in BIP 158. It is a
+ * compact, probabilistic data structure for testing set membership.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        uint8_t nP;  //!< Golomb-Rice coding parameter
+        uint32_t nM;  //!< Inverse false positive rate
+
+        Params(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, uint8_t nPIn = 0, uint32_t nMIn = 1)
+            : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn)
+        {}
+    };
+
+private:
+    Params params;
+    uint32_t nN;  //!< Number of elements in the filter
+    uint64_t nF;  //!< Range of element hashes, F = N * M
+    std::vector<unsigned char> vchEncoded;
+
+    /** Hash a data element to an integer in the range [0, N * M). */
+    uint64_t HashToRange(const Element& element) const;
+
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+
+    /** Helper method used to implement Match and MatchAny */
+    bool MatchInternal(const uint64_t* pElementHashes, size_t nSize) const;
+
+public:
+
+    /** Constructs an empty filter. */
+    explicit GCSFilter(const Params& paramsIn = Params());
+
+    /** Reconstructs an already-created filter from an encoding. Throws std::ios_base::failure if the encoding is
+     *  malformed. */
+    GCSFilter(const Params& paramsIn, std::vector<unsigned char> vchEncodedIn);
+
+    /** Builds a new filter from the params and set of elements. */
+    GCSFilter(const Params& paramsIn, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const Params& GetParams() const { return params; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    /**
+     * Checks if the element may be in the set. False positives are possible
+     * with probability 1/M.
+     */
+    bool Match(const Element& element) const;
+
+    /**
+     * Checks if any of the given elements may be in the set. False positives
+     * are possible with probability 1/M per element checked. This is more
+     * efficient that checking Match on multiple elements separately.
+     */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+constexpr uint8_t BASIC_FILTER_P = 19;
+constexpr uint32_t BASIC_FILTER_M = 784931;
+
+enum class BlockFilterType : uint8_t
+{
+    BASIC = 0,
+    INVALID = 255,
+};
+
+/** Get the human-readable name for a filter type. Returns an empty string for unknown types. */
+const std::string& BlockFilterTypeName(BlockFilterType filterType);
+
+/** Find a filter type by its human-readable name. */
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterTypeRet);
+
+/**
+ * Complete block filter struct as defined in BIP 157. Serialization matches
+ * payload of "cfilter" messages.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType filterType = BlockFilterType::INVALID;
+    uint256 blockHash;
+    GCSFilter filter;
+
+    bool BuildParams(GCSFilter::Params& paramsRet) const;
+
+public:
+
+    BlockFilter() = default;
+
+    //! Reconstruct a BlockFilter from parts.
+    BlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, std::vector<unsigned char> vchFilter);
+
+    //! Construct a new BlockFilter of the specified type from a block.
+    BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const GCSFilter& GetFilter() const { return filter; }
+
+    const std::vector<unsigned char>& GetEncodedFilter() const
+    {
+        return filter.GetEncoded();
+    }
+
+    //! Compute the filter hash.
+    uint256 GetHash() const;
+
+    //! Compute the filter header given the previous one.
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    /** Returns the set of scripts a BASIC filter commits to: all output scripts of the block (except empty and
+     *  OP_RETURN ones) and the scripts of all outputs spent by the block. */
+    static GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo);
+
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        s << static_cast<uint8_t>(filterType)
+          << blockHash
+          << filter.GetEncoded();
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        std::vector<unsigned char> vchEncodedFilter;
+        uint8_t nFilterType;
+
+        s >> nFilterType
+          >> blockHash
+          >> vchEncodedFilter;
+
+        filterType = static_cast<BlockFilterType>(nFilterType);
+
+        GCSFilter::Params params;
+        if (!BuildParams(params)) {
+            throw std::ios_base::failure("unknown filter_type");
+        }
+        filter = GCSFilter(params, std::move(vchEncodedFilter));
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,295 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilterindex.h"
+
+#include "chainparams.h"
+#include "coins.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+CBlockFilterIndex* pblockfilterindex = nullptr;
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe) :
+    filterType(filterTypeIn),
+    db(fMemory ? "" : (GetDataDir() / "blocks" / "filter" / BlockFilterTypeName(filterTypeIn)), nCacheSize, fMemory, fWipe)
+{
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    InterruptSyncThread();
+    StopSyncThread();
+}
+
+void CBlockFilterIndex::StartSyncThread()
+{
+    if (syncThread.joinable()) {
+        assert(false);
+    }
+
+    syncInterrupt.reset();
+    syncThread = std::thread(&TraceThread<std::function<void()> >, "blockfilter", std::function<void()>(std::bind(&CBlockFilterIndex::SyncThreadMain, this)));
+}
+
+void CBlockFilterIndex::InterruptSyncThread()
+{
+    syncInterrupt();
+}
+
+void CBlockFilterIndex::StopSyncThread()
+{
+    if (syncThread.joinable()) {
+        // make sure to call InterruptSyncThread() first
+        if (!syncInterrupt) {
+            assert(false);
+        }
+        syncThread.join();
+    }
+}
+
+const CBlockIndex* CBlockFilterIndex::GetBestBlock() const
+{
+    AssertLockHeld(cs_main);
+    return pindexBest;
+}
+
+bool CBlockFilterIndex::ReadDBVal(const CBlockIndex* pindex, CDBVal& valRet) const
+{
+    return db.Read(std::make_pair(DB_FILTER, pindex->GetBlockHash()), valRet);
+}
+
+bool CBlockFilterIndex::WriteFilter(const BlockFilter& filter, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    assert(pindex->pprev == pindexBest);
+
+    CDBVal val;
+    val.hash = filter.GetHash();
+    val.header = filter.ComputeHeader(bestHeader);
+    val.vchFilter = filter.GetEncodedFilter();
+
+    CDBBatch batch(db);
+    batch.Write(std::make_pair(DB_FILTER, pindex->GetBlockHash()), val);
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    if (!db.WriteBatch(batch)) {
+        return false;
+    }
+
+    pindexBest = pindex;
+    bestHeader = val.header;
+    return true;
+}
+
+bool CBlockFilterIndex::SetBestBlock(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    uint256 header;
+    if (pindex) {
+        CDBVal val;
+        if (!ReadDBVal(pindex, val)) {
+            return error("%s: filter of block %s not found in index", __func__, pindex->GetBlockHash().ToString());
+        }
+        header = val.header;
+    }
+
+    if (!db.Write(DB_BEST_BLOCK, pindex ? pindex->GetBlockHash() : uint256())) {
+        return false;
+    }
+
+    pindexBest = pindex;
+    bestHeader = header;
+    return true;
+}
+
+bool CBlockFilterIndex::InitBestBlock()
+{
+    AssertLockHeld(cs_main);
+
+    uint256 hashBest;
+    const CBlockIndex* pindex = nullptr;
+    if (db.Read(DB_BEST_BLOCK, hashBest)) {
+        auto it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end()) {
+            pindex = it->second;
+        }
+    }
+    if (pindex && !chainActive.Contains(pindex)) {
+        // the index was written on a chain which got reorged away while we were not running
+        pindex = chainActive.FindFork(pindex);
+    }
+    return SetBestBlock(pindex);
+}
+
+void CBlockFilterIndex::SyncThreadMain()
+{
+    {
+        LOCK(cs_main);
+        if (!InitBestBlock()) {
+            LogPrintf("%s: failed to initialize block filter index, index disabled\n", __func__);
+            return;
+        }
+    }
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int64_t nLastLogTime = GetTime();
+
+    while (!syncInterrupt) {
+        const CBlockIndex* pindexNext;
+        CDiskBlockPos blockPos;
+        CDiskBlockPos undoPos;
+        {
+            LOCK(cs_main);
+            if (pindexBest && !chainActive.Contains(pindexBest)) {
+                // the chain got reorged while we were building filters, continue from the fork point
+                if (!SetBestBlock(chainActive.FindFork(pindexBest))) {
+                    LogPrintf("%s: failed to rewind block filter index, index disabled\n", __func__);
+                    return;
+                }
+            }
+
+            pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+            if (!pindexNext) {
+                fSynced = true;
+                LogPrintf("%s: block filter index is synced at height %d\n", __func__, pindexBest ? pindexBest->nHeight : -1);
+                return;
+            }
+
+            if (!(pindexNext->nStatus & BLOCK_HAVE_DATA) || (pindexNext->pprev && !(pindexNext->nStatus & BLOCK_HAVE_UNDO))) {
+                LogPrintf("%s: data of block %s is not available (pruned?), index disabled\n", __func__, pindexNext->GetBlockHash().ToString());
+                return;
+            }
+            blockPos = pindexNext->GetBlockPos();
+            undoPos = pindexNext->GetUndoPos();
+        }
+
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, blockPos, consensusParams) || block.GetHash() != pindexNext->GetBlockHash()) {
+            LogPrintf("%s: failed to read block %s, index disabled\n", __func__, pindexNext->GetBlockHash().ToString());
+            return;
+        }
+        if (pindexNext->pprev && !UndoReadFromDisk(blockundo, undoPos, pindexNext->pprev->GetBlockHash())) {
+            LogPrintf("%s: failed to read undo data of block %s, index disabled\n", __func__, pindexNext->GetBlockHash().ToString());
+            return;
+        }
+
+        BlockFilter filter(filterType, block, blockundo);
+
+        LOCK(cs_main);
+        if (pindexBest != pindexNext->pprev || !chainActive.Contains(pindexNext)) {
+            // reorged in between, retry from the new position
+            continue;
+        }
+        if (!WriteFilter(filter, pindexNext)) {
+            LogPrintf("%s: failed to write filter of block %s, index disabled\n", __func__, pindexNext->GetBlockHash().ToString());
+            return;
+        }
+
+        if (GetTime() - nLastLogTime >= 30) {
+            LogPrintf("%s: block filter index synced up to height %d of %d\n", __func__, pindexNext->nHeight, chainActive.Height());
+            nLastLogTime = GetTime();
+        }
+    }
+}
+
+bool CBlockFilterIndex::BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fSynced) {
+        // the sync thread will pick up the block
+        return true;
+    }
+
+    if (pindex->pprev != pindexBest) {
+        // Only happens when blocks below the tip are connected again, e.g. by VerifyDB. Continue from the parent
+        // if it was indexed before, otherwise leave the index where it is.
+        CDBVal val;
+        if (!pindex->pprev || !ReadDBVal(pindex->pprev, val)) {
+            LogPrintf("%s: parent of block %s is not indexed, skipping\n", __func__, pindex->GetBlockHash().ToString());
+            return true;
+        }
+        pindexBest = pindex->pprev;
+        bestHeader = val.header;
+    }
+
+    return WriteFilter(BlockFilter(filterType, block, blockundo), pindex);
+}
+
+bool CBlockFilterIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fSynced || pindex != pindexBest) {
+        return true;
+    }
+
+    // the filter of the disconnected block is kept, it can still be looked up by its hash
+    return SetBestBlock(pindex->pprev);
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filterRet) const
+{
+    CDBVal val;
+    if (!ReadDBVal(pindex, val)) {
+        return false;
+    }
+
+    try {
+        filterRet = BlockFilter(filterType, pindex->GetBlockHash(), std::move(val.vchFilter));
+    } catch (const std::exception& e) {
+        return error("%s: failed to decode filter of block %s: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& headerRet) const
+{
+    CDBVal val;
+    if (!ReadDBVal(pindex, val)) {
+        return false;
+    }
+    headerRet = val.header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& filtersRet) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight) {
+        return false;
+    }
+
+    filtersRet.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (auto it = filtersRet.rbegin(); it != filtersRet.rend(); ++it, pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, *it)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& hashesRet) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight) {
+        return false;
+    }
+
+    hashesRet.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (auto it = hashesRet.rbegin(); it != hashesRet.rend(); ++it, pindex = pindex->pprev) {
+        CDBVal val;
+        if (!ReadDBVal(pindex, val)) {
+            return false;
+        }
+        *it = val.hash;
+    }
+    return true;
+}
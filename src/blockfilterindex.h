@@ -0,0 +1,103 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKFILTERINDEX_H
+#define BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+#include "threadinterrupt.h"
+
+#include <atomic>
+#include <thread>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+
+/** Maximum number of filters/filter hashes returned for a single getcfilters/getcfheaders request or RPC call */
+static const int MAX_GETCFILTERS_SIZE = 1000;
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+/** Interval between filter headers returned in cfcheckpt messages */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * Index of BIP 158 block filters and BIP 157 filter headers, stored in its own LevelDB under blocks/filter/<type>.
+ *
+ * Filters are stored by block hash, so filters of blocks which got disconnected stay available. Older blocks are
+ * added by a background thread which walks the active chain from the last indexed block to the tip, reading blocks
+ * and undo data from disk. Once it reached the tip, new blocks are added from ConnectBlock and disconnects are
+ * tracked in DisconnectTip, both under cs_main, so the index never misses or reorders a block.
+ */
+class CBlockFilterIndex
+{
+private:
+    struct CDBVal
+    {
+        uint256 hash;
+        uint256 header;
+        std::vector<unsigned char> vchFilter;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(hash);
+            READWRITE(header);
+            READWRITE(vchFilter);
+        }
+    };
+
+    BlockFilterType filterType;
+    CDBWrapper db;
+
+    //! last indexed block of the active chain and its filter header, guarded by cs_main
+    const CBlockIndex* pindexBest{nullptr};
+    uint256 bestHeader;
+    std::atomic<bool> fSynced{false};
+
+    std::thread syncThread;
+    CThreadInterrupt syncInterrupt;
+
+    bool WriteFilter(const BlockFilter& filter, const CBlockIndex* pindex);
+    bool SetBestBlock(const CBlockIndex* pindex);
+    bool ReadDBVal(const CBlockIndex* pindex, CDBVal& valRet) const;
+    /** Reads the last indexed block from the DB and moves it back to the active chain if it was reorged away */
+    bool InitBestBlock();
+
+    void SyncThreadMain();
+
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CBlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+
+    void StartSyncThread();
+    void InterruptSyncThread();
+    void StopSyncThread();
+
+    /** Returns true once the background sync has caught up with the active chain */
+    bool IsSynced() const { return fSynced; }
+    /** Returns the last indexed block, requires cs_main */
+    const CBlockIndex* GetBestBlock() const;
+
+    /** Called by ConnectBlock/DisconnectTip with cs_main held. Does nothing while the index is still syncing. */
+    bool BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    bool BlockDisconnected(const CBlockIndex* pindex);
+
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filterRet) const;
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& headerRet) const;
+    /** Get filters or filter hashes of the ancestors of pindexStop from nStartHeight up to pindexStop */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& filtersRet) const;
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& hashesRet) const;
+};
+
+extern CBlockFilterIndex* pblockfilterindex;
+
+#endif
@@ -9,6 +9,10 @@
 #include "sync.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -17,6 +21,11 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Maximum number of per-worker queues (including the master's) in a CCheckQueue */
+static const unsigned int MAX_CHECKQUEUE_WORKERS = 128;
+/** Time a worker aims to spend on one batch of checks, in nanoseconds */
+static const int64_t CHECKQUEUE_BATCH_TARGET_NANOS = 100000;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -26,12 +35,25 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own queue, which the master fills round-robin. A
+  * worker takes batches from the back of its own queue, and when that is
+  * empty it steals half of the checks from the front of another worker's
+  * queue, trying its neighbours first. The batch size follows the observed
+  * cost of a check, so cheap checks are taken in large batches and
+  * expensive ones in small batches which spread evenly over the workers.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Checks owned by one worker, protected by its own mutex
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Mutex to protect sleeping and waking up the workers and the master
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -40,90 +62,165 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The per-worker queues, the first one belongs to the master. Only the
+    //! first nQueues entries are set.
+    std::vector<std::unique_ptr<WorkerQueue> > vQueues;
+
+    //! The number of per-worker queues in use
+    std::atomic<unsigned int> nQueues;
+
+    //! The number of worker threads which have been started
+    unsigned int nWorkers;
+
+    //! The queue the next checks are added to
+    unsigned int nAddQueue;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of checks in the per-worker queues. This may be briefly
+    //! lower than the real number while checks are being added.
+    std::atomic<int64_t> nQueued;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are idle.
+    std::atomic<int> nIdle;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<int64_t> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Moving average of the time a check takes, in nanoseconds
+    std::atomic<int64_t> nCheckNanos;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** Number of checks to process in one batch, given the observed cost of a check */
+    unsigned int GetBatchSize() const
+    {
+        int64_t nNanos = nCheckNanos.load(std::memory_order_relaxed);
+        if (nNanos <= 0)
+            return nBatchSize;
+        return (unsigned int)std::max<int64_t>(1, std::min<int64_t>(nBatchSize, CHECKQUEUE_BATCH_TARGET_NANOS / nNanos));
+    }
+
+    /** Give a new worker thread its own queue, or share one when there are too many workers */
+    unsigned int RegisterWorker()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        unsigned int nWorker = nWorkers++;
+        if (nWorker + 1 >= MAX_CHECKQUEUE_WORKERS)
+            return 1 + nWorker % (MAX_CHECKQUEUE_WORKERS - 1);
+        vQueues[nWorker + 1].reset(new WorkerQueue);
+        nQueues = nWorker + 2;
+        return nWorker + 1;
+    }
+
+    /**
+     * Take a batch of checks, first from the worker's own queue, and otherwise by stealing half of the
+     * checks of another queue. Stolen checks which don't fit in the batch are kept in the worker's own queue.
+     */
+    bool Take(unsigned int nQueue, std::vector<T>& vChecks)
+    {
+        unsigned int nBatch = GetBatchSize();
+        unsigned int nCount = nQueues;
+        WorkerQueue& own = *vQueues[nQueue];
+        {
+            boost::unique_lock<boost::mutex> lock(own.mutex);
+            size_t nNow = std::min<size_t>(nBatch, own.checks.size());
+            vChecks.resize(nNow);
+            for (size_t i = 0; i < nNow; i++) {
+                // Swap the checks out instead of copying them, so the queue only holds default constructed ones
+                vChecks[i].swap(own.checks.back());
+                own.checks.pop_back();
+            }
+        }
+        if (!vChecks.empty()) {
+            nQueued -= vChecks.size();
+            return true;
+        }
+
+        // Try the neighbouring queues first, which are the ones of workers started around the same time
+        for (unsigned int nDistance = 1; nDistance < nCount; nDistance++) {
+            WorkerQueue& victim = *vQueues[(nQueue + nDistance) % nCount];
+            {
+                boost::unique_lock<boost::mutex> lock(victim.mutex);
+                size_t nSteal = (victim.checks.size() + 1) / 2;
+                vChecks.resize(nSteal);
+                for (size_t i = 0; i < nSteal; i++) {
+                    vChecks[i].swap(victim.checks.front());
+                    victim.checks.pop_front();
+                }
+            }
+            if (vChecks.empty())
+                continue;
+            if (vChecks.size() > nBatch) {
+                boost::unique_lock<boost::mutex> lock(own.mutex);
+                for (size_t i = nBatch; i < vChecks.size(); i++) {
+                    own.checks.emplace_back();
+                    own.checks.back().swap(vChecks[i]);
+                }
+                vChecks.resize(nBatch);
+            }
+            nQueued -= vChecks.size();
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nQueue, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            if (!Take(nQueue, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
+                if (fMaster) {
+                    // No checks are added while the master waits, so it only has to wait for the workers
+                    while (nTodo != 0 && nQueued <= 0)
+                        condMaster.wait(lock); // wait
+                    if (nTodo == 0) {
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
+                        fAllOk = true;
                         // return the current status
                         return fRet;
                     }
+                } else {
                     nIdle++;
-                    cond.wait(lock); // wait
+                    if (nQueued <= 0)
+                        condWorker.wait(lock); // wait
                     nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
+            bool fTimed = fOk;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            if (fTimed && fOk) {
+                int64_t nNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / vChecks.size();
+                int64_t nAverage = nCheckNanos.load(std::memory_order_relaxed);
+                nCheckNanos.store(nAverage + (nNanos - nAverage) / 8, std::memory_order_relaxed);
+            }
+            int64_t nNow = vChecks.size();
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -132,33 +229,48 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : vQueues(MAX_CHECKQUEUE_WORKERS), nQueues(1), nWorkers(0), nAddQueue(0), nQueued(0), nIdle(0),
+                                             fAllOk(true), nTodo(0), nCheckNanos(0), nBatchSize(nBatchSizeIn)
+    {
+        vQueues[0].reset(new WorkerQueue);
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(RegisterWorker());
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        unsigned int nCount = nQueues;
+        size_t nChunk = GetBatchSize();
+        for (size_t nPos = 0; nPos < vChecks.size(); nPos += nChunk) {
+            WorkerQueue& queue = *vQueues[nAddQueue++ % nCount];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            for (size_t i = nPos; i < std::min(nPos + nChunk, vChecks.size()); i++) {
+                queue.checks.emplace_back();
+                queue.checks.back().swap(vChecks[i]);
+            }
+        }
+        nQueued += vChecks.size();
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
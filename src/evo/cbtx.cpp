@@ -101,6 +101,7 @@ bool CheckCbTxMerkleRoots(const CBlock& block, const CBlockIndex* pindex, CValid
 
 bool CalcCbTxMerkleRootMNList(const CBlock& block, const CBlockIndex* pindexPrev, uint256& merkleRootRet, CValidationState& state)
 {
+    AssertLockHeld(cs_main);
     LOCK(deterministicMNManager->cs);
 
     static int64_t nTimeDMN = 0;
@@ -122,25 +123,16 @@ bool CalcCbTxMerkleRootMNList(const CBlock& block, const CBlockIndex* pindexPrev
     int64_t nTime3 = GetTimeMicros(); nTimeSMNL += nTime3 - nTime2;
     LogPrint(BCLog::BENCHMARK, "            - CSimplifiedMNList: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeSMNL * 0.000001);
 
-    static CSimplifiedMNList smlCached;
-    static uint256 merkleRootCached;
-    static bool mutatedCached{false};
-
-    if (sml.mnList == smlCached.mnList) {
-        merkleRootRet = merkleRootCached;
-        return !mutatedCached;
-    }
+    // keeps all hashes of the previous calculation, so that only changed entries need to be rehashed. Guarded by
+    // cs_main, which all callers (block validation and the miner) hold
+    static CSimplifiedMNListMerkleTree merkleTreeCached;
 
     bool mutated = false;
-    merkleRootRet = sml.CalcMerkleRoot(&mutated);
+    merkleRootRet = merkleTreeCached.CalcMerkleRoot(sml, &mutated);
 
     int64_t nTime4 = GetTimeMicros(); nTimeMerkle += nTime4 - nTime3;
     LogPrint(BCLog::BENCHMARK, "            - CalcMerkleRoot: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeMerkle * 0.000001);
 
-    smlCached = std::move(sml);
-    merkleRootCached = merkleRootRet;
-    mutatedCached = mutated;
-
     return !mutated;
 }
 
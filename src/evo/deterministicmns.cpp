@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "deterministicmns.h"
+#include "simplifiedmns.h"
 #include "specialtx.h"
 
 #include "base58.h"
@@ -195,58 +196,56 @@ static int CompareByLastPaid_GetHeight(const CDeterministicMN& dmn)
     return height;
 }
 
-static bool CompareByLastPaid(const CDeterministicMN& _a, const CDeterministicMN& _b)
-{
-    int ah = CompareByLastPaid_GetHeight(_a);
-    int bh = CompareByLastPaid_GetHeight(_b);
-    if (ah == bh) {
-        return _a.proTxHash < _b.proTxHash;
-    } else {
-        return ah < bh;
-    }
-}
-static bool CompareByLastPaid(const CDeterministicMNCPtr& _a, const CDeterministicMNCPtr& _b)
-{
-    return CompareByLastPaid(*_a, *_b);
-}
-
 CDeterministicMNCPtr CDeterministicMNList::GetMNPayee() const
 {
-    if (mnMap.size() == 0) {
+    if (mnPaymentQueue.empty()) {
         return nullptr;
     }
-
-    CDeterministicMNCPtr best;
-    ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-        if (!best || CompareByLastPaid(dmn, best)) {
-            best = dmn;
-        }
-    });
-
-    return best;
+    return GetMN(mnPaymentQueue.front().second);
 }
 
 std::vector<CDeterministicMNCPtr> CDeterministicMNList::GetProjectedMNPayees(int nCount) const
 {
-    if (nCount > GetValidMNsCount()) {
-        nCount = GetValidMNsCount();
+    if (nCount <= 0) {
+        return {};
+    }
+    if ((size_t)nCount > mnPaymentQueue.size()) {
+        nCount = (int)mnPaymentQueue.size();
     }
 
     std::vector<CDeterministicMNCPtr> result;
     result.reserve(nCount);
 
-    ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
+    for (const auto& e : mnPaymentQueue.take(nCount)) {
+        auto dmn = GetMN(e.second);
+        assert(dmn);
         result.emplace_back(dmn);
-    });
-    std::sort(result.begin(), result.end(), [&](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
-        return CompareByLastPaid(a, b);
-    });
-
-    result.resize(nCount);
+    }
 
     return result;
 }
 
+CDeterministicMNList::MnPaymentQueueEntry CDeterministicMNList::GetPaymentQueueEntry(const CDeterministicMN& dmn)
+{
+    return std::make_pair(CompareByLastPaid_GetHeight(dmn), dmn.proTxHash);
+}
+
+void CDeterministicMNList::AddToPaymentQueue(const CDeterministicMN& dmn)
+{
+    auto e = GetPaymentQueueEntry(dmn);
+    auto it = std::lower_bound(mnPaymentQueue.begin(), mnPaymentQueue.end(), e);
+    assert(it == mnPaymentQueue.end() || *it != e);
+    mnPaymentQueue = mnPaymentQueue.insert(it - mnPaymentQueue.begin(), e);
+}
+
+void CDeterministicMNList::RemoveFromPaymentQueue(const CDeterministicMN& dmn)
+{
+    auto e = GetPaymentQueueEntry(dmn);
+    auto it = std::lower_bound(mnPaymentQueue.begin(), mnPaymentQueue.end(), e);
+    assert(it != mnPaymentQueue.end() && *it == e);
+    mnPaymentQueue = mnPaymentQueue.erase(it - mnPaymentQueue.begin());
+}
+
 std::vector<CDeterministicMNCPtr> CDeterministicMNList::CalculateQuorum(size_t maxSize, const uint256& modifier) const
 {
     auto scores = CalculateScores(modifier);
@@ -444,6 +443,9 @@ void CDeterministicMNList::AddMN(const CDeterministicMNCPtr& dmn)
     if (dmn->pdmnState->pubKeyOperator.Get().IsValid()) {
         AddUniqueProperty(dmn, dmn->pdmnState->pubKeyOperator);
     }
+    if (IsMNValid(dmn)) {
+        AddToPaymentQueue(*dmn);
+    }
 }
 
 void CDeterministicMNList::UpdateMN(const CDeterministicMNCPtr& oldDmn, const CDeterministicMNStateCPtr& pdmnState)
@@ -454,6 +456,18 @@ void CDeterministicMNList::UpdateMN(const CDeterministicMNCPtr& oldDmn, const CD
     dmn->pdmnState = pdmnState;
     mnMap = mnMap.set(oldDmn->proTxHash, dmn);
 
+    // only touch the payment queue when the position of the MN actually changes
+    bool fOldValid = IsMNValid(oldDmn);
+    bool fNewValid = IsMNValid(dmn);
+    if (fOldValid != fNewValid || (fNewValid && GetPaymentQueueEntry(*oldDmn) != GetPaymentQueueEntry(*dmn))) {
+        if (fOldValid) {
+            RemoveFromPaymentQueue(*oldDmn);
+        }
+        if (fNewValid) {
+            AddToPaymentQueue(*dmn);
+        }
+    }
+
     UpdateUniqueProperty(dmn, oldState->addr, pdmnState->addr);
     UpdateUniqueProperty(dmn, oldState->keyIDOwner, pdmnState->keyIDOwner);
     UpdateUniqueProperty(dmn, oldState->pubKeyOperator, pdmnState->pubKeyOperator);
@@ -487,6 +501,9 @@ void CDeterministicMNList::RemoveMN(const uint256& proTxHash)
     if (dmn->pdmnState->pubKeyOperator.Get().IsValid()) {
         DeleteUniqueProperty(dmn, dmn->pdmnState->pubKeyOperator);
     }
+    if (IsMNValid(dmn)) {
+        RemoveFromPaymentQueue(*dmn);
+    }
     mnMap = mnMap.erase(proTxHash);
     mnInternalIdMap = mnInternalIdMap.erase(dmn->internalId);
 }
@@ -584,6 +601,9 @@ bool CDeterministicMNManager::UndoBlock(const CBlock& block, const CBlockIndex*
         mnListsCache.erase(blockHash);
     }
 
+    // diffs built for the disconnected block or on top of it won't be requested again
+    mnListDiffCache.Clear();
+
     if (diff.HasChanges()) {
         auto inversedDiff = curList.BuildDiff(prevList);
         GetMainSignals().NotifyMasternodeListChanged(true, curList, inversedDiff);
@@ -14,6 +14,7 @@
 #include "simplifiedmns.h"
 #include "sync.h"
 
+#include "immer/flex_vector.hpp"
 #include "immer/map.hpp"
 #include "immer/map_transient.hpp"
 
@@ -276,6 +277,8 @@ public:
     typedef immer::map<uint256, CDeterministicMNCPtr> MnMap;
     typedef immer::map<uint64_t, uint256> MnInternalIdMap;
     typedef immer::map<uint256, std::pair<uint256, uint32_t> > MnUniquePropertyMap;
+    typedef std::pair<int, uint256> MnPaymentQueueEntry;
+    typedef immer::flex_vector<MnPaymentQueueEntry> MnPaymentQueue;
 
 private:
     uint256 blockHash;
@@ -288,6 +291,11 @@ private:
     // we keep track of this as checking for duplicates would otherwise be painfully slow
     MnUniquePropertyMap mnUniquePropertyMap;
 
+    // all valid MNs ordered by (last paid height, proTxHash), which is the order in which they get paid
+    // this is kept up-to-date in AddMN/UpdateMN/RemoveMN so that finding the next payee does not require sorting
+    // the whole list. It's persistent as well, so lists derived from each other share most of it
+    MnPaymentQueue mnPaymentQueue;
+
 public:
     CDeterministicMNList() {}
     explicit CDeterministicMNList(const uint256& _blockHash, int _height, uint32_t _totalRegisteredCount) :
@@ -321,6 +329,7 @@ public:
         mnMap = MnMap();
         mnUniquePropertyMap = MnUniquePropertyMap();
         mnInternalIdMap = MnInternalIdMap();
+        mnPaymentQueue = MnPaymentQueue();
 
         SerializationOpBase(s, CSerActionUnserialize());
 
@@ -338,13 +347,7 @@ public:
 
     size_t GetValidMNsCount() const
     {
-        size_t count = 0;
-        for (const auto& p : mnMap) {
-            if (IsMNValid(p.second)) {
-                count++;
-            }
-        }
-        return count;
+        return mnPaymentQueue.size();
     }
 
     template <typename Callback>
@@ -417,6 +420,11 @@ public:
      */
     std::vector<CDeterministicMNCPtr> GetProjectedMNPayees(int nCount) const;
 
+    /**
+     * Returns the key under which a MN is sorted in the payment queue. Only meaningful for valid MNs.
+     */
+    static MnPaymentQueueEntry GetPaymentQueueEntry(const CDeterministicMN& dmn);
+
     /**
      * Calculate a quorum based on the modifier. The resulting list is deterministically sorted by score
      * @param maxSize
@@ -485,6 +493,9 @@ public:
     }
 
 private:
+    void AddToPaymentQueue(const CDeterministicMN& dmn);
+    void RemoveFromPaymentQueue(const CDeterministicMN& dmn);
+
     template <typename T>
     void AddUniqueProperty(const CDeterministicMNCPtr& dmn, const T& v)
     {
@@ -15,6 +15,10 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "consensus/merkle.h"
+#include "crypto/sha256.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
 #include "univalue.h"
 #include "validation.h"
 
@@ -89,6 +93,66 @@ uint256 CSimplifiedMNList::CalcMerkleRoot(bool* pmutated) const
     return ComputeMerkleRoot(leaves, pmutated);
 }
 
+uint256 CSimplifiedMNListMerkleTree::CalcMerkleRoot(const CSimplifiedMNList& sml, bool* pmutated)
+{
+    // both sml.mnList and leaves are sorted by proRegTxHash, so we can walk them in parallel
+    std::vector<std::pair<CSimplifiedMNListEntry, uint256>> newLeaves;
+    newLeaves.reserve(sml.mnList.size());
+    std::vector<std::vector<uint256>> newLevels(1);
+    newLevels[0].reserve(sml.mnList.size());
+
+    size_t j = 0;
+    for (const auto& e : sml.mnList) {
+        while (j < leaves.size() && leaves[j].first.proRegTxHash < e->proRegTxHash) {
+            j++;
+        }
+        if (j < leaves.size() && leaves[j].first == *e) {
+            newLeaves.emplace_back(std::move(leaves[j]));
+        } else {
+            newLeaves.emplace_back(*e, e->CalcHash());
+        }
+        newLevels[0].emplace_back(newLeaves.back().second);
+    }
+
+    // same algorithm as ComputeMerkleRoot, but inner nodes are reused when both children did not change
+    bool mutation = false;
+    while (newLevels.back().size() > 1) {
+        size_t nLevel = newLevels.size() - 1;
+        const std::vector<uint256>& cur = newLevels[nLevel];
+        const std::vector<uint256>* prev = nLevel + 1 < levels.size() ? &levels[nLevel] : nullptr;
+
+        std::vector<uint256> parents((cur.size() + 1) / 2);
+        for (size_t i = 0; i < parents.size(); i++) {
+            size_t l = i * 2;
+            size_t r = std::min(l + 1, cur.size() - 1);
+            if (l != r && cur[l] == cur[r]) {
+                mutation = true;
+            }
+            if (prev && l < prev->size() && std::min(l + 1, prev->size() - 1) == r &&
+                (*prev)[l] == cur[l] && (*prev)[r] == cur[r]) {
+                parents[i] = levels[nLevel + 1][i];
+                continue;
+            }
+            unsigned char buf[64];
+            memcpy(buf, cur[l].begin(), 32);
+            memcpy(buf + 32, cur[r].begin(), 32);
+            SHA256D64(parents[i].begin(), buf, 1);
+        }
+        newLevels.emplace_back(std::move(parents));
+    }
+
+    leaves = std::move(newLeaves);
+    levels = std::move(newLevels);
+
+    if (pmutated) {
+        *pmutated = mutation;
+    }
+    if (levels.back().empty()) {
+        return uint256();
+    }
+    return levels.back()[0];
+}
+
 CSimplifiedMNListDiff::CSimplifiedMNListDiff()
 {
 }
@@ -186,10 +250,84 @@ void CSimplifiedMNListDiff::ToJson(UniValue& obj) const
     }
 }
 
-bool BuildSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& blockHash, CSimplifiedMNListDiff& mnListDiffRet, std::string& errorRet)
+CSimplifiedMNListDiffCache mnListDiffCache(DEFAULT_MNLISTDIFF_CACHE_SIZE);
+
+CSimplifiedMNListDiffCache::CSimplifiedMNListDiffCache(size_t _nMaxUsage) :
+    nMaxUsage(_nMaxUsage)
+{
+}
+
+size_t CSimplifiedMNListDiffCache::GetEntryUsage(const Entry& entry)
+{
+    // the deserialized diff needs roughly as much memory as its serialized form
+    return sizeof(Entry) + sizeof(Key) * 2 + entry.vSerialized.capacity() * 2;
+}
+
+CSimplifiedMNListDiffCache::EntryPtr CSimplifiedMNListDiffCache::Get(const uint256& baseBlockHash, const uint256& blockHash)
+{
+    LOCK(cs);
+    auto it = entries.find(std::make_pair(baseBlockHash, blockHash));
+    if (it == entries.end()) {
+        nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    lruList.splice(lruList.begin(), lruList, it->second.second);
+    return it->second.first;
+}
+
+void CSimplifiedMNListDiffCache::Add(const uint256& baseBlockHash, const uint256& blockHash, const EntryPtr& entry)
+{
+    LOCK(cs);
+    size_t nEntryUsage = GetEntryUsage(*entry);
+    if (nEntryUsage > nMaxUsage) {
+        return;
+    }
+
+    auto key = std::make_pair(baseBlockHash, blockHash);
+    if (entries.count(key)) {
+        return;
+    }
+
+    while (!lruList.empty() && nUsage + nEntryUsage > nMaxUsage) {
+        auto it = entries.find(lruList.back());
+        nUsage -= GetEntryUsage(*it->second.first);
+        entries.erase(it);
+        lruList.pop_back();
+        nEvictions++;
+    }
+
+    lruList.emplace_front(key);
+    entries.emplace(key, std::make_pair(entry, lruList.begin()));
+    nUsage += nEntryUsage;
+}
+
+void CSimplifiedMNListDiffCache::Clear()
+{
+    LOCK(cs);
+    lruList.clear();
+    entries.clear();
+    nUsage = 0;
+}
+
+void CSimplifiedMNListDiffCache::ToJson(UniValue& obj) const
+{
+    LOCK(cs);
+    obj.setObject();
+    obj.push_back(Pair("entries", (int64_t)entries.size()));
+    obj.push_back(Pair("usage", (int64_t)nUsage));
+    obj.push_back(Pair("maxUsage", (int64_t)nMaxUsage));
+    obj.push_back(Pair("hits", (int64_t)nHits));
+    obj.push_back(Pair("misses", (int64_t)nMisses));
+    obj.push_back(Pair("evictions", (int64_t)nEvictions));
+    uint64_t nRequests = nHits + nMisses;
+    obj.push_back(Pair("hitRate", nRequests ? (double)nHits / nRequests : 0.0));
+}
+
+bool GetSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& blockHash, CSimplifiedMNListDiffCache::EntryPtr& entryRet, std::string& errorRet)
 {
     AssertLockHeld(cs_main);
-    mnListDiffRet = CSimplifiedMNListDiff();
+    entryRet = nullptr;
 
     const CBlockIndex* baseBlockIndex = chainActive.Genesis();
     if (!baseBlockHash.IsNull()) {
@@ -216,18 +354,30 @@ bool BuildSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& bloc
         return false;
     }
 
-    LOCK(deterministicMNManager->cs);
+    entryRet = mnListDiffCache.Get(baseBlockHash, blockHash);
+    if (entryRet) {
+        return true;
+    }
+
+    int64_t nTime1 = GetTimeMicros();
 
-    auto baseDmnList = deterministicMNManager->GetListForBlock(baseBlockIndex);
-    auto dmnList = deterministicMNManager->GetListForBlock(blockIndex);
-    mnListDiffRet = baseDmnList.BuildSimplifiedDiff(dmnList);
+    auto entry = std::make_shared<CSimplifiedMNListDiffCache::Entry>();
+    CSimplifiedMNListDiff& mnListDiff = entry->diff;
+
+    {
+        LOCK(deterministicMNManager->cs);
+
+        auto baseDmnList = deterministicMNManager->GetListForBlock(baseBlockIndex);
+        auto dmnList = deterministicMNManager->GetListForBlock(blockIndex);
+        mnListDiff = baseDmnList.BuildSimplifiedDiff(dmnList);
+    }
 
     // We need to return the value that was provided by the other peer as it otherwise won't be able to recognize the
     // response. This will usually be identical to the block found in baseBlockIndex. The only difference is when a
     // null block hash was provided to get the diff from the genesis block.
-    mnListDiffRet.baseBlockHash = baseBlockHash;
+    mnListDiff.baseBlockHash = baseBlockHash;
 
-    if (!mnListDiffRet.BuildQuorumsDiff(baseBlockIndex, blockIndex)) {
+    if (!mnListDiff.BuildQuorumsDiff(baseBlockIndex, blockIndex)) {
         errorRet = strprintf("failed to build quorums diff");
         return false;
     }
@@ -239,7 +389,7 @@ bool BuildSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& bloc
         return false;
     }
 
-    mnListDiffRet.cbTx = block.vtx[0];
+    mnListDiff.cbTx = block.vtx[0];
 
     std::vector<uint256> vHashes;
     std::vector<bool> vMatch(block.vtx.size(), false);
@@ -247,7 +397,28 @@ bool BuildSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& bloc
         vHashes.emplace_back(tx->GetHash());
     }
     vMatch[0] = true; // only coinbase matches
-    mnListDiffRet.cbTxMerkleTree = CPartialMerkleTree(vHashes, vMatch);
+    mnListDiff.cbTxMerkleTree = CPartialMerkleTree(vHashes, vMatch);
+
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, entry->vSerialized, 0, mnListDiff);
+    entry->vSerialized.shrink_to_fit();
+
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint(BCLog::BENCHMARK, "%s -- built diff %s -> %s with %d/%d MNs changed/deleted (%d bytes) in %dus\n", __func__,
+             baseBlockHash.ToString(), blockHash.ToString(), mnListDiff.mnList.size(), mnListDiff.deletedMNs.size(),
+             entry->vSerialized.size(), nTime2 - nTime1);
 
+    mnListDiffCache.Add(baseBlockHash, blockHash, entry);
+    entryRet = std::move(entry);
+    return true;
+}
+
+bool BuildSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& blockHash, CSimplifiedMNListDiff& mnListDiffRet, std::string& errorRet)
+{
+    CSimplifiedMNListDiffCache::EntryPtr entry;
+    if (!GetSimplifiedMNListDiff(baseBlockHash, blockHash, entry, errorRet)) {
+        mnListDiffRet = CSimplifiedMNListDiff();
+        return false;
+    }
+    mnListDiffRet = entry->diff;
     return true;
 }
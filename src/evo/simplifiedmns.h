@@ -11,8 +11,13 @@
 #include "netaddress.h"
 #include "pubkey.h"
 #include "serialize.h"
+#include "sync.h"
 #include "version.h"
 
+#include <list>
+#include <map>
+#include <memory>
+
 class UniValue;
 class CDeterministicMNList;
 class CDeterministicMN;
@@ -85,6 +90,23 @@ public:
     uint256 CalcMerkleRoot(bool* pmutated = nullptr) const;
 };
 
+/**
+ * Calculates the merkle root of SMLs while remembering all intermediate hashes of the previous calculation.
+ * Consecutive lists usually differ in only a few entries, so only the hashes of changed entries and the inner nodes
+ * above them need to be recalculated. The result is identical to CSimplifiedMNList::CalcMerkleRoot.
+ */
+class CSimplifiedMNListMerkleTree
+{
+private:
+    // entries and their hashes from the previous calculation, sorted by proRegTxHash
+    std::vector<std::pair<CSimplifiedMNListEntry, uint256>> leaves;
+    // all levels of the previous tree, levels[0] being the leaf hashes and levels.back() the root
+    std::vector<std::vector<uint256>> levels;
+
+public:
+    uint256 CalcMerkleRoot(const CSimplifiedMNList& sml, bool* pmutated = nullptr);
+};
+
 /// P2P messages
 
 class CGetSimplifiedMNListDiff
@@ -146,6 +168,55 @@ public:
     void ToJson(UniValue& obj) const;
 };
 
+/**
+ * Keeps recently built diffs together with their network serialization, so that the same diff requested by multiple
+ * SPV clients (usually tip-1 -> tip or from one of the recent bases) is only built once.
+ * Entries are evicted least recently used first once nMaxUsage is reached. A diff only depends on the two blocks it
+ * was built for and whether they are still part of the active chain is checked before the cache is consulted, but
+ * the cache is cleared when a block is disconnected so that diffs of the stale chain don't take up the space.
+ */
+class CSimplifiedMNListDiffCache
+{
+public:
+    struct Entry {
+        CSimplifiedMNListDiff diff;
+        // serialized with SER_NETWORK/PROTOCOL_VERSION. Only valid for peers with version >= LLMQS_PROTO_VERSION
+        std::vector<unsigned char> vSerialized;
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
+private:
+    typedef std::pair<uint256, uint256> Key;
+
+    mutable CCriticalSection cs;
+    size_t nMaxUsage;
+    size_t nUsage{0};
+    // most recently used at the front
+    std::list<Key> lruList;
+    std::map<Key, std::pair<EntryPtr, std::list<Key>::iterator>> entries;
+
+    uint64_t nHits{0};
+    uint64_t nMisses{0};
+    uint64_t nEvictions{0};
+
+public:
+    explicit CSimplifiedMNListDiffCache(size_t _nMaxUsage);
+
+    EntryPtr Get(const uint256& baseBlockHash, const uint256& blockHash);
+    void Add(const uint256& baseBlockHash, const uint256& blockHash, const EntryPtr& entry);
+    void Clear();
+
+    void ToJson(UniValue& obj) const;
+
+private:
+    static size_t GetEntryUsage(const Entry& entry);
+};
+
+// 16 MiB
+static const size_t DEFAULT_MNLISTDIFF_CACHE_SIZE = 16 * 1024 * 1024;
+extern CSimplifiedMNListDiffCache mnListDiffCache;
+
+bool GetSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& blockHash, CSimplifiedMNListDiffCache::EntryPtr& entryRet, std::string& errorRet);
 bool BuildSimplifiedMNListDiff(const uint256& baseBlockHash, const uint256& blockHash, CSimplifiedMNListDiff& mnListDiffRet, std::string& errorRet);
 
 #endif //ION_SIMPLIFIEDMNS_H
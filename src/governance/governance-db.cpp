@@ -0,0 +1,195 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "governance-db.h"
+
+#include "util.h"
+
+static const std::string DB_VERSION = "go_version";
+static const std::string DB_OBJECT = "go_o";
+static const std::string DB_VOTE = "go_v";
+static const std::string DB_VOTE_RECORD = "go_r";
+static const std::string DB_CACHES = "go_c";
+
+CGovernanceDb::CGovernanceDb(size_t nCacheSize, bool fMemory, bool fWipe) :
+    db(fMemory ? "" : (GetDataDir() / "governance"), nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CGovernanceDb::IsInitialized()
+{
+    int nVersion = 0;
+    return db.Read(DB_VERSION, nVersion) && nVersion == CURRENT_VERSION;
+}
+
+void CGovernanceDb::WriteVersion()
+{
+    int nVersion = CURRENT_VERSION;
+    // synced, which also makes all previous writes durable
+    db.Write(DB_VERSION, nVersion, true);
+}
+
+void CGovernanceDb::WriteObject(const CGovernanceObject& govobj)
+{
+    db.Write(std::make_tuple(DB_OBJECT, govobj.GetHash()), CGovernanceObjectDbRecord(govobj));
+}
+
+void CGovernanceDb::EraseObject(const uint256& nHash)
+{
+    CDBBatch batch(db);
+    batch.Erase(std::make_tuple(DB_OBJECT, nHash));
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    auto voteStart = std::make_tuple(DB_VOTE, nHash, uint256());
+    pcursor->Seek(voteStart);
+    while (pcursor->Valid()) {
+        decltype(voteStart) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != DB_VOTE || std::get<1>(k) != nHash) {
+            break;
+        }
+        batch.Erase(k);
+        pcursor->Next();
+    }
+
+    auto recordStart = std::make_tuple(DB_VOTE_RECORD, nHash, COutPoint(uint256(), 0));
+    pcursor->Seek(recordStart);
+    while (pcursor->Valid()) {
+        decltype(recordStart) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != DB_VOTE_RECORD || std::get<1>(k) != nHash) {
+            break;
+        }
+        batch.Erase(k);
+        pcursor->Next();
+    }
+
+    db.WriteBatch(batch);
+}
+
+void CGovernanceDb::WriteVoteChanges(const CGovernanceObject& govobj, const std::vector<CGovernanceVote>& vecAddedVotes,
+                                     const std::vector<uint256>& vecRemovedVotes, const std::vector<COutPoint>& vecChangedMNs)
+{
+    uint256 nParentHash = govobj.GetHash();
+
+    CDBBatch batch(db);
+    for (const auto& vote : vecAddedVotes) {
+        batch.Write(std::make_tuple(DB_VOTE, nParentHash, vote.GetHash()), vote);
+    }
+    for (const auto& nVoteHash : vecRemovedVotes) {
+        batch.Erase(std::make_tuple(DB_VOTE, nParentHash, nVoteHash));
+    }
+    for (const auto& outpoint : vecChangedMNs) {
+        vote_rec_t voteRecord;
+        if (govobj.GetCurrentMNVotes(outpoint, voteRecord)) {
+            batch.Write(std::make_tuple(DB_VOTE_RECORD, nParentHash, outpoint), voteRecord);
+        } else {
+            batch.Erase(std::make_tuple(DB_VOTE_RECORD, nParentHash, outpoint));
+        }
+    }
+    db.WriteBatch(batch);
+}
+
+bool CGovernanceDb::HasVote(const uint256& nParentHash, const uint256& nVoteHash)
+{
+    return db.Exists(std::make_tuple(DB_VOTE, nParentHash, nVoteHash));
+}
+
+bool CGovernanceDb::ReadVote(const uint256& nParentHash, const uint256& nVoteHash, CGovernanceVote& voteRet)
+{
+    return db.Read(std::make_tuple(DB_VOTE, nParentHash, nVoteHash), voteRet);
+}
+
+CGovernanceObjectVoteFile CGovernanceDb::ReadVoteFile(const uint256& nParentHash)
+{
+    std::vector<CGovernanceVote> votes;
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    auto start = std::make_tuple(DB_VOTE, nParentHash, uint256());
+    pcursor->Seek(start);
+    while (pcursor->Valid()) {
+        decltype(start) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != DB_VOTE || std::get<1>(k) != nParentHash) {
+            break;
+        }
+        CGovernanceVote vote;
+        if (pcursor->GetValue(vote)) {
+            votes.emplace_back(std::move(vote));
+        }
+        pcursor->Next();
+    }
+
+    return CGovernanceObjectVoteFile(std::move(votes));
+}
+
+void CGovernanceDb::LoadObjects(std::map<uint256, CGovernanceObject>& mapObjectsRet)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    auto objStart = std::make_tuple(DB_OBJECT, uint256());
+    pcursor->Seek(objStart);
+    while (pcursor->Valid()) {
+        decltype(objStart) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != DB_OBJECT) {
+            break;
+        }
+        CGovernanceObject govobj;
+        CGovernanceObjectDbRecord record(govobj);
+        if (pcursor->GetValue(record)) {
+            govobj.UnloadVoteFile();
+            mapObjectsRet.emplace(std::get<1>(k), govobj);
+        } else {
+            LogPrintf("CGovernanceDb::%s -- failed to read object %s\n", __func__, std::get<1>(k).ToString());
+        }
+        pcursor->Next();
+    }
+
+    // vote records are sorted by object hash, so this is a single pass over all of them
+    auto recordStart = std::make_tuple(DB_VOTE_RECORD, uint256(), COutPoint(uint256(), 0));
+    pcursor->Seek(recordStart);
+    auto itObj = mapObjectsRet.end();
+    while (pcursor->Valid()) {
+        decltype(recordStart) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != DB_VOTE_RECORD) {
+            break;
+        }
+        if (itObj == mapObjectsRet.end() || itObj->first != std::get<1>(k)) {
+            itObj = mapObjectsRet.find(std::get<1>(k));
+        }
+        vote_rec_t voteRecord;
+        if (itObj != mapObjectsRet.end() && pcursor->GetValue(voteRecord)) {
+            itObj->second.SetCurrentMNVotes(std::get<2>(k), voteRecord);
+        }
+        pcursor->Next();
+    }
+}
+
+void CGovernanceDb::ForEachVoteHash(std::function<void(const uint256& nParentHash, const uint256& nVoteHash)>&& cb)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    auto start = std::make_tuple(DB_VOTE, uint256(), uint256());
+    pcursor->Seek(start);
+    while (pcursor->Valid()) {
+        decltype(start) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != DB_VOTE) {
+            break;
+        }
+        cb(std::get<1>(k), std::get<2>(k));
+        pcursor->Next();
+    }
+}
+
+void CGovernanceDb::WriteCaches(const CDataStream& ss)
+{
+    db.Write(DB_CACHES, std::vector<unsigned char>(ss.begin(), ss.end()));
+}
+
+bool CGovernanceDb::ReadCaches(CDataStream& ssRet)
+{
+    std::vector<unsigned char> vch;
+    if (!db.Read(DB_CACHES, vch)) {
+        return false;
+    }
+    ssRet = CDataStream(vch, ssRet.GetType(), ssRet.GetVersion());
+    return true;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef GOVERNANCE_DB_H
+#define GOVERNANCE_DB_H
+
+#include "dbwrapper.h"
+#include "governance-object.h"
+#include "governance-vote.h"
+#include "governance-votedb.h"
+#include "streams.h"
+
+#include <functional>
+#include <map>
+
+/**
+ * LevelDB backed storage for governance objects and votes.
+ *
+ * Objects, votes and the current votes of each MN are stored as separate records and written as soon as they are
+ * accepted, so only changes hit the disk and a crash does not lose everything since the last dump. Vote files are
+ * not loaded at startup, only the vote hashes (from the keys) and the current MN votes needed for tallying.
+ * All remaining manager state (erased objects, orphan/invalid votes, rate check buffers, ...) is a cache which is
+ * stored as a single record from time to time.
+ */
+class CGovernanceDb
+{
+private:
+    static const int CURRENT_VERSION = 1;
+
+    CDBWrapper db;
+
+public:
+    CGovernanceDb(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /// false if the db was never initialized, e.g. before governance.dat was migrated
+    bool IsInitialized();
+    /// written synchronously, so everything written before is on disk once it returns
+    void WriteVersion();
+
+    void WriteObject(const CGovernanceObject& govobj);
+    /// erases an object together with all its votes and vote records
+    void EraseObject(const uint256& nHash);
+
+    /**
+     * Writes added votes, erases removed votes and updates the current votes of the given MNs
+     * (or erases them if the object has no votes from the MN anymore)
+     */
+    void WriteVoteChanges(const CGovernanceObject& govobj, const std::vector<CGovernanceVote>& vecAddedVotes,
+                          const std::vector<uint256>& vecRemovedVotes, const std::vector<COutPoint>& vecChangedMNs);
+
+    bool HasVote(const uint256& nParentHash, const uint256& nVoteHash);
+    bool ReadVote(const uint256& nParentHash, const uint256& nVoteHash, CGovernanceVote& voteRet);
+    CGovernanceObjectVoteFile ReadVoteFile(const uint256& nParentHash);
+
+    /// loads all objects including their current MN votes. Vote files are left unloaded.
+    void LoadObjects(std::map<uint256, CGovernanceObject>& mapObjectsRet);
+    /// calls cb for each stored vote, without deserializing the votes
+    void ForEachVoteHash(std::function<void(const uint256& nParentHash, const uint256& nVoteHash)>&& cb);
+
+    void WriteCaches(const CDataStream& ss);
+    bool ReadCaches(CDataStream& ssRet);
+};
+
+#endif
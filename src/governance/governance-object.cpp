@@ -39,7 +39,10 @@ CGovernanceObject::CGovernanceObject() :
     fExpired(false),
     fUnparsable(false),
     mapCurrentMNVotes(),
-    fileVotes()
+    fileVotes(),
+    fVoteFileLoaded(true),
+    nVoteFileLastUse(0),
+    fDbRecordDirty(false)
 {
     // PARSE JSON DATA STORAGE (VCHDATA)
     LoadData();
@@ -66,7 +69,10 @@ CGovernanceObject::CGovernanceObject(const uint256& nHashParentIn, int nRevision
     fExpired(false),
     fUnparsable(false),
     mapCurrentMNVotes(),
-    fileVotes()
+    fileVotes(),
+    fVoteFileLoaded(true),
+    nVoteFileLastUse(0),
+    fDbRecordDirty(false)
 {
     // PARSE JSON DATA STORAGE (VCHDATA)
     LoadData();
@@ -93,14 +99,18 @@ CGovernanceObject::CGovernanceObject(const CGovernanceObject& other) :
     fExpired(other.fExpired),
     fUnparsable(other.fUnparsable),
     mapCurrentMNVotes(other.mapCurrentMNVotes),
-    fileVotes(other.fileVotes)
+    fileVotes(other.fileVotes),
+    fVoteFileLoaded(other.fVoteFileLoaded),
+    nVoteFileLastUse(other.nVoteFileLastUse),
+    fDbRecordDirty(other.fDbRecordDirty)
 {
 }
 
 bool CGovernanceObject::ProcessVote(CNode* pfrom,
     const CGovernanceVote& vote,
     CGovernanceException& exception,
-    CConnman& connman)
+    CConnman& connman,
+    const CDeterministicMNList* pmnListVerified)
 {
     LOCK(cs);
 
@@ -114,7 +124,9 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
         return false;
     }
 
-    auto mnList = deterministicMNManager->GetListAtChainTip();
+    // If the signature was already verified, the vote must be checked against the same list. The keys of the
+    // masternode might have changed in the current one
+    auto mnList = pmnListVerified ? *pmnListVerified : deterministicMNManager->GetListAtChainTip();
     auto dmn = mnList.GetMNByCollateral(vote.GetMasternodeOutpoint());
 
     if (!dmn) {
@@ -188,7 +200,7 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
     bool onlyVotingKeyAllowed = nObjectType == GOVERNANCE_OBJECT_PROPOSAL && vote.GetSignal() == VOTE_SIGNAL_FUNDING;
 
     // Finally check that the vote is actually valid (done last because of cost of signature verification)
-    if (!vote.IsValid(onlyVotingKeyAllowed)) {
+    if (!vote.IsValid(mnList, onlyVotingKeyAllowed, pmnListVerified == nullptr)) {
         std::ostringstream ostr;
         ostr << "CGovernanceObject::ProcessVote -- Invalid vote"
              << ", MN outpoint = " << vote.GetMasternodeOutpoint().ToStringShort()
@@ -216,22 +228,52 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
     return true;
 }
 
-void CGovernanceObject::ClearMasternodeVotes()
+std::vector<COutPoint> CGovernanceObject::ClearMasternodeVotes()
 {
     LOCK(cs);
 
     auto mnList = deterministicMNManager->GetListAtChainTip();
 
+    std::vector<COutPoint> vecRemoved;
     vote_m_it it = mapCurrentMNVotes.begin();
     while (it != mapCurrentMNVotes.end()) {
         if (!mnList.HasMNByCollateral(it->first)) {
             fileVotes.RemoveVotesFromMasternode(it->first);
+            vecRemoved.emplace_back(it->first);
             mapCurrentMNVotes.erase(it++);
             fDirtyCache = true;
         } else {
             ++it;
         }
     }
+    return vecRemoved;
+}
+
+void CGovernanceObject::SetVoteFile(CGovernanceObjectVoteFile&& fileVotesIn)
+{
+    LOCK(cs);
+    fileVotes = std::move(fileVotesIn);
+    fVoteFileLoaded = true;
+}
+
+void CGovernanceObject::UnloadVoteFile()
+{
+    LOCK(cs);
+    fileVotes = CGovernanceObjectVoteFile();
+    fVoteFileLoaded = false;
+}
+
+std::vector<uint256> CGovernanceObject::GetAndClearRemovedVotes()
+{
+    LOCK(cs);
+    return fileVotes.GetAndClearRemovedVotes();
+}
+
+void CGovernanceObject::SetCurrentMNVotes(const COutPoint& mnCollateralOutpoint, const vote_rec_t& voteRecord)
+{
+    LOCK(cs);
+    mapCurrentMNVotes[mnCollateralOutpoint] = voteRecord;
+    fDirtyCache = true;
 }
 
 std::set<uint256> CGovernanceObject::RemoveInvalidVotes(const COutPoint& mnOutpoint)
@@ -686,6 +728,7 @@ void CGovernanceObject::UpdateSentinelVariables()
         fCachedDelete = true;
         if (nDeletionTime == 0) {
             nDeletionTime = GetAdjustedTime();
+            fDbRecordDirty = true;
         }
     }
     if (GetAbsoluteYesCount(VOTE_SIGNAL_ENDORSED) >= nAbsVoteReq) fCachedEndorsed = true;
@@ -22,6 +22,7 @@ class CGovernanceManager;
 class CGovernanceTriggerManager;
 class CGovernanceObject;
 class CGovernanceVote;
+class CDeterministicMNList;
 
 static const int MIN_GOVERNANCE_PEER_PROTO_VERSION = 70213;
 static const int GOVERNANCE_FILTER_PROTO_VERSION = 70206;
@@ -106,6 +107,8 @@ struct vote_rec_t {
 
 class CGovernanceObject
 {
+    friend class CGovernanceObjectDbRecord;
+
 public: // Types
     typedef std::map<COutPoint, vote_rec_t> vote_m_t;
 
@@ -177,6 +180,15 @@ private:
 
     CGovernanceObjectVoteFile fileVotes;
 
+    /// false when fileVotes was not loaded from CGovernanceDb yet or was unloaded to save memory
+    bool fVoteFileLoaded;
+
+    /// last time the vote file was needed, used to unload idle vote files
+    int64_t nVoteFileLastUse;
+
+    /// nDeletionTime or fExpired changed since the object was last written to CGovernanceDb
+    bool fDbRecordDirty;
+
 public:
     CGovernanceObject();
 
@@ -243,7 +255,20 @@ public:
 
     void SetExpired()
     {
-        fExpired = true;
+        if (!fExpired) {
+            fExpired = true;
+            fDbRecordDirty = true;
+        }
+    }
+
+    bool IsDbRecordDirty() const
+    {
+        return fDbRecordDirty;
+    }
+
+    void SetDbRecordWritten()
+    {
+        fDbRecordDirty = false;
     }
 
     const CGovernanceObjectVoteFile& GetVoteFile() const
@@ -251,6 +276,30 @@ public:
         return fileVotes;
     }
 
+    bool IsVoteFileLoaded() const
+    {
+        return fVoteFileLoaded;
+    }
+
+    int64_t GetVoteFileLastUse() const
+    {
+        return nVoteFileLastUse;
+    }
+
+    void SetVoteFileLastUse(int64_t nTime)
+    {
+        nVoteFileLastUse = nTime;
+    }
+
+    void SetVoteFile(CGovernanceObjectVoteFile&& fileVotesIn);
+    void UnloadVoteFile();
+
+    /// Returns hashes of votes removed from the vote file since the last call
+    std::vector<uint256> GetAndClearRemovedVotes();
+
+    /// Used when loading the current votes of a MN from CGovernanceDb
+    void SetCurrentMNVotes(const COutPoint& mnCollateralOutpoint, const vote_rec_t& voteRecord);
+
     // Signature related functions
 
     void SetMasternodeOutpoint(const COutPoint& outpoint);
@@ -277,6 +326,7 @@ public:
         fCachedDelete = true;
         if (nDeletionTime == 0) {
             nDeletionTime = nDeletionTime_;
+            fDbRecordDirty = true;
         }
     }
 
@@ -343,10 +393,12 @@ public:
     bool ProcessVote(CNode* pfrom,
         const CGovernanceVote& vote,
         CGovernanceException& exception,
-        CConnman& connman);
+        CConnman& connman,
+        const CDeterministicMNList* pmnListVerified = nullptr);
 
     /// Called when MN's which have voted on this object have been removed
-    void ClearMasternodeVotes();
+    /// Returns the outpoints of the removed MNs.
+    std::vector<COutPoint> ClearMasternodeVotes();
 
     // Revalidate all votes from this MN and delete them if validation fails.
     // This is the case for DIP3 MNs that changed voting or operator keys and
@@ -355,5 +407,37 @@ public:
     std::set<uint256> RemoveInvalidVotes(const COutPoint& mnOutpoint);
 };
 
+/**
+ * Serializes a governance object in the disk format, but without the vote file and the current MN votes.
+ * CGovernanceDb stores these as separate records so that they can be written incrementally and loaded lazily.
+ */
+class CGovernanceObjectDbRecord
+{
+private:
+    CGovernanceObject& obj;
+
+public:
+    explicit CGovernanceObjectDbRecord(const CGovernanceObject& _obj) :
+        obj(const_cast<CGovernanceObject&>(_obj))
+    {
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(obj.nHashParent);
+        READWRITE(obj.nRevision);
+        READWRITE(obj.nTime);
+        READWRITE(obj.nCollateralHash);
+        READWRITE(obj.vchData);
+        READWRITE(obj.nObjectType);
+        READWRITE(obj.masternodeOutpoint);
+        READWRITE(obj.vchSig);
+        READWRITE(obj.nDeletionTime);
+        READWRITE(obj.fExpired);
+    }
+};
 
 #endif
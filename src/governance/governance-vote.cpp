@@ -243,8 +243,7 @@ bool CGovernanceVote::Sign(const CBLSSecretKey& key)
 bool CGovernanceVote::CheckSignature(const CBLSPublicKey& pubKey) const
 {
     uint256 hash = GetSignatureHash();
-    CBLSSignature sig;
-    sig.SetBuf(vchSig);
+    CBLSSignature sig = GetBLSSignature();
     if (!sig.VerifyInsecure(pubKey, hash)) {
         LogPrintf("CGovernanceVote::CheckSignature -- VerifyInsecure() failed\n");
         return false;
@@ -252,7 +251,19 @@ bool CGovernanceVote::CheckSignature(const CBLSPublicKey& pubKey) const
     return true;
 }
 
+CBLSSignature CGovernanceVote::GetBLSSignature() const
+{
+    CBLSSignature sig;
+    sig.SetBuf(vchSig);
+    return sig;
+}
+
 bool CGovernanceVote::IsValid(bool useVotingKey) const
+{
+    return IsValid(deterministicMNManager->GetListAtChainTip(), useVotingKey);
+}
+
+bool CGovernanceVote::IsValid(const CDeterministicMNList& mnList, bool useVotingKey, bool fCheckSignature) const
 {
     if (nTime > GetAdjustedTime() + (60 * 60)) {
         LogPrint(BCLog::GOBJECT, "CGovernanceVote::IsValid -- vote is too far ahead of current time - %s - nTime %lli - Max Time %lli\n", GetHash().ToString(), nTime, GetAdjustedTime() + (60 * 60));
@@ -271,12 +282,16 @@ bool CGovernanceVote::IsValid(bool useVotingKey) const
         return false;
     }
 
-    auto dmn = deterministicMNManager->GetListAtChainTip().GetMNByCollateral(masternodeOutpoint);
+    auto dmn = mnList.GetMNByCollateral(masternodeOutpoint);
     if (!dmn) {
         LogPrint(BCLog::GOBJECT, "CGovernanceVote::IsValid -- Unknown Masternode - %s\n", masternodeOutpoint.ToStringShort());
         return false;
     }
 
+    if (!fCheckSignature) {
+        return true;
+    }
+
     if (useVotingKey) {
         return CheckSignature(dmn->pdmnState->keyIDVoting);
     } else {
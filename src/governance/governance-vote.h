@@ -11,6 +11,7 @@
 
 class CGovernanceVote;
 class CConnman;
+class CDeterministicMNList;
 
 // INTENTION OF MASTERNODES REGARDING ITEM
 enum vote_outcome_enum_t {
@@ -99,7 +100,11 @@ public:
     bool CheckSignature(const CKeyID& keyID) const;
     bool Sign(const CBLSSecretKey& key);
     bool CheckSignature(const CBLSPublicKey& pubKey) const;
+    CBLSSignature GetBLSSignature() const;
     bool IsValid(bool useVotingKey) const;
+    /// Checks the vote against the masternodes in mnList. fCheckSignature=false skips the signature check, e.g.
+    /// because the signature was already batch verified against the same list
+    bool IsValid(const CDeterministicMNList& mnList, bool useVotingKey, bool fCheckSignature = true) const;
     void Relay(CConnman& connman) const;
 
     const COutPoint& GetMasternodeOutpoint() const { return masternodeOutpoint; }
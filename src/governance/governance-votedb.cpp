@@ -14,11 +14,31 @@ CGovernanceObjectVoteFile::CGovernanceObjectVoteFile() :
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other) :
     nMemoryVotes(other.nMemoryVotes),
     listVotes(other.listVotes),
+    mapVoteIndex(),
+    vecRemovedVotes(other.vecRemovedVotes)
+{
+    RebuildIndex();
+}
+
+CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(std::vector<CGovernanceVote>&& votes) :
+    nMemoryVotes(0),
+    listVotes(std::make_move_iterator(votes.begin()), std::make_move_iterator(votes.end())),
     mapVoteIndex()
 {
     RebuildIndex();
 }
 
+CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanceObjectVoteFile& other)
+{
+    if (this != &other) {
+        // CGovernanceVote is not assignable, so the list can't be copy-assigned element by element
+        listVotes = vote_l_t(other.listVotes);
+        vecRemovedVotes = other.vecRemovedVotes;
+        RebuildIndex();
+    }
+    return *this;
+}
+
 void CGovernanceObjectVoteFile::AddVote(const CGovernanceVote& vote)
 {
     uint256 nHash = vote.GetHash();
@@ -62,6 +82,7 @@ void CGovernanceObjectVoteFile::RemoveVotesFromMasternode(const COutPoint& outpo
         if (it->GetMasternodeOutpoint() == outpointMasternode) {
             --nMemoryVotes;
             mapVoteIndex.erase(it->GetHash());
+            vecRemovedVotes.emplace_back(it->GetHash());
             listVotes.erase(it++);
         } else {
             ++it;
@@ -79,6 +100,7 @@ std::set<uint256> CGovernanceObjectVoteFile::RemoveInvalidVotes(const COutPoint&
             bool useVotingKey = fProposal && (it->GetSignal() == VOTE_SIGNAL_FUNDING);
             if (!it->IsValid(useVotingKey)) {
                 removedVotes.emplace(it->GetHash());
+                vecRemovedVotes.emplace_back(it->GetHash());
                 --nMemoryVotes;
                 mapVoteIndex.erase(it->GetHash());
                 listVotes.erase(it++);
@@ -91,6 +113,13 @@ std::set<uint256> CGovernanceObjectVoteFile::RemoveInvalidVotes(const COutPoint&
     return removedVotes;
 }
 
+std::vector<uint256> CGovernanceObjectVoteFile::GetAndClearRemovedVotes()
+{
+    std::vector<uint256> ret;
+    ret.swap(vecRemovedVotes);
+    return ret;
+}
+
 void CGovernanceObjectVoteFile::RemoveOldVotes(const CGovernanceVote& vote)
 {
     vote_l_it it = listVotes.begin();
@@ -102,6 +131,7 @@ void CGovernanceObjectVoteFile::RemoveOldVotes(const CGovernanceVote& vote)
         {
             --nMemoryVotes;
             mapVoteIndex.erase(it->GetHash());
+            vecRemovedVotes.emplace_back(it->GetHash());
             listVotes.erase(it++);
         } else {
             ++it;
@@ -7,6 +7,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 #include "governance-vote.h"
 #include "serialize.h"
@@ -18,8 +19,9 @@
  * Recently received votes are held in memory until a maximum size is reached after
  * which older votes a flushed to a disk file.
  *
- * Note: This is a stub implementation that doesn't limit the number of votes held
- * in memory and doesn't flush to disk.
+ * Note: This implementation doesn't flush to disk by itself. Votes are persisted by
+ * CGovernanceDb, which uses the removed votes journal to keep its records in sync and
+ * allows unloading/reloading the whole file.
  */
 class CGovernanceObjectVoteFile
 {
@@ -43,11 +45,24 @@ private:
 
     vote_m_t mapVoteIndex;
 
+    // hashes of votes removed since the last call to GetAndClearRemovedVotes
+    std::vector<uint256> vecRemovedVotes;
+
 public:
     CGovernanceObjectVoteFile();
 
     CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other);
 
+    /**
+     * Create a file from already deduplicated votes, e.g. when loading them from CGovernanceDb
+     */
+    explicit CGovernanceObjectVoteFile(std::vector<CGovernanceVote>&& votes);
+
+    CGovernanceObjectVoteFile(CGovernanceObjectVoteFile&& other) = default;
+
+    CGovernanceObjectVoteFile& operator=(const CGovernanceObjectVoteFile& other);
+    CGovernanceObjectVoteFile& operator=(CGovernanceObjectVoteFile&& other) = default;
+
     /**
      * Add a vote to the file
      */
@@ -73,6 +88,8 @@ public:
     void RemoveVotesFromMasternode(const COutPoint& outpointMasternode);
     std::set<uint256> RemoveInvalidVotes(const COutPoint& outpointMasternode, bool fProposal);
 
+    std::vector<uint256> GetAndClearRemovedVotes();
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "governance.h"
+#include "bls/bls_batchverifier.h"
 #include "consensus/validation.h"
+#include "flat-database.h"
 #include "governance-classes.h"
 #include "governance-object.h"
 #include "governance-validators.h"
@@ -68,7 +70,14 @@ bool CGovernanceManager::HaveVoteForHash(const uint256& nHash) const
     LOCK(cs);
 
     CGovernanceObject* pGovobj = nullptr;
-    return cmapVoteToObject.Get(nHash, pGovobj) && pGovobj->GetVoteFile().HasVote(nHash);
+    if (!cmapVoteToObject.Get(nHash, pGovobj)) {
+        return false;
+    }
+    if (!pGovobj->IsVoteFileLoaded()) {
+        // no need to load the whole file for a single vote
+        return db && db->HasVote(pGovobj->GetHash(), nHash);
+    }
+    return pGovobj->GetVoteFile().HasVote(nHash);
 }
 
 int CGovernanceManager::GetVoteCount() const
@@ -82,7 +91,18 @@ bool CGovernanceManager::SerializeVoteForHash(const uint256& nHash, CDataStream&
     LOCK(cs);
 
     CGovernanceObject* pGovobj = nullptr;
-    return cmapVoteToObject.Get(nHash, pGovobj) && pGovobj->GetVoteFile().SerializeVoteToStream(nHash, ss);
+    if (!cmapVoteToObject.Get(nHash, pGovobj)) {
+        return false;
+    }
+    if (!pGovobj->IsVoteFileLoaded()) {
+        CGovernanceVote vote;
+        if (!db || !db->ReadVote(pGovobj->GetHash(), nHash, vote)) {
+            return false;
+        }
+        ss << vote;
+        return true;
+    }
+    return pGovobj->GetVoteFile().SerializeVoteToStream(nHash, ss);
 }
 
 void CGovernanceManager::ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman)
@@ -234,21 +254,15 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, const std::string& strComm
             return;
         }
 
-        CGovernanceException exception;
-        if (ProcessVote(pfrom, vote, exception, connman)) {
-            LogPrint(BCLog::GOBJECT, "MNGOVERNANCEOBJECTVOTE -- %s new\n", strHash);
-            masternodeSync.BumpAssetLastTime("MNGOVERNANCEOBJECTVOTE");
-            vote.Relay(connman);
-        } else {
-            LogPrint(BCLog::GOBJECT, "MNGOVERNANCEOBJECTVOTE -- Rejected vote, error = %s\n", exception.what());
-            if ((exception.GetNodePenalty() != 0) && masternodeSync.IsSynced()) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), exception.GetNodePenalty());
+        // Signature verification is expensive, so votes are verified in batches by the vote worker thread, which only
+        // locks cs to apply the already verified votes
+        if (voteWorkThread.joinable()) {
+            if (!EnqueueVote(pfrom, vote)) {
+                LogPrint(BCLog::GOBJECT, "MNGOVERNANCEOBJECTVOTE -- %s not queued\n", strHash);
             }
             return;
         }
-        // SEND NOTIFICATION TO SCRIPT/ZMQ
-        GetMainSignals().NotifyGovernanceVote(vote);
+        ProcessVoteBatch({std::make_pair(pfrom, vote)}, connman);
     }
 }
 
@@ -260,6 +274,10 @@ void CGovernanceManager::CheckOrphanVotes(CGovernanceObject& govobj, CGovernance
 
     ScopedLockBool guard(cs, fRateChecksEnabled, false);
 
+    if (!vecVotePairs.empty()) {
+        EnsureVoteFileLoaded(govobj);
+    }
+
     int64_t nNow = GetAdjustedTime();
     for (auto& pairVote : vecVotePairs) {
         bool fRemove = false;
@@ -268,6 +286,8 @@ void CGovernanceManager::CheckOrphanVotes(CGovernanceObject& govobj, CGovernance
         if (pairVote.second < nNow) {
             fRemove = true;
         } else if (govobj.ProcessVote(nullptr, vote, exception, connman)) {
+            cmapVoteToObject.Insert(vote.GetHash(), &govobj);
+            WriteVoteChanges(govobj, {vote}, {vote.GetMasternodeOutpoint()});
             vote.Relay(connman);
             fRemove = true;
         }
@@ -307,6 +327,11 @@ void CGovernanceManager::AddGovernanceObject(CGovernanceObject& govobj, CConnman
         return;
     }
 
+    // from now on, work on the stored copy so that orphan votes and db writes end up in the managed object
+    CGovernanceObject& govobjStored = objpair.first->second;
+    govobjStored.SetVoteFileLastUse(GetTime());
+    WriteObject(govobjStored);
+
     // SHOULD WE ADD THIS OBJECT TO ANY OTHER MANANGERS?
 
     LogPrint(BCLog::GOBJECT, "CGovernanceManager::AddGovernanceObject -- Before trigger block, GetDataAsPlainString = %s, nObjectType = %d\n",
@@ -315,7 +340,8 @@ void CGovernanceManager::AddGovernanceObject(CGovernanceObject& govobj, CConnman
     if (govobj.GetObjectType() == GOVERNANCE_OBJECT_TRIGGER) {
         if (!triggerman.AddNewTrigger(nHash)) {
             LogPrint(BCLog::GOBJECT, "CGovernanceManager::AddGovernanceObject -- undo adding invalid trigger object: hash = %s\n", nHash.ToString());
-            objpair.first->second.PrepareDeletion(GetAdjustedTime());
+            govobjStored.PrepareDeletion(GetAdjustedTime());
+            WriteObject(govobjStored);
             return;
         }
     }
@@ -331,7 +357,7 @@ void CGovernanceManager::AddGovernanceObject(CGovernanceObject& govobj, CConnman
     // WE MIGHT HAVE PENDING/ORPHAN VOTES FOR THIS OBJECT
 
     CGovernanceException exception;
-    CheckOrphanVotes(govobj, exception, connman);
+    CheckOrphanVotes(govobjStored, exception, connman);
 
     // SEND NOTIFICATION TO SCRIPT/ZMQ
     GetMainSignals().NotifyGovernanceObject(govobj);
@@ -355,7 +381,9 @@ void CGovernanceManager::UpdateCachesAndClean()
         if (it == mapObjects.end()) {
             continue;
         }
-        it->second.ClearMasternodeVotes();
+        EnsureVoteFileLoaded(it->second);
+        auto vecRemovedMNs = it->second.ClearMasternodeVotes();
+        WriteVoteChanges(it->second, {}, vecRemovedMNs);
     }
 
     ScopedLockBool guard(cs, fRateChecksEnabled, false);
@@ -422,6 +450,9 @@ void CGovernanceManager::UpdateCachesAndClean()
             }
 
             mapErasedGovernanceObjects.insert(std::make_pair(nHash, nTimeExpired));
+            if (db) {
+                db->EraseObject(nHash);
+            }
             mapObjects.erase(it++);
         } else {
             // NOTE: triggers are handled via triggerman
@@ -446,6 +477,8 @@ void CGovernanceManager::UpdateCachesAndClean()
         }
     }
 
+    UnloadIdleVoteFiles();
+
     LogPrintf("CGovernanceManager::UpdateCachesAndClean -- %s\n", ToString());
 }
 
@@ -546,6 +579,8 @@ void CGovernanceManager::DoMaintenance(CConnman& connman)
     // CHECK AND REMOVE - REPROCESS GOVERNANCE OBJECTS
 
     UpdateCachesAndClean();
+
+    FlushCache();
 }
 
 bool CGovernanceManager::ConfirmInventoryRequest(const CInv& inv)
@@ -567,7 +602,7 @@ bool CGovernanceManager::ConfirmInventoryRequest(const CInv& inv)
         break;
     } 
     case MSG_GOVERNANCE_OBJECT_VOTE: {
-        if (cmapVoteToObject.HasKey(inv.hash)) {
+        if (cmapVoteToObject.HasKey(inv.hash) || IsVotePending(inv.hash)) {
             LogPrint(BCLog::GOBJECT, "CGovernanceManager::ConfirmInventoryRequest already have governance vote, returning false\n");
             return false;
         }
@@ -612,36 +647,49 @@ void CGovernanceManager::SyncSingleObjVotes(CNode* pnode, const uint256& nProp,
 
     LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- syncing single object to peer=%d, nProp = %s\n", __func__, pnode->GetId(), nProp.ToString());
 
-    LOCK2(cs_main, cs);
-
-    // single valid object and its valid votes
-    object_m_it it = mapObjects.find(nProp);
-    if (it == mapObjects.end()) {
-        LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- no matching object for hash %s, peer=%d\n", __func__, nProp.ToString(), pnode->GetId());
-        return;
-    }
-    CGovernanceObject& govobj = it->second;
-    std::string strHash = it->first.ToString();
+    std::vector<CGovernanceVote> vecVotes;
+    int nObjectType;
+    {
+        LOCK2(cs_main, cs);
 
-    LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- attempting to sync govobj: %s, peer=%d\n", __func__, strHash, pnode->GetId());
+        // single valid object and its valid votes
+        object_m_it it = mapObjects.find(nProp);
+        if (it == mapObjects.end()) {
+            LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- no matching object for hash %s, peer=%d\n", __func__, nProp.ToString(), pnode->GetId());
+            return;
+        }
+        CGovernanceObject& govobj = it->second;
+        std::string strHash = it->first.ToString();
 
-    if (govobj.IsSetCachedDelete() || govobj.IsSetExpired()) {
-        LogPrintf("CGovernanceManager::%s -- not syncing deleted/expired govobj: %s, peer=%d\n", __func__,
-            strHash, pnode->GetId());
-        return;
-    }
+        LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- attempting to sync govobj: %s, peer=%d\n", __func__, strHash, pnode->GetId());
 
-    auto fileVotes = govobj.GetVoteFile();
+        if (govobj.IsSetCachedDelete() || govobj.IsSetExpired()) {
+            LogPrintf("CGovernanceManager::%s -- not syncing deleted/expired govobj: %s, peer=%d\n", __func__,
+                strHash, pnode->GetId());
+            return;
+        }
 
-    for (const auto& vote : fileVotes.GetVotes()) {
-        uint256 nVoteHash = vote.GetHash();
+        EnsureVoteFileLoaded(govobj);
+        vecVotes = govobj.GetVoteFile().GetVotes();
+        nObjectType = govobj.GetObjectType();
+    }
 
-        bool onlyVotingKeyAllowed = govobj.GetObjectType() == GOVERNANCE_OBJECT_PROPOSAL && vote.GetSignal() == VOTE_SIGNAL_FUNDING;
+    // re-check the votes against the current MN list (keys might have changed) without holding any locks
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    std::vector<VoteSigCheck> vecChecks;
+    vecChecks.reserve(vecVotes.size());
+    for (const auto& vote : vecVotes) {
+        bool onlyVotingKeyAllowed = nObjectType == GOVERNANCE_OBJECT_PROPOSAL && vote.GetSignal() == VOTE_SIGNAL_FUNDING;
+        bool fNeedsCheck = !filter.contains(vote.GetHash()) && vote.IsValid(mnList, onlyVotingKeyAllowed, false);
+        vecChecks.push_back({&vote, nullptr, onlyVotingKeyAllowed, fNeedsCheck, false});
+    }
+    VerifyVoteSignatures(mnList, vecChecks);
 
-        if (filter.contains(nVoteHash) || !vote.IsValid(onlyVotingKeyAllowed)) {
+    for (const auto& check : vecChecks) {
+        if (!check.fValid) {
             continue;
         }
-        pnode->PushInventory(CInv(MSG_GOVERNANCE_OBJECT_VOTE, nVoteHash));
+        pnode->PushInventory(CInv(MSG_GOVERNANCE_OBJECT_VOTE, check.pvote->GetHash()));
         ++nVoteCount;
     }
 
@@ -789,7 +837,7 @@ bool CGovernanceManager::MasternodeRateCheck(const CGovernanceObject& govobj, bo
     return false;
 }
 
-bool CGovernanceManager::ProcessVote(CNode* pfrom, const CGovernanceVote& vote, CGovernanceException& exception, CConnman& connman)
+bool CGovernanceManager::ProcessVote(CNode* pfrom, const CGovernanceVote& vote, CGovernanceException& exception, CConnman& connman, const CDeterministicMNList* pmnListVerified)
 {
     ENTER_CRITICAL_SECTION(cs);
     uint256 nHashVote = vote.GetHash();
@@ -838,11 +886,259 @@ bool CGovernanceManager::ProcessVote(CNode* pfrom, const CGovernanceVote& vote,
         return false;
     }
 
-    bool fOk = govobj.ProcessVote(pfrom, vote, exception, connman) && cmapVoteToObject.Insert(nHashVote, &govobj);
+    EnsureVoteFileLoaded(govobj);
+    bool fOk = govobj.ProcessVote(pfrom, vote, exception, connman, pmnListVerified) && cmapVoteToObject.Insert(nHashVote, &govobj);
+    if (fOk) {
+        WriteVoteChanges(govobj, {vote}, {vote.GetMasternodeOutpoint()});
+    }
     LEAVE_CRITICAL_SECTION(cs);
     return fOk;
 }
 
+bool CGovernanceManager::EnqueueVote(CNode* pfrom, const CGovernanceVote& vote)
+{
+    uint256 nHash = vote.GetHash();
+
+    LOCK(cs_pendingVotes);
+    if (mapPendingVotes.count(nHash) || setVerifyingVotes.count(nHash)) {
+        voteQueueStats.nDuplicates++;
+        return false;
+    }
+    if (mapPendingVotes.size() >= MAX_PENDING_GOVERNANCE_VOTES) {
+        LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- vote queue full, dropping vote %s, peer=%d\n", __func__, nHash.ToString(), pfrom->GetId());
+        voteQueueStats.nDropped++;
+        return false;
+    }
+    pfrom->AddRef();
+    mapPendingVotes.emplace(nHash, std::make_pair(pfrom, vote));
+    voteQueueStats.nQueued++;
+    return true;
+}
+
+bool CGovernanceManager::IsVotePending(const uint256& nHash)
+{
+    LOCK(cs_pendingVotes);
+    return mapPendingVotes.count(nHash) || setVerifyingVotes.count(nHash);
+}
+
+void CGovernanceManager::StartVoteWorkThread()
+{
+    if (voteWorkThread.joinable()) {
+        assert(false);
+    }
+
+    int nThreads = std::max(1, std::min(GetNumCores() - 1, MAX_GOVERNANCE_VERIFY_THREADS));
+    verifyPool.resize(nThreads);
+    RenameThreadPool(verifyPool, "ion-gov-verify");
+
+    voteWorkInterrupt.reset();
+    voteWorkThread = std::thread(&TraceThread<std::function<void()> >, "govvotes", std::function<void()>(std::bind(&CGovernanceManager::VoteWorkThreadMain, this)));
+}
+
+void CGovernanceManager::InterruptVoteWorkThread()
+{
+    voteWorkInterrupt();
+}
+
+void CGovernanceManager::StopVoteWorkThread()
+{
+    if (voteWorkThread.joinable()) {
+        // make sure to call InterruptVoteWorkThread() first
+        if (!voteWorkInterrupt) {
+            assert(false);
+        }
+        voteWorkThread.join();
+    }
+    verifyPool.stop(true);
+
+    LOCK(cs_pendingVotes);
+    for (auto& p : mapPendingVotes) {
+        p.second.first->Release();
+    }
+    mapPendingVotes.clear();
+}
+
+void CGovernanceManager::VoteWorkThreadMain()
+{
+    while (!voteWorkInterrupt) {
+        bool fMoreWork = g_connman && ProcessPendingVotes(*g_connman);
+        if (!fMoreWork && !voteWorkInterrupt.sleep_for(std::chrono::milliseconds(100))) {
+            return;
+        }
+    }
+}
+
+bool CGovernanceManager::ProcessPendingVotes(CConnman& connman)
+{
+    std::vector<std::pair<CNode*, CGovernanceVote>> vecVotes;
+    {
+        LOCK(cs_pendingVotes);
+        auto it = mapPendingVotes.begin();
+        while (it != mapPendingVotes.end() && vecVotes.size() < GOVERNANCE_VOTE_BATCH_SIZE) {
+            setVerifyingVotes.emplace(it->first);
+            vecVotes.emplace_back(std::move(it->second));
+            it = mapPendingVotes.erase(it);
+        }
+    }
+
+    if (vecVotes.empty()) {
+        return false;
+    }
+
+    ProcessVoteBatch(vecVotes, connman);
+
+    LOCK(cs_pendingVotes);
+    for (const auto& p : vecVotes) {
+        setVerifyingVotes.erase(p.second.GetHash());
+        p.first->Release();
+    }
+    return true;
+}
+
+void CGovernanceManager::ProcessVoteBatch(const std::vector<std::pair<CNode*, CGovernanceVote>>& vecVotes, CConnman& connman)
+{
+    int64_t nStartTime = GetTimeMicros();
+
+    std::vector<VoteSigCheck> vecChecks;
+    vecChecks.reserve(vecVotes.size());
+    // Figure out which key each vote must be signed with. Only votes for known objects are verified here, all others
+    // (already known, invalid, orphan) are passed to ProcessVote unverified, which handles them without verification
+    {
+        LOCK(cs);
+        for (const auto& p : vecVotes) {
+            const CGovernanceVote& vote = p.second;
+            uint256 nHash = vote.GetHash();
+            VoteSigCheck check{&vote, p.first, false, false, false};
+            auto it = mapObjects.find(vote.GetParentHash());
+            if (it != mapObjects.end() && !cmapVoteToObject.HasKey(nHash) && !cmapInvalidVotes.HasKey(nHash)) {
+                check.fUseVotingKey = it->second.GetObjectType() == GOVERNANCE_OBJECT_PROPOSAL && vote.GetSignal() == VOTE_SIGNAL_FUNDING;
+                check.fNeedsCheck = true;
+            }
+            vecChecks.emplace_back(check);
+        }
+    }
+
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    for (auto& check : vecChecks) {
+        // no need to verify the signature if the vote will be rejected anyway
+        if (check.fNeedsCheck && !check.pvote->IsValid(mnList, check.fUseVotingKey, false)) {
+            check.fNeedsCheck = false;
+        }
+    }
+    VerifyVoteSignatures(mnList, vecChecks);
+
+    size_t nVerified = 0;
+    size_t nBadSignatures = 0;
+    for (const auto& check : vecChecks) {
+        const CGovernanceVote& vote = *check.pvote;
+        CGovernanceException exception;
+        bool fOk = false;
+        if (check.fNeedsCheck) {
+            nVerified++;
+        }
+        if (check.fNeedsCheck && !check.fValid) {
+            // Reject it like ProcessVote would, without verifying the signature again while holding cs
+            nBadSignatures++;
+            std::ostringstream ostr;
+            ostr << "CGovernanceManager::ProcessVoteBatch -- Invalid vote signature"
+                 << ", MN outpoint = " << vote.GetMasternodeOutpoint().ToStringShort()
+                 << ", governance object hash = " << vote.GetParentHash().ToString()
+                 << ", vote hash = " << vote.GetHash().ToString();
+            LogPrintf("%s\n", ostr.str());
+            exception = CGovernanceException(ostr.str(), GOVERNANCE_EXCEPTION_PERMANENT_ERROR, 20);
+            LOCK(cs);
+            AddInvalidVote(vote);
+        } else {
+            // Only trust the signature check if the vote is processed against the same list, the voting or operator
+            // key of the masternode might have changed since
+            fOk = ProcessVote(check.pfrom, vote, exception, connman, check.fValid ? &mnList : nullptr);
+        }
+
+        if (fOk) {
+            LogPrint(BCLog::GOBJECT, "MNGOVERNANCEOBJECTVOTE -- %s new\n", vote.GetHash().ToString());
+            masternodeSync.BumpAssetLastTime("MNGOVERNANCEOBJECTVOTE");
+            vote.Relay(connman);
+            // SEND NOTIFICATION TO SCRIPT/ZMQ
+            GetMainSignals().NotifyGovernanceVote(vote);
+        } else {
+            LogPrint(BCLog::GOBJECT, "MNGOVERNANCEOBJECTVOTE -- Rejected vote, error = %s\n", exception.what());
+            if (check.pfrom && (exception.GetNodePenalty() != 0) && masternodeSync.IsSynced()) {
+                LOCK(cs_main);
+                Misbehaving(check.pfrom->GetId(), exception.GetNodePenalty());
+            }
+        }
+    }
+
+    int64_t nTime = GetTimeMicros() - nStartTime;
+    LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- processed %d votes, verified %d signatures (%d bad) in %dms\n", __func__,
+        vecVotes.size(), nVerified, nBadSignatures, nTime / 1000);
+
+    LOCK(cs_pendingVotes);
+    voteQueueStats.nBatches++;
+    voteQueueStats.nVerified += nVerified;
+    voteQueueStats.nBadSignatures += nBadSignatures;
+    voteQueueStats.nVerifyTime += nTime;
+}
+
+void CGovernanceManager::VerifyVoteSignatures(const CDeterministicMNList& mnList, std::vector<VoteSigCheck>& vecChecks)
+{
+    CBLSBatchVerifier<NodeId, size_t> batchVerifier(false, true, 8);
+    std::vector<size_t> vecBLSChecks;
+    std::vector<std::pair<size_t, CKeyID>> vecECDSAChecks;
+
+    for (size_t i = 0; i < vecChecks.size(); i++) {
+        const auto& check = vecChecks[i];
+        if (!check.fNeedsCheck) {
+            continue;
+        }
+        auto dmn = mnList.GetMNByCollateral(check.pvote->GetMasternodeOutpoint());
+        if (!dmn) {
+            continue;
+        }
+        if (check.fUseVotingKey) {
+            vecECDSAChecks.emplace_back(i, dmn->pdmnState->keyIDVoting);
+        } else {
+            CBLSSignature sig = check.pvote->GetBLSSignature();
+            const CBLSPublicKey& pubKey = dmn->pdmnState->pubKeyOperator.Get();
+            if (!sig.IsValid() || !pubKey.IsValid()) {
+                continue;
+            }
+            batchVerifier.PushMessage(check.pfrom ? check.pfrom->GetId() : -1, i, check.pvote->GetSignatureHash(), sig, pubKey);
+            vecBLSChecks.emplace_back(i);
+        }
+    }
+
+    // ECDSA signatures are verified on the pool while BLS signatures are batch verified on this thread
+    std::vector<std::future<void>> vecFutures;
+    size_t nThreads = (size_t)verifyPool.size();
+    if (nThreads != 0 && !vecECDSAChecks.empty()) {
+        size_t nChunkSize = (vecECDSAChecks.size() + nThreads - 1) / nThreads;
+        for (size_t nBegin = 0; nBegin < vecECDSAChecks.size(); nBegin += nChunkSize) {
+            size_t nEnd = std::min(nBegin + nChunkSize, vecECDSAChecks.size());
+            vecFutures.emplace_back(verifyPool.push([&vecChecks, &vecECDSAChecks, nBegin, nEnd](int threadId) {
+                for (size_t j = nBegin; j < nEnd; j++) {
+                    auto& check = vecChecks[vecECDSAChecks[j].first];
+                    check.fValid = check.pvote->CheckSignature(vecECDSAChecks[j].second);
+                }
+            }));
+        }
+    } else {
+        for (const auto& p : vecECDSAChecks) {
+            auto& check = vecChecks[p.first];
+            check.fValid = check.pvote->CheckSignature(p.second);
+        }
+    }
+
+    batchVerifier.Verify();
+    for (size_t i : vecBLSChecks) {
+        vecChecks[i].fValid = !batchVerifier.badMessages.count(i);
+    }
+
+    for (auto& f : vecFutures) {
+        f.get();
+    }
+}
+
 void CGovernanceManager::CheckPostponedObjects(CConnman& connman)
 {
     if (!masternodeSync.IsSynced()) return;
@@ -933,6 +1229,7 @@ void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nH
 
         if (pObj) {
             filter = CBloomFilter(Params().GetConsensus().nGovernanceFilterElements, GOVERNANCE_FILTER_FP_RATE, GetRandInt(999999), BLOOM_UPDATE_ALL);
+            EnsureVoteFileLoaded(*pObj);
             std::vector<CGovernanceVote> vecVotes = pObj->GetVoteFile().GetVotes();
             nVoteCount = vecVotes.size();
             for (const auto& vote : vecVotes) {
@@ -1090,11 +1387,27 @@ void CGovernanceManager::RebuildIndexes()
     cmapVoteToObject.Clear();
     for (auto& objPair : mapObjects) {
         CGovernanceObject& govobj = objPair.second;
+        if (!govobj.IsVoteFileLoaded()) {
+            continue;
+        }
         std::vector<CGovernanceVote> vecVotes = govobj.GetVoteFile().GetVotes();
         for (size_t i = 0; i < vecVotes.size(); ++i) {
             cmapVoteToObject.Insert(vecVotes[i].GetHash(), &govobj);
         }
     }
+
+    if (db) {
+        // votes of unloaded vote files are indexed from the db keys, without deserializing the votes themselves
+        auto itObj = mapObjects.end();
+        db->ForEachVoteHash([&](const uint256& nParentHash, const uint256& nVoteHash) {
+            if (itObj == mapObjects.end() || itObj->first != nParentHash) {
+                itObj = mapObjects.find(nParentHash);
+            }
+            if (itObj != mapObjects.end() && !itObj->second.IsVoteFileLoaded()) {
+                cmapVoteToObject.Insert(nVoteHash, &itObj->second);
+            }
+        });
+    }
 }
 
 void CGovernanceManager::AddCachedTriggers()
@@ -1125,6 +1438,196 @@ void CGovernanceManager::InitOnLoad()
     LogPrintf("     %s\n", ToString());
 }
 
+bool CGovernanceManager::LoadCache(bool fWipe)
+{
+    LOCK(cs);
+
+    int64_t nStart = GetTimeMillis();
+
+    try {
+        db = std::make_unique<CGovernanceDb>(GOVERNANCE_DB_CACHE_SIZE, false, fWipe);
+    } catch (const std::exception& e) {
+        LogPrintf("CGovernanceManager::%s -- failed to open governance db: %s\n", __func__, e.what());
+        return false;
+    }
+
+    Clear();
+
+    if (!db->IsInitialized()) {
+        // first start with the db, migrate the old flat file once if there is one
+        fs::path pathFlatDB = GetDataDir() / "governance.dat";
+        if (!fWipe && fs::exists(pathFlatDB)) {
+            CFlatDB<CGovernanceManager> flatdb("governance.dat", "magicGovernanceCache");
+            if (!flatdb.Load(*this)) {
+                return false;
+            }
+            for (const auto& p : mapObjects) {
+                const CGovernanceObject& govobj = p.second;
+                db->WriteObject(govobj);
+                std::vector<COutPoint> vecMNs;
+                for (const auto& vote : govobj.GetVoteFile().GetVotes()) {
+                    vecMNs.emplace_back(vote.GetMasternodeOutpoint());
+                }
+                db->WriteVoteChanges(govobj, govobj.GetVoteFile().GetVotes(), {}, vecMNs);
+            }
+            WriteCachesToDb();
+            // the version marks the migration as done, so it must be on disk before the flat file is removed
+            db->WriteVersion();
+            LogPrintf("CGovernanceManager::%s -- migrated %d objects from %s\n", __func__, mapObjects.size(), pathFlatDB.string());
+            fs::remove(pathFlatDB);
+        } else {
+            db->WriteVersion();
+        }
+    } else {
+        db->LoadObjects(mapObjects);
+        if (!ReadCachesFromDb()) {
+            LogPrintf("CGovernanceManager::%s -- could not read governance caches, starting with empty caches\n", __func__);
+        }
+    }
+
+    int64_t nLoaded = GetTimeMillis();
+
+    InitOnLoad();
+
+    LogPrintf("CGovernanceManager::%s -- loaded %d objects in %dms, indexes rebuilt in %dms. Vote files are loaded on demand\n", __func__,
+        mapObjects.size(), nLoaded - nStart, GetTimeMillis() - nLoaded);
+
+    return true;
+}
+
+void CGovernanceManager::FlushCache()
+{
+    LOCK(cs);
+    if (!db) {
+        return;
+    }
+
+    int64_t nStart = GetTimeMillis();
+
+    WriteCachesToDb();
+
+    // deletion state is changed in many places (triggers, validators, ...), the objects only track that it changed
+    int nObjectsWritten = 0;
+    for (auto& p : mapObjects) {
+        if (p.second.IsDbRecordDirty()) {
+            WriteObject(p.second);
+            nObjectsWritten++;
+        }
+    }
+
+    LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- wrote caches and %d objects in %dms\n", __func__, nObjectsWritten, GetTimeMillis() - nStart);
+}
+
+void CGovernanceManager::CloseCache()
+{
+    LOCK(cs);
+    db.reset();
+}
+
+void CGovernanceManager::WriteCachesToDb()
+{
+    AssertLockHeld(cs);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << SERIALIZATION_VERSION_STRING;
+    ss << mapErasedGovernanceObjects;
+    ss << cmapInvalidVotes;
+    ss << cmmapOrphanVotes;
+    ss << mapLastMasternodeObject;
+    ss << lastMNListForVotingKeys;
+    db->WriteCaches(ss);
+}
+
+bool CGovernanceManager::ReadCachesFromDb()
+{
+    AssertLockHeld(cs);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    if (!db->ReadCaches(ss)) {
+        return false;
+    }
+
+    try {
+        std::string strVersion;
+        ss >> strVersion;
+        if (strVersion != SERIALIZATION_VERSION_STRING) {
+            return false;
+        }
+        ss >> mapErasedGovernanceObjects;
+        ss >> cmapInvalidVotes;
+        ss >> cmmapOrphanVotes;
+        ss >> mapLastMasternodeObject;
+        ss >> lastMNListForVotingKeys;
+    } catch (const std::exception& e) {
+        LogPrintf("CGovernanceManager::%s -- deserialization failed: %s\n", __func__, e.what());
+        mapErasedGovernanceObjects.clear();
+        cmapInvalidVotes.Clear();
+        cmmapOrphanVotes.Clear();
+        mapLastMasternodeObject.clear();
+        lastMNListForVotingKeys = CDeterministicMNList();
+        return false;
+    }
+    return true;
+}
+
+void CGovernanceManager::EnsureVoteFileLoaded(CGovernanceObject& govobj) const
+{
+    AssertLockHeld(cs);
+
+    govobj.SetVoteFileLastUse(GetTime());
+    if (govobj.IsVoteFileLoaded()) {
+        return;
+    }
+
+    int64_t nStart = GetTimeMicros();
+    govobj.SetVoteFile(db ? db->ReadVoteFile(govobj.GetHash()) : CGovernanceObjectVoteFile());
+    LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- loaded vote file for %s in %dus\n", __func__, govobj.GetHash().ToString(), GetTimeMicros() - nStart);
+}
+
+void CGovernanceManager::WriteObject(CGovernanceObject& govobj)
+{
+    AssertLockHeld(cs);
+
+    if (!db) {
+        return;
+    }
+    db->WriteObject(govobj);
+    govobj.SetDbRecordWritten();
+}
+
+void CGovernanceManager::WriteVoteChanges(CGovernanceObject& govobj, const std::vector<CGovernanceVote>& vecAddedVotes, const std::vector<COutPoint>& vecChangedMNs)
+{
+    AssertLockHeld(cs);
+
+    auto vecRemovedVotes = govobj.GetAndClearRemovedVotes();
+    if (!db) {
+        return;
+    }
+    db->WriteVoteChanges(govobj, vecAddedVotes, vecRemovedVotes, vecChangedMNs);
+}
+
+void CGovernanceManager::UnloadIdleVoteFiles()
+{
+    AssertLockHeld(cs);
+
+    if (!db) {
+        // nothing to reload them from
+        return;
+    }
+
+    int64_t nNow = GetTime();
+    int nUnloaded = 0;
+    for (auto& p : mapObjects) {
+        CGovernanceObject& govobj = p.second;
+        if (govobj.IsVoteFileLoaded() && nNow - govobj.GetVoteFileLastUse() > GOVERNANCE_VOTEFILE_UNLOAD_TIME) {
+            govobj.UnloadVoteFile();
+            nUnloaded++;
+        }
+    }
+
+    LogPrint(BCLog::GOBJECT, "CGovernanceManager::%s -- unloaded %d idle vote files\n", __func__, nUnloaded);
+}
+
 std::string CGovernanceManager::ToString() const
 {
     LOCK(cs);
@@ -1182,6 +1685,29 @@ UniValue CGovernanceManager::ToJson() const
     jsonObj.push_back(Pair("other", nOtherCount));
     jsonObj.push_back(Pair("erased", (int)mapErasedGovernanceObjects.size()));
     jsonObj.push_back(Pair("votes", (int)cmapVoteToObject.GetSize()));
+    int nVoteFilesLoaded = 0;
+    for (const auto& objpair : mapObjects) {
+        if (objpair.second.IsVoteFileLoaded()) {
+            nVoteFilesLoaded++;
+        }
+    }
+    jsonObj.push_back(Pair("votefiles_loaded", nVoteFilesLoaded));
+
+    UniValue queueObj(UniValue::VOBJ);
+    {
+        LOCK(cs_pendingVotes);
+        queueObj.push_back(Pair("pending", (int)mapPendingVotes.size()));
+        queueObj.push_back(Pair("verifying", (int)setVerifyingVotes.size()));
+        queueObj.push_back(Pair("queued", voteQueueStats.nQueued));
+        queueObj.push_back(Pair("duplicates", voteQueueStats.nDuplicates));
+        queueObj.push_back(Pair("dropped", voteQueueStats.nDropped));
+        queueObj.push_back(Pair("batches", voteQueueStats.nBatches));
+        queueObj.push_back(Pair("verified", voteQueueStats.nVerified));
+        queueObj.push_back(Pair("bad_signatures", voteQueueStats.nBadSignatures));
+        double dRate = voteQueueStats.nVerifyTime > 0 ? voteQueueStats.nVerified * 1000000.0 / voteQueueStats.nVerifyTime : 0;
+        queueObj.push_back(Pair("votes_per_second", dRate));
+    }
+    jsonObj.push_back(Pair("votequeue", queueObj));
     return jsonObj;
 }
 
@@ -1282,10 +1808,17 @@ void CGovernanceManager::RemoveInvalidVotes()
 
     for (const auto& outpoint : changedKeyMNs) {
         for (auto& p : mapObjects) {
+            vote_rec_t voteRecord;
+            if (!p.second.GetCurrentMNVotes(outpoint, voteRecord)) {
+                // no votes from this MN, no need to load the vote file
+                continue;
+            }
+            EnsureVoteFileLoaded(p.second);
             auto removed = p.second.RemoveInvalidVotes(outpoint);
             if (removed.empty()) {
                 continue;
             }
+            WriteVoteChanges(p.second, {}, {outpoint});
             for (auto& voteHash : removed) {
                 cmapVoteToObject.Erase(voteHash);
                 cmapInvalidVotes.Erase(voteHash);
@@ -9,11 +9,15 @@
 #include "cachemap.h"
 #include "cachemultimap.h"
 #include "chain.h"
+#include "ctpl.h"
+#include "governance-db.h"
 #include "governance-exceptions.h"
 #include "governance-object.h"
 #include "governance-vote.h"
 #include "net.h"
+#include "saltedhasher.h"
 #include "sync.h"
+#include "threadinterrupt.h"
 #include "timedata.h"
 #include "util.h"
 
@@ -21,6 +25,10 @@
 
 #include <univalue.h>
 
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 class CGovernanceManager;
 class CGovernanceTriggerManager;
 class CGovernanceObject;
@@ -40,6 +48,18 @@ typedef std::pair<CGovernanceObject, ExpirationInfo> object_info_pair_t;
 
 static const int RATE_BUFFER_SIZE = 5;
 
+// vote files which were not needed for this long are dropped from memory, they are reloaded from the db on demand
+static const int64_t GOVERNANCE_VOTEFILE_UNLOAD_TIME = 10 * 60;
+
+// votes received from peers are queued and verified in batches by the vote worker thread
+static const size_t MAX_PENDING_GOVERNANCE_VOTES = 100000;
+static const size_t GOVERNANCE_VOTE_BATCH_SIZE = 1000;
+// max number of threads used to verify ECDSA vote signatures in parallel
+static const int MAX_GOVERNANCE_VERIFY_THREADS = 4;
+
+// leveldb cache of the governance db, most reads are served by the in-memory objects anyway
+static const size_t GOVERNANCE_DB_CACHE_SIZE = 1 << 20;
+
 class CRateCheckBuffer
 {
 private:
@@ -151,6 +171,7 @@ public:
 class CGovernanceManager
 {
     friend class CGovernanceObject;
+    friend struct CGovernanceManagerTest;
 
 public: // Types
     struct last_object_rec {
@@ -253,6 +274,38 @@ private:
     // used to check for changed voting keys
     CDeterministicMNList lastMNListForVotingKeys;
 
+    // persistent storage of objects and votes, null if LoadCache was not called (e.g. in unit tests)
+    std::unique_ptr<CGovernanceDb> db;
+
+    // Votes received from peers which are waiting for verification. Votes are moved to setVerifyingVotes while
+    // being verified so that duplicates are detected until the vote is applied. A reference to the peer which sent
+    // a vote is held until the vote was processed.
+    mutable CCriticalSection cs_pendingVotes;
+    std::unordered_map<uint256, std::pair<CNode*, CGovernanceVote>, StaticSaltedHasher> mapPendingVotes;
+    std::unordered_set<uint256, StaticSaltedHasher> setVerifyingVotes;
+    struct VoteQueueStats {
+        uint64_t nQueued{0};
+        uint64_t nDuplicates{0};
+        uint64_t nDropped{0};
+        uint64_t nBatches{0};
+        uint64_t nVerified{0};
+        uint64_t nBadSignatures{0};
+        int64_t nVerifyTime{0}; // microseconds
+    } voteQueueStats;
+
+    std::thread voteWorkThread;
+    CThreadInterrupt voteWorkInterrupt;
+    // used to verify ECDSA signatures in parallel, BLS signatures are batch verified in the calling thread
+    ctpl::thread_pool verifyPool;
+
+    struct VoteSigCheck {
+        const CGovernanceVote* pvote;
+        CNode* pfrom;
+        bool fUseVotingKey;
+        bool fNeedsCheck;
+        bool fValid;
+    };
+
     class ScopedLockBool
     {
         bool& ref;
@@ -378,6 +431,11 @@ public:
 
     bool MasternodeRateCheck(const CGovernanceObject& govobj, bool fUpdateFailStatus, bool fForce, bool& fRateCheckBypassed);
 
+    /// Starts the thread which verifies and applies votes received from peers. Without it, votes are processed synchronously.
+    void StartVoteWorkThread();
+    void InterruptVoteWorkThread();
+    void StopVoteWorkThread();
+
     bool ProcessVoteAndRelay(const CGovernanceVote& vote, CGovernanceException& exception, CConnman& connman)
     {
         bool fOK = ProcessVote(nullptr, vote, exception, connman);
@@ -397,6 +455,15 @@ public:
 
     void InitOnLoad();
 
+    /**
+     * Opens the governance db and loads all objects and their current MN votes. Vote files are loaded on demand.
+     * On the first start after an upgrade, governance.dat is migrated to the db.
+     */
+    bool LoadCache(bool fWipe);
+    /// Writes everything that is not written incrementally, i.e. the manager caches and objects with changed deletion state
+    void FlushCache();
+    void CloseCache();
+
     int RequestGovernanceObjectVotes(CNode* pnode, CConnman& connman);
     int RequestGovernanceObjectVotes(const std::vector<CNode*>& vNodesCopy, CConnman& connman);
 
@@ -408,7 +475,25 @@ private:
         cmapInvalidVotes.Insert(vote.GetHash(), vote);
     }
 
-    bool ProcessVote(CNode* pfrom, const CGovernanceVote& vote, CGovernanceException& exception, CConnman& connman);
+    /// pmnListVerified is the masternode list the vote signature was already verified against, if any
+    bool ProcessVote(CNode* pfrom, const CGovernanceVote& vote, CGovernanceException& exception, CConnman& connman, const CDeterministicMNList* pmnListVerified = nullptr);
+
+    /// Queues a vote received from a peer for verification, returns false if it is already queued or the queue is full
+    bool EnqueueVote(CNode* pfrom, const CGovernanceVote& vote);
+    bool IsVotePending(const uint256& nHash);
+    void VoteWorkThreadMain();
+    /// Verifies and applies the next batch of pending votes, returns false if there was nothing to do
+    bool ProcessPendingVotes(CConnman& connman);
+    /**
+     * Verifies the signatures of a batch of votes and processes them. Votes with a bad signature are rejected as
+     * invalid without being processed.
+     */
+    void ProcessVoteBatch(const std::vector<std::pair<CNode*, CGovernanceVote>>& vecVotes, CConnman& connman);
+    /**
+     * Verifies the signatures of all checks with fNeedsCheck set against the MN keys in mnList and sets fValid.
+     * BLS signatures are batch verified, ECDSA signatures are verified in parallel on verifyPool.
+     */
+    void VerifyVoteSignatures(const CDeterministicMNList& mnList, std::vector<VoteSigCheck>& vecChecks);
 
     /// Called to indicate a requested object has been received
     bool AcceptObjectMessage(const uint256& nHash);
@@ -430,6 +515,19 @@ private:
 
     void RemoveInvalidVotes();
 
+    /// Loads the vote file of the object from the db if it was not loaded yet
+    void EnsureVoteFileLoaded(CGovernanceObject& govobj) const;
+
+    /// Writes the object to the db and clears its dirty flag
+    void WriteObject(CGovernanceObject& govobj);
+
+    /// Writes vote changes of the object to the db. Removed votes are taken from the object's vote file.
+    void WriteVoteChanges(CGovernanceObject& govobj, const std::vector<CGovernanceVote>& vecAddedVotes, const std::vector<COutPoint>& vecChangedMNs);
+
+    void UnloadIdleVoteFiles();
+
+    void WriteCachesToDb();
+    bool ReadCachesFromDb();
 };
 
 #endif
@@ -246,3 +246,27 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+CX11NonceHasher::CX11NonceHasher(const std::vector<unsigned char>& vchHeader, size_t nNonceOffset)
+{
+    assert(nNonceOffset + 4 <= vchHeader.size());
+    sph_blake512_init(&ctxPrefix);
+    sph_blake512(&ctxPrefix, vchHeader.data(), nNonceOffset);
+    vchSuffix.assign(vchHeader.begin() + nNonceOffset + 4, vchHeader.end());
+}
+
+uint256 CX11NonceHasher::Hash(uint32_t nNonce) const
+{
+    unsigned char vchNonce[4];
+    WriteLE32(vchNonce, nNonce);
+
+    sph_blake512_context ctx_blake = ctxPrefix;
+    sph_blake512(&ctx_blake, vchNonce, sizeof(vchNonce));
+    if (!vchSuffix.empty()) {
+        sph_blake512(&ctx_blake, vchSuffix.data(), vchSuffix.size());
+    }
+    uint512 hashBlake;
+    sph_blake512_close(&ctx_blake, static_cast<void*>(&hashBlake));
+
+    return HashX11FromBlake512(hashBlake);
+}
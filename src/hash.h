@@ -313,11 +313,9 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
 /* ----------- Ion Hash ------------------------------------------------ */
-template<typename T1>
-inline uint256 HashX11(const T1 pbegin, const T1 pend)
-
+/** The X11 stages after blake512, applied to the blake512 hash of the input */
+inline uint256 HashX11FromBlake512(const uint512& hashBlake)
 {
-    sph_blake512_context     ctx_blake;
     sph_bmw512_context       ctx_bmw;
     sph_groestl512_context   ctx_groestl;
     sph_jh512_context        ctx_jh;
@@ -328,13 +326,9 @@ inline uint256 HashX11(const T1 pbegin, const T1 pend)
     sph_shavite512_context   ctx_shavite;
     sph_simd512_context      ctx_simd;
     sph_echo512_context      ctx_echo;
-    static unsigned char pblank[1];
 
     uint512 hash[11];
-
-    sph_blake512_init(&ctx_blake);
-    sph_blake512 (&ctx_blake, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_blake512_close(&ctx_blake, static_cast<void*>(&hash[0]));
+    hash[0] = hashBlake;
 
     sph_bmw512_init(&ctx_bmw);
     sph_bmw512 (&ctx_bmw, static_cast<const void*>(&hash[0]), 64);
@@ -379,4 +373,38 @@ inline uint256 HashX11(const T1 pbegin, const T1 pend)
     return hash[10].trim256();
 }
 
+template<typename T1>
+inline uint256 HashX11(const T1 pbegin, const T1 pend)
+
+{
+    sph_blake512_context     ctx_blake;
+    static unsigned char pblank[1];
+
+    uint512 hashBlake;
+
+    sph_blake512_init(&ctx_blake);
+    sph_blake512 (&ctx_blake, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
+    sph_blake512_close(&ctx_blake, static_cast<void*>(&hashBlake));
+
+    return HashX11FromBlake512(hashBlake);
+}
+
+/**
+ * X11 of a serialized block header for many nonces, as done by the internal miner. The header bytes in front of the
+ * nonce are absorbed into the blake512 context once, each nonce then only adds the nonce and the bytes after it.
+ */
+class CX11NonceHasher
+{
+private:
+    sph_blake512_context ctxPrefix;
+    std::vector<unsigned char> vchSuffix;
+
+public:
+    /** vchHeader is the serialized header, with the 4 byte little endian nonce at nNonceOffset */
+    CX11NonceHasher(const std::vector<unsigned char>& vchHeader, size_t nNonceOffset);
+
+    /** Same as HashX11 of the header with the nonce set to nNonce */
+    uint256 Hash(uint32_t nNonce) const;
+};
+
 #endif // BITCOIN_HASH_H
@@ -77,6 +77,8 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
 
     std::string strReply = JSONRPCReply(NullUniValue, objError, id);
 
+    // Drop a partially streamed result
+    req->ClearReplyBody();
     req->WriteHeader("Content-Type", "application/json");
     req->WriteReply(nStatus, strReply);
 }
@@ -185,10 +187,26 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // A streamed result is written into the reply while it is produced, followed by the rest of the reply
+            bool fStreamed = false;
+            JSONStreamWriter stream([req, &fStreamed](const std::string& str) {
+                if (!fStreamed) {
+                    req->AppendReplyBody("{\"result\":");
+                    fStreamed = true;
+                }
+                req->AppendReplyBody(str);
+            });
+            jreq.stream = &stream;
+
             UniValue result = tableRPC.execute(jreq);
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            if (stream.IsStarted()) {
+                stream.Flush();
+                strReply = strprintf(",\"error\":null,\"id\":%s}\n", jreq.id.write());
+            } else {
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            }
 
         // array of requests
         } else if (valRequest.isArray())
@@ -114,6 +114,17 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Append to the body of the reply without sending it yet, so large replies can be written while they are
+     * produced. WriteReply appends strReply to it and sends the reply.
+     */
+    void AppendReplyBody(const std::string& str);
+
+    /**
+     * Discard what was appended to the body of the reply, e.g. to send an error instead.
+     */
+    void ClearReplyBody();
 };
 
 /** Event handler closure.
@@ -14,6 +14,7 @@
 #include "addrman.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockfilterindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -25,6 +26,7 @@
 #include "invalid.h"
 #include "key.h"
 #include "validation.h"
+#include "mempool-journal.h"
 #include "miner.h"
 #include "netbase.h"
 #include "net.h"
@@ -87,8 +89,7 @@
 
 #include "evo/deterministicmns.h"
 #include "llmq/quorums_init.h"
-
-#include "llmq/quorums_init.h"
+#include "llmq/quorums_instantsend.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -167,7 +168,6 @@ static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
 
 std::atomic<bool> fRequestShutdown(false);
 std::atomic<bool> fRequestRestart(false);
-std::atomic<bool> fDumpMempoolLater(false);
 
 void StartShutdown()
 {
@@ -218,6 +218,9 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptREST();
     InterruptTorControl();
     llmq::InterruptLLMQSystem();
+    governance.InterruptVoteWorkThread();
+    if (pblockfilterindex)
+        pblockfilterindex->InterruptSyncThread();
     if (g_connman)
         g_connman->Interrupt();
     threadGroup.interrupt_all();
@@ -243,6 +246,9 @@ void PrepareShutdown()
     StopRPC();
     StopHTTPServer();
     llmq::StopLLMQSystem();
+    governance.StopVoteWorkThread();
+    if (pblockfilterindex)
+        pblockfilterindex->StopSyncThread();
 
     // fRPCInWarmup should be `false` if we completed the loading sequence
     // before a shutdown request was received
@@ -274,16 +280,17 @@ void PrepareShutdown()
         // STORE DATA CACHES INTO SERIALIZED DAT FILES
         CFlatDB<CMasternodeMetaMan> flatdb1("mncache.dat", "magicMasternodeCache");
         flatdb1.Dump(mmetaman);
-        CFlatDB<CGovernanceManager> flatdb3("governance.dat", "magicGovernanceCache");
-        flatdb3.Dump(governance);
+        governance.FlushCache();
         CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
         flatdb4.Dump(netfulfilledman);
         CFlatDB<CSporkManager> flatdb6("sporks.dat", "magicSporkCache");
         flatdb6.Dump(sporkManager);
     }
+    governance.CloseCache();
 
-    if (fDumpMempoolLater && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool();
+    if (mempoolJournal) {
+        mempoolJournal->Stop();
+        mempoolJournal.reset();
     }
 
     if (fFeeEstimatesInitialized)
@@ -335,6 +342,8 @@ void PrepareShutdown()
         zerocoinDB = nullptr;
         delete pTokenDB;
         pTokenDB = nullptr;
+        delete pblockfilterindex;
+        pblockfilterindex = nullptr;
     }
 #ifdef ENABLE_WALLET
     for (CWalletRef pwallet : vpwallets) {
@@ -492,6 +501,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-parpin", strprintf("Pin script verification threads to consecutive cpus of the process affinity mask (Linux only, default: %u)", DEFAULT_SCRIPTCHECK_PIN));
+    }
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -509,6 +521,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of BIP 158 compact block filters, used by the getblockfilter rpc call and to speed up wallet rescans (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
@@ -532,6 +545,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve compact block filters to peers per BIP 157 (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
@@ -631,6 +645,9 @@ std::string HelpMessage(HelpMessageMode mode)
 
     strUsage += HelpMessageGroup(_("InstantSend options:"));
     strUsage += HelpMessageOpt("-instantsendnotify=<cmd>", _("Execute command when a wallet InstantSend transaction is successfully locked (%s in cmd is replaced by TxID)"));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-instantsendindexsize=<n>", strprintf("Limit the in-memory index of unconfirmed InstantSend locks to <n> MiB (default: %u)", llmq::DEFAULT_INSTANTSEND_INDEX_SIZE));
+    }
 
 
     strUsage += HelpMessageGroup(_("Node relay options:"));
@@ -843,6 +860,11 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         StartShutdown();
     }
 
+    // After a reindex the blocks were connected without updating the address aggregates, they are built in one go
+    if (!SyncAddressAggregates()) {
+        LogPrintf("Address aggregates not available, address balances are summed up from the address index\n");
+    }
+
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
         StartShutdown();
@@ -882,7 +904,9 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 
     if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         LoadMempool();
-        fDumpMempoolLater = !fRequestShutdown;
+        if (!fRequestShutdown) {
+            mempoolJournal->Start();
+        }
     }
 }
 
@@ -1140,8 +1164,14 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
     }
 
+    // -peerblockfilters requires the block filter index
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS) && !gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+
     if (gArgs.IsArgSet("-devnet")) {
         // Require setting of ports when running devnet
         if (gArgs.GetArg("-listen", DEFAULT_LISTEN) && !gArgs.IsArgSet("-port")) {
@@ -1362,6 +1392,9 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS))
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     if (gArgs.IsArgSet("-vbparams")) {
@@ -1796,6 +1829,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t nEvoDbCache = 1024 * 1024 * 16; // TODO
+    int64_t nBlockFilterIndexCache = 1024 * 1024 * 8;
+    bool fBlockFilterIndex = gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
@@ -1823,6 +1858,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete evoDb;
                 delete zerocoinDB;
                 delete pTokenDB;
+                delete pblockfilterindex;
+                pblockfilterindex = nullptr;
 
                 evoDb = new CEvoDB(nEvoDbCache, false, fReset || fReindexChainState);
                 deterministicMNManager = new CDeterministicMNManager(*evoDb);
@@ -1830,6 +1867,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 llmq::InitLLMQSystem(*evoDb, &scheduler, false, fReset || fReindexChainState);
                 zerocoinDB = new CZerocoinDB(0, false, fReset || fReindexChainState);
                 pTokenDB = new CTokenDB(0, false, fReset || fReindexChainState);
+                if (fBlockFilterIndex) {
+                    pblockfilterindex = new CBlockFilterIndex(BlockFilterType::BASIC, nBlockFilterIndexCache, false, fReset);
+                }
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1984,6 +2024,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                         break;
                     }
                 }
+
+                // Blocks connected before ThreadImport syncs the address aggregates are applied to them right away
+                InitAddressAggregates();
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -2032,6 +2075,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         ::feeEstimator.Read(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // Mempool and block updates to the fee estimator are processed in the background from here on
+    CScheduler::Function feeEstimatorLoop = boost::bind(&CBlockPolicyEstimator::ThreadProcessEvents, &::feeEstimator);
+    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "feeest", feeEstimatorLoop));
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     rewardManager = std::shared_ptr<CRewardManager>(new CRewardManager());
@@ -2146,19 +2193,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
-    strDBName = "governance.dat";
+    strDBName = "governance";
     uiInterface.InitMessage(_("Loading governance cache..."));
-    CFlatDB<CGovernanceManager> flatdb3(strDBName, "magicGovernanceCache");
-    if (fLoadCacheFiles) {
-        if(!flatdb3.Load(governance)) {
-            return InitError(_("Failed to load governance cache from") + "\n" + (pathDB / strDBName).string());
-        }
-        governance.InitOnLoad();
-    } else {
-        CGovernanceManager governanceTmp;
-        if(!flatdb3.Dump(governanceTmp)) {
-            return InitError(_("Failed to clear governance cache at") + "\n" + (pathDB / strDBName).string());
-        }
+    if (!governance.LoadCache(!fLoadCacheFiles)) {
+        return InitError(_("Failed to load governance cache from") + "\n" + (pathDB / strDBName).string());
     }
 
     strDBName = "netfulfilled.dat";
@@ -2182,6 +2220,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         scheduler.scheduleEvery(boost::bind(&CMasternodeSync::DoMaintenance, boost::ref(masternodeSync), boost::ref(*g_connman)), 1 * 1000);
 
         scheduler.scheduleEvery(boost::bind(&CGovernanceManager::DoMaintenance, boost::ref(governance), boost::ref(*g_connman)), 60 * 5 * 1000);
+        governance.StartVoteWorkThread();
     }
 
     scheduler.scheduleEvery(boost::bind(&CMasternodeUtils::DoMaintenance, boost::ref(*g_connman)), 1 * 1000);
@@ -2263,6 +2302,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         vImportFiles.push_back(strFile);
     }
 
+    if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        // Recording and the thread maintaining the journal start in ThreadImport once the mempool was loaded
+        mempoolJournal.reset(new CMempoolJournal(mempool));
+    }
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
     // Wait for genesis block to be processed
@@ -2282,6 +2326,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    if (pblockfilterindex)
+        pblockfilterindex->StartSyncThread();
+
     // ********************************************************* Step 12: start node
 
     //// debug print
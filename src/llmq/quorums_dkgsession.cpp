@@ -337,70 +337,104 @@ void CDKGSession::ReceiveMessage(const uint256& hash, const CDKGContribution& qc
 
     logger.Batch("decrypted our contribution share. time=%d", t2.count());
 
-    bool verifyPending = false;
     receivedSkContributions[member->idx] = skContribution;
     pendingContributionVerifications.emplace_back(member->idx);
     if (pendingContributionVerifications.size() >= 32) {
-        verifyPending = true;
-    }
-
-    if (verifyPending) {
         VerifyPendingContributions();
     }
+
+    // apply results of verifications which finished in the meantime, but don't wait for the others
+    ProcessContributionVerificationResults(false);
 }
 
-// Verifies all pending secret key contributions in one batch
+// Starts verification of all pending secret key contributions in one batch
 // This is done by aggregating the verification vectors belonging to the secret key contributions
 // The resulting aggregated vvec is then used to recover a public key share
 // The public key share must match the public key belonging to the aggregated secret key contributions
 // See CBLSWorker::VerifyContributionShares for more details.
+// Verification happens asynchronously in the BLS worker, so that we can continue to receive contributions.
+// Results are applied by ProcessContributionVerificationResults.
 void CDKGSession::VerifyPendingContributions()
 {
     CDKGLogger logger(*this, __func__);
 
-    cxxtimer::Timer t1(true);
-
     std::vector<size_t> pend = std::move(pendingContributionVerifications);
     if (pend.empty()) {
         return;
     }
 
-    std::vector<size_t> memberIndexes;
-    std::vector<BLSVerificationVectorPtr> vvecs;
-    BLSSecretKeyVector skContributions;
+    auto batch = std::make_shared<ContributionVerificationBatch>();
+    batch->nStartTime = GetTimeMillis();
 
     for (const auto& idx : pend) {
         auto& m = members[idx];
         if (m->bad || m->weComplain) {
             continue;
         }
-        memberIndexes.emplace_back(idx);
-        vvecs.emplace_back(receivedVvecs[idx]);
-        skContributions.emplace_back(receivedSkContributions[idx]);
+        batch->memberIndexes.emplace_back(idx);
+        batch->vvecs.emplace_back(receivedVvecs[idx]);
+        batch->skContributions.emplace_back(receivedSkContributions[idx]);
     }
-
-    auto result = blsWorker.VerifyContributionShares(myId, vvecs, skContributions);
-    if (result.size() != memberIndexes.size()) {
-        logger.Batch("VerifyContributionShares returned result of size %d but size %d was expected, something is wrong", result.size(), memberIndexes.size());
+    if (batch->memberIndexes.empty()) {
         return;
     }
 
-    for (size_t i = 0; i < memberIndexes.size(); i++) {
-        if (!result[i]) {
-            auto& m = members[memberIndexes[i]];
-            logger.Batch("invalid contribution from %s. will complain later", m->dmn->proTxHash.ToString());
-            m->weComplain = true;
-            quorumDKGDebugManager->UpdateLocalMemberStatus(params.type, m->idx, [&](CDKGDebugMemberStatus& status) {
-                status.weComplain = true;
-                return true;
-            });
-        } else {
-            size_t memberIdx = memberIndexes[i];
-            dkgManager.WriteVerifiedSkContribution(params.type, pindexQuorum, members[memberIdx]->dmn->proTxHash, skContributions[i]);
+    // the callback keeps the batch alive until the worker is done with it
+    auto promise = std::make_shared<std::promise<std::vector<bool>>>();
+    batch->result = promise->get_future();
+    inProgressContributionVerifications.emplace_back(batch);
+    blsWorker.AsyncVerifyContributionShares(myId, batch->vvecs, batch->skContributions, true, true,
+        [batch, promise](const std::vector<bool>& result) {
+            promise->set_value(result);
+        });
+
+    logger.Batch("started verification of %d pending contributions, %d batches in progress", batch->memberIndexes.size(), inProgressContributionVerifications.size());
+}
+
+// Applies the results of finished contribution verifications. If fWait is true, waits for all verifications
+// in progress to finish.
+bool CDKGSession::ProcessContributionVerificationResults(bool fWait)
+{
+    CDKGLogger logger(*this, __func__);
+
+    bool didWork = false;
+    for (auto it = inProgressContributionVerifications.begin(); it != inProgressContributionVerifications.end(); ) {
+        auto& batch = **it;
+        if (!fWait && batch.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        auto result = batch.result.get();
+        if (result.size() != batch.memberIndexes.size()) {
+            logger.Batch("VerifyContributionShares returned result of size %d but size %d was expected, something is wrong", result.size(), batch.memberIndexes.size());
+            it = inProgressContributionVerifications.erase(it);
+            continue;
         }
-    }
 
-    logger.Batch("verified %d pending contributions. time=%d", pend.size(), t1.count());
+        for (size_t i = 0; i < batch.memberIndexes.size(); i++) {
+            auto& m = members[batch.memberIndexes[i]];
+            // the member might have been marked bad or complained about while the batch was in flight
+            if (m->bad || m->weComplain) {
+                continue;
+            }
+            if (!result[i]) {
+                logger.Batch("invalid contribution from %s. will complain later", m->dmn->proTxHash.ToString());
+                m->weComplain = true;
+                quorumDKGDebugManager->UpdateLocalMemberStatus(params.type, m->idx, [&](CDKGDebugMemberStatus& status) {
+                    status.weComplain = true;
+                    return true;
+                });
+            } else {
+                dkgManager.WriteVerifiedSkContribution(params.type, pindexQuorum, m->dmn->proTxHash, batch.skContributions[i]);
+            }
+        }
+
+        logger.Batch("verified %d pending contributions. time=%d", batch.memberIndexes.size(), GetTimeMillis() - batch.nStartTime);
+        it = inProgressContributionVerifications.erase(it);
+        didWork = true;
+    }
+    return didWork;
 }
 
 void CDKGSession::VerifyAndComplain(CDKGPendingMessages& pendingMessages)
@@ -409,7 +443,9 @@ void CDKGSession::VerifyAndComplain(CDKGPendingMessages& pendingMessages)
         return;
     }
 
+    // start verification of the remaining contributions and wait for all verifications in progress
     VerifyPendingContributions();
+    ProcessContributionVerificationResults(true);
 
     CDKGLogger logger(*this, __func__);
 
@@ -16,6 +16,9 @@
 
 #include "llmq/quorums_utils.h"
 
+#include <future>
+#include <list>
+
 class UniValue;
 
 namespace llmq
@@ -277,6 +280,17 @@ private:
 
     std::vector<size_t> pendingContributionVerifications;
 
+    // A batch of SK contributions which is currently being verified by the BLS worker. The batch owns all inputs
+    // of the verification, as the worker only keeps references to them.
+    struct ContributionVerificationBatch {
+        std::vector<size_t> memberIndexes;
+        std::vector<BLSVerificationVectorPtr> vvecs;
+        BLSSecretKeyVector skContributions;
+        std::future<std::vector<bool>> result;
+        int64_t nStartTime;
+    };
+    std::list<std::shared_ptr<ContributionVerificationBatch>> inProgressContributionVerifications;
+
     // filled by ReceivePrematureCommitment and used by FinalizeCommitments
     std::set<uint256> validCommitments;
 
@@ -307,6 +321,7 @@ public:
     bool PreVerifyMessage(const uint256& hash, const CDKGContribution& qc, bool& retBan) const;
     void ReceiveMessage(const uint256& hash, const CDKGContribution& qc, bool& retBan);
     void VerifyPendingContributions();
+    bool ProcessContributionVerificationResults(bool fWait);
 
     // Phase 2: complaint
     void VerifyAndComplain(CDKGPendingMessages& pendingMessages);
@@ -535,7 +535,13 @@ void CDKGSessionHandler::HandleDKGRound()
         curSession->Contribute(pendingContributions);
     };
     auto fContributeWait = [this] {
-        return ProcessPendingMessageBatch<CDKGContribution>(*curSession, pendingContributions, 8);
+        bool didWork = ProcessPendingMessageBatch<CDKGContribution>(*curSession, pendingContributions, 8);
+        if (!didWork) {
+            // no more contributions queued, so start verifying what we got so far instead of waiting for a full batch
+            curSession->VerifyPendingContributions();
+        }
+        didWork |= curSession->ProcessContributionVerificationResults(false);
+        return didWork;
     };
     HandlePhase(QuorumPhase_Contribute, QuorumPhase_Complain, curQuorumHash, 0.05, fContributeStart, fContributeWait);
 
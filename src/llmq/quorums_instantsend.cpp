@@ -11,6 +11,7 @@
 #include "coins.h"
 #include "txmempool.h"
 #include "masternode/masternode-sync.h"
+#include "memusage.h"
 #include "net_processing.h"
 #include "spork.h"
 #include "validation.h"
@@ -40,6 +41,57 @@ uint256 CInstantSendLock::GetRequestId() const
 
 ////////////////
 
+void CInstantSendDb::AddToHotIndex(const uint256& hash, const CInstantSendLockPtr& islock)
+{
+    if (hotIslocks.count(hash)) {
+        return;
+    }
+
+    size_t nUsage = memusage::MallocUsage(sizeof(CInstantSendLock)) + memusage::DynamicUsage(islock->inputs) +
+                    memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const uint256, HotEntry>>)) +
+                    memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const uint256, uint256>>)) +
+                    memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const COutPoint, uint256>>)) * islock->inputs.size() +
+                    memusage::MallocUsage(sizeof(uint256) + 2 * sizeof(void*));
+
+    hotOrder.emplace_back(hash);
+    hotIslocks.emplace(hash, HotEntry{islock, std::prev(hotOrder.end()), nUsage});
+    hotTxids[islock->txid] = hash;
+    for (auto& in : islock->inputs) {
+        hotOutpoints[in] = hash;
+    }
+    nHotUsage += nUsage;
+
+    // evict oldest entries until we're within budget again. Evicted entries are still in the DB
+    while (nHotUsage > nHotMaxUsage && !hotOrder.empty()) {
+        RemoveFromHotIndex(hotOrder.front());
+        nHotEvicted++;
+    }
+}
+
+void CInstantSendDb::RemoveFromHotIndex(const uint256& hash)
+{
+    auto it = hotIslocks.find(hash);
+    if (it == hotIslocks.end()) {
+        return;
+    }
+    auto& islock = it->second.islock;
+
+    auto jt = hotTxids.find(islock->txid);
+    if (jt != hotTxids.end() && jt->second == hash) {
+        hotTxids.erase(jt);
+    }
+    for (auto& in : islock->inputs) {
+        auto kt = hotOutpoints.find(in);
+        if (kt != hotOutpoints.end() && kt->second == hash) {
+            hotOutpoints.erase(kt);
+        }
+    }
+
+    nHotUsage -= it->second.nUsage;
+    hotOrder.erase(it->second.orderIt);
+    hotIslocks.erase(it);
+}
+
 void CInstantSendDb::WriteNewInstantSendLock(const uint256& hash, const CInstantSendLock& islock)
 {
     CDBBatch batch(db);
@@ -56,6 +108,7 @@ void CInstantSendDb::WriteNewInstantSendLock(const uint256& hash, const CInstant
     for (auto& in : islock.inputs) {
         outpointCache.insert(in, hash);
     }
+    AddToHotIndex(hash, p);
 }
 
 void CInstantSendDb::RemoveInstantSendLock(CDBBatch& batch, const uint256& hash, CInstantSendLockPtr islock)
@@ -78,6 +131,7 @@ void CInstantSendDb::RemoveInstantSendLock(CDBBatch& batch, const uint256& hash,
     for (auto& in : islock->inputs) {
         outpointCache.erase(in);
     }
+    RemoveFromHotIndex(hash);
 }
 
 static std::tuple<std::string, uint32_t, uint256> BuildInversedISLockKey(const std::string& k, int nHeight, const uint256& islockHash)
@@ -101,7 +155,7 @@ void CInstantSendDb::WriteInstantSendLockArchived(CDBBatch& batch, const uint256
     batch.Write(std::make_tuple(std::string("is_a2"), hash), true);
 }
 
-std::unordered_map<uint256, CInstantSendLockPtr> CInstantSendDb::RemoveConfirmedInstantSendLocks(int nUntilHeight)
+std::unordered_map<uint256, CInstantSendLockPtr> CInstantSendDb::RemoveConfirmedInstantSendLocks(int nUntilHeight, size_t nMaxCount, bool& fMore)
 {
     auto it = std::unique_ptr<CDBIterator>(db.NewIterator());
 
@@ -111,6 +165,8 @@ std::unordered_map<uint256, CInstantSendLockPtr> CInstantSendDb::RemoveConfirmed
 
     CDBBatch batch(db);
     std::unordered_map<uint256, CInstantSendLockPtr> ret;
+    size_t nCount = 0;
+    fMore = false;
     while (it->Valid()) {
         decltype(firstKey) curKey;
         if (!it->GetKey(curKey) || std::get<0>(curKey) != "is_m") {
@@ -120,6 +176,11 @@ std::unordered_map<uint256, CInstantSendLockPtr> CInstantSendDb::RemoveConfirmed
         if (nHeight > nUntilHeight) {
             break;
         }
+        if (nCount >= nMaxCount) {
+            fMore = true;
+            break;
+        }
+        nCount++;
 
         auto& islockHash = std::get<2>(curKey);
         auto islock = GetInstantSendLockByHash(islockHash);
@@ -141,7 +202,7 @@ std::unordered_map<uint256, CInstantSendLockPtr> CInstantSendDb::RemoveConfirmed
     return ret;
 }
 
-void CInstantSendDb::RemoveArchivedInstantSendLocks(int nUntilHeight)
+bool CInstantSendDb::RemoveArchivedInstantSendLocks(int nUntilHeight, size_t nMaxCount)
 {
     auto it = std::unique_ptr<CDBIterator>(db.NewIterator());
 
@@ -150,6 +211,8 @@ void CInstantSendDb::RemoveArchivedInstantSendLocks(int nUntilHeight)
     it->Seek(firstKey);
 
     CDBBatch batch(db);
+    size_t nCount = 0;
+    bool fMore = false;
     while (it->Valid()) {
         decltype(firstKey) curKey;
         if (!it->GetKey(curKey) || std::get<0>(curKey) != "is_a1") {
@@ -159,6 +222,11 @@ void CInstantSendDb::RemoveArchivedInstantSendLocks(int nUntilHeight)
         if (nHeight > nUntilHeight) {
             break;
         }
+        if (nCount >= nMaxCount) {
+            fMore = true;
+            break;
+        }
+        nCount++;
 
         auto& islockHash = std::get<2>(curKey);
         batch.Erase(std::make_tuple(std::string("is_a2"), islockHash));
@@ -168,6 +236,8 @@ void CInstantSendDb::RemoveArchivedInstantSendLocks(int nUntilHeight)
     }
 
     db.WriteBatch(batch);
+
+    return fMore;
 }
 
 bool CInstantSendDb::HasArchivedInstantSendLock(const uint256& islockHash)
@@ -199,6 +269,11 @@ size_t CInstantSendDb::GetInstantSendLockCount()
 
 CInstantSendLockPtr CInstantSendDb::GetInstantSendLockByHash(const uint256& hash)
 {
+    auto hotIt = hotIslocks.find(hash);
+    if (hotIt != hotIslocks.end()) {
+        return hotIt->second.islock;
+    }
+
     CInstantSendLockPtr ret;
     if (islockCache.get(hash, ret)) {
         return ret;
@@ -215,6 +290,11 @@ CInstantSendLockPtr CInstantSendDb::GetInstantSendLockByHash(const uint256& hash
 
 uint256 CInstantSendDb::GetInstantSendLockHashByTxid(const uint256& txid)
 {
+    auto hotIt = hotTxids.find(txid);
+    if (hotIt != hotTxids.end()) {
+        return hotIt->second;
+    }
+
     uint256 islockHash;
 
     bool found = txidCache.get(txid, islockHash);
@@ -244,6 +324,11 @@ CInstantSendLockPtr CInstantSendDb::GetInstantSendLockByTxid(const uint256& txid
 
 CInstantSendLockPtr CInstantSendDb::GetInstantSendLockByInput(const COutPoint& outpoint)
 {
+    auto hotIt = hotOutpoints.find(outpoint);
+    if (hotIt != hotOutpoints.end()) {
+        return GetInstantSendLockByHash(hotIt->second);
+    }
+
     uint256 islockHash;
     bool found = outpointCache.get(outpoint, islockHash);
     if (found && islockHash.IsNull()) {
@@ -331,7 +416,7 @@ std::vector<uint256> CInstantSendDb::RemoveChainedInstantSendLocks(const uint256
 ////////////////
 
 CInstantSendManager::CInstantSendManager(CDBWrapper& _llmqDb) :
-    db(_llmqDb)
+    db(_llmqDb, gArgs.GetArg("-instantsendindexsize", DEFAULT_INSTANTSEND_INDEX_SIZE) * 1024 * 1024)
 {
     workInterrupt.reset();
 }
@@ -1147,13 +1232,48 @@ void CInstantSendManager::HandleFullyConfirmedBlock(const CBlockIndex* pindex)
 {
     LOCK(cs);
 
-    auto& consensusParams = Params().GetConsensus();
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Removal of the now fully confirmed islocks from the DB is done in batches by the worker thread, see
+    // ProcessPendingConfirmedInstantSendLocks
+    nPendingConfirmedHeight = std::max(nPendingConfirmedHeight, pindex->nHeight);
+    fPendingArchivedCleanup = true;
+
+    // Find all previously unlocked TXs that got locked by this fully confirmed (ChainLock) block and remove them
+    // from the nonLockedTxs map. Also collect all children of these TXs and mark them for retrying of IS locking.
+    std::vector<uint256> toRemove;
+    for (auto& p : nonLockedTxs) {
+        auto pindexMined = p.second.pindexMined;
+
+        if (pindexMined && pindex->GetAncestor(pindexMined->nHeight) == pindexMined) {
+            toRemove.emplace_back(p.first);
+        }
+    }
+    for (auto& txid : toRemove) {
+        // This will also add children to pendingRetryTxs
+        RemoveNonLockedTx(txid, true);
+    }
+
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    cleanupStats.nLastBlockTime = nTime;
+    cleanupStats.nMaxBlockTime = std::max(cleanupStats.nMaxBlockTime, nTime);
+    cleanupStats.nTotalBlockTime += nTime;
+    cleanupStats.nBlockCount++;
+}
 
-    auto removeISLocks = db.RemoveConfirmedInstantSendLocks(pindex->nHeight);
+bool CInstantSendManager::ProcessPendingConfirmedInstantSendLocks()
+{
+    LOCK(cs);
 
-    if (pindex->nHeight > 100) {
-        db.RemoveArchivedInstantSendLocks(pindex->nHeight - 100);
+    if (nPendingConfirmedHeight < 0) {
+        return false;
     }
+
+    auto& consensusParams = Params().GetConsensus();
+    int64_t nTimeStart = GetTimeMicros();
+
+    bool fMore = false;
+    auto removeISLocks = db.RemoveConfirmedInstantSendLocks(nPendingConfirmedHeight, INSTANTSEND_CLEANUP_BATCH_SIZE, fMore);
     for (auto& p : removeISLocks) {
         auto& islockHash = p.first;
         auto& islock = p.second;
@@ -1168,21 +1288,26 @@ void CInstantSendManager::HandleFullyConfirmedBlock(const CBlockIndex* pindex)
         // fully confirmed now
         quorumSigningManager->TruncateRecoveredSig(consensusParams.llmqTypeInstantSend, islock->GetRequestId());
     }
+    cleanupStats.nRemovedConfirmed += removeISLocks.size();
 
-    // Find all previously unlocked TXs that got locked by this fully confirmed (ChainLock) block and remove them
-    // from the nonLockedTxs map. Also collect all children of these TXs and mark them for retrying of IS locking.
-    std::vector<uint256> toRemove;
-    for (auto& p : nonLockedTxs) {
-        auto pindexMined = p.second.pindexMined;
-
-        if (pindexMined && pindex->GetAncestor(pindexMined->nHeight) == pindexMined) {
-            toRemove.emplace_back(p.first);
+    // only start with the archive after all confirmed islocks got moved into it
+    if (!fMore && fPendingArchivedCleanup) {
+        if (nPendingConfirmedHeight > 100) {
+            fMore = db.RemoveArchivedInstantSendLocks(nPendingConfirmedHeight - 100, INSTANTSEND_CLEANUP_BATCH_SIZE);
         }
+        fPendingArchivedCleanup = fMore;
     }
-    for (auto& txid : toRemove) {
-        // This will also add children to pendingRetryTxs
-        RemoveNonLockedTx(txid, true);
+
+    if (!fMore) {
+        nPendingConfirmedHeight = -1;
     }
+
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    cleanupStats.nLastBatchTime = nTime;
+    cleanupStats.nTotalBatchTime += nTime;
+    cleanupStats.nBatchCount++;
+
+    return fMore;
 }
 
 void CInstantSendManager::RemoveMempoolConflictsForLock(const uint256& hash, const CInstantSendLock& islock)
@@ -1489,6 +1614,33 @@ size_t CInstantSendManager::GetInstantSendLockCount()
     return db.GetInstantSendLockCount();
 }
 
+UniValue CInstantSendManager::GetInstantSendInfo()
+{
+    LOCK(cs);
+
+    UniValue index(UniValue::VOBJ);
+    index.push_back(Pair("count", (int64_t)db.GetHotIndexCount()));
+    index.push_back(Pair("usage", (int64_t)db.GetHotIndexUsage()));
+    index.push_back(Pair("maxusage", (int64_t)db.GetHotIndexMaxUsage()));
+    index.push_back(Pair("evicted", (int64_t)db.GetHotIndexEvicted()));
+
+    UniValue cleanup(UniValue::VOBJ);
+    cleanup.push_back(Pair("blocks", cleanupStats.nBlockCount));
+    cleanup.push_back(Pair("lastblocktime", cleanupStats.nLastBlockTime));
+    cleanup.push_back(Pair("maxblocktime", cleanupStats.nMaxBlockTime));
+    cleanup.push_back(Pair("avgblocktime", cleanupStats.nBlockCount ? cleanupStats.nTotalBlockTime / cleanupStats.nBlockCount : 0));
+    cleanup.push_back(Pair("batches", cleanupStats.nBatchCount));
+    cleanup.push_back(Pair("lastbatchtime", cleanupStats.nLastBatchTime));
+    cleanup.push_back(Pair("avgbatchtime", cleanupStats.nBatchCount ? cleanupStats.nTotalBatchTime / cleanupStats.nBatchCount : 0));
+    cleanup.push_back(Pair("removedconfirmed", cleanupStats.nRemovedConfirmed));
+    cleanup.push_back(Pair("pendingheight", nPendingConfirmedHeight));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("unconfirmedindex", index));
+    ret.push_back(Pair("cleanup", cleanup));
+    return ret;
+}
+
 void CInstantSendManager::WorkThreadMain()
 {
     while (!workInterrupt) {
@@ -1496,6 +1648,7 @@ void CInstantSendManager::WorkThreadMain()
 
         didWork |= ProcessPendingInstantSendLocks();
         didWork |= ProcessPendingRetryLockTxs();
+        didWork |= ProcessPendingConfirmedInstantSendLocks();
 
         if (!didWork) {
             if (!workInterrupt.sleep_for(std::chrono::milliseconds(100))) {
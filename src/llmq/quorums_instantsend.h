@@ -11,12 +11,18 @@
 #include "unordered_lru_cache.h"
 #include "primitives/transaction.h"
 
+#include <list>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace llmq
 {
 
+// Default memory budget (in MiB) for the in-memory index of unconfirmed islocks
+static const int64_t DEFAULT_INSTANTSEND_INDEX_SIZE = 32;
+// Maximum number of confirmed/archived islocks cleaned up per batch by the worker thread
+static const size_t INSTANTSEND_CLEANUP_BATCH_SIZE = 1000;
+
 class CInstantSendLock
 {
 public:
@@ -49,8 +55,30 @@ private:
     unordered_lru_cache<uint256, uint256, StaticSaltedHasher, 10000> txidCache;
     unordered_lru_cache<COutPoint, uint256, SaltedOutpointHasher, 10000> outpointCache;
 
+    /**
+     * In-memory index of unconfirmed islocks, keyed by islock hash, txid and inputs. Entries are added when a new
+     * islock is written and dropped when the islock is removed after it got fully confirmed. If the memory budget
+     * is exceeded, the oldest entries are evicted and lookups for them fall back to the LRU caches and the DB.
+     */
+    struct HotEntry {
+        CInstantSendLockPtr islock;
+        std::list<uint256>::iterator orderIt;
+        size_t nUsage;
+    };
+    std::unordered_map<uint256, HotEntry, StaticSaltedHasher> hotIslocks;
+    std::unordered_map<uint256, uint256, StaticSaltedHasher> hotTxids;
+    std::unordered_map<COutPoint, uint256, SaltedOutpointHasher> hotOutpoints;
+    // islock hashes in insertion order, oldest first
+    std::list<uint256> hotOrder;
+    size_t nHotUsage{0};
+    size_t nHotMaxUsage;
+    uint64_t nHotEvicted{0};
+
+    void AddToHotIndex(const uint256& hash, const CInstantSendLockPtr& islock);
+    void RemoveFromHotIndex(const uint256& hash);
+
 public:
-    CInstantSendDb(CDBWrapper& _db) : db(_db) {}
+    CInstantSendDb(CDBWrapper& _db, size_t _nHotMaxUsage) : db(_db), nHotMaxUsage(_nHotMaxUsage) {}
 
     void WriteNewInstantSendLock(const uint256& hash, const CInstantSendLock& islock);
     void RemoveInstantSendLock(CDBBatch& batch, const uint256& hash, CInstantSendLockPtr islock);
@@ -58,8 +86,12 @@ public:
     void WriteInstantSendLockMined(const uint256& hash, int nHeight);
     void RemoveInstantSendLockMined(const uint256& hash, int nHeight);
     void WriteInstantSendLockArchived(CDBBatch& batch, const uint256& hash, int nHeight);
-    std::unordered_map<uint256, CInstantSendLockPtr> RemoveConfirmedInstantSendLocks(int nUntilHeight);
-    void RemoveArchivedInstantSendLocks(int nUntilHeight);
+    /**
+     * Removes up to nMaxCount islocks which were mined at or below nUntilHeight. fMore is set to true if there are
+     * more entries left to remove for that height range.
+     */
+    std::unordered_map<uint256, CInstantSendLockPtr> RemoveConfirmedInstantSendLocks(int nUntilHeight, size_t nMaxCount, bool& fMore);
+    bool RemoveArchivedInstantSendLocks(int nUntilHeight, size_t nMaxCount);
     bool HasArchivedInstantSendLock(const uint256& islockHash);
     size_t GetInstantSendLockCount();
 
@@ -70,6 +102,26 @@ public:
 
     std::vector<uint256> GetInstantSendLocksByParent(const uint256& parent);
     std::vector<uint256> RemoveChainedInstantSendLocks(const uint256& islockHash, const uint256& txid, int nHeight);
+
+    size_t GetHotIndexCount() const { return hotIslocks.size(); }
+    size_t GetHotIndexUsage() const { return nHotUsage; }
+    size_t GetHotIndexMaxUsage() const { return nHotMaxUsage; }
+    uint64_t GetHotIndexEvicted() const { return nHotEvicted; }
+};
+
+struct CInstantSendCleanupStats
+{
+    // time spent in HandleFullyConfirmedBlock, per block
+    int64_t nLastBlockTime{0};
+    int64_t nMaxBlockTime{0};
+    int64_t nTotalBlockTime{0};
+    int64_t nBlockCount{0};
+
+    // background migration of confirmed islocks out of the unconfirmed set
+    int64_t nLastBatchTime{0};
+    int64_t nTotalBatchTime{0};
+    int64_t nBatchCount{0};
+    int64_t nRemovedConfirmed{0};
 };
 
 class CInstantSendManager : public CRecoveredSigsListener
@@ -111,6 +163,12 @@ private:
 
     std::unordered_set<uint256, StaticSaltedHasher> pendingRetryTxs;
 
+    // Height up to which islocks are fully confirmed but not yet removed by the worker thread, or -1 if there is
+    // nothing left to clean up
+    int nPendingConfirmedHeight{-1};
+    bool fPendingArchivedCleanup{false};
+    CInstantSendCleanupStats cleanupStats;
+
 public:
     CInstantSendManager(CDBWrapper& _llmqDb);
     ~CInstantSendManager();
@@ -155,6 +213,7 @@ public:
     void UpdatedBlockTip(const CBlockIndex* pindexNew);
 
     void HandleFullyConfirmedBlock(const CBlockIndex* pindex);
+    bool ProcessPendingConfirmedInstantSendLocks();
 
     void RemoveMempoolConflictsForLock(const uint256& hash, const CInstantSendLock& islock);
     void ResolveBlockConflicts(const uint256& islockHash, const CInstantSendLock& islock);
@@ -167,6 +226,7 @@ public:
     bool GetInstantSendLockHashByTxid(const uint256& txid, uint256& ret);
 
     size_t GetInstantSendLockCount();
+    UniValue GetInstantSendInfo();
 
     void WorkThreadMain();
 };
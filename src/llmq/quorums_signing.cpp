@@ -36,22 +36,136 @@ UniValue CRecoveredSig::ToJson() const
     return ret;
 }
 
-CRecoveredSigsDb::CRecoveredSigsDb(CDBWrapper& _db) :
-    db(_db)
+static uint256 BuildIdFilterKey(Consensus::LLMQType llmqType, const uint256& id)
+{
+    return ::SerializeHash(std::make_pair(llmqType, id));
+}
+
+CRecoveredSigsDb::CRecoveredSigsDb(CDBWrapper& _db, size_t nExistenceFilterSize) :
+    db(_db),
+    nExistenceFilterKeys(3 * nExistenceFilterSize),
+    existenceFilter(nExistenceFilterKeys, 0.001)
 {
     if (Params().NetworkIDString() == CBaseChainParams::TESTNET) {
         // TODO this can be completely removed after some time (when we're pretty sure the conversion has been run on most testnet MNs)
-        if (db.Exists(std::string("rs_upgraded"))) {
-            return;
+        if (!db.Exists(std::string("rs_upgraded"))) {
+            ConvertInvalidTimeKeys();
+            AddVoteTimeKeys();
+
+            db.Write(std::string("rs_upgraded"), (uint8_t)1);
+        }
+    }
+
+    // The existence filter is built by the first cleanup, until then all lookups go to the caches and the DB
+}
+
+// Builds a new existence filter from the ids, sign hashes and object hashes of all recovered sigs in the DB. The DB
+// is scanned without holding cs, the recovered sigs written in the meantime are added to the new filter when it
+// replaces the current one.
+void CRecoveredSigsDb::RebuildExistenceFilter()
+{
+    AssertLockNotHeld(cs);
+
+    int64_t nTimeStart = GetTimeMillis();
+
+    {
+        LOCK(cs);
+        fExistenceFilterRebuilding = true;
+        vExistenceFilterPending.clear();
+    }
+
+    CRollingBloomFilter filter(nExistenceFilterKeys, 0.001);
+    size_t nInserts = 0;
+    auto addToFilter = [&](const uint256& hash) {
+        filter.insert(hash);
+        nInserts++;
+    };
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    // each recSig has 2 "rs_r" keys, both starting with llmqType and id
+    auto k1 = std::make_tuple(std::string("rs_r"), (Consensus::LLMQType)0, uint256());
+    pcursor->Seek(k1);
+    std::pair<Consensus::LLMQType, uint256> lastId;
+    while (pcursor->Valid()) {
+        decltype(k1) k;
+        if (!pcursor->GetKey(k) || std::get<0>(k) != "rs_r") {
+            break;
+        }
+        if (std::get<1>(k) != lastId.first || std::get<2>(k) != lastId.second) {
+            lastId = std::make_pair(std::get<1>(k), std::get<2>(k));
+            addToFilter(BuildIdFilterKey(lastId.first, lastId.second));
+        }
+        pcursor->Next();
+    }
+
+    for (const auto& prefix : {std::string("rs_h"), std::string("rs_s")}) {
+        auto k2 = std::make_tuple(prefix, uint256());
+        pcursor->Seek(k2);
+        while (pcursor->Valid()) {
+            decltype(k2) k;
+            if (!pcursor->GetKey(k) || std::get<0>(k) != prefix) {
+                break;
+            }
+            addToFilter(std::get<1>(k));
+            pcursor->Next();
         }
+    }
+    pcursor.reset();
+
+    LOCK(cs);
+    for (const uint256& hash : vExistenceFilterPending) {
+        addToFilter(hash);
+    }
+    vExistenceFilterPending.clear();
+    fExistenceFilterRebuilding = false;
+
+    std::swap(existenceFilter, filter);
+    nExistenceFilterInserts = nInserts;
+    nExistenceFilterDbKeys = nInserts;
+    fExistenceFilterComplete = nInserts < nExistenceFilterKeys;
+    nExistenceFilterRebuilds++;
 
-        ConvertInvalidTimeKeys();
-        AddVoteTimeKeys();
+    LogPrint(BCLog::LLMQ, "CRecoveredSigsDb::%s -- added %d entries, complete=%d, time=%d\n", __func__,
+             nExistenceFilterInserts, fExistenceFilterComplete, GetTimeMillis() - nTimeStart);
+}
+
+void CRecoveredSigsDb::AddToExistenceFilter(const uint256& hash)
+{
+    AssertLockHeld(cs);
 
-        db.Write(std::string("rs_upgraded"), (uint8_t)1);
+    existenceFilter.insert(hash);
+    nExistenceFilterDbKeys++;
+    if (++nExistenceFilterInserts >= nExistenceFilterKeys) {
+        // older entries might get lost from now on
+        fExistenceFilterComplete = false;
     }
 }
 
+void CRecoveredSigsDb::RemovedFromDb(size_t nKeys)
+{
+    AssertLockHeld(cs);
+    nExistenceFilterDbKeys -= std::min(nExistenceFilterDbKeys, nKeys);
+}
+
+bool CRecoveredSigsDb::IsExistenceFilterComplete()
+{
+    LOCK(cs);
+    return fExistenceFilterComplete;
+}
+
+uint64_t CRecoveredSigsDb::GetExistenceFilterRebuilds()
+{
+    LOCK(cs);
+    return nExistenceFilterRebuilds;
+}
+
+bool CRecoveredSigsDb::MightExist(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    return !fExistenceFilterComplete || existenceFilter.contains(hash);
+}
+
 // This converts time values in "rs_t" from host endiannes to big endiannes, which is required to have proper ordering of the keys
 void CRecoveredSigsDb::ConvertInvalidTimeKeys()
 {
@@ -127,6 +241,13 @@ void CRecoveredSigsDb::AddVoteTimeKeys()
 
 bool CRecoveredSigsDb::HasRecoveredSig(Consensus::LLMQType llmqType, const uint256& id, const uint256& msgHash)
 {
+    {
+        LOCK(cs);
+        if (!MightExist(BuildIdFilterKey(llmqType, id))) {
+            return false;
+        }
+    }
+
     auto k = std::make_tuple(std::string("rs_r"), llmqType, id, msgHash);
     return db.Exists(k);
 }
@@ -137,6 +258,9 @@ bool CRecoveredSigsDb::HasRecoveredSigForId(Consensus::LLMQType llmqType, const
     bool ret;
     {
         LOCK(cs);
+        if (!MightExist(BuildIdFilterKey(llmqType, id))) {
+            return false;
+        }
         if (hasSigForIdCache.get(cacheKey, ret)) {
             return ret;
         }
@@ -156,6 +280,9 @@ bool CRecoveredSigsDb::HasRecoveredSigForSession(const uint256& signHash)
     bool ret;
     {
         LOCK(cs);
+        if (!MightExist(signHash)) {
+            return false;
+        }
         if (hasSigForSessionCache.get(signHash, ret)) {
             return ret;
         }
@@ -174,6 +301,9 @@ bool CRecoveredSigsDb::HasRecoveredSigForHash(const uint256& hash)
     bool ret;
     {
         LOCK(cs);
+        if (!MightExist(hash)) {
+            return false;
+        }
         if (hasSigForHashCache.get(hash, ret)) {
             return ret;
         }
@@ -243,16 +373,35 @@ void CRecoveredSigsDb::WriteRecoveredSig(const llmq::CRecoveredSig& recSig)
     auto k4 = std::make_tuple(std::string("rs_s"), signHash);
     batch.Write(k4, (uint8_t)1);
 
-    // store by current time. Allows fast cleanup of old recSigs
+    // store by current time. Allows fast cleanup of old recSigs. The value holds everything needed to remove the
+    // other keys, so that cleanup doesn't need to read the recSig
     auto k5 = std::make_tuple(std::string("rs_t"), (uint32_t)htobe32(curTime), recSig.llmqType, recSig.id);
-    batch.Write(k5, (uint8_t)1);
+    batch.Write(k5, std::make_tuple(recSig.msgHash, recSig.GetHash(), signHash));
+
+    // The filter must know the keys before they are in the DB, otherwise a lookup in between would skip the DB
+    const uint256 filterKeys[] = {BuildIdFilterKey(recSig.llmqType, recSig.id), signHash, recSig.GetHash()};
+    uint64_t nRebuilds;
+    {
+        LOCK(cs);
+        for (const uint256& hash : filterKeys) {
+            AddToExistenceFilter(hash);
+        }
+        nRebuilds = nExistenceFilterRebuilds;
+    }
 
     db.WriteBatch(batch);
 
     {
-        int64_t t = GetTimeMillis();
-
         LOCK(cs);
+        // A rebuild which replaced the filter in the meantime or is still scanning the DB might have missed the keys
+        for (const uint256& hash : filterKeys) {
+            if (nExistenceFilterRebuilds != nRebuilds) {
+                AddToExistenceFilter(hash);
+            } else if (fExistenceFilterRebuilding) {
+                vExistenceFilterPending.push_back(hash);
+            }
+        }
+
         hasSigForIdCache.insert(std::make_pair((Consensus::LLMQType)recSig.llmqType, recSig.id), true);
         hasSigForSessionCache.insert(signHash, true);
         hasSigForHashCache.insert(recSig.GetHash(), true);
@@ -296,6 +445,9 @@ void CRecoveredSigsDb::RemoveRecoveredSig(CDBBatch& batch, Consensus::LLMQType l
     hasSigForSessionCache.erase(signHash);
     if (deleteHashKey) {
         hasSigForHashCache.erase(recSig.GetHash());
+        // A truncated recovered sig keeps its hash and time keys, its keys are accounted for when the cleanup
+        // removes them
+        RemovedFromDb(3);
     }
 }
 
@@ -318,16 +470,55 @@ void CRecoveredSigsDb::TruncateRecoveredSig(Consensus::LLMQType llmqType, const
     db.WriteBatch(batch);
 }
 
+// Removes all recovered sigs which are older than maxAge. This only happens for whole time buckets (see
+// RECSIG_CLEANUP_BUCKET_SIZE) and each bucket is removed with a single batch. cs is only held while the caches are
+// updated for a bucket, so that the signing thread is not stalled by the cleanup.
 void CRecoveredSigsDb::CleanupOldRecoveredSigs(int64_t maxAge)
 {
+    uint32_t endTime = (uint32_t)(GetAdjustedTime() - maxAge);
+    endTime -= endTime % RECSIG_CLEANUP_BUCKET_SIZE;
+    if (endTime <= nRecSigsCleanupTime) {
+        return;
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    int64_t nMaxLockTime = 0;
+
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
 
     auto start = std::make_tuple(std::string("rs_t"), (uint32_t)0, (Consensus::LLMQType)0, uint256());
-    uint32_t endTime = (uint32_t)(GetAdjustedTime() - maxAge);
     pcursor->Seek(start);
 
-    std::vector<std::pair<Consensus::LLMQType, uint256>> toDelete;
-    std::vector<decltype(start)> toDelete2;
+    CDBBatch batch(db);
+    std::vector<std::pair<Consensus::LLMQType, uint256>> legacyEntries;
+    std::vector<std::tuple<std::pair<Consensus::LLMQType, uint256>, uint256, uint256>> cacheEntries;
+    uint32_t curBucket = 0;
+    size_t cnt = 0;
+    size_t bucketCnt = 0;
+
+    auto flushBucket = [&]() {
+        int64_t nLockStart = GetTimeMicros();
+        {
+            LOCK(cs);
+            // entries written by older versions don't carry the other keys, so we must read the recSig
+            for (auto& e : legacyEntries) {
+                RemoveRecoveredSig(batch, e.first, e.second, true, false);
+            }
+            for (auto& e : cacheEntries) {
+                hasSigForIdCache.erase(std::get<0>(e));
+                hasSigForHashCache.erase(std::get<1>(e));
+                hasSigForSessionCache.erase(std::get<2>(e));
+            }
+            RemovedFromDb(3 * cacheEntries.size());
+        }
+        nMaxLockTime = std::max(nMaxLockTime, GetTimeMicros() - nLockStart);
+
+        db.WriteBatch(batch);
+        batch.Clear();
+        legacyEntries.clear();
+        cacheEntries.clear();
+        bucketCnt++;
+    };
 
     while (pcursor->Valid()) {
         decltype(start) k;
@@ -335,41 +526,62 @@ void CRecoveredSigsDb::CleanupOldRecoveredSigs(int64_t maxAge)
         if (!pcursor->GetKey(k) || std::get<0>(k) != "rs_t") {
             break;
         }
-        if (be32toh(std::get<1>(k)) >= endTime) {
+        uint32_t t = be32toh(std::get<1>(k));
+        if (t >= endTime) {
             break;
         }
 
-        toDelete.emplace_back(std::get<2>(k), std::get<3>(k));
-        toDelete2.emplace_back(k);
+        uint32_t bucket = t / RECSIG_CLEANUP_BUCKET_SIZE;
+        if (cnt != 0 && bucket != curBucket) {
+            flushBucket();
+        }
+        curBucket = bucket;
+
+        Consensus::LLMQType llmqType = std::get<2>(k);
+        const uint256& id = std::get<3>(k);
+
+        std::tuple<uint256, uint256, uint256> v;
+        if (pcursor->GetValueSize() > sizeof(uint8_t) && pcursor->GetValue(v)) {
+            const uint256& msgHash = std::get<0>(v);
+            const uint256& hash = std::get<1>(v);
+            const uint256& signHash = std::get<2>(v);
+            batch.Erase(std::make_tuple(std::string("rs_r"), llmqType, id));
+            batch.Erase(std::make_tuple(std::string("rs_r"), llmqType, id, msgHash));
+            batch.Erase(std::make_tuple(std::string("rs_h"), hash));
+            batch.Erase(std::make_tuple(std::string("rs_s"), signHash));
+            cacheEntries.emplace_back(std::make_pair(llmqType, id), hash, signHash);
+        } else {
+            legacyEntries.emplace_back(llmqType, id);
+        }
+        batch.Erase(k);
+        cnt++;
 
         pcursor->Next();
     }
     pcursor.reset();
 
-    if (toDelete.empty()) {
-        return;
+    if (cnt != 0) {
+        flushBucket();
     }
+    nRecSigsCleanupTime = endTime;
 
-    CDBBatch batch(db);
+    // The filter is built by the first cleanup. Later it is only rebuilt after it rolled over, once the filter can
+    // hold all recovered sigs left in the DB
+    bool fRebuild;
     {
         LOCK(cs);
-        for (auto& e : toDelete) {
-            RemoveRecoveredSig(batch, e.first, e.second, true, false);
-
-            if (batch.SizeEstimate() >= (1 << 24)) {
-                db.WriteBatch(batch);
-                batch.Clear();
-            }
-        }
+        fRebuild = !fExistenceFilterComplete && (nExistenceFilterRebuilds == 0 || nExistenceFilterDbKeys < nExistenceFilterKeys);
     }
-
-    for (auto& e : toDelete2) {
-        batch.Erase(e);
+    if (fRebuild) {
+        RebuildExistenceFilter();
     }
 
-    db.WriteBatch(batch);
+    if (cnt == 0) {
+        return;
+    }
 
-    LogPrint(BCLog::LLMQ, "CRecoveredSigsDb::%d -- deleted %d entries\n", __func__, toDelete.size());
+    LogPrint(BCLog::LLMQ, "CRecoveredSigsDb::%s -- deleted %d entries in %d buckets, time=%dus, maxLockTime=%dus\n", __func__,
+             cnt, bucketCnt, GetTimeMicros() - nTimeStart, nMaxLockTime);
 }
 
 bool CRecoveredSigsDb::HasVotedOnId(Consensus::LLMQType llmqType, const uint256& id)
@@ -396,26 +608,46 @@ void CRecoveredSigsDb::WriteVoteForId(Consensus::LLMQType llmqType, const uint25
     db.WriteBatch(batch);
 }
 
+// Same as CleanupOldRecoveredSigs, but for votes. The "rs_vt" keys already contain everything needed to remove the
+// vote, so no lock is required.
 void CRecoveredSigsDb::CleanupOldVotes(int64_t maxAge)
 {
+    uint32_t endTime = (uint32_t)(GetAdjustedTime() - maxAge);
+    endTime -= endTime % RECSIG_CLEANUP_BUCKET_SIZE;
+    if (endTime <= nVotesCleanupTime) {
+        return;
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
 
     auto start = std::make_tuple(std::string("rs_vt"), (uint32_t)0, (Consensus::LLMQType)0, uint256());
-    uint32_t endTime = (uint32_t)(GetAdjustedTime() - maxAge);
     pcursor->Seek(start);
 
     CDBBatch batch(db);
+    uint32_t curBucket = 0;
     size_t cnt = 0;
+    size_t bucketCnt = 0;
     while (pcursor->Valid()) {
         decltype(start) k;
 
         if (!pcursor->GetKey(k) || std::get<0>(k) != "rs_vt") {
             break;
         }
-        if (be32toh(std::get<1>(k)) >= endTime) {
+        uint32_t t = be32toh(std::get<1>(k));
+        if (t >= endTime) {
             break;
         }
 
+        uint32_t bucket = t / RECSIG_CLEANUP_BUCKET_SIZE;
+        if (cnt != 0 && bucket != curBucket) {
+            db.WriteBatch(batch);
+            batch.Clear();
+            bucketCnt++;
+        }
+        curBucket = bucket;
+
         Consensus::LLMQType llmqType = std::get<2>(k);
         const uint256& id = std::get<3>(k);
 
@@ -428,13 +660,17 @@ void CRecoveredSigsDb::CleanupOldVotes(int64_t maxAge)
     }
     pcursor.reset();
 
+    nVotesCleanupTime = endTime;
+
     if (cnt == 0) {
         return;
     }
 
     db.WriteBatch(batch);
+    bucketCnt++;
 
-    LogPrint(BCLog::LLMQ, "CRecoveredSigsDb::%d -- deleted %d entries\n", __func__, cnt);
+    LogPrint(BCLog::LLMQ, "CRecoveredSigsDb::%s -- deleted %d entries in %d buckets, time=%dus\n", __func__,
+             cnt, bucketCnt, GetTimeMicros() - nTimeStart);
 }
 
 //////////////////
@@ -7,6 +7,7 @@
 
 #include "llmq/quorums.h"
 
+#include "bloom.h"
 #include "net.h"
 #include "chainparams.h"
 #include "saltedhasher.h"
@@ -18,6 +19,12 @@
 namespace llmq
 {
 
+// Old recovered sigs and votes are removed in whole time buckets of this many seconds
+static const int64_t RECSIG_CLEANUP_BUCKET_SIZE = 10 * 60;
+// Number of recovered sigs the existence filter of CRecoveredSigsDb is guaranteed to remember. Each recovered sig
+// adds 3 keys to the filter (id, sign hash and object hash)
+static const unsigned int RECSIG_EXISTENCE_FILTER_SIZE = 500000;
+
 class CRecoveredSig
 {
 public:
@@ -71,8 +78,31 @@ private:
     unordered_lru_cache<uint256, bool, StaticSaltedHasher, 30000> hasSigForSessionCache;
     unordered_lru_cache<uint256, bool, StaticSaltedHasher, 30000> hasSigForHashCache;
 
+    /**
+     * Contains the ids, sign hashes and object hashes of all recovered sigs in the DB. If an entry is not in the
+     * filter, we know that it's not in the DB and can skip the caches and the DB lookup. This only holds while
+     * fExistenceFilterComplete is true, which is the case once the first cleanup built the filter and as long as it
+     * did not roll over. If it did, it is rebuilt from the DB on the next cleanup, but only once the DB holds fewer
+     * keys than the filter can remember.
+     */
+    const size_t nExistenceFilterKeys;
+    CRollingBloomFilter existenceFilter;
+    bool fExistenceFilterComplete{false};
+    size_t nExistenceFilterInserts{0};
+    // Number of filter keys of the recovered sigs in the DB. Exact after a rebuild, and estimated from the writes
+    // and removals afterwards
+    size_t nExistenceFilterDbKeys{0};
+    uint64_t nExistenceFilterRebuilds{0};
+    // Keys written while a rebuild scans the DB (without cs), added to the new filter when it replaces the current one
+    bool fExistenceFilterRebuilding{false};
+    std::vector<uint256> vExistenceFilterPending;
+
+    // end of the last time bucket which got cleaned up
+    uint32_t nRecSigsCleanupTime{0};
+    uint32_t nVotesCleanupTime{0};
+
 public:
-    CRecoveredSigsDb(CDBWrapper& _db);
+    CRecoveredSigsDb(CDBWrapper& _db, size_t nExistenceFilterSize = RECSIG_EXISTENCE_FILTER_SIZE);
 
     void ConvertInvalidTimeKeys();
     void AddVoteTimeKeys();
@@ -89,6 +119,9 @@ public:
 
     void CleanupOldRecoveredSigs(int64_t maxAge);
 
+    bool IsExistenceFilterComplete();
+    uint64_t GetExistenceFilterRebuilds();
+
     // votes are removed when the recovered sig is written to the db
     bool HasVotedOnId(Consensus::LLMQType llmqType, const uint256& id);
     bool GetVoteForId(Consensus::LLMQType llmqType, const uint256& id, uint256& msgHashRet);
@@ -99,6 +132,11 @@ public:
 private:
     bool ReadRecoveredSig(Consensus::LLMQType llmqType, const uint256& id, CRecoveredSig& ret);
     void RemoveRecoveredSig(CDBBatch& batch, Consensus::LLMQType llmqType, const uint256& id, bool deleteHashKey, bool deleteTimeKey);
+
+    void RebuildExistenceFilter();
+    void AddToExistenceFilter(const uint256& hash);
+    void RemovedFromDb(size_t nKeys);
+    bool MightExist(const uint256& hash);
 };
 
 class CRecoveredSigsListener
@@ -0,0 +1,357 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempool-journal.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <deque>
+#include <set>
+
+#include <boost/bind.hpp>
+
+std::unique_ptr<CMempoolJournal> mempoolJournal;
+
+static const uint64_t MEMPOOL_JOURNAL_VERSION = 2;
+
+CMempoolJournal::CMempoolJournal(CTxMemPool& poolIn) :
+    pool(poolIn), pathJournal(GetDataDir() / MEMPOOL_JOURNAL_FILENAME), fileJournal(nullptr), fActive(false), nRecords(0)
+{
+}
+
+CMempoolJournal::~CMempoolJournal()
+{
+    Stop();
+}
+
+void CMempoolJournal::EntryAdded(CTransactionRef tx, int64_t nTime)
+{
+    LOCK(cs);
+    vPending.push_back(Record{RECORD_ADD, tx, tx->GetHash(), nTime});
+}
+
+void CMempoolJournal::EntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    vPending.push_back(Record{RECORD_REMOVE, nullptr, tx->GetHash(), 0});
+}
+
+void CMempoolJournal::EntryPrioritised(const uint256& hash, const CAmount& nFeeDelta)
+{
+    LOCK(cs);
+    vPending.push_back(Record{RECORD_PRIORITISE, nullptr, hash, nFeeDelta});
+}
+
+void CMempoolJournal::PrioritisationCleared(const uint256& hash)
+{
+    LOCK(cs);
+    vPending.push_back(Record{RECORD_CLEAR_PRIORITISATION, nullptr, hash, 0});
+}
+
+void CMempoolJournal::ThreadMaintain()
+{
+    // Compacting writes and syncs the whole snapshot, which would stall other tasks on the shared scheduler thread
+    while (interruptMaintain.sleep_for(std::chrono::milliseconds(MEMPOOL_JOURNAL_FLUSH_INTERVAL))) {
+        Maintain();
+    }
+}
+
+bool CMempoolJournal::Start()
+{
+    LOCK(csFile);
+    if (fActive)
+        return true;
+
+    connAdded = pool.NotifyEntryAdded.connect(boost::bind(&CMempoolJournal::EntryAdded, this, _1, _2));
+    connRemoved = pool.NotifyEntryRemoved.connect(boost::bind(&CMempoolJournal::EntryRemoved, this, _1, _2));
+    connPrioritised = pool.NotifyEntryPrioritised.connect(boost::bind(&CMempoolJournal::EntryPrioritised, this, _1, _2));
+    connPrioritisationCleared = pool.NotifyPrioritisationCleared.connect(boost::bind(&CMempoolJournal::PrioritisationCleared, this, _1));
+    fActive = true;
+
+    // The snapshot and journal on disk may still contain transactions which weren't accepted again
+    bool fResult = CompactLocked();
+
+    interruptMaintain.reset();
+    threadMaintain = std::thread(&TraceThread<std::function<void()> >, "mempooljrnl", std::function<void()>(std::bind(&CMempoolJournal::ThreadMaintain, this)));
+    return fResult;
+}
+
+void CMempoolJournal::Stop()
+{
+    // The thread takes csFile
+    interruptMaintain();
+    if (threadMaintain.joinable())
+        threadMaintain.join();
+
+    LOCK(csFile);
+    if (!fActive)
+        return;
+
+    connAdded.disconnect();
+    connRemoved.disconnect();
+    connPrioritised.disconnect();
+    connPrioritisationCleared.disconnect();
+
+    FlushLocked();
+    if (fileJournal) {
+        FileCommit(fileJournal);
+        fclose(fileJournal);
+        fileJournal = nullptr;
+    }
+    fActive = false;
+}
+
+void CMempoolJournal::Maintain()
+{
+    LOCK(csFile);
+    if (!fActive)
+        return;
+
+    uint64_t nRecordsNow;
+    {
+        LOCK(cs);
+        nRecordsNow = nRecords + vPending.size();
+    }
+    if (nRecordsNow > std::max<uint64_t>(MEMPOOL_JOURNAL_MIN_COMPACT_RECORDS, 2 * pool.size())) {
+        CompactLocked();
+    } else {
+        FlushLocked();
+    }
+}
+
+bool CMempoolJournal::Compact()
+{
+    LOCK(csFile);
+    if (!fActive)
+        return false;
+    return CompactLocked();
+}
+
+bool CMempoolJournal::FlushLocked()
+{
+    AssertLockHeld(csFile);
+
+    std::vector<Record> vRecords;
+    {
+        LOCK(cs);
+        vRecords.swap(vPending);
+        nRecords += vRecords.size();
+    }
+    if (vRecords.empty() || !fileJournal)
+        return true;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    for (const Record& record : vRecords) {
+        ss << record.nType;
+        if (record.nType == RECORD_ADD) {
+            ss << *record.tx << record.nValue;
+        } else {
+            ss << record.hash;
+            if (record.nType == RECORD_PRIORITISE)
+                ss << record.nValue;
+        }
+    }
+    if (fwrite(ss.data(), 1, ss.size(), fileJournal) != ss.size() || fflush(fileJournal) != 0) {
+        LogPrintf("%s: Failed to write to %s\n", __func__, pathJournal.string());
+        return false;
+    }
+    return true;
+}
+
+bool CMempoolJournal::CompactLocked()
+{
+    AssertLockHeld(csFile);
+    int64_t nStart = GetTimeMicros();
+
+    // The signals are sent while holding pool.cs, so the pending records are exactly the changes included in the
+    // snapshot which weren't written to the journal yet
+    std::vector<TxMempoolInfo> vInfo;
+    std::map<uint256, CAmount> mapDeltas;
+    std::vector<Record> vDropped;
+    {
+        LOCK2(pool.cs, cs);
+        vInfo = pool.infoAll();
+        mapDeltas = pool.mapDeltas;
+        vDropped.swap(vPending);
+    }
+
+    uint64_t nSnapshotId = GetRand(std::numeric_limits<uint64_t>::max());
+    if (!DumpMempool(vInfo, mapDeltas, nSnapshotId)) {
+        // Keep the previous snapshot and journal, and the changes not written to it yet
+        LOCK(cs);
+        vPending.insert(vPending.begin(), vDropped.begin(), vDropped.end());
+        return false;
+    }
+
+    if (fileJournal) {
+        fclose(fileJournal);
+    }
+    fileJournal = fsbridge::fopen(pathJournal, "wb");
+    {
+        LOCK(cs);
+        nRecords = 0;
+    }
+    if (!fileJournal) {
+        LogPrintf("%s: Failed to open %s, changes to the mempool are persisted at the next compaction\n", __func__, pathJournal.string());
+        return false;
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << MEMPOOL_JOURNAL_VERSION << nSnapshotId;
+    if (fwrite(ss.data(), 1, ss.size(), fileJournal) != ss.size() || fflush(fileJournal) != 0) {
+        LogPrintf("%s: Failed to write to %s\n", __func__, pathJournal.string());
+        return false;
+    }
+
+    LogPrint(BCLog::MEMPOOL, "%s: Compacted mempool journal, %u transactions in %.2fms\n", __func__, vInfo.size(), 0.001 * (GetTimeMicros() - nStart));
+    return true;
+}
+
+// Moves transactions behind the transactions of vtx they spend, otherwise keeping their order
+static void SortParentsFirst(std::vector<CTransactionRef>& vtx, std::vector<int64_t>& vTime)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        mapIndex.emplace(vtx[i]->GetHash(), i);
+    }
+
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    std::vector<bool> vDone(vtx.size(), false);
+    // Number of parents not placed yet, and the children waiting for each transaction
+    std::vector<size_t> vMissing(vtx.size(), 0);
+    std::multimap<size_t, size_t> mapWaiting;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : vtx[i]->vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && !vDone[it->second] && setParents.insert(it->second).second) {
+                mapWaiting.emplace(it->second, i);
+            }
+        }
+        vMissing[i] = setParents.size();
+        if (vMissing[i] != 0)
+            continue;
+
+        // Place the transaction, and the children which only waited for it
+        std::deque<size_t> queue(1, i);
+        while (!queue.empty()) {
+            size_t n = queue.front();
+            queue.pop_front();
+            vDone[n] = true;
+            vOrder.push_back(n);
+            auto range = mapWaiting.equal_range(n);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (--vMissing[it->second] == 0)
+                    queue.push_back(it->second);
+            }
+            mapWaiting.erase(range.first, range.second);
+        }
+    }
+    if (vOrder.size() != vtx.size()) {
+        // Only possible with a dependency cycle, which no valid transactions have; keep the order then
+        return;
+    }
+
+    std::vector<CTransactionRef> vtxSorted;
+    std::vector<int64_t> vTimeSorted;
+    vtxSorted.reserve(vtx.size());
+    vTimeSorted.reserve(vtx.size());
+    for (size_t n : vOrder) {
+        vtxSorted.push_back(vtx[n]);
+        vTimeSorted.push_back(vTime[n]);
+    }
+    vtx.swap(vtxSorted);
+    vTime.swap(vTimeSorted);
+}
+
+bool CMempoolJournal::Replay(const fs::path& path, uint64_t nSnapshotId, std::vector<CTransactionRef>& vtx,
+                             std::vector<int64_t>& vTime, std::map<uint256, CAmount>& mapDeltas)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        mapIndex[vtx[i]->GetHash()] = i;
+    }
+
+    int64_t nRecordsRead = 0;
+    try {
+        uint64_t nVersion, nId;
+        file >> nVersion >> nId;
+        if (nVersion != MEMPOOL_JOURNAL_VERSION || nId != nSnapshotId) {
+            LogPrintf("%s: Ignoring mempool journal not matching the mempool snapshot\n", __func__);
+            return false;
+        }
+
+        while (true) {
+            uint8_t nType;
+            try {
+                file >> nType;
+            } catch (const std::ios_base::failure&) {
+                break; // end of the journal
+            }
+            if (nType == RECORD_ADD) {
+                CTransactionRef tx;
+                int64_t nTime;
+                file >> tx >> nTime;
+                auto it = mapIndex.find(tx->GetHash());
+                if (it != mapIndex.end() && vtx[it->second]) {
+                    continue;
+                }
+                mapIndex[tx->GetHash()] = vtx.size();
+                vtx.push_back(tx);
+                vTime.push_back(nTime);
+            } else if (nType == RECORD_REMOVE) {
+                uint256 hash;
+                file >> hash;
+                auto it = mapIndex.find(hash);
+                if (it != mapIndex.end()) {
+                    vtx[it->second] = nullptr;
+                    mapIndex.erase(it);
+                }
+            } else if (nType == RECORD_PRIORITISE) {
+                uint256 hash;
+                int64_t nFeeDelta;
+                file >> hash >> nFeeDelta;
+                mapDeltas[hash] += nFeeDelta;
+            } else if (nType == RECORD_CLEAR_PRIORITISATION) {
+                uint256 hash;
+                file >> hash;
+                mapDeltas.erase(hash);
+            } else {
+                throw std::runtime_error(strprintf("unknown record type %d", nType));
+            }
+            nRecordsRead++;
+        }
+    } catch (const std::exception& e) {
+        // A record may have been cut off when the node didn't shut down cleanly, keep everything before it
+        LogPrintf("%s: Failed to read mempool journal after %d records: %s\n", __func__, nRecordsRead, e.what());
+    }
+
+    // Drop the removed transactions, keeping the order of the remaining ones
+    size_t nKept = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vtx[i]) {
+            vtx[nKept] = vtx[i];
+            vTime[nKept] = vTime[i];
+            nKept++;
+        }
+    }
+    vtx.resize(nKept);
+    vTime.resize(nKept);
+    SortParentsFirst(vtx, vTime);
+
+    LogPrint(BCLog::MEMPOOL, "%s: Replayed %d mempool journal records\n", __func__, nRecordsRead);
+    return true;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MEMPOOL_JOURNAL_H
+#define MEMPOOL_JOURNAL_H
+
+#include "amount.h"
+#include "fs.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "threadinterrupt.h"
+#include "uint256.h"
+
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+class CMempoolJournal;
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+extern std::unique_ptr<CMempoolJournal> mempoolJournal;
+
+static const char* const MEMPOOL_JOURNAL_FILENAME = "mempool.journal";
+//! Interval in which the journal is appended to, in ms
+static const int64_t MEMPOOL_JOURNAL_FLUSH_INTERVAL = 1000;
+//! The journal is compacted into mempool.dat once it holds more records than this, or twice the mempool size
+static const uint64_t MEMPOOL_JOURNAL_MIN_COMPACT_RECORDS = 10000;
+
+/**
+ * Persists the mempool incrementally.
+ *
+ * mempool.dat holds a snapshot of the mempool, mempool.journal the additions, removals and prioritisations since
+ * the snapshot was taken. Changes are collected from the mempool signals and appended to the journal periodically
+ * by a thread of its own, so shutting down only needs to write the last changes. Once the journal grows large it is
+ * compacted by that thread: a new snapshot is written and the journal restarted. The journal starts with the id of the snapshot it continues, a
+ * journal not matching the snapshot is ignored.
+ */
+class CMempoolJournal
+{
+private:
+    enum : uint8_t {
+        RECORD_ADD = 1,
+        RECORD_REMOVE = 2,
+        RECORD_PRIORITISE = 3,
+        RECORD_CLEAR_PRIORITISATION = 4,
+    };
+
+    struct Record {
+        uint8_t nType;
+        CTransactionRef tx;  //!< RECORD_ADD only
+        uint256 hash;
+        int64_t nValue;      //!< Entry time for RECORD_ADD, fee delta for RECORD_PRIORITISE
+    };
+
+    CTxMemPool& pool;
+    const fs::path pathJournal;
+
+    //! Serializes writing the journal and snapshot. Must be taken before pool.cs and cs
+    CCriticalSection csFile;
+    FILE* fileJournal;
+    bool fActive;
+    boost::signals2::connection connAdded, connRemoved, connPrioritised, connPrioritisationCleared;
+
+    std::thread threadMaintain;
+    CThreadInterrupt interruptMaintain;
+
+    //! Protects the records not yet written. Taken while holding pool.cs by the mempool signals
+    CCriticalSection cs;
+    std::vector<Record> vPending;
+    uint64_t nRecords; //!< Records since the last compaction
+
+    void EntryAdded(CTransactionRef tx, int64_t nTime);
+    void EntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void EntryPrioritised(const uint256& hash, const CAmount& nFeeDelta);
+    void PrioritisationCleared(const uint256& hash);
+
+    void ThreadMaintain();
+
+    bool FlushLocked();
+    bool CompactLocked();
+
+public:
+    explicit CMempoolJournal(CTxMemPool& poolIn);
+    ~CMempoolJournal();
+
+    /**
+     * Start recording changes, writing a fresh snapshot first, and start the thread maintaining the journal. Called
+     * once the mempool was loaded.
+     */
+    bool Start();
+    /** Stop the maintaining thread, write the pending changes and stop recording. */
+    void Stop();
+    /**
+     * Append the pending changes to the journal, compacting it if it grew too large. Called every
+     * MEMPOOL_JOURNAL_FLUSH_INTERVAL by the maintaining thread.
+     */
+    void Maintain();
+    /** Write a new snapshot and restart the journal. */
+    bool Compact();
+
+    /**
+     * Apply the journal continuing the snapshot nSnapshotId to the entries loaded from the snapshot. vtx and vTime
+     * are kept in the order the transactions entered the mempool, except that transactions are moved behind the
+     * transactions they spend, e.g. a transaction re-added after a reorg behind its children. The fee deltas are
+     * applied to mapDeltas.
+     */
+    static bool Replay(const fs::path& path, uint64_t nSnapshotId, std::vector<CTransactionRef>& vtx,
+                       std::vector<int64_t>& vTime, std::map<uint256, CAmount>& mapDeltas);
+};
+
+#endif // MEMPOOL_JOURNAL_H
@@ -122,8 +122,38 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    fPackagesSkipped = false;
+    setUnsafeTxs.clear();
 }
 
+/**
+ * The package selection of the last CreateNewBlock call. Mining pools and stakers ask for new templates several
+ * times per second, mostly without any change to the chain tip or the mempool in between.
+ *
+ * The entries are only used while the mempool had no removals since they were selected (see
+ * CTxMemPool::GetTransactionsAdded), so the iterators are still valid, and while none of the transactions left
+ * out as not safe for mining became safe.
+ */
+struct CPackageSelectionCache
+{
+    uint256 hashPrevBlock;
+    std::vector<uint256> vCommitmentHashes;
+    unsigned int nBlockMaxSize{0};
+    CFeeRate blockMinFeeRate;
+    unsigned int nTransactionsUpdated{0};
+    unsigned int nTransactionsAdded{0};
+    size_t nMempoolTxs{0};
+    bool fPackagesSkipped{false};
+    std::set<uint256> setUnsafeTxs;
+    int nPackagesSelected{0};
+    // in block order
+    std::vector<CTxMemPool::txiter> vSelected;
+};
+
+static CCriticalSection cs_packageSelectionCache;
+static std::unique_ptr<CPackageSelectionCache> packageSelectionCache;
+
 bool BlockAssembler::SplitCoinstakeVouts(std::shared_ptr<CMutableTransaction> coinstakeTx) {
 #ifdef ENABLE_WALLET
     // Calculate if we need to split the output
@@ -204,10 +234,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                        ? nMedianTimePast
                        : pblock->GetBlockTime();
 
+    std::vector<uint256> vCommitmentHashes;
     if (fDIP0003Active_context) {
         for (auto& p : chainparams.GetConsensus().llmqs) {
             CTransactionRef qcTx;
             if (llmq::quorumBlockProcessor->GetMinableCommitmentTx(p.first, nHeight, qcTx)) {
+                vCommitmentHashes.emplace_back(qcTx->GetHash());
                 pblock->vtx.emplace_back(qcTx);
                 pblocktemplate->vTxFees.emplace_back(0);
                 pblocktemplate->vTxSigOps.emplace_back(0);
@@ -219,7 +251,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    const char* pszSelection = addCachedPackageTxs(nPackagesSelected, nDescendantsUpdated, pindexPrev, vCommitmentHashes);
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -335,11 +367,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        {
+            // Don't hand out the same selection again
+            LOCK(cs_packageSelectionCache);
+            packageSelectionCache.reset();
+        }
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCHMARK, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCHMARK, "CreateNewBlock() packages: %.2fms (%s selection, %d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), pszSelection, nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -375,6 +412,7 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
             return false;
         if (!llmq::chainLocksHandler->IsTxSafeForMining(it->GetTx().GetHash())) {
+            setUnsafeTxs.emplace(it->GetTx().GetHash());
             return false;
         }
     }
@@ -538,6 +576,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOps)) {
+            fPackagesSkipped = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -592,6 +631,164 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+bool BlockAssembler::addPackageTxsForAdded(const std::vector<CTxMemPool::txiter>& vAdded, int &nPackagesSelected)
+{
+    std::vector<CTxMemPool::txiter> vCandidates(vAdded);
+    while (!vCandidates.empty()) {
+        // Parents before children, so a package only contains its not yet selected ancestors
+        std::sort(vCandidates.begin(), vCandidates.end(), CompareTxIterByAncestorCount());
+
+        // Descendants of the packages added in this round, their ancestor fee rate went up
+        CTxMemPool::setEntries setDescendants;
+        for (CTxMemPool::txiter iter : vCandidates) {
+            if (inBlock.count(iter)) {
+                continue;
+            }
+
+            CTxMemPool::setEntries ancestors;
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+            onlyUnconfirmed(ancestors);
+            ancestors.insert(iter);
+
+            uint64_t packageSize = 0;
+            CAmount packageFees = 0;
+            unsigned int packageSigOps = 0;
+            for (CTxMemPool::txiter it : ancestors) {
+                packageSize += it->GetTxSize();
+                packageFees += it->GetModifiedFee();
+                packageSigOps += it->GetSigOpCount();
+            }
+
+            if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+                continue;
+            }
+            if (!TestPackage(packageSize, packageSigOps)) {
+                // The block is full, which packages get in depends on the fee rates of all of them
+                return false;
+            }
+            if (!TestPackageTransactions(ancestors)) {
+                continue;
+            }
+
+            std::vector<CTxMemPool::txiter> sortedEntries;
+            SortForBlock(ancestors, iter, sortedEntries);
+            for (size_t i=0; i<sortedEntries.size(); ++i) {
+                AddToBlock(sortedEntries[i]);
+            }
+            ++nPackagesSelected;
+
+            for (CTxMemPool::txiter it : ancestors) {
+                mempool.CalculateDescendants(it, setDescendants);
+            }
+        }
+
+        vCandidates.clear();
+        for (CTxMemPool::txiter it : setDescendants) {
+            if (!inBlock.count(it)) {
+                vCandidates.emplace_back(it);
+            }
+        }
+    }
+    return true;
+}
+
+// Transactions become safe for mining when they're IS locked or after waiting for the IS lock timed out
+static bool AnyTxSafeForMining(const std::set<uint256>& setTxs)
+{
+    for (const uint256& txid : setTxs) {
+        if (llmq::chainLocksHandler->IsTxSafeForMining(txid)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* BlockAssembler::addCachedPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const CBlockIndex* pindexPrev,
+                                                const std::vector<uint256>& vCommitmentHashes)
+{
+    AssertLockHeld(mempool.cs);
+
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    const unsigned int nTransactionsAdded = mempool.GetTransactionsAdded();
+    const char* pszSelection = "new";
+    bool fFullSelection = true;
+
+    // Block state before any package was added, to start over if the cached selection can't be extended
+    const size_t nBlockTxsBefore = pblock->vtx.size();
+    const uint64_t nBlockSizeBefore = nBlockSize;
+    const uint64_t nBlockTxBefore = nBlockTx;
+    const unsigned int nBlockSigOpsBefore = nBlockSigOps;
+
+    LOCK(cs_packageSelectionCache);
+    const CPackageSelectionCache* cache = packageSelectionCache.get();
+    if (cache && cache->hashPrevBlock == pindexPrev->GetBlockHash() && cache->vCommitmentHashes == vCommitmentHashes &&
+        cache->nBlockMaxSize == nBlockMaxSize && cache->blockMinFeeRate == blockMinFeeRate &&
+        nTransactionsUpdated - cache->nTransactionsUpdated == nTransactionsAdded - cache->nTransactionsAdded &&
+        mempool.vTxHashes.size() == cache->nMempoolTxs + (nTransactionsAdded - cache->nTransactionsAdded) &&
+        !AnyTxSafeForMining(cache->setUnsafeTxs)) {
+        // Only additions since the cached selection, so all selected entries are still in the mempool
+        for (CTxMemPool::txiter iter : cache->vSelected) {
+            AddToBlock(iter);
+        }
+        nPackagesSelected = cache->nPackagesSelected;
+        fPackagesSkipped = cache->fPackagesSkipped;
+        setUnsafeTxs = cache->setUnsafeTxs;
+
+        if (nTransactionsAdded == cache->nTransactionsAdded) {
+            return "reused";
+        }
+
+        // The added entries are at the end of vTxHashes
+        std::vector<CTxMemPool::txiter> vAdded;
+        for (size_t i = cache->nMempoolTxs; i < mempool.vTxHashes.size(); i++) {
+            vAdded.emplace_back(mempool.vTxHashes[i].second);
+        }
+        if (!fPackagesSkipped && addPackageTxsForAdded(vAdded, nPackagesSelected)) {
+            pszSelection = "extended";
+            fFullSelection = false;
+        } else {
+            pblock->vtx.resize(nBlockTxsBefore);
+            pblocktemplate->vTxFees.resize(nBlockTxsBefore);
+            pblocktemplate->vTxSigOps.resize(nBlockTxsBefore);
+            inBlock.clear();
+            nBlockSize = nBlockSizeBefore;
+            nBlockTx = nBlockTxBefore;
+            nBlockSigOps = nBlockSigOpsBefore;
+            nFees = 0;
+            fPackagesSkipped = false;
+            setUnsafeTxs.clear();
+            nPackagesSelected = 0;
+        }
+    }
+
+    if (fFullSelection) {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
+
+    std::unique_ptr<CPackageSelectionCache> newCache(new CPackageSelectionCache());
+    newCache->hashPrevBlock = pindexPrev->GetBlockHash();
+    newCache->vCommitmentHashes = vCommitmentHashes;
+    newCache->nBlockMaxSize = nBlockMaxSize;
+    newCache->blockMinFeeRate = blockMinFeeRate;
+    newCache->nTransactionsUpdated = nTransactionsUpdated;
+    newCache->nTransactionsAdded = nTransactionsAdded;
+    newCache->nMempoolTxs = mempool.vTxHashes.size();
+    newCache->fPackagesSkipped = fPackagesSkipped;
+    newCache->setUnsafeTxs = setUnsafeTxs;
+    newCache->nPackagesSelected = nPackagesSelected;
+    for (size_t i = nBlockTxsBefore; i < pblock->vtx.size(); i++) {
+        auto it = mempool.mapTx.find(pblock->vtx[i]->GetHash());
+        assert(it != mempool.mapTx.end());
+        newCache->vSelected.emplace_back(it);
+    }
+    packageSelectionCache = std::move(newCache);
+
+    return pszSelection;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
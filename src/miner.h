@@ -156,6 +156,10 @@ private:
     unsigned int nBlockSigOps;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Set when a package was left out because it did not fit into the block
+    bool fPackagesSkipped;
+    // Transactions which left their packages out because they were not safe for mining yet
+    std::set<uint256> setUnsafeTxs;
 
     // Chain context for the block
     int nHeight;
@@ -191,6 +195,17 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+    /** Same as addPackageTxs, but reuses the package selection of the previous template on the same tip. If the
+      * mempool is unchanged since, the selection is reused as is, if transactions were only added to the
+      * mempool, only the packages of the added transactions are considered. A transaction left out as not safe
+      * for mining which became safe forces a new selection. Returns "new", "reused" or
+      * "extended", depending on how the selection was made. */
+    const char* addCachedPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const CBlockIndex* pindexPrev,
+                                    const std::vector<uint256>& vCommitmentHashes);
+    /** Add the packages of transactions which were added to the mempool after the other block transactions were
+      * selected, and then of the descendants of the added packages. Returns false if a package did not fit into
+      * the block, so a full selection has to be made. */
+    bool addPackageTxsForAdded(const std::vector<CTxMemPool::txiter>& vAdded, int &nPackagesSelected);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
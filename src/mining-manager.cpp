@@ -5,6 +5,7 @@
 #include "mining-manager.h"
 
 #include "chainparams.h"
+#include "hash.h"
 #include "init.h"
 #include "miner.h"
 #include "net.h"
@@ -15,9 +16,11 @@
 #include "pos/stakeinput.h"
 #include "script/sign.h"
 #include "script/tokengroup.h"
+#include "streams.h"
 #include "tokens/tokengroupmanager.h"
 #include "utilmoneystr.h"
 #include "validation.h"
+#include "versionbits.h"
 #include "wallet/wallet.h"
 
 // fix windows build
@@ -30,32 +33,58 @@ std::shared_ptr<CMiningManager> miningManager;
 // Internal miner
 //
 
-//	
-// ScanHash scans nonces looking for a hash with at least some zero bits.	
-// The nonce is usually preserved between calls, but periodically or if the	
-// nonce is 0xffff0000 or above, the block is rebuilt and nNonce starts over at	
-// zero.	
-//	
+//
+// ScanHash scans nonces looking for a hash with at least some zero bits.
+// The nonce is usually preserved between calls, but periodically or if the
+// nonce reaches the end of the nonce range of the miner thread, the block is
+// rebuilt and nNonce starts over at the beginning of the range.
+//
 
-bool static ScanHash(const CBlockHeader *pblock, const arith_uint256& hashTarget, uint32_t& nNonce, uint256& phash)
+//! Offset of nNonce in the serialized block header
+static const size_t HEADER_NONCE_OFFSET = 76;
+
+bool static ScanHash(const CBlockHeader *pblock, const arith_uint256& hashTarget, uint32_t& nNonce, uint32_t nNonceEnd, uint256& phash)
 {
-    // HashX11 currently does not have an intermediary state
-    // So we revert to doing a full hash calculation and check
-    CBlockHeader block = *pblock;
-    while (true) {
-        nNonce++;
-        block.nNonce = nNonce;
-        phash = block.GetHash();
-
-        if (UintToArith256(phash) <= hashTarget)
-            return true;
-        // If nothing found after trying for a while, return -1	
-        if ((nNonce & 0xfff) == 0)	
-            return false;	
+    uint32_t nHashes = 0;
+    bool fFound = false;
+    if ((pblock->nVersion & BLOCKTYPEBITS_MASK) == BlockTypeBits::BLOCKTYPE_MINING) {
+        // The header in front of the nonce is absorbed once per call, not once per nonce
+        std::vector<unsigned char> vchHeader;
+        CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION, vchHeader, 0);
+        ss << *pblock;
+        CX11NonceHasher hasher(vchHeader, HEADER_NONCE_OFFSET);
+        while (nNonce < nNonceEnd) {
+            nNonce++;
+            nHashes++;
+            phash = hasher.Hash(nNonce);
+            if (UintToArith256(phash) <= hashTarget) {
+                fFound = true;
+                break;
+            }
+            // If nothing found after trying for a while, return false
+            if ((nNonce & 0xfff) == 0)
+                break;
+        }
+    } else {
+        CBlockHeader block = *pblock;
+        while (nNonce < nNonceEnd) {
+            nNonce++;
+            nHashes++;
+            block.nNonce = nNonce;
+            phash = block.GetHash();
+            if (UintToArith256(phash) <= hashTarget) {
+                fFound = true;
+                break;
+            }
+            if ((nNonce & 0xfff) == 0)
+                break;
+        }
     }
+    miningManager->AddHashes(nHashes);
+    return fFound;
 }
 
-void static IONMiner(CWallet * const pwallet)
+void static IONMiner(CWallet * const pwallet, int nThread, int nThreads)
 {
     LogPrintf("IONMiner started\n");
     RenameThread("ion-miner");
@@ -167,10 +196,13 @@ void static IONMiner(CWallet * const pwallet)
                 break;
             }
             
+            // Each miner thread scans its own part of the nonce space
+            const uint32_t nNonceBegin = (uint32_t)(((uint64_t)1 << 32) * nThread / nThreads);
+            const uint32_t nNonceEnd = (uint32_t)((((uint64_t)1 << 32) * (nThread + 1) / nThreads) - 1);
             uint256 hash;
-            uint32_t nNonce = 0;
+            uint32_t nNonce = nNonceBegin;
             while (true) {
-                if (ScanHash(pblock, hashTarget, nNonce, hash)) {
+                if (ScanHash(pblock, hashTarget, nNonce, nNonceEnd, hash)) {
                     // Found a solution
                     pblock->nNonce = nNonce;
                     assert(hash == pblock->GetHash());
@@ -192,9 +224,8 @@ void static IONMiner(CWallet * const pwallet)
                 // Check for stop or if block needs to be rebuilt	
                 boost::this_thread::interruption_point();	
 
-                if (nNonce >= 0xffff0000) {
-                    nNonce = 0;
-                    break;	
+                if (nNonce >= nNonceEnd) {
+                    break;
                 }
                 if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
                     break;
@@ -262,13 +293,14 @@ bool CMiningManager::GenerateBitcoins(bool fGenerate, int nThreads)
             delete minerThreads;
             minerThreads = NULL;
         }
+        ResetHashRate();
 
         if (nThreads == 0 || !fGenerate)
             return false;
 
         minerThreads = new boost::thread_group();
-        for (unsigned int i = 0; i < nThreads; i++)
-            minerThreads->create_thread(boost::bind(&IONMiner, boost::ref(pwallet)));
+        for (int i = 0; i < nThreads; i++)
+            minerThreads->create_thread(boost::bind(&IONMiner, boost::ref(pwallet), i, nThreads));
     }
 
     return true;
@@ -280,3 +312,38 @@ void CMiningManager::UpdatedBlockTip(const CBlockIndex* pindex)
 
     tipIndex = pindex;
 }
+
+void CMiningManager::AddHashes(uint64_t nHashes)
+{
+    uint64_t nTotal = nHashesDone.fetch_add(nHashes) + nHashes;
+    int64_t nNow = GetTimeMillis();
+
+    // Update the rate every HASHRATE_INTERVAL ms, by the thread which sees the interval expire first
+    TRY_LOCK(csHashRate, lockHashRate);
+    if (!lockHashRate || nNow - nHashRateStartTime < HASHRATE_INTERVAL) {
+        return;
+    }
+    if (nHashRateStartTime != 0) {
+        dHashesPerSec = 1000.0 * (nTotal - nHashRateStartCount) / (nNow - nHashRateStartTime);
+    }
+    nHashRateStartTime = nNow;
+    nHashRateStartCount = nTotal;
+}
+
+void CMiningManager::ResetHashRate()
+{
+    LOCK(csHashRate);
+    dHashesPerSec = 0;
+    nHashRateStartTime = 0;
+    nHashRateStartCount = nHashesDone;
+}
+
+double CMiningManager::GetHashesPerSec() const
+{
+    LOCK(csHashRate);
+    // the miner threads have stopped reporting
+    if (nHashRateStartTime != 0 && GetTimeMillis() - nHashRateStartTime > 3 * HASHRATE_INTERVAL) {
+        return 0;
+    }
+    return dHashesPerSec;
+}
@@ -11,6 +11,8 @@
 
 #include <univalue.h>
 
+#include <atomic>
+
 class CBlock;
 class CBlockIndex;
 class CChainParams;
@@ -23,6 +25,9 @@ class uint256;
 
 extern std::shared_ptr<CMiningManager> miningManager;
 
+//! Interval in which the hash rate of the internal miner is measured, in ms
+static const int64_t HASHRATE_INTERVAL = 4000;
+
 class CMiningManager
 {
 public:
@@ -37,6 +42,15 @@ private:
     unsigned int nExtraNonce;
     const unsigned int nHashInterval;
 
+    //! Hashes done by the miner threads, the hash rate is updated from it every HASHRATE_INTERVAL ms
+    std::atomic<uint64_t> nHashesDone{0};
+    mutable CCriticalSection csHashRate;
+    int64_t nHashRateStartTime{0};
+    uint64_t nHashRateStartCount{0};
+    double dHashesPerSec{0};
+
+    void ResetHashRate();
+
 public:
     CMiningManager(const CChainParams& chainparams, CConnman* const connman, CWallet * const pwalletIn = nullptr);
 
@@ -48,6 +62,11 @@ public:
 
     void UpdatedBlockTip(const CBlockIndex* pindex);
 
+    //! Called by the miner threads with the number of hashes they did
+    void AddHashes(uint64_t nHashes);
+    //! Hash rate of the internal miner, 0 if it is not running
+    double GetHashesPerSec() const;
+
 };
 
 #endif // MINING_CLIENT_H
@@ -9,6 +9,7 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockfilterindex.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
@@ -1678,6 +1679,40 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
+/** Append the orphans spending outputs of tx to vtx */
+static void GetOrphansSpending(const CTransaction& tx, std::vector<CTransactionRef>& vtx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+{
+    AssertLockHeld(g_cs_orphans);
+    std::set<uint256> setAdded;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(tx.GetHash(), i));
+        if (it_by_prev == mapOrphanTransactionsByPrev.end()) continue;
+        for (const auto& elem : it_by_prev->second) {
+            if (setAdded.insert(elem->first).second)
+                vtx.push_back(elem->second.tx);
+        }
+    }
+}
+
+/**
+ * Verify the scripts of the orphans in orphan_work_set without cs_main, so that ProcessOrphanTx finds them in the
+ * script execution cache.
+ */
+void static PreValidateOrphanTxs(const std::set<uint256>& orphan_work_set)
+{
+    std::vector<CTransactionRef> vOrphans;
+    {
+        LOCK(g_cs_orphans);
+        for (const uint256& orphanHash : orphan_work_set) {
+            auto orphan_it = mapOrphanTransactions.find(orphanHash);
+            if (orphan_it != mapOrphanTransactions.end())
+                vOrphans.push_back(orphan_it->second.tx);
+        }
+    }
+    if (!vOrphans.empty())
+        PreValidateMempoolBatch(mempool, vOrphans);
+}
+
 void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans)
 {
     AssertLockHeld(cs_main);
@@ -1736,6 +1771,52 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
     }
 }
 
+/**
+ * Validates a getcfilters/getcfheaders/getcfcheckpt request and looks up the stop block. Peers asking for filters
+ * we don't serve or for invalid ranges are disconnected (BIP 157).
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chainparams, BlockFilterType filterType,
+                                      uint32_t nStartHeight, const uint256& stopHash, uint32_t nMaxHeightDiff,
+                                      const CBlockIndex*& pindexStopRet)
+{
+    bool fSupported = (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) && pblockfilterindex &&
+                      pblockfilterindex->GetFilterType() == filterType;
+    if (!fSupported) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filterType));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(stopHash);
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (it == mapBlockIndex.end() || !BlockRequestAllowed(it->second, chainparams.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n", pfrom->GetId(), stopHash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        pindexStopRet = it->second;
+    }
+
+    uint32_t nStopHeight = pindexStopRet->nHeight;
+    if (nStartHeight > nStopHeight) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with start height %d and stop height %d\n",
+                 pfrom->GetId(), nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (nStopHeight - nStartHeight >= nMaxHeightDiff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), nStopHeight - nStartHeight + 1, nMaxHeightDiff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -2507,6 +2588,22 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             mmetaman.DisallowMixing(dmn->proTxHash);
         }
 
+        // Verify the scripts of the transaction and of the orphans waiting for it before cs_main is taken, its
+        // admission below then only repeats the checks against the flags of the current block
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            fAlreadyHave = AlreadyHave(inv);
+        }
+        if (!fAlreadyHave) {
+            std::vector<CTransactionRef> vPreValidate(1, ptx);
+            {
+                LOCK(g_cs_orphans);
+                GetOrphansSpending(tx, vPreValidate);
+            }
+            PreValidateMempoolBatch(mempool, vPreValidate);
+        }
+
         LOCK2(cs_main, g_cs_orphans);
 
         bool fMissingInputs = false;
@@ -3162,10 +3259,18 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         LOCK(cs_main);
 
-        CSimplifiedMNListDiff mnListDiff;
+        CSimplifiedMNListDiffCache::EntryPtr mnListDiffEntry;
         std::string strError;
-        if (BuildSimplifiedMNListDiff(cmd.baseBlockHash, cmd.blockHash, mnListDiff, strError)) {
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNLISTDIFF, mnListDiff));
+        if (GetSimplifiedMNListDiff(cmd.baseBlockHash, cmd.blockHash, mnListDiffEntry, strError)) {
+            if (pfrom->GetSendVersion() >= LLMQS_PROTO_VERSION) {
+                // send the already serialized diff
+                CSerializedNetMsg msg;
+                msg.command = NetMsgType::MNLISTDIFF;
+                msg.data = mnListDiffEntry->vSerialized;
+                connman->PushMessage(pfrom, std::move(msg));
+            } else {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNLISTDIFF, mnListDiffEntry->diff));
+            }
         } else {
             LogPrint(BCLog::NET, "getmnlistdiff failed for baseBlockHash=%s, blockHash=%s. error=%s\n", cmd.baseBlockHash.ToString(), cmd.blockHash.ToString(), strError);
             Misbehaving(pfrom->GetId(), 1);
@@ -3183,6 +3288,92 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
+    if (strCommand == NetMsgType::GETCFILTERS) {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 stopHash;
+        vRecv >> nFilterType >> nStartHeight >> stopHash;
+
+        const BlockFilterType filterType = static_cast<BlockFilterType>(nFilterType);
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, chainparams, filterType, nStartHeight, stopHash, MAX_GETCFILTERS_SIZE, pindexStop)) {
+            return true;
+        }
+
+        std::vector<BlockFilter> filters;
+        if (!pblockfilterindex->LookupFilterRange(nStartHeight, pindexStop, filters)) {
+            LogPrint(BCLog::NET, "failed to find block filters in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filterType), nStartHeight, stopHash.ToString());
+            return true;
+        }
+
+        for (const auto& filter : filters) {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+        }
+        return true;
+    }
+
+
+    if (strCommand == NetMsgType::GETCFHEADERS) {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 stopHash;
+        vRecv >> nFilterType >> nStartHeight >> stopHash;
+
+        const BlockFilterType filterType = static_cast<BlockFilterType>(nFilterType);
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, chainparams, filterType, nStartHeight, stopHash, MAX_GETCFHEADERS_SIZE, pindexStop)) {
+            return true;
+        }
+
+        uint256 prevHeader;
+        if (nStartHeight > 0) {
+            const CBlockIndex* pindexPrev = pindexStop->GetAncestor(static_cast<int>(nStartHeight - 1));
+            if (!pblockfilterindex->LookupFilterHeader(pindexPrev, prevHeader)) {
+                LogPrint(BCLog::NET, "failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filterType), pindexPrev->GetBlockHash().ToString());
+                return true;
+            }
+        }
+
+        std::vector<uint256> filterHashes;
+        if (!pblockfilterindex->LookupFilterHashRange(nStartHeight, pindexStop, filterHashes)) {
+            LogPrint(BCLog::NET, "failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filterType), nStartHeight, stopHash.ToString());
+            return true;
+        }
+
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFHEADERS, nFilterType, pindexStop->GetBlockHash(), prevHeader, filterHashes));
+        return true;
+    }
+
+
+    if (strCommand == NetMsgType::GETCFCHECKPT) {
+        uint8_t nFilterType;
+        uint256 stopHash;
+        vRecv >> nFilterType >> stopHash;
+
+        const BlockFilterType filterType = static_cast<BlockFilterType>(nFilterType);
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, chainparams, filterType, 0, stopHash, std::numeric_limits<uint32_t>::max(), pindexStop)) {
+            return true;
+        }
+
+        std::vector<uint256> headers(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        for (int i = headers.size() - 1; i >= 0; i--) {
+            const CBlockIndex* pindex = pindexStop->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+            if (!pblockfilterindex->LookupFilterHeader(pindex, headers[i])) {
+                LogPrint(BCLog::NET, "failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filterType), pindex->GetBlockHash().ToString());
+                return true;
+            }
+        }
+
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFCHECKPT, nFilterType, pindexStop->GetBlockHash(), headers));
+        return true;
+    }
+
+
     if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
         // message would be undesirable as we transmit it ourselves.
@@ -3271,6 +3462,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         ProcessGetData(pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
 
     if (!pfrom->orphan_work_set.empty()) {
+        PreValidateOrphanTxs(pfrom->orphan_work_set);
         LOCK2(cs_main, g_cs_orphans);
         ProcessOrphanTx(connman, pfrom->orphan_work_set);
     }
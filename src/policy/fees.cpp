@@ -15,6 +15,8 @@
 #include "util.h"
 
 static constexpr double INF_FEERATE = 1e99;
+/** The pending decay of the moving averages is applied once it drops below this */
+static constexpr double MIN_DECAY_SCALE = 1e-9;
 
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
@@ -100,6 +102,12 @@ private:
 
     double decay;
 
+    // The moving averages above are stored without the decay applied since it
+    // was last folded into them, so decaying them per block is a single
+    // multiplication. The actual averages are the stored ones times decayScale,
+    // new data points are added divided by it.
+    double decayScale;
+
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
@@ -112,6 +120,9 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Fold the pending decay into the moving averages */
+    void ApplyDecayScale();
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -123,6 +134,10 @@ public:
     TxConfirmStats(const std::vector<double>& defaultBuckets, const std::map<double, unsigned int>& defaultBucketMap,
                    unsigned int maxPeriods, double decay, unsigned int scale);
 
+    /** Copy stats, referring to the given buckets which must be equal to the ones of other */
+    TxConfirmStats(const TxConfirmStats& other, const std::vector<double>& buckets,
+                   const std::map<double, unsigned int>& bucketMap);
+
     /** Roll the circular buffer for unconfirmed txs*/
     void ClearCurrent(unsigned int nBlockHeight);
 
@@ -180,6 +195,7 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     : buckets(defaultBuckets), bucketMap(defaultBucketMap)
 {
     decay = _decay;
+    decayScale = 1;
     scale = _scale;
     confAvg.resize(maxPeriods);
     for (unsigned int i = 0; i < maxPeriods; i++) {
@@ -196,6 +212,16 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     resizeInMemoryCounters(buckets.size());
 }
 
+TxConfirmStats::TxConfirmStats(const TxConfirmStats& other, const std::vector<double>& _buckets,
+                               const std::map<double, unsigned int>& _bucketMap)
+    : buckets(_buckets), bucketMap(_bucketMap),
+      txCtAvg(other.txCtAvg), confAvg(other.confAvg), failAvg(other.failAvg), avg(other.avg),
+      decay(other.decay), decayScale(other.decayScale), scale(other.scale),
+      unconfTxs(other.unconfTxs), oldUnconfTxs(other.oldUnconfTxs)
+{
+    assert(buckets == other.buckets);
+}
+
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
     unconfTxs.resize(GetMaxConfirms());
@@ -222,23 +248,32 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    double weight = 1 / decayScale;
     for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+        confAvg[i - 1][bucketindex] += weight;
     }
-    txCtAvg[bucketindex]++;
-    avg[bucketindex] += val;
+    txCtAvg[bucketindex] += weight;
+    avg[bucketindex] += val * weight;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
+{
+    decayScale *= decay;
+    if (decayScale < MIN_DECAY_SCALE)
+        ApplyDecayScale();
+}
+
+void TxConfirmStats::ApplyDecayScale()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
         for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
+            confAvg[i][j] = confAvg[i][j] * decayScale;
         for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
+            failAvg[i][j] = failAvg[i][j] * decayScale;
+        avg[j] = avg[j] * decayScale;
+        txCtAvg[j] = txCtAvg[j] * decayScale;
     }
+    decayScale = 1;
 }
 
 // returns -1 on error conditions
@@ -286,9 +321,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        nConf += confAvg[periodTarget - 1][bucket] * decayScale;
+        totalNum += txCtAvg[bucket] * decayScale;
+        failNum += failAvg[periodTarget - 1][bucket] * decayScale;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -343,6 +378,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     // Find the bucket with the median transaction and then report the average feerate from that bucket
     // This is a compromise between finding the median which we can't since we don't save all tx's
     // and reporting the average which is less accurate
+    // Only ratios of the stored averages are used here, so they needn't be scaled
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
@@ -396,12 +432,14 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    TxConfirmStats stats(*this, buckets, bucketMap);
+    stats.ApplyDecayScale();
     fileout << decay;
     fileout << scale;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << stats.avg;
+    fileout << stats.txCtAvg;
+    fileout << stats.confAvg;
+    fileout << stats.failAvg;
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -420,6 +458,7 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
         filein >> scale;
     }
 
+    decayScale = 1;
     filein >> avg;
     if (avg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in feerate average bucket count");
@@ -505,25 +544,78 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         unsigned int periodsAgo = blocksAgo / scale;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+            failAvg[i][bucketindex] += 1 / decayScale;
         }
     }
 }
 
+struct CBlockPolicyEstimator::EstimatorState
+{
+    std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
+    std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
+
+    /** Classes to track historical data on transaction confirmations */
+    std::unique_ptr<TxConfirmStats> feeStats;
+    std::unique_ptr<TxConfirmStats> shortStats;
+    std::unique_ptr<TxConfirmStats> longStats;
+
+    unsigned int nBestSeenHeight;
+    unsigned int firstRecordedHeight;
+    unsigned int historicalFirst;
+    unsigned int historicalBest;
+
+    EstimatorState() : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0) {}
+
+    EstimatorState(const EstimatorState& other) :
+        buckets(other.buckets), bucketMap(other.bucketMap),
+        feeStats(new TxConfirmStats(*other.feeStats, buckets, bucketMap)),
+        shortStats(new TxConfirmStats(*other.shortStats, buckets, bucketMap)),
+        longStats(new TxConfirmStats(*other.longStats, buckets, bucketMap)),
+        nBestSeenHeight(other.nBestSeenHeight), firstRecordedHeight(other.firstRecordedHeight),
+        historicalFirst(other.historicalFirst), historicalBest(other.historicalBest) {}
+
+    /** Number of blocks of data recorded while fee estimates have been running */
+    unsigned int BlockSpan() const;
+    /** Number of blocks of recorded fee estimate data represented in saved data file */
+    unsigned int HistoricalBlockSpan() const;
+    /** Calculation of highest target that reasonable estimate can be provided for */
+    unsigned int MaxUsableEstimate() const;
+
+    /** Helper for estimateSmartFee */
+    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
+    /** Helper for estimateSmartFee */
+    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
+};
+
+CBlockPolicyEstimator::TxFeeInfo::TxFeeInfo(const CTxMemPoolEntry& entry) :
+    hash(entry.GetTx().GetHash()), nHeight(entry.GetHeight())
+{
+    // Feerates are stored and reported as BTC-per-kb:
+    feeRate = (double)CFeeRate(entry.GetFee(), entry.GetTxSize()).GetFeePerK();
+}
+
 // This function is called from CTxMemPool::removeUnchecked to ensure
 // txs removed from the mempool for any reason are no longer
 // tracked. Txs that were part of a block have already been removed in
 // processBlockTx to ensure they are never double tracked, but it is
 // of no harm to try to remove them again.
-bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
+void CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
 {
-    LOCK(cs_feeEstimator);
+    Event event(Event::TX_REMOVED);
+    event.tx.hash = hash;
+    event.fFlag = inBlock;
+    QueueEvent(std::move(event));
+}
+
+bool CBlockPolicyEstimator::removeTxLocked(const uint256& hash, bool inBlock)
+{
+    AssertLockHeld(cs_feeEstimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
-        feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        mapMemPoolTxs.erase(hash);
+        state->feeStats->removeTx(pos->second.blockHeight, state->nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        state->shortStats->removeTx(pos->second.blockHeight, state->nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        state->longStats->removeTx(pos->second.blockHeight, state->nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        mapMemPoolTxs.erase(pos);
         return true;
     } else {
         return false;
@@ -531,41 +623,139 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator()
-    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
+    : state(new EstimatorState()), trackedTxs(0), untrackedTxs(0), fThreadRunning(false)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
     size_t bucketIndex = 0;
     for (double bucketBoundary = MIN_BUCKET_FEERATE; bucketBoundary <= MAX_BUCKET_FEERATE; bucketBoundary *= FEE_SPACING, bucketIndex++) {
-        buckets.push_back(bucketBoundary);
-        bucketMap[bucketBoundary] = bucketIndex;
+        state->buckets.push_back(bucketBoundary);
+        state->bucketMap[bucketBoundary] = bucketIndex;
     }
-    buckets.push_back(INF_FEERATE);
-    bucketMap[INF_FEERATE] = bucketIndex;
-    assert(bucketMap.size() == buckets.size());
+    state->buckets.push_back(INF_FEERATE);
+    state->bucketMap[INF_FEERATE] = bucketIndex;
+    assert(state->bucketMap.size() == state->buckets.size());
+
+    state->feeStats.reset(new TxConfirmStats(state->buckets, state->bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+    state->shortStats.reset(new TxConfirmStats(state->buckets, state->bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+    state->longStats.reset(new TxConfirmStats(state->buckets, state->bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
 
-    feeStats = new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE);
-    shortStats = new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE);
-    longStats = new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE);
+    LOCK(cs_feeEstimator);
+    PublishLocked();
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
 {
-    delete feeStats;
-    delete shortStats;
-    delete longStats;
 }
 
-void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
+void CBlockPolicyEstimator::QueueEvent(Event&& event)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutexQueue);
+        vQueue.push_back(std::move(event));
+        if (fThreadRunning) {
+            condQueue.notify_one();
+            return;
+        }
+    }
+    LOCK(cs_feeEstimator);
+    ProcessQueueLocked();
+}
+
+void CBlockPolicyEstimator::ProcessQueueLocked()
+{
+    AssertLockHeld(cs_feeEstimator);
+
+    // Events are taken from the queue while holding cs_feeEstimator, so they are processed in order
+    std::vector<Event> vEvents;
+    {
+        boost::unique_lock<boost::mutex> lock(mutexQueue);
+        vEvents.swap(vQueue);
+    }
+
+    // Transactions added since the last block don't count before the next one, but removing a tracked transaction
+    // (evicted, expired or replaced) updates the unconfirmed counts and failure averages the estimates use
+    bool fPublish = false;
+    for (const Event& event : vEvents) {
+        switch (event.type) {
+        case Event::TX_ADDED:
+            processTransactionLocked(event.tx, event.fFlag);
+            break;
+        case Event::TX_REMOVED:
+            if (removeTxLocked(event.tx.hash, event.fFlag)) {
+                fPublish = true;
+            }
+            break;
+        case Event::BLOCK:
+            processBlockLocked(event.nBlockHeight, event.vBlockTxs);
+            fPublish = true;
+            break;
+        }
+    }
+    if (fPublish) {
+        PublishLocked();
+    }
+}
+
+void CBlockPolicyEstimator::ThreadProcessEvents()
+{
+    fThreadRunning = true;
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutexQueue);
+                while (vQueue.empty()) {
+                    condQueue.wait(lock);
+                }
+            }
+            LOCK(cs_feeEstimator);
+            ProcessQueueLocked();
+        }
+    } catch (...) {
+        // Events queued from now on are processed by the caller again
+        fThreadRunning = false;
+        throw;
+    }
+}
+
+void CBlockPolicyEstimator::SyncWithQueue()
 {
     LOCK(cs_feeEstimator);
-    unsigned int txHeight = entry.GetHeight();
-    uint256 hash = entry.GetTx().GetHash();
+    ProcessQueueLocked();
+}
+
+void CBlockPolicyEstimator::PublishLocked()
+{
+    AssertLockHeld(cs_feeEstimator);
+    std::shared_ptr<const EstimatorState> copy = std::make_shared<const EstimatorState>(*state);
+    LOCK(cs_published);
+    published = copy;
+}
+
+std::shared_ptr<const CBlockPolicyEstimator::EstimatorState> CBlockPolicyEstimator::GetPublished() const
+{
+    LOCK(cs_published);
+    return published;
+}
+
+void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
+{
+    Event event(Event::TX_ADDED);
+    event.tx = TxFeeInfo(entry);
+    event.fFlag = validFeeEstimate;
+    QueueEvent(std::move(event));
+}
+
+void CBlockPolicyEstimator::processTransactionLocked(const TxFeeInfo& tx, bool validFeeEstimate)
+{
+    AssertLockHeld(cs_feeEstimator);
+    unsigned int txHeight = tx.nHeight;
+    const uint256& hash = tx.hash;
     if (mapMemPoolTxs.count(hash)) {
         LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error mempool tx %s already being tracked\n", hash.ToString());
         return;
     }
 
-    if (txHeight != nBestSeenHeight) {
+    if (txHeight != state->nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random they don't
         // affect the estimate.  We'll potentially double count transactions in 1-block reorgs.
         // Ignore txs if BlockPolicyEstimator is not in sync with chainActive.Tip().
@@ -581,21 +771,18 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     }
     trackedTxs++;
 
-    // Feerates are stored and reported as BTC-per-kb:
-    CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
-
     mapMemPoolTxs[hash].blockHeight = txHeight;
-    unsigned int bucketIndex = feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex = state->feeStats->NewTx(txHeight, tx.feeRate);
     mapMemPoolTxs[hash].bucketIndex = bucketIndex;
-    unsigned int bucketIndex2 = shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex2 = state->shortStats->NewTx(txHeight, tx.feeRate);
     assert(bucketIndex == bucketIndex2);
-    unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+    unsigned int bucketIndex3 = state->longStats->NewTx(txHeight, tx.feeRate);
     assert(bucketIndex == bucketIndex3);
 }
 
-bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
+bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const TxFeeInfo& tx)
 {
-    if (!removeTx(entry->GetTx().GetHash(), true)) {
+    if (!removeTxLocked(tx.hash, true)) {
         // This transaction wasn't being tracked for fee estimation
         return false;
     }
@@ -603,7 +790,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // How many blocks did it take for miners to include this transaction?
     // blocksToConfirm is 1-based, so a transaction included in the earliest
     // possible block has confirmation count of 1
-    int blocksToConfirm = nBlockHeight - entry->GetHeight();
+    int blocksToConfirm = nBlockHeight - tx.nHeight;
     if (blocksToConfirm <= 0) {
         // This can't happen because we don't process transactions from a block with a height
         // lower than our greatest seen height
@@ -611,20 +798,28 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
         return false;
     }
 
-    // Feerates are stored and reported as BTC-per-kb:
-    CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
-
-    feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    state->feeStats->Record(blocksToConfirm, tx.feeRate);
+    state->shortStats->Record(blocksToConfirm, tx.feeRate);
+    state->longStats->Record(blocksToConfirm, tx.feeRate);
     return true;
 }
 
 void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
                                          std::vector<const CTxMemPoolEntry*>& entries)
 {
-    LOCK(cs_feeEstimator);
-    if (nBlockHeight <= nBestSeenHeight) {
+    Event event(Event::BLOCK);
+    event.nBlockHeight = nBlockHeight;
+    event.vBlockTxs.reserve(entries.size());
+    for (const auto& entry : entries) {
+        event.vBlockTxs.emplace_back(*entry);
+    }
+    QueueEvent(std::move(event));
+}
+
+void CBlockPolicyEstimator::processBlockLocked(unsigned int nBlockHeight, const std::vector<TxFeeInfo>& vBlockTxs)
+{
+    AssertLockHeld(cs_feeEstimator);
+    if (nBlockHeight <= state->nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random
         // they don't affect the estimate.
         // And if an attacker can re-org the chain at will, then
@@ -636,34 +831,34 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // Must update nBestSeenHeight in sync with ClearCurrent so that
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
-    nBestSeenHeight = nBlockHeight;
+    state->nBestSeenHeight = nBlockHeight;
 
     // Update unconfirmed circular buffer
-    feeStats->ClearCurrent(nBlockHeight);
-    shortStats->ClearCurrent(nBlockHeight);
-    longStats->ClearCurrent(nBlockHeight);
+    state->feeStats->ClearCurrent(nBlockHeight);
+    state->shortStats->ClearCurrent(nBlockHeight);
+    state->longStats->ClearCurrent(nBlockHeight);
 
     // Decay all exponential averages
-    feeStats->UpdateMovingAverages();
-    shortStats->UpdateMovingAverages();
-    longStats->UpdateMovingAverages();
+    state->feeStats->UpdateMovingAverages();
+    state->shortStats->UpdateMovingAverages();
+    state->longStats->UpdateMovingAverages();
 
     unsigned int countedTxs = 0;
     // Update averages with data points from current block
-    for (const auto& entry : entries) {
-        if (processBlockTx(nBlockHeight, entry))
+    for (const auto& tx : vBlockTxs) {
+        if (processBlockTx(nBlockHeight, tx))
             countedTxs++;
     }
 
-    if (firstRecordedHeight == 0 && countedTxs > 0) {
-        firstRecordedHeight = nBestSeenHeight;
-        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy first recorded height %u\n", firstRecordedHeight);
+    if (state->firstRecordedHeight == 0 && countedTxs > 0) {
+        state->firstRecordedHeight = state->nBestSeenHeight;
+        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy first recorded height %u\n", state->firstRecordedHeight);
     }
 
 
     LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy estimates updated by %u of %u block txs, since last block %u of %u tracked, mempool map size %u, max target %u from %s\n",
-             countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
-             MaxUsableEstimate(), HistoricalBlockSpan() > BlockSpan() ? "historical" : "current");
+             countedTxs, vBlockTxs.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
+             state->MaxUsableEstimate(), state->HistoricalBlockSpan() > state->BlockSpan() ? "historical" : "current");
 
     trackedTxs = 0;
     untrackedTxs = 0;
@@ -680,20 +875,21 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
 
 CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult* result) const
 {
+    std::shared_ptr<const EstimatorState> estimates = GetPublished();
     TxConfirmStats* stats;
     double sufficientTxs = SUFFICIENT_FEETXS;
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        stats = shortStats;
+        stats = estimates->shortStats.get();
         sufficientTxs = SUFFICIENT_TXS_SHORT;
         break;
     }
     case FeeEstimateHorizon::MED_HALFLIFE: {
-        stats = feeStats;
+        stats = estimates->feeStats.get();
         break;
     }
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        stats = longStats;
+        stats = estimates->longStats.get();
         break;
     }
     default: {
@@ -701,14 +897,13 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
     }
     }
 
-    LOCK(cs_feeEstimator);
     // Return failure if trying to analyze a target we're not tracking
     if (confTarget <= 0 || (unsigned int)confTarget > stats->GetMaxConfirms())
         return CFeeRate(0);
     if (successThreshold > 1)
         return CFeeRate(0);
 
-    double median = stats->EstimateMedianVal(confTarget, sufficientTxs, successThreshold, true, nBestSeenHeight, result);
+    double median = stats->EstimateMedianVal(confTarget, sufficientTxs, successThreshold, true, estimates->nBestSeenHeight, result);
 
     if (median < 0)
         return CFeeRate(0);
@@ -718,15 +913,16 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
 
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
+    std::shared_ptr<const EstimatorState> estimates = GetPublished();
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        return shortStats->GetMaxConfirms();
+        return estimates->shortStats->GetMaxConfirms();
     }
     case FeeEstimateHorizon::MED_HALFLIFE: {
-        return feeStats->GetMaxConfirms();
+        return estimates->feeStats->GetMaxConfirms();
     }
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        return longStats->GetMaxConfirms();
+        return estimates->longStats->GetMaxConfirms();
     }
     default: {
         throw std::out_of_range("CBlockPolicyEstimator::HighestTargetTracked unknown FeeEstimateHorizon");
@@ -734,7 +930,7 @@ unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon hori
     }
 }
 
-unsigned int CBlockPolicyEstimator::BlockSpan() const
+unsigned int CBlockPolicyEstimator::EstimatorState::BlockSpan() const
 {
     if (firstRecordedHeight == 0) return 0;
     assert(nBestSeenHeight >= firstRecordedHeight);
@@ -742,7 +938,7 @@ unsigned int CBlockPolicyEstimator::BlockSpan() const
     return nBestSeenHeight - firstRecordedHeight;
 }
 
-unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
+unsigned int CBlockPolicyEstimator::EstimatorState::HistoricalBlockSpan() const
 {
     if (historicalFirst == 0) return 0;
     assert(historicalBest >= historicalFirst);
@@ -752,7 +948,7 @@ unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
     return historicalBest - historicalFirst;
 }
 
-unsigned int CBlockPolicyEstimator::MaxUsableEstimate() const
+unsigned int CBlockPolicyEstimator::EstimatorState::MaxUsableEstimate() const
 {
     // Block spans are divided by 2 to make sure there are enough potential failing data points for the estimate
     return std::min(longStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
@@ -762,7 +958,7 @@ unsigned int CBlockPolicyEstimator::MaxUsableEstimate() const
  * time horizon which tracks confirmations up to the desired target.  If
  * checkShorterHorizon is requested, also allow short time horizon estimates
  * for a lower target to reduce the given answer */
-double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
+double CBlockPolicyEstimator::EstimatorState::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
 {
     double estimate = -1;
     if (confTarget >= 1 && confTarget <= longStats->GetMaxConfirms()) {
@@ -801,7 +997,7 @@ double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, doubl
 /** Ensure that for a conservative estimate, the DOUBLE_SUCCESS_PCT is also met
  * at 2 * target for any longer time horizons.
  */
-double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
+double CBlockPolicyEstimator::EstimatorState::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
 {
     double estimate = -1;
     EstimationResult tempResult;
@@ -827,7 +1023,7 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(cs_feeEstimator);
+    std::shared_ptr<const EstimatorState> estimates = GetPublished();
 
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
@@ -838,14 +1034,14 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     EstimationResult tempResult;
 
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+    if (confTarget <= 0 || (unsigned int)confTarget > estimates->longStats->GetMaxConfirms()) {
         return CFeeRate(0);  // error condition
     }
 
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget == 1) confTarget = 2;
 
-    unsigned int maxUsableEstimate = MaxUsableEstimate();
+    unsigned int maxUsableEstimate = estimates->MaxUsableEstimate();
     if ((unsigned int)confTarget > maxUsableEstimate) {
         confTarget = maxUsableEstimate;
     }
@@ -864,13 +1060,13 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * the purpose of conservative estimates is not to let short term
      * fluctuations lower our estimates by too much.
      */
-    double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
+    double halfEst = estimates->estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
     if (feeCalc) {
         feeCalc->est = tempResult;
         feeCalc->reason = FeeReason::HALF_ESTIMATE;
     }
     median = halfEst;
-    double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
+    double actualEst = estimates->estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
         if (feeCalc) {
@@ -878,7 +1074,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
             feeCalc->reason = FeeReason::FULL_ESTIMATE;
         }
     }
-    double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
+    double doubleEst = estimates->estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
         if (feeCalc) {
@@ -888,7 +1084,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     }
 
     if (conservative || median == -1) {
-        double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
+        double consEst =  estimates->estimateConservativeFee(2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
             if (feeCalc) {
@@ -904,23 +1100,24 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 }
 
 
-bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
+bool CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
     try {
         LOCK(cs_feeEstimator);
+        ProcessQueueLocked();
         fileout << 140100; // version required to read: 5.0.99 or later
         fileout << CLIENT_VERSION; // version that wrote the file
-        fileout << nBestSeenHeight;
-        if (BlockSpan() > HistoricalBlockSpan()/2) {
-            fileout << firstRecordedHeight << nBestSeenHeight;
+        fileout << state->nBestSeenHeight;
+        if (state->BlockSpan() > state->HistoricalBlockSpan()/2) {
+            fileout << state->firstRecordedHeight << state->nBestSeenHeight;
         }
         else {
-            fileout << historicalFirst << historicalBest;
+            fileout << state->historicalFirst << state->historicalBest;
         }
-        fileout << buckets;
-        feeStats->Write(fileout);
-        shortStats->Write(fileout);
-        longStats->Write(fileout);
+        fileout << state->buckets;
+        state->feeStats->Write(fileout);
+        state->shortStats->Write(fileout);
+        state->longStats->Write(fileout);
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -933,6 +1130,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
 {
     try {
         LOCK(cs_feeEstimator);
+        ProcessQueueLocked();
         int nVersionRequired, nVersionThatWrote;
         unsigned int nFileBestSeenHeight, nFileHistoricalFirst, nFileHistoricalBest;
         filein >> nVersionRequired >> nVersionThatWrote;
@@ -979,32 +1177,24 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             if (numBuckets <= 1 || numBuckets > 1000)
                 throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 feerate buckets");
 
-            std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
-            std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
-            std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
-            fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
-            fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
-            fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
-
-            // Fee estimates file parsed correctly
-            // Copy buckets from file and refresh our bucketmap
-            buckets = fileBuckets;
-            bucketMap.clear();
-            for (unsigned int i = 0; i < buckets.size(); i++) {
-                bucketMap[buckets[i]] = i;
+            std::unique_ptr<EstimatorState> fileState(new EstimatorState());
+            fileState->buckets = fileBuckets;
+            for (unsigned int i = 0; i < fileBuckets.size(); i++) {
+                fileState->bucketMap[fileBuckets[i]] = i;
             }
+            fileState->feeStats.reset(new TxConfirmStats(fileState->buckets, fileState->bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+            fileState->shortStats.reset(new TxConfirmStats(fileState->buckets, fileState->bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+            fileState->longStats.reset(new TxConfirmStats(fileState->buckets, fileState->bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+            fileState->feeStats->Read(filein, nVersionThatWrote, numBuckets);
+            fileState->shortStats->Read(filein, nVersionThatWrote, numBuckets);
+            fileState->longStats->Read(filein, nVersionThatWrote, numBuckets);
 
-            // Destroy old TxConfirmStats and point to new ones that already reference buckets and bucketMap
-            delete feeStats;
-            delete shortStats;
-            delete longStats;
-            feeStats = fileFeeStats.release();
-            shortStats = fileShortStats.release();
-            longStats = fileLongStats.release();
-
-            nBestSeenHeight = nFileBestSeenHeight;
-            historicalFirst = nFileHistoricalFirst;
-            historicalBest = nFileHistoricalBest;
+            // Fee estimates file parsed correctly
+            fileState->nBestSeenHeight = nFileBestSeenHeight;
+            fileState->historicalFirst = nFileHistoricalFirst;
+            fileState->historicalBest = nFileHistoricalBest;
+            state = std::move(fileState);
+            PublishLocked();
         }
     }
     catch (const std::exception& e) {
@@ -1019,8 +1209,9 @@ void CBlockPolicyEstimator::FlushUnconfirmed(CTxMemPool& pool) {
     std::vector<uint256> txids;
     pool.queryHashes(txids);
     LOCK(cs_feeEstimator);
+    ProcessQueueLocked();
     for (auto& txid : txids) {
-        removeTx(txid, false);
+        removeTxLocked(txid, false);
     }
     int64_t endclear = GetTimeMicros();
     LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %ld micros\n",txids.size(), endclear - startclear);
@@ -12,10 +12,15 @@
 #include "random.h"
 #include "sync.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CAutoFile;
 class CFeeRate;
 class CTxMemPoolEntry;
@@ -65,6 +70,13 @@ class TxConfirmStats;
  * outstanding and use both of these numbers to increase the number of transactions
  * we've seen in that feerate bucket when calculating an estimate for any number
  * of confirmations below the number of blocks they've been outstanding.
+ *
+ * The mempool reports transactions and blocks through an event queue, so updating
+ * the stats doesn't hold up the validation thread. The queue is processed by a
+ * background thread (see ThreadProcessEvents), or by the caller if it isn't
+ * running. Estimates are calculated from an immutable copy of the stats which is
+ * published after each block and after removals of tracked transactions, so they
+ * don't wait for the queue either.
  */
 
 /* Identifier for each of the 3 different TxConfirmStats which will track
@@ -199,7 +211,7 @@ public:
     void processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate);
 
     /** Remove a transaction from the mempool tracking stats*/
-    bool removeTx(uint256 hash, bool inBlock);
+    void removeTx(uint256 hash, bool inBlock);
 
     /** DEPRECATED. Return a feerate estimate */
     CFeeRate estimateFee(int confTarget) const;
@@ -218,7 +230,7 @@ public:
     CFeeRate estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult *result = nullptr) const;
 
     /** Write estimation data to a file */
-    bool Write(CAutoFile& fileout) const;
+    bool Write(CAutoFile& fileout);
 
     /** Read estimation data from a file */
     bool Read(CAutoFile& filein);
@@ -229,12 +241,13 @@ public:
     /** Calculation of highest target that estimates are tracked for */
     unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
 
-private:
-    unsigned int nBestSeenHeight;
-    unsigned int firstRecordedHeight;
-    unsigned int historicalFirst;
-    unsigned int historicalBest;
+    /** Process the event queue until interrupted. Events are processed by the caller while this isn't running */
+    void ThreadProcessEvents();
 
+    /** Process the events queued so far */
+    void SyncWithQueue();
+
+private:
     struct TxStatsInfo
     {
         unsigned int blockHeight;
@@ -242,35 +255,65 @@ private:
         TxStatsInfo() : blockHeight(0), bucketIndex(0) {}
     };
 
+    /** Fee estimation data of a transaction */
+    struct TxFeeInfo
+    {
+        uint256 hash;
+        unsigned int nHeight;
+        double feeRate; //!< in satoshis per kB
+        TxFeeInfo() : nHeight(0), feeRate(0) {}
+        explicit TxFeeInfo(const CTxMemPoolEntry& entry);
+    };
+
+    struct Event
+    {
+        enum Type : uint8_t {
+            TX_ADDED,
+            TX_REMOVED,
+            BLOCK,
+        } type;
+        TxFeeInfo tx;                   //!< TX_ADDED and TX_REMOVED (hash only)
+        bool fFlag;                     //!< validFeeEstimate for TX_ADDED, inBlock for TX_REMOVED
+        unsigned int nBlockHeight;      //!< BLOCK
+        std::vector<TxFeeInfo> vBlockTxs; //!< BLOCK, the block transactions which were in the mempool
+        explicit Event(Type typeIn) : type(typeIn), fFlag(false), nBlockHeight(0) {}
+    };
+
+    /** Stats and block heights the estimates are calculated from, defined in fees.cpp */
+    struct EstimatorState;
+
+    mutable CCriticalSection cs_feeEstimator;
+
+    // The following are protected by cs_feeEstimator
+    std::unique_ptr<EstimatorState> state;
+
     // map of txids to information about that transaction
     std::map<uint256, TxStatsInfo> mapMemPoolTxs;
 
-    /** Classes to track historical data on transaction confirmations */
-    TxConfirmStats* feeStats;
-    TxConfirmStats* shortStats;
-    TxConfirmStats* longStats;
-
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
 
-    std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
-    std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
-
-    mutable CCriticalSection cs_feeEstimator;
-
+    /** Events not processed yet. Taken after cs_feeEstimator */
+    boost::mutex mutexQueue;
+    boost::condition_variable condQueue;
+    std::vector<Event> vQueue;
+    std::atomic<bool> fThreadRunning;
+
+    /** The copy of state estimates are calculated from */
+    mutable CCriticalSection cs_published;
+    std::shared_ptr<const EstimatorState> published;
+
+    void QueueEvent(Event&& event);
+    /** Process the queued events, publishing the state if a block or a removal of a tracked tx was processed */
+    void ProcessQueueLocked();
+    void PublishLocked();
+    std::shared_ptr<const EstimatorState> GetPublished() const;
+
+    void processTransactionLocked(const TxFeeInfo& tx, bool validFeeEstimate);
+    bool removeTxLocked(const uint256& hash, bool inBlock);
+    void processBlockLocked(unsigned int nBlockHeight, const std::vector<TxFeeInfo>& vBlockTxs);
     /** Process a transaction confirmed in a block*/
-    bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
-
-    /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
-    /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
-    /** Number of blocks of data recorded while fee estimates have been running */
-    unsigned int BlockSpan() const;
-    /** Number of blocks of recorded fee estimate data represented in saved data file */
-    unsigned int HistoricalBlockSpan() const;
-    /** Calculation of highest target that reasonable estimate can be provided for */
-    unsigned int MaxUsableEstimate() const;
+    bool processBlockTx(unsigned int nBlockHeight, const TxFeeInfo& tx);
 };
 
 #endif /*BITCOIN_POLICYESTIMATOR_H */
@@ -9,6 +9,7 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "blockfilterindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -1053,6 +1054,77 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hash\"   (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash = ParseHashV(request.params[0], "blockhash");
+
+    std::string strFilterType = BlockFilterTypeName(BlockFilterType::BASIC);
+    if (!request.params[1].isNull()) {
+        strFilterType = request.params[1].get_str();
+    }
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(strFilterType, filterType)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    if (!pblockfilterindex || pblockfilterindex->GetFilterType() != filterType) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + strFilterType);
+    }
+
+    const CBlockIndex* pblockindex;
+    bool fBlockIndexed;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        pblockindex = it->second;
+
+        const CBlockIndex* pindexBest = pblockfilterindex->GetBestBlock();
+        fBlockIndexed = pindexBest && pindexBest->GetAncestor(pblockindex->nHeight) == pblockindex;
+    }
+
+    BlockFilter filter;
+    uint256 filterHeader;
+    if (!pblockfilterindex->LookupFilter(pblockindex, filter) ||
+        !pblockfilterindex->LookupFilterHeader(pblockindex, filterHeader)) {
+        std::string strErr = "Filter not found.";
+        if (!fBlockIndexed && !pblockfilterindex->IsSynced()) {
+            strErr += " Block filters are still in the process of being indexed.";
+        } else if (!fBlockIndexed) {
+            strErr += " Block is not part of the indexed chain.";
+        } else {
+            strErr += " This error is unexpected and indicates index corruption.";
+        }
+        throw JSONRPCError(RPC_MISC_ERROR, strErr);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", filterHeader.GetHex()));
+    return ret;
+}
+
 struct CCoinsStats
 {
     int nHeight;
@@ -2619,6 +2691,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getbestchainlock",       &getbestchainlock,       true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
     { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbosity|verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getblockhashes",         &getblockhashes,         true,  {"high","low"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
@@ -9,6 +9,7 @@
 #include "chain.h"
 #include "clientversion.h"
 #include "core_io.h"
+#include "crypto/common.h"
 #include "init.h"
 #include "httpserver.h"
 #include "net.h"
@@ -16,6 +17,7 @@
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -707,11 +709,6 @@ bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
     return a.second.blockHeight < b.second.blockHeight;
 }
 
-bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
-                   std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> b) {
-    return a.second.time < b.second.time;
-}
-
 UniValue getaddressmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -749,33 +746,51 @@ UniValue getaddressmempool(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > indexes;
-
-    if (!mempool.getAddressIndex(addresses, indexes)) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    // Encode each address once instead of once per delta
+    std::map<std::pair<uint160, int>, std::string> mapEncoded;
+    for (const auto& address : addresses) {
+        std::string encoded;
+        if (!getAddressFromIndex(address.second, address.first, encoded)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        }
+        mapEncoded[address] = encoded;
     }
 
-    std::sort(indexes.begin(), indexes.end(), timestampSort);
-
-    UniValue result(UniValue::VARR);
-
-    for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::iterator it = indexes.begin();
-         it != indexes.end(); it++) {
-
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.addressBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    // The deltas are copied out of the mempool address index, the result is built once mempool.cs was released
+    struct CDelta
+    {
+        const std::string* address;
+        uint256 txhash;
+        int64_t time;
+        unsigned int index;
+        CAmount amount;
+        uint256 prevhash;
+        unsigned int prevout;
+    };
+    std::vector<CDelta> deltas;
+    {
+        LOCK(mempool.cs);
+        std::vector<const CMempoolAddressDelta*> indexes;
+        mempool.getAddressIndex(addresses, indexes);
+
+        deltas.reserve(indexes.size());
+        for (const CMempoolAddressDelta* it : indexes) {
+            const std::string* address = &mapEncoded[std::make_pair(it->list->key.addressBytes, it->list->key.type)];
+            deltas.push_back(CDelta{address, it->tx->txhash, it->tx->time, it->index, it->amount, it->prevhash, it->prevout});
         }
+    }
 
+    UniValue result(UniValue::VARR);
+    for (const CDelta& it : deltas) {
         UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("address", address));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("satoshis", it->second.amount));
-        delta.push_back(Pair("timestamp", it->second.time));
-        if (it->second.amount < 0) {
-            delta.push_back(Pair("prevtxid", it->second.prevhash.GetHex()));
-            delta.push_back(Pair("prevout", (int)it->second.prevout));
+        delta.push_back(Pair("address", *it.address));
+        delta.push_back(Pair("txid", it.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)it.index));
+        delta.push_back(Pair("satoshis", it.amount));
+        delta.push_back(Pair("timestamp", it.time));
+        if (it.amount < 0) {
+            delta.push_back(Pair("prevtxid", it.prevhash.GetHex()));
+            delta.push_back(Pair("prevout", (int)it.prevout));
         }
         result.push_back(delta);
     }
@@ -850,12 +865,134 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
     return result;
 }
 
+//! Page size for getaddressdeltas and getaddresstxids when a cursor but no limit is given
+static const int DEFAULT_ADDRESS_INDEX_PAGE_SIZE = 1000;
+
+typedef std::pair<int, unsigned int> CAddressIndexPosition; //!< (height, txindex) of a transaction
+
+/** The continuation token returned by paginated address index queries, opaque to the caller */
+static std::string EncodeAddressIndexCursor(const CAddressIndexPosition& pos)
+{
+    unsigned char data[8];
+    WriteBE32(data, pos.first);
+    WriteBE32(data + 4, pos.second);
+    return HexStr(data, data + sizeof(data));
+}
+
+static bool DecodeAddressIndexCursor(const std::string& str, CAddressIndexPosition& pos)
+{
+    if (str.size() != 16 || !IsHex(str))
+        return false;
+    std::vector<unsigned char> data = ParseHex(str);
+    pos.first = ReadBE32(data.data());
+    pos.second = ReadBE32(data.data() + 4);
+    return pos.first >= 0;
+}
+
+/**
+ * Read the optional "limit" and "cursor" parameters of a paginated address index query. Returns whether the query
+ * is paginated, in which case the cursor (if any) replaces the start position.
+ */
+static bool getPaginationFromParams(const UniValue& params, int& limit, CAddressIndexPosition& pos)
+{
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return false;
+
+    limit = DEFAULT_ADDRESS_INDEX_PAGE_SIZE;
+    if (!limitValue.isNull()) {
+        limit = limitValue.get_int();
+        if (limit <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit must be positive");
+        }
+    }
+    if (!cursorValue.isNull() && !DecodeAddressIndexCursor(cursorValue.get_str(), pos)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    return true;
+}
+
+static CAddressIndexCursor* getAddressIndexCursor(const std::pair<uint160, int>& address, const CAddressIndexPosition& pos, int end)
+{
+    CAddressIndexCursor* pcursor = GetAddressIndexCursor(address.first, address.second, pos.first, pos.second, end);
+    if (!pcursor) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    return pcursor;
+}
+
+/**
+ * Read the address index entries of the addresses transaction by transaction in block order, starting at pos and
+ * ending after height end (0 for no limit). fn gets the entries of a transaction and returns false to stop before
+ * it, pos is then set to its position. Returns whether all entries were read.
+ */
+static bool ReadAddressIndexByTx(const std::vector<std::pair<uint160, int> >& addresses, CAddressIndexPosition& pos, int end,
+                                 const std::function<bool(const std::vector<std::pair<CAddressIndexKey, CAmount> >&)>& fn)
+{
+    std::vector<std::unique_ptr<CAddressIndexCursor> > cursors;
+    for (const auto& address : addresses) {
+        cursors.emplace_back(getAddressIndexCursor(address, pos, end));
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries;
+    while (true) {
+        bool fFound = false;
+        CAddressIndexPosition posTx;
+        for (const auto& pcursor : cursors) {
+            if (pcursor->Valid()) {
+                CAddressIndexPosition posCursor(pcursor->GetKey().blockHeight, pcursor->GetKey().txindex);
+                if (!fFound || posCursor < posTx) {
+                    posTx = posCursor;
+                    fFound = true;
+                }
+            }
+        }
+        if (!fFound)
+            break;
+
+        entries.clear();
+        for (const auto& pcursor : cursors) {
+            for (; pcursor->Valid() && CAddressIndexPosition(pcursor->GetKey().blockHeight, pcursor->GetKey().txindex) == posTx; pcursor->Next()) {
+                entries.emplace_back(pcursor->GetKey(), pcursor->GetValue());
+            }
+        }
+        if (!fn(entries)) {
+            pos = posTx;
+            return false;
+        }
+    }
+
+    for (const auto& pcursor : cursors) {
+        if (pcursor->Failed()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+    return true;
+}
+
+static UniValue AddressDeltaToJSON(const CAddressIndexKey& key, CAmount amount, const std::string& address)
+{
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", amount));
+    delta.push_back(Pair("txid", key.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)key.index));
+    delta.push_back(Pair("blockindex", (int)key.txindex));
+    delta.push_back(Pair("height", key.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
 UniValue getaddressdeltas(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
         throw std::runtime_error(
             "getaddressdeltas\n"
             "\nReturns all changes for an address (requires addressindex to be enabled).\n"
+            "With \"limit\" or \"cursor\" the changes of all addresses are returned in block order, one page at a time.\n"
             "\nArguments:\n"
             "{\n"
             "  \"addresses\"\n"
@@ -865,6 +1002,8 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) The number of changes per page, the changes of a transaction are not split across pages\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -877,8 +1016,14 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with \"limit\" or \"cursor\"):\n"
+            "{\n"
+            "  \"deltas\"  (array) The changes as above\n"
+            "  \"cursor\"  (string) The cursor of the next page, omitted on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"]}'")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"]}")
         );
 
@@ -896,6 +1041,10 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "End value is expected to be greater than start");
         }
     }
+    if (start <= 0 || end <= 0) {
+        start = 0;
+        end = 0;
+    }
 
     std::vector<std::pair<uint160, int> > addresses;
 
@@ -903,39 +1052,74 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::map<std::pair<uint160, int>, std::string> mapEncoded;
+    for (const auto& address : addresses) {
+        if (!getAddressFromIndex(address.second, address.first, mapEncoded[address])) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        }
+    }
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    int limit;
+    CAddressIndexPosition pos(start, 0);
+    bool fPaged = getPaginationFromParams(request.params, limit, pos);
+
+    // The deltas are written while they are read from the index, without holding all of them
+    JSONStreamWriter& stream = *request.stream;
+
+    if (!fPaged) {
+        stream.BeginArray();
+        for (const auto& address : addresses) {
+            std::unique_ptr<CAddressIndexCursor> pcursor(getAddressIndexCursor(address, pos, end));
+            for (; pcursor->Valid(); pcursor->Next()) {
+                stream.Value(AddressDeltaToJSON(pcursor->GetKey(), pcursor->GetValue(), mapEncoded[address]));
             }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+            if (pcursor->Failed()) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
+        stream.EndArray();
+        return NullUniValue;
     }
 
-    UniValue result(UniValue::VARR);
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    stream.BeginObject();
+    stream.Key("deltas");
+    stream.BeginArray();
+    int count = 0;
+    bool fComplete = ReadAddressIndexByTx(addresses, pos, end, [&](const std::vector<std::pair<CAddressIndexKey, CAmount> >& entries) {
+        if (count > 0 && count + (int)entries.size() > limit)
+            return false;
+        for (const auto& entry : entries) {
+            stream.Value(AddressDeltaToJSON(entry.first, entry.second, mapEncoded[std::make_pair(entry.first.hashBytes, (int)entry.first.type)]));
         }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        result.push_back(delta);
+        count += entries.size();
+        return true;
+    });
+    stream.EndArray();
+    if (!fComplete) {
+        stream.Key("cursor");
+        stream.Value(EncodeAddressIndexCursor(pos));
     }
+    stream.EndObject();
 
-    return result;
+    return NullUniValue;
+}
+
+/** Sum up the address index entries of an address, for when the address aggregates aren't available */
+static CAddressAggregate SumAddressIndex(const std::pair<uint160, int>& address)
+{
+    CAddressAggregate aggregate;
+    uint256 hashLastTx;
+    std::unique_ptr<CAddressIndexCursor> pcursor(getAddressIndexCursor(address, CAddressIndexPosition(0, 0), 0));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        const CAddressIndexKey& key = pcursor->GetKey();
+        aggregate.AddEntry(key, pcursor->GetValue(), key.txhash != hashLastTx);
+        aggregate.lastHeight = key.blockHeight;
+        hashLastTx = key.txhash;
+    }
+    if (pcursor->Failed()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    return aggregate;
 }
 
 UniValue getaddressbalance(const JSONRPCRequest& request)
@@ -956,6 +1140,9 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
             "{\n"
             "  \"balance\"  (string) The current balance in duffs\n"
             "  \"received\"  (string) The total number of duffs received (including change)\n"
+            "  \"txcount\"  (number) The number of transactions involving the address, summed up over the addresses\n"
+            "  \"utxocount\"  (number) The number of unspent outputs\n"
+            "  \"lastheight\"  (number) The height of the last block involving the address(es)\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"]}'")
@@ -968,27 +1155,24 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    CAddressAggregate total;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    for (const auto& address : addresses) {
+        CAddressAggregate aggregate;
+        if (!GetAddressAggregate(address.first, address.second, aggregate)) {
+            // The aggregates are not built yet
+            aggregate = SumAddressIndex(address);
         }
-    }
-
-    CAmount balance = 0;
-    CAmount received = 0;
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
-        }
-        balance += it->second;
+        total.Apply(aggregate, false);
+        total.lastHeight = std::max(total.lastHeight, aggregate.lastHeight);
     }
 
     UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("balance", balance));
-    result.push_back(Pair("received", received));
+    result.push_back(Pair("balance", total.balance));
+    result.push_back(Pair("received", total.received));
+    result.push_back(Pair("txcount", total.txCount));
+    result.push_back(Pair("utxocount", total.utxoCount));
+    result.push_back(Pair("lastheight", total.lastHeight));
 
     return result;
 
@@ -1000,6 +1184,7 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         throw std::runtime_error(
             "getaddresstxids\n"
             "\nReturns the txids for an address(es) (requires addressindex to be enabled).\n"
+            "With \"limit\" or \"cursor\" the txids are returned in block order, one page at a time.\n"
             "\nArguments:\n"
             "{\n"
             "  \"addresses\"\n"
@@ -1009,14 +1194,22 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) The number of txids per page\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with \"limit\" or \"cursor\"):\n"
+            "{\n"
+            "  \"txids\"  (array) The transaction ids as above\n"
+            "  \"cursor\"  (string) The cursor of the next page, omitted on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"]}'")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"idFcVh28YpxoCdJhiVjmsUn1Cq9rpJ6KP6\"]}")
         );
 
@@ -1036,45 +1229,66 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             end = endValue.get_int();
         }
     }
-
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    if (start <= 0 || end <= 0) {
+        start = 0;
+        end = 0;
     }
 
-    std::set<std::pair<int, std::string> > txids;
-    UniValue result(UniValue::VARR);
+    int limit;
+    CAddressIndexPosition pos(start, 0);
+    bool fPaged = getPaginationFromParams(request.params, limit, pos);
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        int height = it->first.blockHeight;
-        std::string txid = it->first.txhash.GetHex();
+    // The txids are written while they are read from the index, without holding all of them
+    JSONStreamWriter& stream = *request.stream;
 
-        if (addresses.size() > 1) {
-            txids.insert(std::make_pair(height, txid));
-        } else {
-            if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
+    if (!fPaged) {
+        // The txids of several addresses are sorted by height, then txid
+        int height = -1;
+        std::set<std::string> txids;
+
+        stream.BeginArray();
+        ReadAddressIndexByTx(addresses, pos, end, [&](const std::vector<std::pair<CAddressIndexKey, CAmount> >& entries) {
+            const CAddressIndexKey& key = entries.front().first;
+            if (addresses.size() == 1) {
+                stream.Value(key.txhash.GetHex());
+                return true;
             }
+            if (key.blockHeight != height) {
+                for (const std::string& txid : txids) {
+                    stream.Value(txid);
+                }
+                txids.clear();
+                height = key.blockHeight;
+            }
+            txids.insert(key.txhash.GetHex());
+            return true;
+        });
+        for (const std::string& txid : txids) {
+            stream.Value(txid);
         }
+        stream.EndArray();
+        return NullUniValue;
     }
 
-    if (addresses.size() > 1) {
-        for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
-            result.push_back(it->second);
-        }
+    stream.BeginObject();
+    stream.Key("txids");
+    stream.BeginArray();
+    int count = 0;
+    bool fComplete = ReadAddressIndexByTx(addresses, pos, end, [&](const std::vector<std::pair<CAddressIndexKey, CAmount> >& entries) {
+        if (count == limit)
+            return false;
+        stream.Value(entries.front().first.txhash.GetHex());
+        count++;
+        return true;
+    });
+    stream.EndArray();
+    if (!fComplete) {
+        stream.Key("cursor");
+        stream.Value(EncodeAddressIndexCursor(pos));
     }
+    stream.EndObject();
 
-    return result;
-
+    return NullUniValue;
 }
 
 UniValue getspentinfo(const JSONRPCRequest& request)
@@ -61,6 +61,77 @@ UniValue JSONRPCError(int code, const std::string& message)
     return error;
 }
 
+void JSONStreamWriter::Separate()
+{
+    fStarted = true;
+    if (fAfterKey) {
+        fAfterKey = false;
+    } else if (!vFirst.empty()) {
+        if (!vFirst.back())
+            buffer += ',';
+        vFirst.back() = false;
+    }
+}
+
+void JSONStreamWriter::MaybeFlush()
+{
+    if (buffer.size() >= JSON_STREAM_CHUNK_SIZE)
+        Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    buffer += '{';
+    vFirst.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    buffer += '}';
+    vFirst.pop_back();
+    MaybeFlush();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    buffer += '[';
+    vFirst.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    buffer += ']';
+    vFirst.pop_back();
+    MaybeFlush();
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    Separate();
+    buffer += UniValue(key).write();
+    buffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    buffer += value.write();
+    MaybeFlush();
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (!buffer.empty()) {
+        sink(buffer);
+        buffer.clear();
+    }
+}
+
 /** Username used when cookie authentication is in use (arbitrary, only for
  * recognizability in debugging/logging purposes)
  */
@@ -9,10 +9,12 @@
 
 #include "fs.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <univalue.h>
 
@@ -92,6 +94,42 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
+/**
+ * Writes a JSON document as text while it is produced, for RPC results too large to be built as a UniValue first.
+ * The structure is written with Begin/End and Key, the leaves as UniValues. The text is passed to the sink in chunks
+ * of about JSON_STREAM_CHUNK_SIZE bytes, the rest on Flush.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+    static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+    explicit JSONStreamWriter(Sink sinkIn) : sink(sinkIn), fStarted(false), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    void Flush();
+
+    //! Whether anything was written yet
+    bool IsStarted() const { return fStarted; }
+
+private:
+    Sink sink;
+    std::string buffer;
+    //! For each open object or array, whether no element was written to it yet
+    std::vector<bool> vFirst;
+    bool fStarted;
+    bool fAfterKey;
+
+    void Separate();
+    void MaybeFlush();
+};
+
 /** Generate a new RPC authentication cookie and write it to disk */
 bool GenerateAuthCookie(std::string *cookie_out);
 /** Read the RPC authentication cookie from disk */
@@ -1112,6 +1112,36 @@ UniValue protx_diff(const JSONRPCRequest& request)
     return ret;
 }
 
+[[ noreturn ]] void protx_diffcacheinfo_help()
+{
+    throw std::runtime_error(
+            "protx diffcacheinfo\n"
+            "\nReturns statistics about the cache of masternode list diffs served to SPV clients and\n"
+            "returned by \"protx diff\".\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": n,       (numeric) Number of cached diffs\n"
+            "  \"usage\": n,         (numeric) Approximate memory used by cached diffs in bytes\n"
+            "  \"maxUsage\": n,      (numeric) Memory limit of the cache in bytes\n"
+            "  \"hits\": n,          (numeric) Number of diffs served from the cache\n"
+            "  \"misses\": n,        (numeric) Number of diffs that had to be built\n"
+            "  \"evictions\": n,     (numeric) Number of diffs evicted due to the memory limit\n"
+            "  \"hitRate\": x.xxx    (numeric) hits / (hits + misses)\n"
+            "}\n"
+    );
+}
+
+UniValue protx_diffcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        protx_diffcacheinfo_help();
+    }
+
+    UniValue ret;
+    mnListDiffCache.ToJson(ret);
+    return ret;
+}
+
 [[ noreturn ]] void protx_help()
 {
     throw std::runtime_error(
@@ -1135,6 +1165,7 @@ UniValue protx_diff(const JSONRPCRequest& request)
             "  revoke            - Create and send ProUpRevTx to network\n"
 #endif
             "  diff              - Calculate a diff and a proof between two masternode lists\n"
+            "  diffcacheinfo     - Return statistics about the cache of masternode list diffs\n"
     );
 }
 
@@ -1168,6 +1199,8 @@ UniValue protx(const JSONRPCRequest& request)
         return protx_info(request);
     } else if (command == "diff") {
         return protx_diff(request);
+    } else if (command == "diffcacheinfo") {
+        return protx_diffcacheinfo(request);
     } else {
         protx_help();
     }
@@ -11,6 +11,7 @@
 #include "llmq/quorums_blockprocessor.h"
 #include "llmq/quorums_debug.h"
 #include "llmq/quorums_dkgsession.h"
+#include "llmq/quorums_instantsend.h"
 #include "llmq/quorums_signing.h"
 
 void quorum_list_help()
@@ -430,10 +431,46 @@ UniValue quorum(const JSONRPCRequest& request)
     }
 }
 
+UniValue getinstantsendinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getinstantsendinfo\n"
+            "Returns details about the in-memory index of unconfirmed InstantSend locks and the cleanup of\n"
+            "fully confirmed locks.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"unconfirmedindex\": {\n"
+            "    \"count\": xxxxx,            (numeric) Number of islocks held in memory\n"
+            "    \"usage\": xxxxx,            (numeric) Estimated memory usage of the index in bytes\n"
+            "    \"maxusage\": xxxxx,         (numeric) Memory budget of the index in bytes (see -instantsendindexsize)\n"
+            "    \"evicted\": xxxxx           (numeric) Number of islocks evicted because the budget was exceeded\n"
+            "  },\n"
+            "  \"cleanup\": {\n"
+            "    \"blocks\": xxxxx,           (numeric) Number of fully confirmed blocks handled\n"
+            "    \"lastblocktime\": xxxxx,    (numeric) Time spent handling the last fully confirmed block in microseconds\n"
+            "    \"maxblocktime\": xxxxx,     (numeric) Maximum time spent handling a fully confirmed block in microseconds\n"
+            "    \"avgblocktime\": xxxxx,     (numeric) Average time spent handling a fully confirmed block in microseconds\n"
+            "    \"batches\": xxxxx,          (numeric) Number of background cleanup batches\n"
+            "    \"lastbatchtime\": xxxxx,    (numeric) Duration of the last cleanup batch in microseconds\n"
+            "    \"avgbatchtime\": xxxxx,     (numeric) Average duration of a cleanup batch in microseconds\n"
+            "    \"removedconfirmed\": xxxxx, (numeric) Number of fully confirmed islocks removed\n"
+            "    \"pendingheight\": xxxxx     (numeric) Height up to which islocks are still waiting to be removed, -1 if none\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getinstantsendinfo", "")
+            + HelpExampleRpc("getinstantsendinfo", "")
+        );
+
+    return llmq::quorumInstantSendManager->GetInstantSendInfo();
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "evo",                "quorum",                 &quorum,                 false, {}  },
+    { "evo",                "getinstantsendinfo",     &getinstantsendinfo,     true,  {}  },
 };
 
 void RegisterQuorumsRPCCommands(CRPCTable &tableRPC)
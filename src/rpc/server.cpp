@@ -553,11 +553,21 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     try
     {
         // Execute, convert arguments to array if necessary
-        if (request.params.isObject()) {
-            return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
-        } else {
-            return pcmd->actor(request);
+        JSONRPCRequest jreq = request.params.isObject() ? transformNamedArguments(request, pcmd->argNames) : request;
+
+        // Collect a streamed result when the caller can't take it directly
+        std::string strStreamed;
+        JSONStreamWriter writer([&strStreamed](const std::string& str) { strStreamed += str; });
+        if (!jreq.stream)
+            jreq.stream = &writer;
+
+        UniValue result = pcmd->actor(jreq);
+        if (writer.IsStarted()) {
+            writer.Flush();
+            if (!result.read(strStreamed))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Invalid streamed result");
         }
+        return result;
     }
     catch (const std::exception& e)
     {
@@ -45,8 +45,13 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /**
+     * Large results may be written here instead of being returned, the handler then returns NullUniValue. Set
+     * by the HTTP server to write straight into the reply, otherwise CRPCTable::execute collects the result.
+     */
+    JSONStreamWriter* stream;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), stream(nullptr) {}
     void parse(const UniValue& valRequest);
 };
 
@@ -9,6 +9,7 @@
 
 #include "uint256.h"
 #include "amount.h"
+#include "saltedhasher.h"
 #include "script/script.h"
 #include "serialize.h"
 
@@ -38,6 +39,9 @@ struct CSpentIndexKey {
         outputIndex = 0;
     }
 
+    friend bool operator==(const CSpentIndexKey& a, const CSpentIndexKey& b) {
+        return a.txid == b.txid && a.outputIndex == b.outputIndex;
+    }
 };
 
 struct CSpentIndexValue {
@@ -98,6 +102,15 @@ struct CSpentIndexKeyCompare
     }
 };
 
+template<>
+struct SaltedHasherImpl<CSpentIndexKey>
+{
+    static std::size_t CalcHash(const CSpentIndexKey& v, uint64_t k0, uint64_t k1)
+    {
+        return SipHashUint256Extra(k0, k1, v.txid, v.outputIndex);
+    }
+};
+
 struct CSpentIndexTxInfo
 {
     std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mSpentInfo;
@@ -305,6 +318,63 @@ struct CAddressIndexKey {
 
 };
 
+/**
+ * Totals over the address index entries of one address, kept up to date as blocks are connected and disconnected so
+ * they don't need to be summed up for every query.
+ */
+struct CAddressAggregate {
+    CAmount balance;
+    CAmount received;
+    int64_t txCount;
+    int64_t utxoCount;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+        READWRITE(utxoCount);
+        READWRITE(lastHeight);
+    }
+
+    CAddressAggregate() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        utxoCount = 0;
+        lastHeight = 0;
+    }
+
+    //! Account for an address index entry. fNewTx is false for further entries of the same transaction
+    void AddEntry(const CAddressIndexKey& key, CAmount amount, bool fNewTx) {
+        balance += amount;
+        if (key.spending) {
+            utxoCount--;
+        } else {
+            received += amount;
+            utxoCount++;
+        }
+        if (fNewTx)
+            txCount++;
+    }
+
+    //! Add the totals of other, or subtract them when fUndo. lastHeight is left to the caller
+    void Apply(const CAddressAggregate& other, bool fUndo) {
+        int sign = fUndo ? -1 : 1;
+        balance += sign * other.balance;
+        received += sign * other.received;
+        txCount += sign * other.txCount;
+        utxoCount += sign * other.utxoCount;
+    }
+};
+
 struct CAddressIndexIteratorKey {
     unsigned int type;
     uint160 hashBytes;
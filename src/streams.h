@@ -16,6 +16,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -96,6 +97,166 @@ private:
     size_t nPos;
 };
 
+/* Minimal stream for reading from an existing byte vector by reference
+ */
+class CVectorReader
+{
+private:
+    const int nType;
+    const int nVersion;
+    const std::vector<unsigned char>& vchData;
+    size_t nPos;
+
+public:
+
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  vchDataIn  Referenced byte vector to read from
+ * @param[in]  nPosIn Starting position. Vector index where reads should start.
+*/
+    CVectorReader(int nTypeIn, int nVersionIn, const std::vector<unsigned char>& vchDataIn, size_t nPosIn) : nType(nTypeIn), nVersion(nVersionIn), vchData(vchDataIn), nPos(nPosIn)
+    {
+        if (nPos > vchData.size()) {
+            throw std::ios_base::failure("CVectorReader(...): end of data (nPos > vchData.size())");
+        }
+    }
+
+    template<typename T>
+    CVectorReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const
+    {
+        return vchData.size() - nPos;
+    }
+    bool empty() const
+    {
+        return vchData.size() == nPos;
+    }
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        // Read from the beginning of the buffer
+        size_t nPosNext = nPos + n;
+        if (nPosNext > vchData.size()) {
+            throw std::ios_base::failure("CVectorReader::read(): end of data");
+        }
+        memcpy(dst, vchData.data() + nPos, n);
+        nPos = nPosNext;
+    }
+};
+
+/* Reads single bits from a byte stream, most significant bit first
+ */
+template <typename IStream>
+class CBitStreamReader
+{
+private:
+    IStream& istream;
+    /// Buffered byte read in from the input stream. A new byte is read into the buffer when nOffset reaches 8.
+    uint8_t nBuffer{0};
+    /// Number of high order bits in nBuffer already returned by previous Read() calls
+    int nOffset{8};
+
+public:
+    explicit CBitStreamReader(IStream& istreamIn) : istream(istreamIn) {}
+
+    /** Read the specified number of bits from the stream. The data is returned in the nbits least significant
+     *  bits of a 64-bit uint.
+     */
+    uint64_t Read(int nbits)
+    {
+        if (nbits < 0 || nbits > 64) {
+            throw std::out_of_range("nbits must be between 0 and 64");
+        }
+
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (nOffset == 8) {
+                istream >> nBuffer;
+                nOffset = 0;
+            }
+
+            int bits = std::min(8 - nOffset, nbits);
+            data <<= bits;
+            data |= static_cast<uint8_t>(nBuffer << nOffset) >> (8 - bits);
+            nOffset += bits;
+            nbits -= bits;
+        }
+        return data;
+    }
+};
+
+/* Writes single bits to a byte stream, most significant bit first
+ */
+template <typename OStream>
+class CBitStreamWriter
+{
+private:
+    OStream& ostream;
+    /// Buffered byte waiting to be written to the output stream. The byte is written when nOffset reaches 8 or
+    /// Flush() is called.
+    uint8_t nBuffer{0};
+    /// Number of high order bits in nBuffer already written by previous Write() calls and not yet flushed
+    int nOffset{0};
+
+public:
+    explicit CBitStreamWriter(OStream& ostreamIn) : ostream(ostreamIn) {}
+
+    ~CBitStreamWriter()
+    {
+        Flush();
+    }
+
+    /** Write the nbits least significant bits of a 64-bit int to the output stream. Data is buffered until it
+     *  completes an octet.
+     */
+    void Write(uint64_t data, int nbits)
+    {
+        if (nbits < 0 || nbits > 64) {
+            throw std::out_of_range("nbits must be between 0 and 64");
+        }
+
+        while (nbits > 0) {
+            int bits = std::min(8 - nOffset, nbits);
+            nBuffer |= (data << (64 - nbits)) >> (64 - 8 + nOffset);
+            nOffset += bits;
+            nbits -= bits;
+
+            if (nOffset == 8) {
+                Flush();
+            }
+        }
+    }
+
+    /** Flush any unwritten bits to the output stream, padding with 0's to the next byte boundary
+     */
+    void Flush()
+    {
+        if (nOffset == 0) {
+            return;
+        }
+
+        ostream << nBuffer;
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
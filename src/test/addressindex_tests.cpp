@@ -0,0 +1,100 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "txdb.h"
+
+#include "test/test_ion.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+static void CheckAggregate(CBlockTreeDB& db, const uint160& hash, CAmount balance, CAmount received, int64_t txCount, int64_t utxoCount, int lastHeight)
+{
+    CAddressAggregate aggregate;
+    BOOST_CHECK(db.ReadAddressAggregate(hash, 1, aggregate));
+    BOOST_CHECK_EQUAL(aggregate.balance, balance);
+    BOOST_CHECK_EQUAL(aggregate.received, received);
+    BOOST_CHECK_EQUAL(aggregate.txCount, txCount);
+    BOOST_CHECK_EQUAL(aggregate.utxoCount, utxoCount);
+    BOOST_CHECK_EQUAL(aggregate.lastHeight, lastHeight);
+}
+
+BOOST_AUTO_TEST_CASE(address_aggregates)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint256 hashBlocks[3];
+    CBlockIndex blocks[3];
+    for (int i = 0; i < 3; i++) {
+        hashBlocks[i] = ArithToUint256(arith_uint256(100 + i));
+        blocks[i].phashBlock = &hashBlocks[i];
+        blocks[i].nHeight = i;
+        blocks[i].pprev = i > 0 ? &blocks[i - 1] : nullptr;
+    }
+
+    uint160 hashA(std::vector<unsigned char>(20, 0xaa));
+    uint160 hashB(std::vector<unsigned char>(20, 0xbb));
+    uint256 tx1 = ArithToUint256(arith_uint256(1));
+    uint256 tx2 = ArithToUint256(arith_uint256(2));
+    uint256 tx3 = ArithToUint256(arith_uint256(3));
+
+    // Block 1: A receives two outputs of tx1, B one output of tx1 and one of tx2
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock1;
+    vBlock1.emplace_back(CAddressIndexKey(1, hashA, 1, 1, tx1, 0, false), 5 * COIN);
+    vBlock1.emplace_back(CAddressIndexKey(1, hashA, 1, 1, tx1, 1, false), 3 * COIN);
+    vBlock1.emplace_back(CAddressIndexKey(1, hashB, 1, 1, tx1, 2, false), 1 * COIN);
+    vBlock1.emplace_back(CAddressIndexKey(1, hashB, 1, 2, tx2, 0, false), 2 * COIN);
+    // Block 2: tx3 spends the first output of A and returns change to it
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock2;
+    vBlock2.emplace_back(CAddressIndexKey(1, hashA, 2, 1, tx3, 0, true), -5 * COIN);
+    vBlock2.emplace_back(CAddressIndexKey(1, hashA, 2, 1, tx3, 0, false), 4 * COIN);
+
+    BOOST_CHECK(db.WriteAddressIndex(vBlock1));
+    BOOST_CHECK(db.UpdateAddressAggregates(vBlock1, &blocks[1], false));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(db.UpdateAddressAggregates(vBlock2, &blocks[2], false));
+
+    uint256 hashBest;
+    BOOST_CHECK(db.ReadAddressAggregatesBestBlock(hashBest));
+    BOOST_CHECK(hashBest == hashBlocks[2]);
+    CheckAggregate(db, hashA, 7 * COIN, 12 * COIN, 2, 2, 2);
+    CheckAggregate(db, hashB, 3 * COIN, 3 * COIN, 2, 2, 1);
+
+    // Rebuilding from the index gives the same aggregates, also when leaving out the entries above the tip
+    BOOST_CHECK(db.RebuildAddressAggregates(&blocks[2], 4));
+    CheckAggregate(db, hashA, 7 * COIN, 12 * COIN, 2, 2, 2);
+    CheckAggregate(db, hashB, 3 * COIN, 3 * COIN, 2, 2, 1);
+    BOOST_CHECK(db.RebuildAddressAggregates(&blocks[1], 1));
+    CheckAggregate(db, hashA, 8 * COIN, 8 * COIN, 1, 2, 1);
+    BOOST_CHECK(db.ReadAddressAggregatesBestBlock(hashBest));
+    BOOST_CHECK(hashBest == hashBlocks[1]);
+
+    // Block 2 connected while rebuilding up to block 1 is applied afterwards, like SyncAddressAggregates catches up
+    BOOST_CHECK(db.UpdateAddressAggregates(vBlock2, &blocks[2], false));
+    CheckAggregate(db, hashA, 7 * COIN, 12 * COIN, 2, 2, 2);
+    CheckAggregate(db, hashB, 3 * COIN, 3 * COIN, 2, 2, 1);
+    BOOST_CHECK(db.ReadAddressAggregatesBestBlock(hashBest));
+    BOOST_CHECK(hashBest == hashBlocks[2]);
+
+    // Disconnecting block 2 restores the aggregates of block 1, including the last height
+    BOOST_CHECK(db.RebuildAddressAggregates(&blocks[2], 2));
+    BOOST_CHECK(db.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(db.UpdateAddressAggregates(vBlock2, &blocks[2], true));
+    CheckAggregate(db, hashA, 8 * COIN, 8 * COIN, 1, 2, 1);
+    CheckAggregate(db, hashB, 3 * COIN, 3 * COIN, 2, 2, 1);
+    BOOST_CHECK(db.ReadAddressAggregatesBestBlock(hashBest));
+    BOOST_CHECK(hashBest == hashBlocks[1]);
+
+    // Disconnecting block 1 removes them
+    BOOST_CHECK(db.EraseAddressIndex(vBlock1));
+    BOOST_CHECK(db.UpdateAddressAggregates(vBlock1, &blocks[1], true));
+    CAddressAggregate aggregate;
+    BOOST_CHECK(!db.ReadAddressAggregate(hashA, 1, aggregate));
+    BOOST_CHECK(!db.ReadAddressAggregate(hashB, 1, aggregate));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "undo.h"
+#include "test/test_ion.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        GCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // a filter reconstructed from its encoding behaves the same
+    GCSFilter filter2(filter.GetParams(), filter.GetEncoded());
+    BOOST_CHECK_EQUAL(filter2.GetN(), 100);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter2.Match(element));
+    }
+
+    // truncated or padded encodings are rejected
+    std::vector<unsigned char> vchTruncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 1);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), vchTruncated), std::ios_base::failure);
+    std::vector<unsigned char> vchPadded(filter.GetEncoded());
+    vchPadded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), vchPadded), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+{
+    GCSFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetN(), 0);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1);
+
+    const GCSFilter::Params& params = filter.GetParams();
+    BOOST_CHECK_EQUAL(params.nSipHashK0, 0);
+    BOOST_CHECK_EQUAL(params.nSipHashK1, 0);
+    BOOST_CHECK_EQUAL(params.nP, 0);
+    BOOST_CHECK_EQUAL(params.nM, 1);
+
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(32)));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included_scripts[5], excluded_scripts[3];
+
+    // First two are outputs on a single transaction.
+    included_scripts[0] << std::vector<unsigned char>(0, 65) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(1, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // Third is an output on in a second transaction.
+    included_scripts[2] << OP_1 << std::vector<unsigned char>(2, 33) << OP_1 << OP_CHECKMULTISIG;
+
+    // Last two are spent by a single transaction.
+    included_scripts[3] << OP_HASH160 << std::vector<unsigned char>(3, 20) << OP_EQUAL;
+    included_scripts[4] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(4, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // OP_RETURN output is an output on the second transaction.
+    excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(4, 40);
+
+    // This script is not related to the block at all.
+    excluded_scripts[1] << std::vector<unsigned char>(5, 33) << OP_CHECKSIG;
+
+    // OP_RETURN is non-standard since it's not followed by a data push, but is still excluded from
+    // filter.
+    excluded_scripts[2] << OP_RETURN << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+    CMutableTransaction tx_1;
+    tx_1.vout.emplace_back(100, included_scripts[0]);
+    tx_1.vout.emplace_back(200, included_scripts[1]);
+    tx_1.vout.emplace_back(0, excluded_scripts[0]);
+
+    CMutableTransaction tx_2;
+    tx_2.vout.emplace_back(300, included_scripts[2]);
+    tx_2.vout.emplace_back(0, excluded_scripts[2]);
+    tx_2.vout.emplace_back(400, CScript()); // Should be ignored.
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx_1));
+    block.vtx.push_back(MakeTransactionRef(tx_2));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[3]), 1000, true, false);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(600, included_scripts[4]), 10000, false, false);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(700, CScript()), 100000, false, false);
+
+    BlockFilter block_filter(BlockFilterType::BASIC, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+
+    for (const CScript& script : included_scripts) {
+        BOOST_CHECK(filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+    for (const CScript& script : excluded_scripts) {
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+
+    // Test serialization/unserialization.
+    BlockFilter block_filter2;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    stream >> block_filter2;
+
+    BOOST_CHECK(block_filter.GetFilterType() == block_filter2.GetFilterType());
+    BOOST_CHECK(block_filter.GetBlockHash() == block_filter2.GetBlockHash());
+    BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+
+    // Reconstruction from parts gives the same filter, hash and header
+    BlockFilter block_filter3(BlockFilterType::BASIC, block.GetHash(), block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter.GetHash() == block_filter3.GetHash());
+
+    uint256 prevHeader = InsecureRand256();
+    BOOST_CHECK(block_filter.ComputeHeader(prevHeader) == block_filter3.ComputeHeader(prevHeader));
+    BOOST_CHECK(block_filter.ComputeHeader(prevHeader) != block_filter.ComputeHeader(uint256()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(255)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::BASIC);
+
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
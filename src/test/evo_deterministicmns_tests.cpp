@@ -19,6 +19,7 @@
 #include "evo/specialtx.h"
 #include "evo/providertx.h"
 #include "evo/deterministicmns.h"
+#include "evo/simplifiedmns.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -453,4 +454,19 @@ BOOST_FIXTURE_TEST_CASE(dip3_protx, TestChainDIP3Setup)
 
     const_cast<Consensus::Params&>(Params().GetConsensus()).DIP0003EnforcementHeight = DIP0003EnforcementHeightBackup;
 }
+
+BOOST_FIXTURE_TEST_CASE(dip3_mnlistdiff_cache_disconnect, TestChainDIP3Setup)
+{
+    uint256 baseBlockHash = chainActive.Tip()->pprev->GetBlockHash();
+    uint256 blockHash = chainActive.Tip()->GetBlockHash();
+    auto entry = std::make_shared<CSimplifiedMNListDiffCache::Entry>();
+    mnListDiffCache.Add(baseBlockHash, blockHash, entry);
+    BOOST_CHECK(mnListDiffCache.Get(baseBlockHash, blockHash) == entry);
+
+    // Disconnecting a block drops the cached diffs
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == baseBlockHash);
+    BOOST_CHECK(mnListDiffCache.Get(baseBlockHash, blockHash) == nullptr);
+}
 BOOST_AUTO_TEST_SUITE_END()
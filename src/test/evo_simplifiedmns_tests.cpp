@@ -69,5 +69,69 @@ BOOST_AUTO_TEST_CASE(simplifiedmns_merkleroots)
     //printf("merkleRoot=\"%s\",\n", calculatedMerkleRoot.c_str());
 
     BOOST_CHECK(expectedMerkleRoot == calculatedMerkleRoot);
+
+    // the incremental tree must always match the full calculation, no matter how the list changes between calls
+    CSimplifiedMNListMerkleTree merkleTree;
+    BOOST_CHECK(merkleTree.CalcMerkleRoot(sml).ToString() == expectedMerkleRoot);
+    BOOST_CHECK(merkleTree.CalcMerkleRoot(sml).ToString() == expectedMerkleRoot);
+
+    auto checkIncremental = [&](const std::vector<CSimplifiedMNListEntry>& e) {
+        CSimplifiedMNList sml2(e);
+        bool mutated1 = false, mutated2 = false;
+        uint256 root1 = sml2.CalcMerkleRoot(&mutated1);
+        uint256 root2 = merkleTree.CalcMerkleRoot(sml2, &mutated2);
+        BOOST_CHECK(root1 == root2);
+        BOOST_CHECK(mutated1 == mutated2);
+    };
+
+    // update a single entry
+    entries[7].isValid = false;
+    checkIncremental(entries);
+    // remove entries, including the last one
+    entries.erase(entries.begin() + 3);
+    checkIncremental(entries);
+    entries.pop_back();
+    checkIncremental(entries);
+    // add an entry
+    CSimplifiedMNListEntry smle = entries[0];
+    smle.proRegTxHash.SetHex(strprintf("%064x", 100));
+    entries.emplace_back(smle);
+    checkIncremental(entries);
+    // a single entry and an empty list
+    checkIncremental(std::vector<CSimplifiedMNListEntry>(entries.begin(), entries.begin() + 1));
+    checkIncremental({});
+    checkIncremental(entries);
+}
+
+BOOST_AUTO_TEST_CASE(simplifiedmns_diffcache)
+{
+    CSimplifiedMNListDiffCache cache(1000);
+
+    uint256 a = uint256S("01"), b = uint256S("02"), c = uint256S("03");
+
+    auto entry1 = std::make_shared<CSimplifiedMNListDiffCache::Entry>();
+    entry1->vSerialized.resize(200);
+    auto entry2 = std::make_shared<CSimplifiedMNListDiffCache::Entry>();
+    entry2->vSerialized.resize(200);
+
+    BOOST_CHECK(cache.Get(a, b) == nullptr);
+    cache.Add(a, b, entry1);
+    BOOST_CHECK(cache.Get(a, b) == entry1);
+    BOOST_CHECK(cache.Get(b, a) == nullptr);
+
+    // does not fit together with entry1, so entry1 must be evicted
+    cache.Add(a, c, entry2);
+    BOOST_CHECK(cache.Get(a, c) == entry2);
+    BOOST_CHECK(cache.Get(a, b) == nullptr);
+
+    // too large to be cached at all
+    auto entry3 = std::make_shared<CSimplifiedMNListDiffCache::Entry>();
+    entry3->vSerialized.resize(1000);
+    cache.Add(b, c, entry3);
+    BOOST_CHECK(cache.Get(b, c) == nullptr);
+    BOOST_CHECK(cache.Get(a, c) == entry2);
+
+    cache.Clear();
+    BOOST_CHECK(cache.Get(a, c) == nullptr);
 }
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "governance/governance-db.h"
+
+#include "test/test_ion.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(governance_db_tests, BasicTestingSetup)
+
+static vote_rec_t MakeVoteRecord(const CGovernanceVote& vote)
+{
+    vote_rec_t voteRecord;
+    voteRecord.mapInstances[vote.GetSignal()] = vote_instance_t(vote.GetOutcome(), vote.GetTimestamp(), vote.GetTimestamp());
+    return voteRecord;
+}
+
+BOOST_AUTO_TEST_CASE(governance_db_objects_and_votes)
+{
+    CGovernanceDb db(1 << 20, true, true);
+    BOOST_CHECK(!db.IsInitialized());
+    db.WriteVersion();
+    BOOST_CHECK(db.IsInitialized());
+
+    CGovernanceObject govobj(uint256(), 1, 1000, uint256S("01"), "");
+    uint256 nHash = govobj.GetHash();
+    db.WriteObject(govobj);
+
+    COutPoint mn1(uint256S("aa"), 0);
+    COutPoint mn2(uint256S("bb"), 1);
+    CGovernanceVote vote1(mn1, nHash, VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES);
+    vote1.SetTime(100);
+    CGovernanceVote vote2(mn2, nHash, VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_NO);
+    vote2.SetTime(101);
+
+    govobj.SetCurrentMNVotes(mn1, MakeVoteRecord(vote1));
+    govobj.SetCurrentMNVotes(mn2, MakeVoteRecord(vote2));
+    db.WriteVoteChanges(govobj, {vote1, vote2}, {}, {mn1, mn2});
+
+    BOOST_CHECK(db.HasVote(nHash, vote1.GetHash()));
+    BOOST_CHECK(db.HasVote(nHash, vote2.GetHash()));
+    CGovernanceVote voteRead;
+    BOOST_CHECK(db.ReadVote(nHash, vote1.GetHash(), voteRead));
+    BOOST_CHECK(voteRead.GetHash() == vote1.GetHash());
+
+    auto fileVotes = db.ReadVoteFile(nHash);
+    BOOST_CHECK_EQUAL(fileVotes.GetVoteCount(), 2);
+    BOOST_CHECK(fileVotes.HasVote(vote2.GetHash()));
+
+    // objects are loaded with their current MN votes, but without the vote file
+    std::map<uint256, CGovernanceObject> mapObjects;
+    db.LoadObjects(mapObjects);
+    BOOST_CHECK_EQUAL(mapObjects.size(), 1);
+    BOOST_CHECK(mapObjects.count(nHash));
+    const CGovernanceObject& govobjLoaded = mapObjects.at(nHash);
+    BOOST_CHECK(!govobjLoaded.IsVoteFileLoaded());
+    vote_rec_t voteRecord;
+    BOOST_CHECK(govobjLoaded.GetCurrentMNVotes(mn1, voteRecord));
+    BOOST_CHECK(voteRecord.mapInstances.at(VOTE_SIGNAL_FUNDING).eOutcome == VOTE_OUTCOME_YES);
+    BOOST_CHECK(govobjLoaded.GetCurrentMNVotes(mn2, voteRecord));
+
+    int nVoteHashes = 0;
+    db.ForEachVoteHash([&](const uint256& nParentHash, const uint256& nVoteHash) {
+        BOOST_CHECK(nParentHash == nHash);
+        nVoteHashes++;
+    });
+    BOOST_CHECK_EQUAL(nVoteHashes, 2);
+
+    // removing the votes of a MN also removes its vote record
+    CGovernanceObject govobj2(uint256(), 1, 1000, uint256S("01"), "");
+    govobj2.SetCurrentMNVotes(mn1, MakeVoteRecord(vote1));
+    db.WriteVoteChanges(govobj2, {}, {vote2.GetHash()}, {mn2});
+    BOOST_CHECK(db.HasVote(nHash, vote1.GetHash()));
+    BOOST_CHECK(!db.HasVote(nHash, vote2.GetHash()));
+    mapObjects.clear();
+    db.LoadObjects(mapObjects);
+    BOOST_CHECK(mapObjects.at(nHash).GetCurrentMNVotes(mn1, voteRecord));
+    BOOST_CHECK(!mapObjects.at(nHash).GetCurrentMNVotes(mn2, voteRecord));
+
+    // erasing the object erases everything belonging to it
+    db.EraseObject(nHash);
+    mapObjects.clear();
+    db.LoadObjects(mapObjects);
+    BOOST_CHECK(mapObjects.empty());
+    BOOST_CHECK(!db.HasVote(nHash, vote1.GetHash()));
+    nVoteHashes = 0;
+    db.ForEachVoteHash([&](const uint256& nParentHash, const uint256& nVoteHash) {
+        nVoteHashes++;
+    });
+    BOOST_CHECK_EQUAL(nVoteHashes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(governance_votefile_removed_votes)
+{
+    uint256 nParentHash = uint256S("01");
+    COutPoint mn1(uint256S("aa"), 0);
+
+    CGovernanceVote vote1(mn1, nParentHash, VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES);
+    vote1.SetTime(100);
+    CGovernanceVote vote2(mn1, nParentHash, VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_NO);
+    vote2.SetTime(200);
+
+    CGovernanceObjectVoteFile fileVotes;
+    fileVotes.AddVote(vote1);
+    BOOST_CHECK(fileVotes.GetAndClearRemovedVotes().empty());
+
+    // a newer vote for the same signal replaces the old one, which must be reported so that the db can erase it
+    fileVotes.AddVote(vote2);
+    auto vecRemoved = fileVotes.GetAndClearRemovedVotes();
+    BOOST_CHECK_EQUAL(vecRemoved.size(), 1);
+    BOOST_CHECK(vecRemoved[0] == vote1.GetHash());
+    BOOST_CHECK(fileVotes.GetAndClearRemovedVotes().empty());
+
+    fileVotes.RemoveVotesFromMasternode(mn1);
+    vecRemoved = fileVotes.GetAndClearRemovedVotes();
+    BOOST_CHECK_EQUAL(vecRemoved.size(), 1);
+    BOOST_CHECK(vecRemoved[0] == vote2.GetHash());
+    BOOST_CHECK_EQUAL(fileVotes.GetVoteCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(governance_object_db_record_dirty)
+{
+    CGovernanceObject govobj(uint256(), 1, 1000, uint256S("01"), "");
+    BOOST_CHECK(!govobj.IsDbRecordDirty());
+
+    // only changes of the stored deletion state mark the object for the next flush
+    govobj.PrepareDeletion(2000);
+    BOOST_CHECK(govobj.IsDbRecordDirty());
+    govobj.SetDbRecordWritten();
+    govobj.PrepareDeletion(3000);
+    BOOST_CHECK(!govobj.IsDbRecordDirty());
+    BOOST_CHECK_EQUAL(govobj.GetDeletionTime(), 2000);
+
+    govobj.SetExpired();
+    BOOST_CHECK(govobj.IsDbRecordDirty());
+    govobj.SetDbRecordWritten();
+    govobj.SetExpired();
+    BOOST_CHECK(!govobj.IsDbRecordDirty());
+
+    // objects loaded from the db are clean
+    CGovernanceDb db(1 << 20, true, true);
+    db.WriteObject(govobj);
+    std::map<uint256, CGovernanceObject> mapObjects;
+    db.LoadObjects(mapObjects);
+    BOOST_CHECK(!mapObjects.at(govobj.GetHash()).IsDbRecordDirty());
+    BOOST_CHECK(mapObjects.at(govobj.GetHash()).IsSetExpired());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,178 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_ion.h"
+
+#include "governance/governance.h"
+#include "governance/governance-vote.h"
+#include "keystore.h"
+#include "netbase.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "validation.h"
+
+#include "evo/deterministicmns.h"
+#include "evo/providertx.h"
+#include "evo/specialtx.h"
+
+#include <boost/test/unit_test.hpp>
+
+struct CGovernanceManagerTest
+{
+    static void AddObject(CGovernanceManager& gov, const CGovernanceObject& govobj)
+    {
+        LOCK(gov.cs);
+        gov.mapObjects.emplace(govobj.GetHash(), govobj);
+    }
+
+    static bool HasValidVote(CGovernanceManager& gov, const uint256& nHash)
+    {
+        LOCK(gov.cs);
+        return gov.cmapVoteToObject.HasKey(nHash);
+    }
+
+    static bool HasInvalidVote(CGovernanceManager& gov, const uint256& nHash)
+    {
+        LOCK(gov.cs);
+        return gov.cmapInvalidVotes.HasKey(nHash);
+    }
+
+    static void ProcessVoteBatch(CGovernanceManager& gov, const std::vector<std::pair<CNode*, CGovernanceVote>>& vecVotes, CConnman& connman)
+    {
+        gov.ProcessVoteBatch(vecVotes, connman);
+    }
+};
+
+typedef std::map<COutPoint, std::pair<int, CAmount>> SimpleUTXOMap;
+
+static SimpleUTXOMap BuildSimpleUtxoMap(const std::vector<CTransaction>& txs)
+{
+    SimpleUTXOMap utxos;
+    for (size_t i = 0; i < txs.size(); i++) {
+        auto& tx = txs[i];
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            utxos.emplace(COutPoint(tx.GetHash(), j), std::make_pair((int)i + 1, tx.vout[j].nValue));
+        }
+    }
+    return utxos;
+}
+
+static std::vector<COutPoint> SelectUTXOs(SimpleUTXOMap& utoxs, CAmount amount, CAmount& changeRet)
+{
+    changeRet = 0;
+
+    std::vector<COutPoint> selectedUtxos;
+    CAmount selectedAmount = 0;
+    while (!utoxs.empty()) {
+        bool found = false;
+        for (auto it = utoxs.begin(); it != utoxs.end(); ++it) {
+            if (chainActive.Height() - it->second.first < 101) {
+                continue;
+            }
+
+            found = true;
+            selectedAmount += it->second.second;
+            selectedUtxos.emplace_back(it->first);
+            utoxs.erase(it);
+            break;
+        }
+        BOOST_ASSERT(found);
+        if (selectedAmount >= amount) {
+            changeRet = selectedAmount - amount;
+            break;
+        }
+    }
+
+    return selectedUtxos;
+}
+
+static void SignTransaction(CMutableTransaction& tx, const CKey& coinbaseKey)
+{
+    CBasicKeyStore tempKeystore;
+    tempKeystore.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        CTransactionRef txFrom;
+        uint256 hashBlock;
+        BOOST_ASSERT(GetTransaction(tx.vin[i].prevout.hash, txFrom, Params().GetConsensus(), hashBlock));
+        BOOST_ASSERT(SignSignature(tempKeystore, *txFrom, tx, i, SIGHASH_ALL));
+    }
+}
+
+static CMutableTransaction CreateProRegTx(SimpleUTXOMap& utxos, const CKey& coinbaseKey, CBLSSecretKey& operatorKeyRet)
+{
+    CKey ownerKey;
+    ownerKey.MakeNewKey(true);
+    operatorKeyRet.MakeNewKey();
+    CScript scriptPayout = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    CAmount change;
+    auto inputs = SelectUTXOs(utxos, MASTERNODE_COLLATERAL_AMOUNT, change);
+
+    CProRegTx proTx;
+    proTx.collateralOutpoint.n = 0;
+    proTx.addr = LookupNumeric("1.1.1.1", 1);
+    proTx.keyIDOwner = ownerKey.GetPubKey().GetID();
+    proTx.pubKeyOperator = operatorKeyRet.GetPublicKey();
+    proTx.keyIDVoting = ownerKey.GetPubKey().GetID();
+    proTx.scriptPayout = scriptPayout;
+
+    CMutableTransaction tx;
+    tx.nVersion = 3;
+    tx.nType = TRANSACTION_PROVIDER_REGISTER;
+    for (const auto& input : inputs) {
+        tx.vin.emplace_back(CTxIn(input));
+    }
+    tx.vout.emplace_back(CTxOut(MASTERNODE_COLLATERAL_AMOUNT, scriptPayout));
+    if (change != 0) {
+        tx.vout.emplace_back(CTxOut(change, scriptPayout));
+    }
+    proTx.inputsHash = CalcTxInputsHash(tx);
+    SetTxPayload(tx, proTx);
+    SignTransaction(tx, coinbaseKey);
+
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_SUITE(governance_vote_tests, TestChainDIP3Setup)
+
+BOOST_AUTO_TEST_CASE(governance_vote_batch_bad_signature)
+{
+    auto utxos = BuildSimpleUtxoMap(coinbaseTxns);
+    CBLSSecretKey operatorKey;
+    auto tx = CreateProRegTx(utxos, coinbaseKey, operatorKey);
+    CreateAndProcessBlock({tx}, coinbaseKey);
+    deterministicMNManager->UpdatedBlockTip(chainActive.Tip());
+    BOOST_ASSERT(deterministicMNManager->GetListAtChainTip().HasMN(tx.GetHash()));
+
+    // objects without data are of unknown type, so votes for them must be signed with the operator key
+    CGovernanceObject govobj(uint256(), 1, GetAdjustedTime(), uint256S("01"), "");
+    CGovernanceManagerTest::AddObject(governance, govobj);
+
+    COutPoint mnOutpoint(tx.GetHash(), 0);
+    CGovernanceVote goodVote(mnOutpoint, govobj.GetHash(), VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES);
+    BOOST_CHECK(goodVote.Sign(operatorKey));
+    CGovernanceVote badVote(mnOutpoint, govobj.GetHash(), VOTE_SIGNAL_DELETE, VOTE_OUTCOME_YES);
+    CBLSSecretKey otherKey;
+    otherKey.MakeNewKey();
+    BOOST_CHECK(badVote.Sign(otherKey));
+
+    CAddress addr(CService(), NODE_NONE);
+    CNode dummyNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true);
+    CGovernanceManagerTest::ProcessVoteBatch(governance, {std::make_pair(&dummyNode, goodVote), std::make_pair(&dummyNode, badVote)}, *connman);
+
+    // the bad vote is rejected without being processed, the good one is accepted
+    BOOST_CHECK(CGovernanceManagerTest::HasValidVote(governance, goodVote.GetHash()));
+    BOOST_CHECK(!CGovernanceManagerTest::HasInvalidVote(governance, goodVote.GetHash()));
+    BOOST_CHECK(CGovernanceManagerTest::HasInvalidVote(governance, badVote.GetHash()));
+    BOOST_CHECK(!CGovernanceManagerTest::HasValidVote(governance, badVote.GetHash()));
+
+    // a bad vote which is received again is known to be invalid
+    CGovernanceException exception;
+    BOOST_CHECK(!governance.ProcessVoteAndRelay(badVote, exception, *connman));
+
+    governance.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "crypto/common.h"
 #include "utilstrencodings.h"
 #include "test/test_ion.h"
 
@@ -150,4 +151,20 @@ BOOST_AUTO_TEST_CASE(siphash)
     BOOST_CHECK_EQUAL(SipHashUint256(1, 2, ss.GetHash()), 0x79751e980c2a0a35ULL);
 }
 
+BOOST_AUTO_TEST_CASE(x11_nonce_hasher)
+{
+    // 80 byte headers and 112 byte headers with the accumulator checkpoint after the nonce
+    for (size_t nSize : {80, 112}) {
+        std::vector<unsigned char> vchHeader(nSize);
+        for (size_t i = 0; i < nSize; i++) {
+            vchHeader[i] = InsecureRandBits(8);
+        }
+        CX11NonceHasher hasher(vchHeader, 76);
+        for (uint32_t nNonce : {0U, 1U, 0x12345678U, 0xffffffffU, InsecureRand32()}) {
+            WriteLE32(&vchHeader[76], nNonce);
+            BOOST_CHECK(hasher.Hash(nNonce) == HashX11(vchHeader.begin(), vchHeader.end()));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_ion.h"
+
+#include "arith_uint256.h"
+#include "dbwrapper.h"
+#include "hash.h"
+#include "llmq/quorums_instantsend.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace llmq;
+
+BOOST_FIXTURE_TEST_SUITE(llmq_instantsend_tests, BasicTestingSetup)
+
+static CInstantSendLock MakeLock(int n)
+{
+    CInstantSendLock islock;
+    islock.txid = ArithToUint256(arith_uint256(1000 + n));
+    islock.inputs.emplace_back(ArithToUint256(arith_uint256(2000 + n)), 0);
+    islock.inputs.emplace_back(ArithToUint256(arith_uint256(2000 + n)), 1);
+    return islock;
+}
+
+BOOST_AUTO_TEST_CASE(instantsend_hot_index)
+{
+    CDBWrapper dbw(fs::temp_directory_path() / fs::unique_path(), 1 << 20, true, true);
+
+    // Find out how much memory one entry takes, all test locks have the same shape
+    size_t nEntryUsage;
+    {
+        CInstantSendDb db(dbw, 1 << 20);
+        CInstantSendLock islock = MakeLock(0);
+        uint256 hash = ::SerializeHash(islock);
+        db.WriteNewInstantSendLock(hash, islock);
+        BOOST_CHECK_EQUAL(db.GetHotIndexCount(), 1);
+        nEntryUsage = db.GetHotIndexUsage();
+        BOOST_CHECK(nEntryUsage > 0);
+
+        BOOST_CHECK(db.GetInstantSendLockByHash(hash)->txid == islock.txid);
+        BOOST_CHECK(db.GetInstantSendLockHashByTxid(islock.txid) == hash);
+        BOOST_CHECK(db.GetInstantSendLockByInput(islock.inputs[1])->txid == islock.txid);
+        BOOST_CHECK(!db.GetInstantSendLockByTxid(MakeLock(1).txid));
+    }
+
+    // With room for 3 entries, adding 5 evicts the 2 oldest ones, which are still found in the DB
+    CInstantSendDb db(dbw, 3 * nEntryUsage);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 5; i++) {
+        CInstantSendLock islock = MakeLock(i);
+        hashes.emplace_back(::SerializeHash(islock));
+        db.WriteNewInstantSendLock(hashes.back(), islock);
+    }
+    BOOST_CHECK_EQUAL(db.GetHotIndexCount(), 3);
+    BOOST_CHECK_EQUAL(db.GetHotIndexEvicted(), 2);
+    BOOST_CHECK_EQUAL(db.GetHotIndexUsage(), 3 * nEntryUsage);
+    for (int i = 0; i < 5; i++) {
+        CInstantSendLock islock = MakeLock(i);
+        BOOST_CHECK(db.GetInstantSendLockByHash(hashes[i])->txid == islock.txid);
+        BOOST_CHECK(db.GetInstantSendLockHashByTxid(islock.txid) == hashes[i]);
+        BOOST_CHECK(db.GetInstantSendLockByInput(islock.inputs[0])->txid == islock.txid);
+    }
+
+    // Removing an entry frees its memory
+    CDBBatch batch(dbw);
+    db.RemoveInstantSendLock(batch, hashes[4], nullptr);
+    dbw.WriteBatch(batch);
+    BOOST_CHECK_EQUAL(db.GetHotIndexCount(), 2);
+    BOOST_CHECK_EQUAL(db.GetHotIndexUsage(), 2 * nEntryUsage);
+    BOOST_CHECK(!db.GetInstantSendLockByHash(hashes[4]));
+    BOOST_CHECK(db.GetInstantSendLockHashByTxid(MakeLock(4).txid).IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(instantsend_batched_cleanup)
+{
+    CDBWrapper dbw(fs::temp_directory_path() / fs::unique_path(), 1 << 20, true, true);
+    CInstantSendDb db(dbw, 1 << 20);
+
+    // 3 locks mined at each of the heights 1 to 5
+    std::map<uint256, int> mapHeights;
+    for (int i = 0; i < 15; i++) {
+        CInstantSendLock islock = MakeLock(i);
+        uint256 hash = ::SerializeHash(islock);
+        db.WriteNewInstantSendLock(hash, islock);
+        db.WriteInstantSendLockMined(hash, 1 + i / 3);
+        mapHeights[hash] = 1 + i / 3;
+    }
+
+    // The 9 locks up to height 3 are removed in batches of at most 4
+    std::set<uint256> setRemoved;
+    bool fMore = true;
+    int nBatches = 0;
+    while (fMore) {
+        auto removed = db.RemoveConfirmedInstantSendLocks(3, 4, fMore);
+        BOOST_CHECK(removed.size() <= 4);
+        for (const auto& p : removed) {
+            BOOST_CHECK(mapHeights[p.first] <= 3);
+            BOOST_CHECK(setRemoved.insert(p.first).second);
+        }
+        nBatches++;
+    }
+    BOOST_CHECK_EQUAL(nBatches, 3);
+    BOOST_CHECK_EQUAL(setRemoved.size(), 9);
+    BOOST_CHECK_EQUAL(db.GetHotIndexCount(), 6);
+    for (const auto& p : mapHeights) {
+        BOOST_CHECK_EQUAL(!db.GetInstantSendLockByHash(p.first), p.second <= 3);
+        BOOST_CHECK_EQUAL(db.HasArchivedInstantSendLock(p.first), p.second <= 3);
+    }
+
+    // Nothing is left to remove for these heights
+    BOOST_CHECK(db.RemoveConfirmedInstantSendLocks(3, 4, fMore).empty());
+    BOOST_CHECK(!fMore);
+
+    // Archived locks up to height 2 are removed in batches too, the ones of height 3 are kept
+    BOOST_CHECK(db.RemoveArchivedInstantSendLocks(2, 4));
+    BOOST_CHECK(!db.RemoveArchivedInstantSendLocks(2, 4));
+    for (const auto& p : mapHeights) {
+        BOOST_CHECK_EQUAL(db.HasArchivedInstantSendLock(p.first), p.second == 3);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
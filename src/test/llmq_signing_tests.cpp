@@ -0,0 +1,126 @@
+// Copyright (c) 2018-2020 The Ion Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_ion.h"
+
+#include "arith_uint256.h"
+#include "dbwrapper.h"
+#include "llmq/quorums_signing.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace llmq;
+
+BOOST_FIXTURE_TEST_SUITE(llmq_signing_tests, BasicTestingSetup)
+
+static CRecoveredSig MakeRecoveredSig(int n)
+{
+    CRecoveredSig recSig;
+    recSig.llmqType = Consensus::LLMQ_50_60;
+    recSig.quorumHash = ArithToUint256(arith_uint256(1));
+    recSig.id = ArithToUint256(arith_uint256(1000 + n));
+    recSig.msgHash = ArithToUint256(arith_uint256(2000 + n));
+    recSig.UpdateHash();
+    return recSig;
+}
+
+static void WriteRecoveredSigs(CRecoveredSigsDb& db, int nStart, int nCount)
+{
+    for (int i = nStart; i < nStart + nCount; i++) {
+        db.WriteRecoveredSig(MakeRecoveredSig(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(recsigs_existence_filter_cleanup)
+{
+    const int64_t nOldTime = 1000000;
+    const int64_t nNewTime = nOldTime + 100000;
+
+    // The filter remembers 10 recovered sigs, which are 30 keys
+    {
+        CDBWrapper dbw(fs::temp_directory_path() / fs::unique_path(), 1 << 20, true, true);
+        CRecoveredSigsDb db(dbw, 10);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+
+        // The filter is built by the first cleanup
+        SetMockTime(nOldTime);
+        db.CleanupOldRecoveredSigs(nOldTime / 2);
+        BOOST_CHECK(db.IsExistenceFilterComplete());
+        BOOST_CHECK_EQUAL(db.GetExistenceFilterRebuilds(), 1);
+
+        // 15 old and 5 new recovered sigs roll the filter over
+        SetMockTime(nOldTime);
+        WriteRecoveredSigs(db, 0, 15);
+        SetMockTime(nNewTime);
+        WriteRecoveredSigs(db, 15, 5);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+        for (int i = 0; i < 20; i++) {
+            BOOST_CHECK(db.HasRecoveredSigForId(Consensus::LLMQ_50_60, MakeRecoveredSig(i).id));
+        }
+
+        // After removing the old ones, the remaining 5 fit into the filter again
+        db.CleanupOldRecoveredSigs(nNewTime - nOldTime - 10 * 60);
+        BOOST_CHECK(db.IsExistenceFilterComplete());
+        BOOST_CHECK_EQUAL(db.GetExistenceFilterRebuilds(), 2);
+        for (int i = 0; i < 20; i++) {
+            const CRecoveredSig recSig = MakeRecoveredSig(i);
+            BOOST_CHECK_EQUAL(db.HasRecoveredSigForId(Consensus::LLMQ_50_60, recSig.id), i >= 15);
+            BOOST_CHECK_EQUAL(db.HasRecoveredSigForHash(recSig.GetHash()), i >= 15);
+        }
+    }
+
+    // If the remaining recovered sigs don't fit into the filter, it isn't rebuilt on each cleanup
+    {
+        CDBWrapper dbw(fs::temp_directory_path() / fs::unique_path(), 1 << 20, true, true);
+        CRecoveredSigsDb db(dbw, 10);
+        SetMockTime(nOldTime);
+        db.CleanupOldRecoveredSigs(nOldTime / 2);
+        WriteRecoveredSigs(db, 0, 20);
+        SetMockTime(nOldTime + 20 * 60);
+        WriteRecoveredSigs(db, 20, 5);
+        SetMockTime(nNewTime);
+        WriteRecoveredSigs(db, 25, 15);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+
+        db.CleanupOldRecoveredSigs(nNewTime - nOldTime - 10 * 60);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+        db.CleanupOldRecoveredSigs(nNewTime - nOldTime - 30 * 60);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+        BOOST_CHECK_EQUAL(db.GetExistenceFilterRebuilds(), 1);
+        for (int i = 0; i < 40; i++) {
+            BOOST_CHECK_EQUAL(db.HasRecoveredSigForId(Consensus::LLMQ_50_60, MakeRecoveredSig(i).id), i >= 25);
+        }
+    }
+
+    // Truncated recovered sigs are only accounted for once, when the cleanup removes their remaining keys
+    {
+        CDBWrapper dbw(fs::temp_directory_path() / fs::unique_path(), 1 << 20, true, true);
+        CRecoveredSigsDb db(dbw, 10);
+        SetMockTime(nOldTime);
+        db.CleanupOldRecoveredSigs(nOldTime / 2);
+        WriteRecoveredSigs(db, 0, 8);
+        for (int i = 0; i < 6; i++) {
+            db.TruncateRecoveredSig(Consensus::LLMQ_50_60, MakeRecoveredSig(i).id);
+            BOOST_CHECK(db.HasRecoveredSigForHash(MakeRecoveredSig(i).GetHash()));
+        }
+        SetMockTime(nNewTime);
+        WriteRecoveredSigs(db, 8, 11);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+
+        // The 11 new recovered sigs still don't fit into the filter, so it isn't rebuilt
+        db.CleanupOldRecoveredSigs(nNewTime - nOldTime - 10 * 60);
+        BOOST_CHECK(!db.IsExistenceFilterComplete());
+        BOOST_CHECK_EQUAL(db.GetExistenceFilterRebuilds(), 1);
+        for (int i = 0; i < 19; i++) {
+            const CRecoveredSig recSig = MakeRecoveredSig(i);
+            BOOST_CHECK_EQUAL(db.HasRecoveredSigForId(Consensus::LLMQ_50_60, recSig.id), i >= 8);
+            BOOST_CHECK_EQUAL(db.HasRecoveredSigForHash(recSig.GetHash()), i >= 8);
+        }
+    }
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
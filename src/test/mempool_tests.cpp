@@ -3,6 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "mempool-journal.h"
+#include "script/standard.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -428,6 +431,89 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolReorgUpdateTest)
+{
+    // A diamond (txA -> txB, txC -> txD) whose top was disconnected from the chain: the descendants are already in
+    // the pool when txA is re-added, and every traversal reaches txD twice.
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txA;
+    txA.vin.resize(1);
+    txA.vin[0].scriptSig = CScript() << OP_11;
+    txA.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txA.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txA.vout[i].nValue = 10 * COIN;
+    }
+    CMutableTransaction txB, txC;
+    for (int i = 0; i < 2; i++) {
+        CMutableTransaction& tx = i == 0 ? txB : txC;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout = COutPoint(txA.GetHash(), i);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 9 * COIN;
+    }
+    CMutableTransaction txD;
+    txD.vin.resize(2);
+    txD.vin[0].scriptSig = CScript() << OP_11;
+    txD.vin[0].prevout = COutPoint(txB.GetHash(), 0);
+    txD.vin[1].scriptSig = CScript() << OP_11;
+    txD.vin[1].prevout = COutPoint(txC.GetHash(), 0);
+    txD.vout.resize(1);
+    txD.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txD.vout[0].nValue = 17 * COIN;
+
+    pool.addUnchecked(txB.GetHash(), entry.Fee(1000LL).FromTx(txB));
+    pool.addUnchecked(txC.GetHash(), entry.Fee(1000LL).FromTx(txC));
+    pool.addUnchecked(txD.GetHash(), entry.Fee(1000LL).FromTx(txD));
+    pool.addUnchecked(txA.GetHash(), entry.Fee(1000LL).FromTx(txA));
+    pool.UpdateTransactionsFromBlock({txA.GetHash()});
+
+    CTxMemPool::txiter itA = pool.mapTx.find(txA.GetHash());
+    CTxMemPool::txiter itD = pool.mapTx.find(txD.GetHash());
+    BOOST_CHECK_EQUAL(itA->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itA->GetModFeesWithDescendants(), 4000);
+    BOOST_CHECK_EQUAL(itD->GetCountWithAncestors(), 4);
+    BOOST_CHECK_EQUAL(itD->GetModFeesWithAncestors(), 4000);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(itA).size(), 2);
+
+    CTxMemPool::setEntries setAncestors;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*itD, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3);
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*itD, setAncestors, 3, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+
+    CTxMemPool::setEntries setDescendants;
+    {
+        LOCK(pool.cs);
+        pool.CalculateDescendants(itA, setDescendants);
+    }
+    BOOST_CHECK_EQUAL(setDescendants.size(), 4);
+
+    // Prioritising txD updates its ancestors and descendants once each
+    pool.PrioritiseTransaction(txD.GetHash(), 500);
+    BOOST_CHECK_EQUAL(itA->GetModFeesWithDescendants(), 4500);
+    BOOST_CHECK_EQUAL(itD->GetModFeesWithAncestors(), 4500);
+    pool.PrioritiseTransaction(txA.GetHash(), 500);
+    BOOST_CHECK_EQUAL(itD->GetModFeesWithAncestors(), 5000);
+
+    // Removing txA as if mined updates the descendants once
+    std::vector<CTransactionRef> vtx = {MakeTransactionRef(txA)};
+    pool.removeForBlock(vtx, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK_EQUAL(itD->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itD->GetModFeesWithAncestors(), 3500);
+
+    pool.removeRecursive(txB);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    pool.removeRecursive(txC);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool;
@@ -581,4 +667,181 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolJournalReplayTest)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.n = i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10000LL;
+    }
+
+    CTxMemPool testPool;
+    CMempoolJournal journal(testPool);
+    fs::path pathJournal = GetDataDir() / MEMPOOL_JOURNAL_FILENAME;
+
+    // Starting writes an empty snapshot and the journal continuing it
+    testPool.addUnchecked(tx[0].GetHash(), entry.Time(100).FromTx(tx[0]));
+    BOOST_CHECK(journal.Start());
+    testPool.addUnchecked(tx[1].GetHash(), entry.Time(200).FromTx(tx[1]));
+    testPool.addUnchecked(tx[2].GetHash(), entry.Time(300).FromTx(tx[2]));
+    testPool.PrioritiseTransaction(tx[2].GetHash(), 5000);
+    testPool.removeRecursive(tx[1]);
+    journal.Stop();
+
+    uint64_t nVersion, nSnapshotId;
+    {
+        CAutoFile file(fsbridge::fopen(pathJournal, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> nVersion >> nSnapshotId;
+    }
+
+    // The snapshot holds tx[0], the journal adds tx[2] and its fee delta
+    std::vector<CTransactionRef> vtx(1, MakeTransactionRef(tx[0]));
+    std::vector<int64_t> vTime(1, 100);
+    std::map<uint256, CAmount> mapDeltas;
+    BOOST_CHECK(!CMempoolJournal::Replay(pathJournal, nSnapshotId + 1, vtx, vTime, mapDeltas));
+    BOOST_CHECK_EQUAL(vtx.size(), 1);
+    BOOST_CHECK(CMempoolJournal::Replay(pathJournal, nSnapshotId, vtx, vTime, mapDeltas));
+    BOOST_CHECK_EQUAL(vtx.size(), 2);
+    BOOST_CHECK(vtx[0]->GetHash() == tx[0].GetHash());
+    BOOST_CHECK(vtx[1]->GetHash() == tx[2].GetHash());
+    BOOST_CHECK_EQUAL(vTime[1], 300);
+    BOOST_CHECK_EQUAL(mapDeltas.size(), 1);
+    BOOST_CHECK_EQUAL(mapDeltas[tx[2].GetHash()], 5000);
+
+    // Removing an entry added in the snapshot, and a truncated trailing record
+    testPool.removeRecursive(tx[0]);
+    BOOST_CHECK(journal.Start());
+    testPool.removeRecursive(tx[2]);
+    testPool.addUnchecked(tx[1].GetHash(), entry.Time(400).FromTx(tx[1]));
+    journal.Stop();
+    {
+        CAutoFile file(fsbridge::fopen(pathJournal, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> nVersion >> nSnapshotId;
+    }
+    fs::resize_file(pathJournal, fs::file_size(pathJournal) - 1);
+
+    vtx.assign(1, MakeTransactionRef(tx[2]));
+    vTime.assign(1, 300);
+    mapDeltas.clear();
+    BOOST_CHECK(CMempoolJournal::Replay(pathJournal, nSnapshotId, vtx, vTime, mapDeltas));
+    BOOST_CHECK(vtx.empty());
+    BOOST_CHECK(vTime.empty());
+
+    // A parent re-added after its child, e.g. after a reorg, is replayed before it. Cleared fee deltas are dropped.
+    CMutableTransaction child = tx[1];
+    child.vin[0].prevout = COutPoint(tx[0].GetHash(), 0);
+    testPool.removeRecursive(tx[1]);
+    BOOST_CHECK(journal.Start());
+    testPool.addUnchecked(child.GetHash(), entry.Time(500).FromTx(child));
+    testPool.addUnchecked(tx[2].GetHash(), entry.Time(600).FromTx(tx[2]));
+    testPool.addUnchecked(tx[0].GetHash(), entry.Time(700).FromTx(tx[0]));
+    testPool.PrioritiseTransaction(tx[0].GetHash(), 1000);
+    testPool.PrioritiseTransaction(tx[2].GetHash(), 2000);
+    testPool.ClearPrioritisation(tx[0].GetHash());
+    journal.Stop();
+    {
+        CAutoFile file(fsbridge::fopen(pathJournal, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> nVersion >> nSnapshotId;
+    }
+
+    vtx.clear();
+    vTime.clear();
+    mapDeltas.clear();
+    BOOST_CHECK(CMempoolJournal::Replay(pathJournal, nSnapshotId, vtx, vTime, mapDeltas));
+    BOOST_CHECK_EQUAL(vtx.size(), 3);
+    BOOST_CHECK(vtx[0]->GetHash() == tx[2].GetHash());
+    BOOST_CHECK(vtx[1]->GetHash() == tx[0].GetHash());
+    BOOST_CHECK(vtx[2]->GetHash() == child.GetHash());
+    BOOST_CHECK_EQUAL(vTime[1], 700);
+    BOOST_CHECK_EQUAL(vTime[2], 500);
+    BOOST_CHECK_EQUAL(mapDeltas.size(), 1);
+    BOOST_CHECK_EQUAL(mapDeltas[tx[2].GetHash()], 2000);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAddressIndexTest)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    TestMemPoolEntryHelper entry;
+    CTxMemPool testPool;
+
+    CKeyID keyA(uint160(std::vector<unsigned char>(20, 1)));
+    CKeyID keyB(uint160(std::vector<unsigned char>(20, 2)));
+    CScript scriptA = GetScriptForDestination(keyA);
+    CScript scriptB = GetScriptForDestination(keyB);
+
+    // tx[i] spends a coin of A and pays B and A
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].prevout = COutPoint(InsecureRand256(), i);
+        view.AddCoin(tx[i].vin[0].prevout, Coin(CTxOut(10 * COIN, scriptA), 1, false, false), false);
+        tx[i].vout.resize(2);
+        tx[i].vout[0].scriptPubKey = scriptB;
+        tx[i].vout[0].nValue = 1 * COIN;
+        tx[i].vout[1].scriptPubKey = scriptA;
+        tx[i].vout[1].nValue = 8 * COIN;
+    }
+    // tx[2] entered the mempool first
+    testPool.addAddressIndex(entry.Time(200).FromTx(tx[0]), view);
+    testPool.addAddressIndex(entry.Time(300).FromTx(tx[1]), view);
+    testPool.addAddressIndex(entry.Time(100).FromTx(tx[2]), view);
+    testPool.addSpentIndex(entry.FromTx(tx[0]), view);
+    testPool.addSpentIndex(entry.FromTx(tx[1]), view);
+
+    std::vector<std::pair<uint160, int> > addresses;
+    addresses.emplace_back(keyB, 1);
+    addresses.emplace_back(keyA, 1);
+    {
+        LOCK(testPool.cs);
+        std::vector<const CMempoolAddressDelta*> vDeltas;
+        testPool.getAddressIndex(addresses, vDeltas);
+        BOOST_CHECK_EQUAL(vDeltas.size(), 9);
+        BOOST_CHECK(vDeltas.front()->tx->txhash == tx[2].GetHash());
+        BOOST_CHECK(vDeltas.back()->tx->txhash == tx[1].GetHash());
+        for (size_t i = 1; i < vDeltas.size(); i++) {
+            BOOST_CHECK(vDeltas[i - 1]->tx->time <= vDeltas[i]->tx->time);
+        }
+        // The deltas of tx[2] are B's output, A's input and A's output
+        BOOST_CHECK(vDeltas[0]->list->key.addressBytes == keyB);
+        BOOST_CHECK(vDeltas[1]->spending);
+        BOOST_CHECK_EQUAL(vDeltas[1]->amount, -10 * COIN);
+        BOOST_CHECK(vDeltas[1]->prevhash == tx[2].vin[0].prevout.hash);
+        BOOST_CHECK_EQUAL(vDeltas[2]->amount, 8 * COIN);
+    }
+
+    testPool.removeAddressIndex(tx[0].GetHash());
+    testPool.removeAddressIndex(tx[2].GetHash());
+    {
+        LOCK(testPool.cs);
+        std::vector<const CMempoolAddressDelta*> vDeltas;
+        testPool.getAddressIndex(std::vector<std::pair<uint160, int> >(1, std::make_pair(uint160(keyB), 1)), vDeltas);
+        BOOST_CHECK_EQUAL(vDeltas.size(), 1);
+        BOOST_CHECK(vDeltas[0]->tx->txhash == tx[1].GetHash());
+        BOOST_CHECK(vDeltas[0]->prev == nullptr && vDeltas[0]->next == nullptr);
+    }
+    testPool.removeAddressIndex(tx[1].GetHash());
+    {
+        LOCK(testPool.cs);
+        std::vector<const CMempoolAddressDelta*> vDeltas;
+        testPool.getAddressIndex(addresses, vDeltas);
+        BOOST_CHECK(vDeltas.empty());
+    }
+
+    CSpentIndexKey key(tx[1].vin[0].prevout.hash, tx[1].vin[0].prevout.n);
+    CSpentIndexValue value;
+    BOOST_CHECK(testPool.getSpentIndex(key, value));
+    BOOST_CHECK(value.txid == tx[1].GetHash());
+    BOOST_CHECK(value.addressHash == keyA);
+    testPool.removeSpentIndex(tx[1]);
+    BOOST_CHECK(!testPool.getSpentIndex(key, value));
+    key = CSpentIndexKey(tx[0].vin[0].prevout.hash, tx[0].vin[0].prevout.n);
+    BOOST_CHECK(testPool.getSpentIndex(key, value));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
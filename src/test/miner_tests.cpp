@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "chainparams.h"
 #include "coins.h"
 #include "consensus/consensus.h"
@@ -10,11 +11,14 @@
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "validation.h"
+#include "llmq/quorums_chainlocks.h"
 #include "masternode/masternode-payments.h"
 #include "miner.h"
+#include "net.h"
 #include "policy/policy.h"
 #include "pubkey.h"
 #include "script/standard.h"
+#include "spork.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -190,11 +194,85 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
 
     // This tx will be mineable, and should cause hashLowFeeTx2 to be selected
     // as well.
+    // As the mempool only had additions since the previous template, this
+    // extends the previous package selection.
     tx.vin[0].prevout.n = 1;
     tx.vout[0].nValue = 100000000 - 10000; // 10k satoshi fee
     mempool.addUnchecked(tx.GetHash(), entry.Fee(10000).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
+
+    // Without any mempool change, the previous package selection is reused
+    std::unique_ptr<CBlockTemplate> pblocktemplate2 = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate2->block.vtx.size(), pblocktemplate->block.vtx.size());
+    for (size_t i=1; i<pblocktemplate->block.vtx.size(); ++i) {
+        BOOST_CHECK(pblocktemplate2->block.vtx[i]->GetHash() == pblocktemplate->block.vtx[i]->GetHash());
+    }
+    BOOST_CHECK(pblocktemplate2->vTxFees == pblocktemplate->vTxFees);
+
+    // A removal forces a new selection
+    mempool.removeRecursive(tx);
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    for (size_t i=0; i<pblocktemplate->block.vtx.size(); ++i) {
+        BOOST_CHECK(pblocktemplate->block.vtx[i]->GetHash() != tx.GetHash());
+        BOOST_CHECK(pblocktemplate->block.vtx[i]->GetHash() != hashFreeTx2);
+    }
+}
+
+// A transaction left out because it was not safe for mining yet gets selected once it is, even if the mempool
+// didn't change since the previous template
+void TestUnsafePackageSelection(const CChainParams& chainparams, CScript scriptPubKey, std::vector<CTransactionRef>& txFirst)
+{
+    // Enable InstantSend block filtering and ChainLocks
+    CKey sporkKey;
+    sporkKey.MakeNewKey(false);
+    CBitcoinSecret sporkSecret(sporkKey);
+    CBitcoinAddress sporkAddress;
+    sporkAddress.Set(sporkKey.GetPubKey().GetID());
+    BOOST_CHECK(sporkManager.SetSporkAddress(sporkAddress.ToString()));
+    BOOST_CHECK(sporkManager.SetMinSporkKeys(1));
+    BOOST_CHECK(sporkManager.SetPrivKey(sporkSecret.ToString()));
+    for (SporkId nSporkID : {SPORK_12_INSTANTSEND_ENABLED, SPORK_13_INSTANTSEND_BLOCK_FILTERING, SPORK_19_CHAINLOCKS_ENABLED}) {
+        BOOST_CHECK(sporkManager.UpdateSpork(nSporkID, 0, *g_connman));
+    }
+    llmq::chainLocksHandler->CheckActiveState();
+
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[3]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    CTransactionRef ptx = MakeTransactionRef(tx);
+    mempool.addUnchecked(ptx->GetHash(), entry.Fee(10000).Time(nTime).SpendsCoinbase(true).FromTx(tx));
+    llmq::chainLocksHandler->TransactionAddedToMempool(ptx, nTime);
+
+    auto hasTx = [&](const std::unique_ptr<CBlockTemplate>& pblocktemplate) {
+        for (const auto& blockTx : pblocktemplate->block.vtx) {
+            if (blockTx->GetHash() == ptx->GetHash()) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Not IS locked, neither in a new nor in the reused selection
+    BOOST_CHECK(!hasTx(AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey)));
+    BOOST_CHECK(!hasTx(AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey)));
+
+    // Safe after waiting for the IS lock timed out (CChainLocksHandler::WAIT_FOR_ISLOCK_TIMEOUT)
+    SetMockTime(nTime + 10 * 60);
+    BOOST_CHECK(hasTx(AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey)));
+
+    SetMockTime(0);
+    mempool.clear();
+    sporkManager.Clear();
+    llmq::chainLocksHandler->CheckActiveState();
 }
 
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
@@ -528,6 +606,8 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     mempool.clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    mempool.clear();
+    TestUnsafePackageSelection(chainparams, scriptPubKey, txFirst);
 
     fCheckpointsEnabled = true;
 }
@@ -11,6 +11,7 @@
 #include "test/test_ion.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, BasicTestingSetup)
 
@@ -179,4 +180,103 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesBackground)
+{
+    // Updates processed by the background thread give the same estimates as updates processed by the caller.
+    // 600 blocks make the short horizon fold its pending decay into the stored averages.
+    CBlockPolicyEstimator feeEstInline;
+    CBlockPolicyEstimator feeEstBackground;
+    CTxMemPool mpoolInline(&feeEstInline);
+    CTxMemPool mpoolBackground(&feeEstBackground);
+    boost::thread thread(&CBlockPolicyEstimator::ThreadProcessEvents, &feeEstBackground);
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    std::vector<CTransactionRef> block;
+    std::vector<CTransactionRef> vUnconfirmed;
+    for (int blocknum = 0; blocknum < 600; blocknum++) {
+        for (int j = 0; j < 10; j++) {
+            tx.vin[0].prevout.n = 100*blocknum+j;
+            CTxMemPoolEntry txEntry = entry.Fee(1000 * (j+1)).Time(GetTime()).Height(blocknum).FromTx(tx);
+            mpoolInline.addUnchecked(tx.GetHash(), txEntry);
+            mpoolBackground.addUnchecked(tx.GetHash(), txEntry);
+            // Higher fee transactions are mined in the next block, lower ones a few blocks later
+            if (j >= 5) {
+                block.push_back(MakeTransactionRef(tx));
+            } else {
+                vUnconfirmed.push_back(MakeTransactionRef(tx));
+            }
+        }
+        if (blocknum % 4 == 3) {
+            block.insert(block.end(), vUnconfirmed.begin(), vUnconfirmed.end());
+            vUnconfirmed.clear();
+        }
+        mpoolInline.removeForBlock(block, blocknum + 1);
+        mpoolBackground.removeForBlock(block, blocknum + 1);
+        block.clear();
+    }
+
+    thread.interrupt();
+    thread.join();
+    feeEstBackground.SyncWithQueue();
+
+    BOOST_CHECK(feeEstInline.estimateFee(2) != CFeeRate(0));
+    for (int i = 1; i <= 48; i++) {
+        BOOST_CHECK(feeEstInline.estimateFee(i) == feeEstBackground.estimateFee(i));
+        BOOST_CHECK(feeEstInline.estimateSmartFee(i, nullptr, true) == feeEstBackground.estimateSmartFee(i, nullptr, true));
+        BOOST_CHECK(feeEstInline.estimateSmartFee(i, nullptr, false) == feeEstBackground.estimateSmartFee(i, nullptr, false));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesRemoval)
+{
+    // Transactions leaving the mempool without a block count as failures right away, not only after the next block
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    // 50 transactions which never confirm
+    std::vector<CTransactionRef> vUnconfirmed;
+    for (int j = 0; j < 50; j++) {
+        tx.vin[0].prevout.n = 10000 + j;
+        mpool.addUnchecked(tx.GetHash(), entry.Fee(10000).Time(GetTime()).Height(0).FromTx(tx));
+        vUnconfirmed.push_back(MakeTransactionRef(tx));
+    }
+
+    // and 10 of the same fee rate confirming in the next block, for 20 blocks
+    std::vector<CTransactionRef> block;
+    for (int blocknum = 0; blocknum < 20; blocknum++) {
+        for (int j = 0; j < 10; j++) {
+            tx.vin[0].prevout.n = 100*blocknum+j;
+            mpool.addUnchecked(tx.GetHash(), entry.Fee(10000).Time(GetTime()).Height(blocknum).FromTx(tx));
+            block.push_back(MakeTransactionRef(tx));
+        }
+        mpool.removeForBlock(block, blocknum + 1);
+        block.clear();
+    }
+
+    EstimationResult result;
+    feeEst.estimateRawFee(1, 0.95, FeeEstimateHorizon::SHORT_HALFLIFE, &result);
+    BOOST_CHECK_EQUAL(result.fail.inMempool, 50);
+    BOOST_CHECK_EQUAL(result.fail.leftMempool, 0);
+
+    for (const CTransactionRef& ptx : vUnconfirmed) {
+        mpool.removeRecursive(*ptx);
+    }
+    feeEst.estimateRawFee(1, 0.95, FeeEstimateHorizon::SHORT_HALFLIFE, &result);
+    BOOST_CHECK_EQUAL(result.fail.inMempool, 0);
+    BOOST_CHECK(result.fail.leftMempool > 49.9);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
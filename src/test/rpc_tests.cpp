@@ -238,6 +238,56 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(json_stream_writer)
+{
+    UniValue list(UniValue::VARR);
+    list.push_back("x");
+    list.push_back(UniValue(UniValue::VOBJ));
+    list.push_back(NullUniValue);
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("a", 1));
+    expected.push_back(Pair("list", list));
+    expected.push_back(Pair("b\"c", true));
+
+    std::string str;
+    JSONStreamWriter stream([&str](const std::string& s) { str += s; });
+    BOOST_CHECK(!stream.IsStarted());
+    stream.BeginObject();
+    stream.Key("a");
+    stream.Value(1);
+    stream.Key("list");
+    stream.BeginArray();
+    stream.Value("x");
+    stream.BeginObject();
+    stream.EndObject();
+    stream.Value(NullUniValue);
+    stream.EndArray();
+    stream.Key("b\"c");
+    stream.Value(true);
+    stream.EndObject();
+    BOOST_CHECK(stream.IsStarted());
+    // Nothing is passed on before the first chunk is full
+    BOOST_CHECK(str.empty());
+    stream.Flush();
+    BOOST_CHECK_EQUAL(str, expected.write());
+
+    // Large results are passed on in chunks
+    size_t nChunks = 0;
+    str.clear();
+    JSONStreamWriter streamLarge([&](const std::string& s) { str += s; nChunks++; });
+    streamLarge.BeginArray();
+    for (int i = 0; i < 100000; i++) {
+        streamLarge.Value(i);
+    }
+    streamLarge.EndArray();
+    streamLarge.Flush();
+    BOOST_CHECK(nChunks > 1);
+    UniValue parsed;
+    BOOST_CHECK(parsed.read(str));
+    BOOST_CHECK_EQUAL(parsed.size(), 100000);
+    BOOST_CHECK_EQUAL(parsed[99999].get_int(), 99999);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(std::string("clearbanned")));
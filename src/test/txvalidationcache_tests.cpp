@@ -91,6 +91,75 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+static CMutableTransaction
+CreateSignedSpend(const COutPoint& prevout, const CScript& scriptPubKey, const CKey& key, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch_admission, TestChain100Setup)
+{
+    // A batch is admitted with the same results as admitting its transactions one by one, including
+    // transactions spending outputs of earlier transactions in the batch.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend = CreateSignedSpend(COutPoint(coinbaseTxns[0].GetHash(), 0), scriptPubKey, coinbaseKey, 11*CENT);
+    CMutableTransaction child = CreateSignedSpend(COutPoint(spend.GetHash(), 0), scriptPubKey, coinbaseKey, 10*CENT);
+    CMutableTransaction doubleSpend = CreateSignedSpend(COutPoint(coinbaseTxns[0].GetHash(), 0), scriptPubKey, coinbaseKey, 12*CENT);
+    CMutableTransaction badSig = CreateSignedSpend(COutPoint(coinbaseTxns[1].GetHash(), 0), scriptPubKey, coinbaseKey, 11*CENT);
+    badSig.vout[0].nValue = 13*CENT; // invalidates the signature
+    CMutableTransaction orphan = CreateSignedSpend(COutPoint(GetRandHash(), 0), scriptPubKey, coinbaseKey, 11*CENT);
+
+    // The input scripts of the independent transactions are checked without cs_main
+    {
+        std::vector<std::vector<CTxOut> > vSpent(1, std::vector<CTxOut>(1, coinbaseTxns[0].vout[0]));
+        BOOST_CHECK(CheckInputScriptsParallel({MakeTransactionRef(spend)}, vSpent, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+        vSpent[0][0] = coinbaseTxns[1].vout[0];
+        BOOST_CHECK(!CheckInputScriptsParallel({MakeTransactionRef(badSig)}, vSpent, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+
+        // A failing transaction doesn't stop the checks of the others
+        vSpent.push_back(std::vector<CTxOut>(1, coinbaseTxns[0].vout[0]));
+        std::vector<bool> vValid;
+        BOOST_CHECK(!CheckInputScriptsParallel({MakeTransactionRef(badSig), MakeTransactionRef(spend)}, vSpent, STANDARD_SCRIPT_VERIFY_FLAGS, false, &vValid));
+        BOOST_CHECK(vValid == std::vector<bool>({false, true}));
+    }
+
+    std::vector<CTransactionRef> vtx = {MakeTransactionRef(spend), MakeTransactionRef(child), MakeTransactionRef(doubleSpend),
+                                        MakeTransactionRef(badSig), MakeTransactionRef(orphan)};
+    std::vector<CValidationState> vState;
+    std::vector<bool> vMissingInputs;
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vState, false, &vMissingInputs), 2);
+    BOOST_CHECK_EQUAL(vState.size(), vtx.size());
+    BOOST_CHECK_EQUAL(vMissingInputs.size(), vtx.size());
+
+    BOOST_CHECK(vState[0].IsValid() && mempool.exists(spend.GetHash()));
+    BOOST_CHECK(vState[1].IsValid() && mempool.exists(child.GetHash()));
+    BOOST_CHECK_EQUAL(vState[2].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(vState[3].IsInvalid() && !mempool.exists(badSig.GetHash()));
+    BOOST_CHECK(!vMissingInputs[3]);
+    BOOST_CHECK(vMissingInputs[4] && !mempool.exists(orphan.GetHash()));
+    BOOST_CHECK_EQUAL(mempool.size(), 2);
+
+    // Admitting the batch again rejects the transactions already in the pool
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vState, false), 0);
+    BOOST_CHECK_EQUAL(vState[0].GetRejectReason(), "txn-already-in-mempool");
+    mempool.clear();
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
@@ -619,4 +619,15 @@ BOOST_AUTO_TEST_CASE(version_info_helper)
     BOOST_CHECK_THROW(IntVersionToString(0), std::bad_cast);
 }
 
+BOOST_AUTO_TEST_CASE(util_thread_affinity_cpus)
+{
+    std::vector<int> vCpus = GetThreadAffinityCpus();
+#ifdef __linux__
+    BOOST_CHECK(!vCpus.empty());
+#endif
+    for (size_t i = 1; i < vCpus.size(); i++) {
+        BOOST_CHECK(vCpus[i - 1] < vCpus[i]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
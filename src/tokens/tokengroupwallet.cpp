@@ -57,8 +57,7 @@ OP_HASH256 [32-byte-hash-value] OP_EQUAL
 void GetAllGroupBalances(const CWallet *wallet, std::unordered_map<CTokenGroupID, CAmount> &balances)
 {
     std::vector<COutput> coins;
-    wallet->FilterCoins(coins, [&balances](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, NoGroup, [&balances](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if ((tg.associatedGroup != NoGroup) && !tg.isAuthority()) // must be sitting in any group address
         {
             if (tg.quantity > std::numeric_limits<CAmount>::max() - balances[tg.associatedGroup])
@@ -73,8 +72,7 @@ void GetAllGroupBalances(const CWallet *wallet, std::unordered_map<CTokenGroupID
 void GetAllGroupBalancesAndAuthorities(const CWallet *wallet, std::unordered_map<CTokenGroupID, CAmount> &balances, std::unordered_map<CTokenGroupID, GroupAuthorityFlags> &authorities)
 {
     std::vector<COutput> coins;
-    wallet->FilterCoins(coins, [&balances, &authorities](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, NoGroup, [&balances, &authorities](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if ((tg.associatedGroup != NoGroup)) {
             authorities[tg.associatedGroup] |= tg.controllingGroupFlags();
             if (!tg.isAuthority()) {
@@ -91,8 +89,7 @@ void GetAllGroupBalancesAndAuthorities(const CWallet *wallet, std::unordered_map
 }
 
 void ListAllGroupAuthorities(const CWallet *wallet, std::vector<COutput> &coins) {
-    wallet->FilterCoins(coins, [](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, NoGroup, [](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if (tg.isAuthority()) {
             return true;
         } else {
@@ -102,8 +99,7 @@ void ListAllGroupAuthorities(const CWallet *wallet, std::vector<COutput> &coins)
 }
 
 void ListGroupAuthorities(const CWallet *wallet, std::vector<COutput> &coins, const CTokenGroupID &grpID) {
-    wallet->FilterCoins(coins, [grpID](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, grpID, [grpID](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if (tg.isAuthority() && tg.associatedGroup == grpID) {
             return true;
         } else {
@@ -116,8 +112,7 @@ CAmount GetGroupBalance(const CTokenGroupID &grpID, const CTxDestination &dest,
 {
     std::vector<COutput> coins;
     CAmount balance = 0;
-    wallet->FilterCoins(coins, [grpID, dest, &balance](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, grpID, [grpID, dest, &balance](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if ((grpID == tg.associatedGroup) && !tg.isAuthority()) // must be sitting in group address
         {
             bool useit = dest == CTxDestination(CNoDestination());
@@ -149,8 +144,7 @@ void GetGroupBalanceAndAuthorities(CAmount &balance, GroupAuthorityFlags &author
     std::vector<COutput> coins;
     balance = 0;
     authorities = GroupAuthorityFlags::NONE;
-    wallet->FilterCoins(coins, [grpID, dest, &balance, &authorities](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, grpID, [grpID, dest, &balance, &authorities](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if ((grpID == tg.associatedGroup)) // must be sitting in group address
         {
             bool useit = dest == CTxDestination(CNoDestination());
@@ -182,8 +176,7 @@ void GetGroupBalanceAndAuthorities(CAmount &balance, GroupAuthorityFlags &author
 }
 
 void GetGroupCoins(const CWallet *wallet, std::vector<COutput>& coins, CAmount& balance, const CTokenGroupID &grpID, const CTxDestination &dest) {
-    wallet->FilterCoins(coins, [dest, grpID, &balance](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, grpID, [dest, grpID, &balance](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if ((grpID == tg.associatedGroup) && !tg.isAuthority()) {
             bool useit = dest == CTxDestination(CNoDestination());
             if (!useit) {
@@ -212,8 +205,7 @@ void GetGroupAuthority(const CWallet *wallet, std::vector<COutput>& coins, Group
     // Todo:
     // - Find the coin with the minimum amount of authorities
     // - If needed, combine coins to provide the requested authorities
-    wallet->FilterCoins(coins, [flags, dest, grpID](const CWalletTx *tx, const CTxOut *out) {
-        CTokenGroupInfo tg(out->scriptPubKey);
+    wallet->FilterGroupedCoins(coins, grpID, [flags, dest, grpID](const CWalletTx *tx, const CTxOut *out, const CTokenGroupInfo &tg) {
         if ((grpID == tg.associatedGroup) && tg.isAuthority() && hasCapability(tg.controllingGroupFlags(), flags)) {
             bool useit = dest == CTxDestination(CNoDestination());
             if (!useit) {
@@ -423,7 +415,7 @@ void GroupMelt(CWalletTx &wtxNew, const CTokenGroupID &grpID, CAmount totalNeede
     // Find melt authority
     std::vector<COutput> coins;
 
-    int nOptions = wallet->FilterCoins(coins, [grpID](const CWalletTx *tx, const CTxOut *out) {
+    int nOptions = wallet->FilterCoins(coins, grpID, [grpID](const CWalletTx *tx, const CTxOut *out) {
         CTokenGroupInfo tg(out->scriptPubKey);
         if ((tg.associatedGroup == grpID) && tg.allowsMelt())
         {
@@ -438,7 +430,7 @@ void GroupMelt(CWalletTx &wtxNew, const CTokenGroupID &grpID, CAmount totalNeede
     if ((nOptions == 0) && (grpID.isSubgroup()))
     {
         // if its a subgroup look for a parent authority that will work
-        nOptions = wallet->FilterCoins(coins, [grpID](const CWalletTx *tx, const CTxOut *out) {
+        nOptions = wallet->FilterCoins(coins, grpID.parentGroup(), [grpID](const CWalletTx *tx, const CTxOut *out) {
             CTokenGroupInfo tg(out->scriptPubKey);
             if (tg.isAuthority() && tg.allowsRenew() && tg.allowsSubgroup() && tg.allowsMelt() &&
                 (tg.associatedGroup == grpID.parentGroup()))
@@ -464,7 +456,7 @@ void GroupMelt(CWalletTx &wtxNew, const CTokenGroupID &grpID, CAmount totalNeede
 
     // Find meltable coins
     coins.clear();
-    wallet->FilterCoins(coins, [grpID](const CWalletTx *tx, const CTxOut *out) {
+    wallet->FilterCoins(coins, grpID, [grpID](const CWalletTx *tx, const CTxOut *out) {
         CTokenGroupInfo tg(out->scriptPubKey);
         // must be a grouped output sitting in group address
         return ((grpID == tg.associatedGroup) && !tg.isAuthority());
@@ -512,7 +504,7 @@ void GroupSend(CWalletTx &wtxNew,
     } else {
         if (totalXDMNeeded > 0) {
             CTokenGroupID XDMGrpID = tokenGroupManager->GetDarkMatterID();
-            wallet->FilterCoins(coins, [XDMGrpID, &totalXDMAvailable](const CWalletTx *tx, const CTxOut *out) {
+            wallet->FilterCoins(coins, XDMGrpID, [XDMGrpID, &totalXDMAvailable](const CWalletTx *tx, const CTxOut *out) {
                 CTokenGroupInfo tg(out->scriptPubKey);
                 if ((XDMGrpID == tg.associatedGroup) && !tg.isAuthority())
                 {
@@ -534,7 +526,7 @@ void GroupSend(CWalletTx &wtxNew,
     }
 
     CAmount totalAvailable = 0;
-    wallet->FilterCoins(coins, [grpID, &totalAvailable](const CWalletTx *tx, const CTxOut *out) {
+    wallet->FilterCoins(coins, grpID, [grpID, &totalAvailable](const CWalletTx *tx, const CTxOut *out) {
         CTokenGroupInfo tg(out->scriptPubKey);
         if ((grpID == tg.associatedGroup) && !tg.isAuthority())
         {
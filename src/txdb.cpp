@@ -16,7 +16,9 @@
 #include "init.h"
 #include "xion/accumulators.h"
 
+#include <atomic>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -26,6 +28,8 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSAGGREGATE = 'A';
+static const char DB_ADDRESSAGGREGATE_BLOCK = 'g';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
@@ -329,34 +333,213 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
+    if (start <= 0 || end <= 0) {
+        start = 0;
+    }
+
+    std::unique_ptr<CAddressIndexCursor> pcursor(AddressIndexCursor(addressHash, type, start, 0, end));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        addressIndex.push_back(std::make_pair(pcursor->GetKey(), pcursor->GetValue()));
+    }
+
+    return !pcursor->Failed();
+}
+
+CAddressIndexCursor* CBlockTreeDB::AddressIndexCursor(uint160 addressHash, int type, int startHeight,
+                                                      unsigned int startTxIndex, int endHeight) {
+    CAddressIndexCursor* i = new CAddressIndexCursor(NewIterator(), addressHash, endHeight);
+    // A null txid, index and spending flag make this the first possible key at the start position
+    i->pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(type, addressHash, startHeight, startTxIndex, uint256(), 0, false)));
+    i->ReadEntry();
+    return i;
+}
+
+void CAddressIndexCursor::ReadEntry()
+{
+    std::pair<char, CAddressIndexKey> key;
+    fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == hashBytes &&
+             (nEndHeight <= 0 || key.second.blockHeight <= nEndHeight);
+    if (!fValid)
+        return;
+
+    entry.first = key.second;
+    if (!pcursor->GetValue(entry.second)) {
+        fValid = false;
+        fFailed = true;
+        error("failed to get address index value");
+    }
+}
+
+void CAddressIndexCursor::Next()
+{
+    pcursor->Next();
+    ReadEntry();
+}
+
+bool CBlockTreeDB::ReadAddressAggregate(uint160 addressHash, int type, CAddressAggregate &aggregate) {
+    return Read(std::make_pair(DB_ADDRESSAGGREGATE, CAddressIndexIteratorKey(type, addressHash)), aggregate);
+}
+
+bool CBlockTreeDB::ReadAddressAggregatesBestBlock(uint256 &hashBlock) {
+    return Read(DB_ADDRESSAGGREGATE_BLOCK, hashBlock);
+}
+
+int CBlockTreeDB::ReadLastAddressIndexHeight(uint160 addressHash, int type, int beforeHeight) {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    // Step back from the first possible entry at beforeHeight
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(type, addressHash, beforeHeight, 0, uint256(), 0, false)));
+    if (pcursor->Valid()) {
+        pcursor->Prev();
     } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+        pcursor->SeekToLast();
     }
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
+    std::pair<char, CAddressIndexKey> key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+        key.second.type == (unsigned int)type && key.second.hashBytes == addressHash) {
+        return key.second.blockHeight;
+    }
+    return 0;
+}
+
+bool CBlockTreeDB::UpdateAddressAggregates(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex, bool fUndo) {
+    // Sum up the changes of the block per address, each address counts a transaction once
+    std::map<std::pair<unsigned int, uint160>, std::pair<CAddressAggregate, const uint256*> > mapChanges;
+    for (const auto& entry : vect) {
+        auto& change = mapChanges[std::make_pair(entry.first.type, entry.first.hashBytes)];
+        change.first.AddEntry(entry.first, entry.second, !change.second || *change.second != entry.first.txhash);
+        change.second = &entry.first.txhash;
+    }
+
+    CDBBatch batch(*this);
+    for (const auto& change : mapChanges) {
+        CAddressIndexIteratorKey key(change.first.first, change.first.second);
+        CAddressAggregate aggregate;
+        if (!Read(std::make_pair(DB_ADDRESSAGGREGATE, key), aggregate)) {
+            aggregate.SetNull();
+        }
+        aggregate.Apply(change.second.first, fUndo);
+
+        if (aggregate.txCount <= 0) {
+            batch.Erase(std::make_pair(DB_ADDRESSAGGREGATE, key));
+            continue;
+        }
+        if (!fUndo) {
+            aggregate.lastHeight = pindex->nHeight;
+        } else if (aggregate.lastHeight >= pindex->nHeight) {
+            aggregate.lastHeight = ReadLastAddressIndexHeight(key.hashBytes, key.type, pindex->nHeight);
+        }
+        batch.Write(std::make_pair(DB_ADDRESSAGGREGATE, key), aggregate);
+    }
+    batch.Write(DB_ADDRESSAGGREGATE_BLOCK, fUndo ? pindex->pprev->GetBlockHash() : pindex->GetBlockHash());
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::RebuildAddressAggregatesRange(unsigned int type, unsigned char hashPrefix, int maxHeight) {
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    uint160 hashStart;
+    *hashStart.begin() = hashPrefix;
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, hashStart)));
+
+    // The entries of an address, and those of a transaction, are adjacent in the index
+    bool fAddress = false;
+    uint160 hashAddress;
+    uint256 hashLastTx;
+    CAddressAggregate aggregate;
+    for (; ; pcursor->Next()) {
+        std::pair<char, CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+                      key.second.type == type && *key.second.hashBytes.begin() == hashPrefix;
+
+        if (fAddress && (!fValid || key.second.hashBytes != hashAddress)) {
+            if (aggregate.txCount > 0) {
+                batch.Write(std::make_pair(DB_ADDRESSAGGREGATE, CAddressIndexIteratorKey(type, hashAddress)), aggregate);
             }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
+            if (batch.SizeEstimate() > batch_size) {
+                if (!WriteBatch(batch))
+                    return false;
+                batch.Clear();
             }
-        } else {
+            fAddress = false;
+        }
+        if (!fValid)
             break;
+        if (ShutdownRequested())
+            return false;
+
+        if (!fAddress) {
+            fAddress = true;
+            hashAddress = key.second.hashBytes;
+            hashLastTx.SetNull();
+            aggregate.SetNull();
         }
+        if (key.second.blockHeight > maxHeight)
+            continue;
+
+        CAmount amount;
+        if (!pcursor->GetValue(amount))
+            return error("failed to get address index value");
+        aggregate.AddEntry(key.second, amount, key.second.txhash != hashLastTx);
+        aggregate.lastHeight = key.second.blockHeight;
+        hashLastTx = key.second.txhash;
     }
 
-    return true;
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::RebuildAddressAggregates(const CBlockIndex* pindex, int nThreads) {
+    int64_t nStart = GetTimeMillis();
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+
+    // The aggregates are out of sync until the rebuild completed
+    if (!Erase(DB_ADDRESSAGGREGATE_BLOCK))
+        return false;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    for (pcursor->Seek(DB_ADDRESSAGGREGATE); pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSAGGREGATE)
+            break;
+        batch.Erase(key);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    if (!WriteBatch(batch))
+        return false;
+
+    // Every address type and first byte of the address hash is a range of addresses summed up independently
+    static const int RANGE_COUNT = 2 * 256;
+    std::atomic<int> nNextRange(0);
+    std::atomic<bool> fFailed(false);
+    auto worker = [&]() {
+        for (int nRange = nNextRange++; nRange < RANGE_COUNT && !fFailed; nRange = nNextRange++) {
+            if (!RebuildAddressAggregatesRange(1 + nRange / 256, nRange % 256, pindex->nHeight)) {
+                fFailed = true;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads - 1; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (fFailed)
+        return false;
+
+    LogPrintf("Rebuilt address aggregates up to height %d in %dms\n", pindex->nHeight, GetTimeMillis() - nStart);
+    return Write(DB_ADDRESSAGGREGATE_BLOCK, pindex->GetBlockHash());
 }
 
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
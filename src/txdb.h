@@ -108,6 +108,39 @@ private:
     friend class CCoinsViewDB;
 };
 
+/**
+ * Iterates over the address index entries of one address in block order, (height, txindex), without reading them
+ * all at once. Used for addresses with too many entries to be returned by ReadAddressIndex.
+ */
+class CAddressIndexCursor
+{
+public:
+    ~CAddressIndexCursor() {}
+
+    bool Valid() const { return fValid; }
+    //! Only valid while Valid()
+    const CAddressIndexKey& GetKey() const { return entry.first; }
+    CAmount GetValue() const { return entry.second; }
+    void Next();
+
+    //! Reading an entry failed, the cursor stopped before the end
+    bool Failed() const { return fFailed; }
+
+private:
+    CAddressIndexCursor(CDBIterator* pcursorIn, const uint160& addressHash, int endHeight):
+        pcursor(pcursorIn), hashBytes(addressHash), nEndHeight(endHeight), fValid(false), fFailed(false) {}
+    void ReadEntry();
+
+    std::unique_ptr<CDBIterator> pcursor;
+    const uint160 hashBytes;
+    const int nEndHeight;
+    std::pair<CAddressIndexKey, CAmount> entry;
+    bool fValid;
+    bool fFailed;
+
+    friend class CBlockTreeDB;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -135,11 +168,30 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    /**
+     * Return a cursor over the address index entries of an address, starting at the first entry not before
+     * (startHeight, startTxIndex) and ending after the entries at endHeight (0 for no limit).
+     */
+    CAddressIndexCursor* AddressIndexCursor(uint160 addressHash, int type, int startHeight,
+                                            unsigned int startTxIndex = 0, int endHeight = 0);
+    bool ReadAddressAggregate(uint160 addressHash, int type, CAddressAggregate &aggregate);
+    /** The block the address aggregates were last updated to, missing while they aren't in sync with the index */
+    bool ReadAddressAggregatesBestBlock(uint256 &hashBlock);
+    /**
+     * Add the address index entries of the block pindex to the address aggregates, or remove them with fUndo.
+     * The entries of a transaction must be adjacent in vect.
+     */
+    bool UpdateAddressAggregates(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex, bool fUndo);
+    /** Rebuild the address aggregates from the address index entries up to pindex, summing up with nThreads threads */
+    bool RebuildAddressAggregates(const CBlockIndex* pindex, int nThreads);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+private:
+    int ReadLastAddressIndexHeight(uint160 addressHash, int type, int beforeHeight);
+    bool RebuildAddressAggregatesRange(unsigned int type, unsigned char hashPrefix, int maxHeight);
 };
 
 #endif // BITCOIN_TXDB_H
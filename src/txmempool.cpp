@@ -69,34 +69,43 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints& lp)
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
-
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (const txiter childEntry : setChildren) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (const txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+    vecEntries vAllDescendants;
+    {
+        const EpochGuard epoch(*this);
+        vecEntries &stageEntries = vTraversalStage;
+        for (const txiter childEntry : GetMemPoolChildren(updateIt)) {
+            visited(childEntry);
+            stageEntries.push_back(childEntry);
+        }
+
+        while (!stageEntries.empty()) {
+            const txiter cit = stageEntries.back();
+            stageEntries.pop_back();
+            vAllDescendants.push_back(cit);
+            const setEntries &setChildren = GetMemPoolChildren(cit);
+            for (const txiter childEntry : setChildren) {
+                cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
+                if (cacheIt != cachedDescendants.end()) {
+                    // We've already calculated this one, just add the entries for this set
+                    // but don't traverse again.
+                    for (const txiter cacheEntry : cacheIt->second) {
+                        if (!visited(cacheEntry)) {
+                            vAllDescendants.push_back(cacheEntry);
+                        }
+                    }
+                } else if (!visited(childEntry)) {
+                    // Schedule for later processing
+                    stageEntries.push_back(childEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    for (txiter cit : vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
@@ -132,25 +141,27 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // setMemPoolChildren will be updated, an assumption made in
     // UpdateForDescendants.
     for (const uint256 &hash : reverse_iterate(vHashesToUpdate)) {
-        // we cache the in-mempool children to avoid duplicate updates
-        setEntries setChildren;
         // calculate children from mapNextTx
         txiter it = mapTx.find(hash);
         if (it == mapTx.end()) {
             continue;
         }
-        auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
-        // First calculate the children, and update setMemPoolChildren to
-        // include them, and update their setMemPoolParents to include this tx.
-        for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
-            const uint256 &childHash = iter->second->GetHash();
-            txiter childIter = mapTx.find(childHash);
-            assert(childIter != mapTx.end());
-            // We can skip updating entries we've encountered before or that
-            // are in the block (which are already accounted for).
-            if (setChildren.insert(childIter).second && !setAlreadyIncluded.count(childHash)) {
-                UpdateChild(it, childIter, true);
-                UpdateParent(childIter, it, true);
+        {
+            // we mark the in-mempool children to avoid duplicate updates
+            const EpochGuard epoch(*this);
+            auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
+            // First calculate the children, and update setMemPoolChildren to
+            // include them, and update their setMemPoolParents to include this tx.
+            for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
+                const uint256 &childHash = iter->second->GetHash();
+                txiter childIter = mapTx.find(childHash);
+                assert(childIter != mapTx.end());
+                // We can skip updating entries we've encountered before or that
+                // are in the block (which are already accounted for).
+                if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
+                    UpdateChild(it, childIter, true);
+                    UpdateParent(childIter, it, true);
+                }
             }
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
@@ -161,17 +172,22 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 {
     LOCK(cs);
 
-    setEntries parentHashes;
+    const EpochGuard epoch(*this);
+    vecEntries &parentHashes = vTraversalStage;
     const CTransaction &tx = entry.GetTx();
 
+    for (txiter ancestorIt : setAncestors) {
+        visited(ancestorIt);
+    }
+
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
         // GetMemPoolParents() is only valid for entries in the mempool, so we
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
+            if (piter != mapTx.end() && !visited(piter)) {
+                parentHashes.push_back(piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -182,16 +198,20 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const txiter piter : GetMemPoolParents(it)) {
+            if (!visited(piter)) {
+                parentHashes.push_back(piter);
+            }
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -208,8 +228,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -221,9 +241,11 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     return true;
 }
 
-void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
+template <typename Entries>
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, const Entries &ancestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    // UpdateChild only modifies the links of the parents, so the parents of it can't change here
+    const setEntries &parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     for (txiter piter : parentIters) {
         UpdateChild(piter, it, add);
@@ -231,11 +253,47 @@ void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
     const CAmount updateFee = updateCount * it->GetModifiedFee();
-    for (txiter ancestorIt : setAncestors) {
+    for (txiter ancestorIt : ancestors) {
         mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
     }
 }
 
+void CTxMemPool::GetAncestorsByLinks(txiter it, vecEntries &vAncestors) const
+{
+    const EpochGuard epoch(*this);
+    vecEntries &stage = vTraversalStage;
+    visited(it);
+    stage.push_back(it);
+    while (!stage.empty()) {
+        const txiter cit = stage.back();
+        stage.pop_back();
+        for (const txiter piter : GetMemPoolParents(cit)) {
+            if (!visited(piter)) {
+                vAncestors.push_back(piter);
+                stage.push_back(piter);
+            }
+        }
+    }
+}
+
+void CTxMemPool::GetDescendants(txiter it, vecEntries &vDescendants) const
+{
+    const EpochGuard epoch(*this);
+    vecEntries &stage = vTraversalStage;
+    visited(it);
+    stage.push_back(it);
+    while (!stage.empty()) {
+        const txiter cit = stage.back();
+        stage.pop_back();
+        for (const txiter childiter : GetMemPoolChildren(cit)) {
+            if (!visited(childiter)) {
+                vDescendants.push_back(childiter);
+                stage.push_back(childiter);
+            }
+        }
+    }
+}
+
 void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncestors)
 {
     int64_t updateCount = setAncestors.size();
@@ -262,7 +320,8 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
 {
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    // The traversals below reuse one vector instead of building a set per entry
+    vecEntries vEntries;
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
@@ -271,25 +330,21 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
+            vEntries.clear();
+            GetDescendants(removeIt, vEntries); // doesn't include self
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCount();
-            for (txiter dit : setDescendants) {
+            for (txiter dit : vEntries) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
             }
         }
     }
     for (txiter removeIt : entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
+        // Since this is a tx that is already in the mempool, we can walk its
+        // ancestors through mapLinks instead of searching its inputs.  If the
+        // mempool is in a consistent state, then both should be correct,
+        // though walking the links is a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
         // of ancestors reachable via mapLinks will be the same as the set of 
@@ -303,10 +358,11 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // differ from the set of mempool parents we'd calculate by searching,
         // and it's important that we use the mapLinks[] notion of ancestor
         // transactions as the set of things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        vEntries.clear();
+        GetAncestorsByLinks(removeIt, vEntries);
         // Note that UpdateAncestorsOf severs the child links that point to
         // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
+        UpdateAncestorsOf(false, removeIt, vEntries);
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update setMemPoolParents
@@ -337,7 +393,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), nTransactionsAdded(0), minerPolicyEstimator(estimator), nEpoch(0), fHasEpochGuard(false)
 {
     _clear(); //lock free clear
 
@@ -347,6 +403,19 @@ CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
     nCheckFrequency = 0;
 }
 
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& poolIn) : pool(poolIn)
+{
+    assert(!pool.fHasEpochGuard);
+    ++pool.nEpoch;
+    pool.fHasEpochGuard = true;
+    pool.vTraversalStage.clear();
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    pool.fHasEpochGuard = false;
+}
+
 bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
@@ -359,6 +428,12 @@ unsigned int CTxMemPool::GetTransactionsUpdated() const
     return nTransactionsUpdated;
 }
 
+unsigned int CTxMemPool::GetTransactionsAdded() const
+{
+    LOCK(cs);
+    return nTransactionsAdded;
+}
+
 void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 {
     LOCK(cs);
@@ -367,11 +442,11 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
-    NotifyEntryAdded(entry.GetSharedTx());
     // Add to memory pool without checking anything.
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
+    NotifyEntryAdded(entry.GetSharedTx(), entry.GetTime());
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
     mapLinks.insert(make_pair(newit, TxLinks()));
 
@@ -415,6 +490,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
+    nTransactionsAdded++;
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
@@ -471,88 +547,125 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     return true;
 }
 
+/** Address type and hash of a script indexed by the address index, type 0 if it isn't indexed */
+static int GetIndexAddress(const CScript& script, uint160& addressHash)
+{
+    if (script.IsPayToScriptHash()) {
+        addressHash = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        return 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        addressHash = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        return 1;
+    } else if (script.IsPayToPublicKey()) {
+        addressHash = Hash160(script.begin()+1, script.end()-1);
+        return 1;
+    }
+    addressHash.SetNull();
+    return 0;
+}
+
 void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
 
     uint256 txhash = tx.GetHash();
+    std::pair<addressTxMap::iterator, bool> ret = mapAddressTxs.emplace(txhash, CMempoolAddressTx());
+    if (!ret.second) {
+        return;
+    }
+    CMempoolAddressTx& addressTx = ret.first->second;
+    addressTx.txhash = txhash;
+    addressTx.time = entry.GetTime();
+
+    std::vector<CMempoolAddressKey> vKeys;
+    uint160 addressHash;
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
+        const CTxIn& input = tx.vin[j];
         const Coin& coin = view.AccessCoin(input.prevout);
         const CTxOut &prevout = coin.out;
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-            std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-            uint160 hashBytes(Hash160(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.end()-1));
-            CMempoolAddressDeltaKey key(1, hashBytes, txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
+        int addressType = GetIndexAddress(prevout.scriptPubKey, addressHash);
+        if (addressType) {
+            addressTx.deltas.emplace_back(j, true, prevout.nValue * -1, input.prevout.hash, input.prevout.n);
+            vKeys.emplace_back(addressType, addressHash);
         }
     }
 
     for (unsigned int k = 0; k < tx.vout.size(); k++) {
         const CTxOut &out = tx.vout[k];
-        if (out.scriptPubKey.IsPayToScriptHash()) {
-            std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-            std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-            std::pair<addressDeltaMap::iterator,bool> ret;
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToPublicKey()) {
-            uint160 hashBytes(Hash160(out.scriptPubKey.begin()+1, out.scriptPubKey.end()-1));
-            std::pair<addressDeltaMap::iterator,bool> ret;
-            CMempoolAddressDeltaKey key(1, hashBytes, txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        }
-    }
-
-    mapAddressInserted.insert(std::make_pair(txhash, inserted));
-}
-
-bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
-                                 std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
+        int addressType = GetIndexAddress(out.scriptPubKey, addressHash);
+        if (addressType) {
+            addressTx.deltas.emplace_back(k, false, out.nValue, uint256(), 0);
+            vKeys.emplace_back(addressType, addressHash);
+        }
+    }
+
+    // Append the deltas to the lists of their addresses
+    for (size_t i = 0; i < addressTx.deltas.size(); i++) {
+        CMempoolAddressDelta& delta = addressTx.deltas[i];
+        addressDeltaMap::iterator it = mapAddress.find(vKeys[i]);
+        if (it == mapAddress.end()) {
+            it = mapAddress.emplace(vKeys[i], CMempoolAddressDeltas(vKeys[i])).first;
+        }
+        CMempoolAddressDeltas& list = it->second;
+        delta.tx = &addressTx;
+        delta.list = &list;
+        delta.prev = list.last;
+        if (list.last) {
+            list.last->next = &delta;
+        } else {
+            list.first = &delta;
+        }
+        list.last = &delta;
+        list.count++;
+    }
+}
+
+void CTxMemPool::getAddressIndex(const std::vector<std::pair<uint160, int> > &addresses,
+                                 std::vector<const CMempoolAddressDelta*> &results) const
 {
-    LOCK(cs);
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
+    AssertLockHeld(cs);
+    size_t nBegin = results.size();
+    for (const auto& address : addresses) {
+        addressDeltaMap::const_iterator it = mapAddress.find(CMempoolAddressKey(address.second, address.first));
+        if (it == mapAddress.end()) {
+            continue;
+        }
+        results.reserve(results.size() + it->second.count);
+        for (const CMempoolAddressDelta* delta = it->second.first; delta; delta = delta->next) {
+            results.push_back(delta);
         }
     }
-    return true;
+    // The deltas of each address are already in the order their transactions were added, which is mostly
+    // ordered by time
+    std::stable_sort(results.begin() + nBegin, results.end(), [](const CMempoolAddressDelta* a, const CMempoolAddressDelta* b) {
+        return a->tx->time < b->tx->time;
+    });
 }
 
 bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
     LOCK(cs);
-    addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
+    addressTxMap::iterator it = mapAddressTxs.find(txhash);
 
-    if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+    if (it != mapAddressTxs.end()) {
+        for (CMempoolAddressDelta& delta : it->second.deltas) {
+            CMempoolAddressDeltas* list = delta.list;
+            if (delta.prev) {
+                delta.prev->next = delta.next;
+            } else {
+                list->first = delta.next;
+            }
+            if (delta.next) {
+                delta.next->prev = delta.prev;
+            } else {
+                list->last = delta.prev;
+            }
+            if (--list->count == 0) {
+                mapAddress.erase(list->key);
+            }
         }
-        mapAddressInserted.erase(it);
+        mapAddressTxs.erase(it);
     }
 
     return true;
@@ -563,39 +676,20 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCac
     LOCK(cs);
 
     const CTransaction& tx = entry.GetTx();
-    std::vector<CSpentIndexKey> inserted;
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
+        const CTxIn& input = tx.vin[j];
         const Coin& coin = view.AccessCoin(input.prevout);
         const CTxOut &prevout = coin.out;
         uint160 addressHash;
-        int addressType;
-
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            addressHash = uint160(std::vector<unsigned char> (prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-            addressType = 2;
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-            addressHash = uint160(std::vector<unsigned char> (prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-            addressType = 1;
-        } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-            addressHash = Hash160(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.end()-1);
-            addressType = 1;
-        } else {
-            addressHash.SetNull();
-            addressType = 0;
-        }
+        int addressType = GetIndexAddress(prevout.scriptPubKey, addressHash);
 
         CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
         CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
 
         mapSpent.insert(std::make_pair(key, value));
-        inserted.push_back(key);
-
     }
-
-    mapSpentInserted.insert(make_pair(txhash, inserted));
 }
 
 bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
@@ -611,17 +705,19 @@ bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return false;
 }
 
-bool CTxMemPool::removeSpentIndex(const uint256 txhash)
+bool CTxMemPool::removeSpentIndex(const CTransaction &tx)
 {
     LOCK(cs);
-    mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
+    if (mapSpent.empty()) {
+        return true;
+    }
 
-    if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapSpent.erase(*mit);
+    const uint256& txhash = tx.GetHash();
+    for (const CTxIn& input : tx.vin) {
+        mapSpentIndex::iterator it = mapSpent.find(CSpentIndexKey(input.prevout.hash, input.prevout.n));
+        if (it != mapSpent.end() && it->second.txid == txhash) {
+            mapSpent.erase(it);
         }
-        mapSpentInserted.erase(it);
     }
 
     return true;
@@ -631,6 +727,8 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     NotifyEntryRemoved(it->GetSharedTx(), reason);
     const uint256 hash = it->GetTx().GetHash();
+    removeAddressIndex(hash);
+    removeSpentIndex(it->GetTx());
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
@@ -695,8 +793,6 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
-    removeAddressIndex(hash);
-    removeSpentIndex(hash);
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and adds to
@@ -707,22 +803,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
+    const EpochGuard epoch(*this);
+    vecEntries &stage = vTraversalStage;
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        visited(entryit);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!setDescendants.count(childiter) && !visited(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -990,9 +1088,13 @@ void CTxMemPool::_clear()
 {
     mapLinks.clear();
     mapTx.clear();
+    vTxHashes.clear();
     mapNextTx.clear();
     mapProTxAddresses.clear();
     mapProTxPubKeyIDs.clear();
+    mapAddress.clear();
+    mapAddressTxs.clear();
+    mapSpent.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -1326,22 +1428,20 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         LOCK(cs);
         CAmount &delta = mapDeltas[hash];
         delta += nFeeDelta;
+        NotifyEntryPrioritised(hash, nFeeDelta);
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
             // Now update all ancestors' modified fees with descendants
-            setEntries setAncestors;
-            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-            std::string dummy;
-            CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-            for (txiter ancestorIt : setAncestors) {
+            vecEntries vAncestors;
+            GetAncestorsByLinks(it, vAncestors);
+            for (txiter ancestorIt : vAncestors) {
                 mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
             }
             // Now update all descendants' modified fees with ancestors
-            setEntries setDescendants;
-            CalculateDescendants(it, setDescendants);
-            setDescendants.erase(it);
-            for (txiter descendantIt : setDescendants) {
+            vecEntries vDescendants;
+            GetDescendants(it, vDescendants);
+            for (txiter descendantIt : vDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
@@ -1363,7 +1463,8 @@ void CTxMemPool::ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const
 void CTxMemPool::ClearPrioritisation(const uint256 hash)
 {
     LOCK(cs);
-    mapDeltas.erase(hash);
+    if (mapDeltas.erase(hash))
+        NotifyPrioritisationCleared(hash);
 }
 
 bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
@@ -12,6 +12,7 @@
 #include <map>
 #include <vector>
 #include <utility>
+#include <unordered_map>
 #include <string>
 
 #include "addressindex.h"
@@ -140,6 +141,9 @@ public:
     // If this is a proTx, this will be the hash of the key for which this ProTx was valid
     mutable uint256 validForProTxKey;
     mutable bool isKeyChangeProTx{false};
+
+    //! Epoch in which this entry was last visited by a mempool traversal, see CTxMemPool::EpochGuard
+    mutable uint64_t nEpoch{0};
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -424,6 +428,7 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    unsigned int nTransactionsAdded; //!< Counts only additions, see GetTransactionsAdded
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx' byte sizes
@@ -433,6 +438,9 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    mutable uint64_t nEpoch; //!< Current traversal epoch, see EpochGuard
+    mutable bool fHasEpochGuard; //!< Whether a traversal is in progress
+
     void trackPackageRemoved(const CFeeRate& rate);
 
 public:
@@ -483,6 +491,7 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    typedef std::vector<txiter> vecEntries;
 
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
@@ -497,18 +506,19 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    // Address index: the deltas are owned by their transaction in mapAddressTxs and linked into the list of their
+    // address in mapAddress, so adding and removing a transaction and querying an address don't depend on the
+    // number of other deltas
+    typedef std::unordered_map<CMempoolAddressKey, CMempoolAddressDeltas, SaltedHasher<CMempoolAddressKey, SaltedHasherBase> > addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
-    addressDeltaMapInserted mapAddressInserted;
+    typedef std::unordered_map<uint256, CMempoolAddressTx, SaltedTxidHasher> addressTxMap;
+    addressTxMap mapAddressTxs;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    // Spent index, the entries of a transaction are found through its inputs when it is removed
+    typedef std::unordered_map<CSpentIndexKey, CSpentIndexValue, SaltedHasher<CSpentIndexKey, SaltedHasherBase> > mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
-    mapSpentIndexInserted mapSpentInserted;
-
     std::multimap<uint256, uint256> mapProTxRefs; // proTxHash -> transaction (all TXs that refer to an existing proTx)
     std::map<CService, uint256> mapProTxAddresses;
     std::map<CKeyID, uint256> mapProTxPubKeyIDs;
@@ -518,6 +528,33 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /**
+     * Marks a traversal of the ancestor/descendant graph. Entries are marked visited by setting their nEpoch to the
+     * current epoch instead of collecting them in temporary sets, which makes traversals allocation free. Starting
+     * a new epoch invalidates all marks; traversals can't be nested. Requires cs.
+     */
+    class EpochGuard
+    {
+    private:
+        const CTxMemPool& pool;
+
+    public:
+        explicit EpochGuard(const CTxMemPool& poolIn);
+        ~EpochGuard();
+    };
+
+    /** Returns whether the entry has been visited in the current epoch, and marks it as visited. */
+    bool visited(txiter it) const
+    {
+        assert(fHasEpochGuard);
+        bool fVisited = it->nEpoch >= nEpoch;
+        it->nEpoch = nEpoch;
+        return fVisited;
+    }
+
+    //! Traversal stack reused by all traversals, only valid within an epoch
+    mutable vecEntries vTraversalStage;
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
 public:
@@ -545,13 +582,17 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate = true);
 
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
-    bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
-                         std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
+    /**
+     * Append the deltas of the given addresses to results, ordered by the time their transactions entered the
+     * mempool. The deltas aren't copied, the pointers are valid while holding cs.
+     */
+    void getAddressIndex(const std::vector<std::pair<uint160, int> > &addresses,
+                         std::vector<const CMempoolAddressDelta*> &results) const;
     bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool removeSpentIndex(const uint256 txhash);
+    bool removeSpentIndex(const CTransaction &tx);
 
     void removeRecursive(const CTransaction &tx, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
@@ -570,6 +611,9 @@ public:
     void queryHashes(std::vector<uint256>& vtxid);
     bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
+    /** Number of transactions added to the pool. While GetTransactionsUpdated grows by the same amount, the pool only
+     *  had additions, and the added entries are at the end of vTxHashes. */
+    unsigned int GetTransactionsAdded() const;
     void AddTransactionsUpdated(unsigned int n);
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
@@ -666,8 +710,11 @@ public:
 
     size_t DynamicMemoryUsage() const;
 
-    boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
+    /** Signals are sent while holding cs. NotifyEntryAdded passes the entry time. */
+    boost::signals2::signal<void (CTransactionRef, int64_t)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    boost::signals2::signal<void (const uint256&, const CAmount&)> NotifyEntryPrioritised;
+    boost::signals2::signal<void (const uint256&)> NotifyPrioritisationCleared;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -687,7 +734,12 @@ private:
             cacheMap &cachedDescendants,
             const std::set<uint256> &setExclude);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
-    void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
+    template <typename Entries>
+    void UpdateAncestorsOf(bool add, txiter hash, const Entries &ancestors);
+    /** Append all in-mempool ancestors of an entry, found through mapLinks, to vAncestors (excluding the entry itself). */
+    void GetAncestorsByLinks(txiter it, vecEntries &vAncestors) const;
+    /** Append all in-mempool descendants of an entry to vDescendants (excluding the entry itself). */
+    void GetDescendants(txiter it, vecEntries &vDescendants) const;
     /** Set ancestor state for an entry */
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
     /** For each transaction being removed, update ancestors and any direct children.
@@ -77,6 +77,10 @@
 #include <sys/prctl.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #ifdef HAVE_MALLOPT_ARENA_MAX
 #include <malloc.h>
 #endif
@@ -947,6 +951,40 @@ void RenameThread(const char* name)
     LogPrintf("%s: thread new name %s\n", __func__, name);
 }
 
+bool SetThreadAffinity(int nCpu)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(nCpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        LogPrintf("%s: failed to pin thread to cpu %d\n", __func__, nCpu);
+        return false;
+    }
+    return true;
+#else
+    // Prevent warnings for unused parameters...
+    (void)nCpu;
+    return false;
+#endif
+}
+
+std::vector<int> GetThreadAffinityCpus()
+{
+    std::vector<int> vCpus;
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int nCpu = 0; nCpu < CPU_SETSIZE; nCpu++) {
+            if (CPU_ISSET(nCpu, &set))
+                vCpus.push_back(nCpu);
+        }
+    }
+#endif
+    return vCpus;
+}
+
 std::string GetThreadName()
 {
     char name[16];
@@ -358,6 +358,10 @@ std::string HelpMessageOpt(const std::string& option, const std::string& message
 int GetNumCores();
 
 void RenameThread(const char* name);
+/** Pin the calling thread to one cpu, only supported on Linux */
+bool SetThreadAffinity(int nCpu);
+/** The cpus the calling thread is allowed to run on in ascending order, empty if unknown. Only supported on Linux */
+std::vector<int> GetThreadAffinityCpus();
 std::string GetThreadName();
 
 namespace ctpl {
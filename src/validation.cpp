@@ -9,6 +9,7 @@
 
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockfilterindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -39,6 +40,7 @@
 #include "tinyformat.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "mempool-journal.h"
 #include "ui_interface.h"
 #include "undo.h"
 #include "util.h"
@@ -97,6 +99,18 @@ std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = true;
 bool fAddressIndex = false;
+/** Whether the address aggregates are kept up to date with the chain, set by InitAddressAggregates or SyncAddressAggregates */
+static std::atomic<bool> fAddressAggregatesSynced(false);
+/** A block connected (or disconnected with fUndo) while the address aggregates are rebuilt */
+struct CAddressAggregatesJournalEntry
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vect;
+    const CBlockIndex* pindex;
+    bool fUndo;
+};
+/** Whether blocks are journaled to be applied to the address aggregates after the rebuild, guarded by cs_main */
+static bool fAddressAggregatesJournaling = false;
+static std::vector<CAddressAggregatesJournalEntry> vAddressAggregatesJournal;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
@@ -898,6 +912,109 @@ bool GetAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressAggregate(uint160 addressHash, int type, CAddressAggregate &aggregate)
+{
+    if (!fAddressIndex || !fAddressAggregatesSynced)
+        return false;
+
+    // Addresses without any activity have no aggregate
+    if (!pblocktree->ReadAddressAggregate(addressHash, type, aggregate))
+        aggregate.SetNull();
+
+    return true;
+}
+
+static bool UpdateAddressAggregates(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex, bool fUndo)
+{
+    AssertLockHeld(cs_main);
+
+    if (fAddressAggregatesSynced)
+        return pblocktree->UpdateAddressAggregates(vect, pindex, fUndo);
+    if (fAddressAggregatesJournaling)
+        vAddressAggregatesJournal.push_back(CAddressAggregatesJournalEntry{vect, pindex, fUndo});
+    return true;
+}
+
+void InitAddressAggregates()
+{
+    if (!fAddressIndex)
+        return;
+
+    LOCK(cs_main);
+    uint256 hashBlock;
+    if (chainActive.Tip() && pblocktree->ReadAddressAggregatesBestBlock(hashBlock) && hashBlock == chainActive.Tip()->GetBlockHash())
+        fAddressAggregatesSynced = true;
+}
+
+bool SyncAddressAggregates()
+{
+    if (!fAddressIndex || fAddressAggregatesSynced)
+        return true;
+
+    const CBlockIndex* pindexSnapshot;
+    {
+        LOCK(cs_main);
+        if (!chainActive.Tip())
+            return true;
+        pindexSnapshot = chainActive.Tip();
+        fAddressAggregatesJournaling = true;
+        vAddressAggregatesJournal.clear();
+    }
+
+    // The aggregates are rebuilt from the index entries up to the snapshot without holding cs_main, the blocks
+    // connected and disconnected in the meantime are journaled and applied afterwards
+    while (true) {
+        LogPrintf("Rebuilding address aggregates...\n");
+        bool fRebuilt = pblocktree->RebuildAddressAggregates(pindexSnapshot, std::max(1, GetNumCores()));
+
+        LOCK(cs_main);
+        if (!fRebuilt) {
+            fAddressAggregatesJournaling = false;
+            vAddressAggregatesJournal.clear();
+            return error("%s: failed to rebuild address aggregates", __func__);
+        }
+
+        // Entries up to the snapshot which were erased during the rebuild may or may not have been summed up
+        bool fReorged = false;
+        for (const auto& entry : vAddressAggregatesJournal) {
+            if (entry.fUndo && entry.pindex->nHeight <= pindexSnapshot->nHeight) {
+                fReorged = true;
+                break;
+            }
+        }
+        if (fReorged) {
+            pindexSnapshot = chainActive.Tip();
+            vAddressAggregatesJournal.clear();
+            continue;
+        }
+
+        for (const auto& entry : vAddressAggregatesJournal) {
+            if (!pblocktree->UpdateAddressAggregates(entry.vect, entry.pindex, entry.fUndo)) {
+                fAddressAggregatesJournaling = false;
+                vAddressAggregatesJournal.clear();
+                return error("%s: failed to update address aggregates", __func__);
+            }
+        }
+        if (!vAddressAggregatesJournal.empty())
+            LogPrintf("Applied %u blocks connected or disconnected during the rebuild to the address aggregates\n", vAddressAggregatesJournal.size());
+        fAddressAggregatesJournaling = false;
+        vAddressAggregatesJournal.clear();
+        fAddressAggregatesSynced = true;
+        return true;
+    }
+}
+
+CAddressIndexCursor* GetAddressIndexCursor(uint160 addressHash, int type, int startHeight,
+                                           unsigned int startTxIndex, int endHeight)
+{
+    if (!fAddressIndex) {
+        error("address index not enabled");
+        return nullptr;
+    }
+
+    return pblocktree->AddressIndexCursor(addressHash, type, startHeight, startTxIndex, endHeight);
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -1310,9 +1427,16 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    if (pfailed && *pfailed)
+        return true;
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     PrecomputedTransactionData txdata(*ptxTo);
-    return VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, txdata, cacheStore), &error);
+    bool fOk = VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, txdata, cacheStore), &error);
+    if (!fOk && pfailed) {
+        *pfailed = true;
+        return true;
+    }
+    return fOk;
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1335,6 +1459,16 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1395,11 +1529,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // correct (ie that the transaction hash which is in tx's prevouts
             // properly commits to the scriptPubKey in the inputs view of that
             // transaction).
-            uint256 hashCacheEntry;
-            // We only use the first 19 bytes of nonce to avoid a second SHA
-            // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
@@ -1487,6 +1617,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -1513,6 +1645,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1716,8 +1850,8 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
                     } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
                         uint160 hashBytes(Hash160(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.end()-1));
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, hash, j, false), prevout.nValue));
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, hash, j), CAddressUnspentValue()));
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undoHeight)));
                     } else {
                         continue;
                     }
@@ -1757,6 +1891,11 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
             AbortNode("Failed to write address unspent index");
             return DISCONNECT_FAILED;
         }
+        // Like the token groups, the aggregates are kept when the disconnect is only checked
+        if (fDisconnectTokens && !UpdateAddressAggregates(addressIndex, pindex, true)) {
+            AbortNode("Failed to write address aggregates");
+            return DISCONNECT_FAILED;
+        }
     }
 
     evoDb->WriteBestBlock(pindex->pprev->GetBlockHash());
@@ -1792,10 +1931,207 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
+    static std::atomic<int> nScriptCheckWorkers(0);
+    int nWorker = nScriptCheckWorkers++;
     RenameThread("ion-scriptch");
+    // Consecutive cpus usually share a NUMA node, so the workers stealing from their neighbours stay close together.
+    // The cpus are taken from the affinity mask inherited from the process (e.g. set by taskset or a cpuset), not
+    // assumed to be 0..n-1. The workers start at the second allowed cpu, so with fewer workers than cpus the first
+    // one is never taken by a worker. The thread connecting the block isn't pinned, it can run on any of them.
+    if (gArgs.GetBoolArg("-parpin", DEFAULT_SCRIPTCHECK_PIN)) {
+        std::vector<int> vCpus = GetThreadAffinityCpus();
+        if (!vCpus.empty())
+            SetThreadAffinity(vCpus[(nWorker + 1) % vCpus.size()]);
+    }
     scriptcheckqueue.Thread();
 }
 
+bool CheckInputScriptsParallel(const std::vector<CTransactionRef>& vtx, const std::vector<std::vector<CTxOut> >& vSpentOutputs,
+                               unsigned int flags, bool cacheSigStore, std::vector<bool>* pvValid)
+{
+    assert(vtx.size() == vSpentOutputs.size());
+
+    // The checks keep pointers to their PrecomputedTransactionData and failure flag, so neither may be reallocated
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vtx.size());
+    std::unique_ptr<std::atomic<bool>[]> vFailed(new std::atomic<bool>[vtx.size()]);
+
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        const CTransaction& tx = *vtx[i];
+        const std::vector<CTxOut>& vSpent = vSpentOutputs[i];
+        assert(vSpent.size() == tx.vin.size());
+        txdata.emplace_back(tx);
+        vFailed[i] = false;
+
+        std::vector<CScriptCheck> vChecks;
+        if (nScriptCheckThreads)
+            vChecks.reserve(tx.vin.size());
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            CScriptCheck check(vSpent[j].scriptPubKey, vSpent[j].nValue, tx, j, flags, cacheSigStore, &txdata.back());
+            // Every transaction is verified independently, a failing one doesn't stop the checks of the others
+            check.SetFailureFlag(&vFailed[i]);
+            if (nScriptCheckThreads) {
+                vChecks.push_back(CScriptCheck());
+                check.swap(vChecks.back());
+            } else {
+                check();
+            }
+        }
+        control.Add(vChecks);
+    }
+    control.Wait();
+
+    bool fAllOk = true;
+    if (pvValid)
+        pvValid->assign(vtx.size(), true);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!vFailed[i])
+            continue;
+        fAllOk = false;
+        if (pvValid)
+            (*pvValid)[i] = false;
+    }
+    return fAllOk;
+}
+
+/** Maximum number of inputs verified under one control of the script check queue during a batch pre-validation */
+static const size_t MEMPOOL_BATCH_SCRIPT_CHECK_INPUTS = 1000;
+
+void PreValidateMempoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx,
+                             std::vector<std::vector<COutPoint> >* pvCoinsToUncache)
+{
+    AssertLockNotHeld(cs_main);
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Snapshot the outputs spent by every transaction whose inputs are known to the chain tip, the mempool or an
+    // earlier transaction of the batch
+    std::vector<CTransactionRef> vPrecheck;
+    std::vector<std::vector<CTxOut> > vSpentOutputs;
+    if (pvCoinsToUncache)
+        pvCoinsToUncache->assign(vtx.size(), std::vector<COutPoint>());
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        std::map<uint256, const CTransaction*> mapBatchTxs;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const CTransaction& tx = *vtx[i];
+            mapBatchTxs.emplace(tx.GetHash(), &tx);
+            if (tx.IsCoinBase() || tx.HasZerocoinSpendInputs() || pool.exists(tx.GetHash()))
+                continue;
+            // Pre-validated before, e.g. an orphan pre-validated with its parent
+            if (scriptExecutionCache.contains(GetScriptExecutionCacheEntry(tx, STANDARD_SCRIPT_VERIFY_FLAGS), false))
+                continue;
+
+            std::vector<CTxOut> vSpent;
+            vSpent.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                auto itParent = mapBatchTxs.find(txin.prevout.hash);
+                if (itParent != mapBatchTxs.end()) {
+                    if (txin.prevout.n >= itParent->second->vout.size())
+                        break;
+                    vSpent.push_back(itParent->second->vout[txin.prevout.n]);
+                    continue;
+                }
+                bool fCached = pcoinsTip->HaveCoinInCache(txin.prevout);
+                Coin coin;
+                bool fHave = viewMemPool.GetCoin(txin.prevout, coin) && !coin.IsSpent();
+                // Without a caller to clean up, leave the coins cache as it was
+                if (!fCached && pvCoinsToUncache)
+                    (*pvCoinsToUncache)[i].push_back(txin.prevout);
+                else if (!fCached)
+                    pcoinsTip->Uncache(txin.prevout);
+                if (!fHave)
+                    break;
+                vSpent.push_back(coin.out);
+            }
+            if (vSpent.size() == tx.vin.size()) {
+                vPrecheck.push_back(vtx[i]);
+                vSpentOutputs.push_back(std::move(vSpent));
+            }
+        }
+    }
+    int64_t nTime1 = GetTimeMicros();
+
+    // Verify the scripts without holding any locks. Transactions failing the cheap checks are not script checked.
+    // Those passing the standard script checks are added to the script execution cache, so their admission only
+    // repeats the checks against the flags of the current block, which find their signatures in the signature
+    // cache. Failures are reported by the admission.
+    // The script check queue serves one caller at a time and a block connect waits for it, so the scripts are
+    // verified in chunks of limited size.
+    size_t nValid = 0;
+    {
+        std::vector<CTransactionRef> vScriptCheck;
+        std::vector<std::vector<CTxOut> > vScriptSpent;
+        size_t nScriptCheckInputs = 0;
+        for (size_t i = 0; i < vPrecheck.size(); i++) {
+            CValidationState stateDummy;
+            std::string reason;
+            if (CheckTransaction(*vPrecheck[i], stateDummy, true) && (!fRequireStandard || IsStandardTx(*vPrecheck[i], reason))) {
+                nScriptCheckInputs += vPrecheck[i]->vin.size();
+                vScriptCheck.push_back(vPrecheck[i]);
+                vScriptSpent.push_back(std::move(vSpentOutputs[i]));
+            }
+            if (vScriptCheck.empty() || (nScriptCheckInputs < MEMPOOL_BATCH_SCRIPT_CHECK_INPUTS && i + 1 < vPrecheck.size()))
+                continue;
+
+            std::vector<bool> vValid;
+            CheckInputScriptsParallel(vScriptCheck, vScriptSpent, STANDARD_SCRIPT_VERIFY_FLAGS, true, &vValid);
+            {
+                LOCK(cs_main); // for scriptExecutionCache
+                for (size_t j = 0; j < vScriptCheck.size(); j++) {
+                    if (!vValid[j])
+                        continue;
+                    scriptExecutionCache.insert(GetScriptExecutionCacheEntry(*vScriptCheck[j], STANDARD_SCRIPT_VERIFY_FLAGS));
+                    nValid++;
+                }
+            }
+            vScriptCheck.clear();
+            vScriptSpent.clear();
+            nScriptCheckInputs = 0;
+        }
+    }
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint(BCLog::BENCHMARK, "%s: %u/%u txs pre-validated, %u valid, snapshot %.2fms, scripts %.2fms\n", __func__,
+             vPrecheck.size(), vtx.size(), nValid, 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime2 - nTime1));
+}
+
+size_t AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState,
+                               bool fLimitFree, std::vector<bool>* pvMissingInputs, const std::vector<int64_t>* pvAcceptTime)
+{
+    assert(!pvAcceptTime || pvAcceptTime->size() == vtx.size());
+    const CChainParams& chainparams = Params();
+
+    vState.assign(vtx.size(), CValidationState());
+    if (pvMissingInputs)
+        pvMissingInputs->assign(vtx.size(), false);
+
+    std::vector<std::vector<COutPoint> > vCoinsToUncache;
+    PreValidateMempoolBatch(pool, vtx, &vCoinsToUncache);
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Admit the transactions in order, only holding cs_main for one transaction at a time
+    size_t nAccepted = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        LOCK(cs_main);
+        bool fMissingInputs = false;
+        int64_t nAcceptTime = pvAcceptTime ? (*pvAcceptTime)[i] : GetTime();
+        if (AcceptToMemoryPoolWithTime(chainparams, pool, vState[i], vtx[i], fLimitFree, &fMissingInputs, nAcceptTime, false, 0, false)) {
+            nAccepted++;
+        } else {
+            for (const COutPoint& outpoint : vCoinsToUncache[i])
+                pcoinsTip->Uncache(outpoint);
+        }
+        if (pvMissingInputs)
+            (*pvMissingInputs)[i] = fMissingInputs;
+    }
+
+    LogPrint(BCLog::BENCHMARK, "%s: %u/%u txs accepted, admission %.2fms\n", __func__,
+             nAccepted, vtx.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+    return nAccepted;
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2446,6 +2782,10 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+
+        if (!UpdateAddressAggregates(addressIndex, pindex, false)) {
+            return AbortNode(state, "Failed to write address aggregates");
+        }
     }
 
     if (fSpentIndex)
@@ -2456,6 +2796,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
             return AbortNode(state, "Failed to write timestamp index");
 
+    if (pblockfilterindex && !pblockfilterindex->BlockConnected(block, blockundo, pindex))
+        return AbortNode(state, "Failed to write block filter index");
+
     if (!pTokenDB->WriteTokenGroupsBatch(newTokenGroups))
         return AbortNode(state, "Failed to write token creation data");
     if (!tokenGroupManager->AddTokenGroups(newTokenGroups)) {
@@ -2703,6 +3046,8 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         assert(flushed);
         dbTx->Commit();
     }
+    if (pblockfilterindex && !pblockfilterindex->BlockDisconnected(pindexDelete))
+        return AbortNode(state, "Failed to update block filter index");
     LogPrint(BCLog::BENCHMARK, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
@@ -4903,11 +5248,13 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Version 2 adds the id of the mempool journal continuing the snapshot
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Number of transactions pre-validated together when loading the mempool
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
 
 bool LoadMempool(void)
 {
-    const CChainParams& chainparams = Params();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
     FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
     CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
@@ -4921,12 +5268,19 @@ bool LoadMempool(void)
     int64_t failed = 0;
     int64_t nNow = GetTime();
 
+    std::vector<CTransactionRef> vtx;
+    std::vector<int64_t> vTime;
+    std::map<uint256, CAmount> mapDeltas;
+    uint64_t nSnapshotId = 0;
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        if (version >= 2) {
+            file >> nSnapshotId;
+        }
         uint64_t num;
         file >> num;
         while (num--) {
@@ -4937,70 +5291,81 @@ bool LoadMempool(void)
             file >> nTime;
             file >> nFeeDelta;
 
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, true, nullptr, nTime, false, 0, false);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
-                }
-            } else {
-                ++skipped;
+            if (nFeeDelta) {
+                mapDeltas[tx->GetHash()] += nFeeDelta;
             }
-            if (ShutdownRequested())
-                return false;
+            vtx.push_back(tx);
+            vTime.push_back(nTime);
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
-
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.second);
+        std::map<uint256, CAmount> mapOtherDeltas;
+        file >> mapOtherDeltas;
+        for (const auto& i : mapOtherDeltas) {
+            mapDeltas[i.first] += i.second;
         }
     } catch (const std::exception& e) {
         LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
         return false;
     }
+    file.fclose();
+
+    // Apply the changes recorded after the snapshot was taken
+    if (nSnapshotId) {
+        CMempoolJournal::Replay(GetDataDir() / MEMPOOL_JOURNAL_FILENAME, nSnapshotId, vtx, vTime, mapDeltas);
+    }
+
+    for (const auto& i : mapDeltas) {
+        if (i.second) {
+            mempool.PrioritiseTransaction(i.first, i.second);
+        }
+    }
+
+    // Re-admit the transactions in batches, in the order they entered the mempool with parents before their
+    // children (the snapshot is sorted by depth, Replay sorts the journal's additions). The scripts of each batch are
+    // verified in parallel on the script check queue before the transactions are admitted one by one.
+    std::vector<CTransactionRef> vBatch;
+    std::vector<int64_t> vBatchTime;
+    std::vector<CValidationState> vState;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vTime[i] + nExpiryTimeout > nNow) {
+            vBatch.push_back(vtx[i]);
+            vBatchTime.push_back(vTime[i]);
+        } else {
+            ++skipped;
+        }
+        if (vBatch.size() < MEMPOOL_LOAD_BATCH_SIZE && i + 1 < vtx.size())
+            continue;
+
+        size_t nAccepted = AcceptToMemoryPoolBatch(mempool, vBatch, vState, true, nullptr, &vBatchTime);
+        count += nAccepted;
+        failed += vBatch.size() - nAccepted;
+        vBatch.clear();
+        vBatchTime.clear();
+        if (ShutdownRequested())
+            return false;
+    }
 
     LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
     return true;
 }
 
-void DumpMempool(void)
+bool DumpMempool(const std::vector<TxMempoolInfo>& vInfo, std::map<uint256, CAmount> mapDeltas, uint64_t nSnapshotId)
 {
     int64_t start = GetTimeMicros();
 
-    std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
-
-    {
-        LOCK(mempool.cs);
-        for (const auto &i : mempool.mapDeltas) {
-            mapDeltas[i.first] = i.second;
-        }
-        vinfo = mempool.infoAll();
-    }
-
-    int64_t mid = GetTimeMicros();
-
     try {
         FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
         if (!filestr) {
-            return;
+            return false;
         }
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << nSnapshotId;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
+        file << (uint64_t)vInfo.size();
+        for (const auto& i : vInfo) {
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
@@ -5012,10 +5377,12 @@ void DumpMempool(void)
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
         int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*0.000001, (last-mid)*0.000001);
+        LogPrint(BCLog::MEMPOOL, "Dumped mempool: %gs to dump\n", (last-start)*0.000001);
     } catch (const std::exception& e) {
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
     }
+    return true;
 }
 
 //! Guess how far we are in the verification process at the given block index
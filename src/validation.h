@@ -36,6 +36,8 @@
 #include "xion/zerocoindb.h"
 
 class CBlockIndex;
+class CBlockUndo;
+class CAddressIndexCursor;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
@@ -49,6 +51,7 @@ class CTxMemPool;
 class CValidationState;
 class PrecomputedTransactionData;
 struct ChainTxData;
+struct TxMempoolInfo;
 
 struct LockPoints;
 
@@ -83,10 +86,12 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
-/** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+/** Maximum number of script-checking threads allowed, the per-worker check queues scale beyond 16 threads */
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parpin default (pin script-checking threads to cpus) */
+static const bool DEFAULT_SCRIPTCHECK_PIN = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -331,6 +336,44 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false,
                         const CAmount nAbsurdFee=0, bool fDryRun=false);
 
+/**
+ * (try to) add a batch of transactions to the memory pool, in order.
+ *
+ * The batch is pre-validated with PreValidateMempoolBatch first. Each transaction is then admitted with the regular
+ * AcceptToMemoryPool checks in a short serialized phase, so the result for every transaction is the same as when
+ * admitting them one by one. vState receives one validation state per transaction, pvMissingInputs (if given)
+ * whether its inputs were missing. pvAcceptTime (if given) holds the acceptance time of each transaction, the
+ * current time is used otherwise. Returns the number of transactions accepted.
+ *
+ * Used to load mempool.dat.
+ */
+size_t AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState,
+                               bool fLimitFree, std::vector<bool>* pvMissingInputs = nullptr,
+                               const std::vector<int64_t>* pvAcceptTime = nullptr);
+
+/**
+ * Verify the input scripts of a batch of transactions on the script check queue without holding cs_main, before
+ * they are admitted with AcceptToMemoryPool. The inputs may spend the chain tip, the mempool or earlier transactions
+ * of the batch. Transactions passing the standard script checks are added to the script execution cache, so their
+ * admission doesn't verify them again under cs_main; failures are left to the admission to report.
+ *
+ * Coins read from disk are returned per transaction in pvCoinsToUncache (if given), for the caller to uncache if the
+ * transaction isn't admitted, and uncached right away otherwise. Relayed transactions and orphans are pre-validated
+ * before net processing takes cs_main for them. The script checks share the script check queue with block
+ * validation, which waits for each chunk of the pre-validation. Must not be called with cs_main held.
+ */
+void PreValidateMempoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx,
+                             std::vector<std::vector<COutPoint> >* pvCoinsToUncache = nullptr);
+
+/**
+ * Verify the input scripts of a set of transactions on the script check queue (or inline without script check
+ * threads). vSpentOutputs[i][j] is the output spent by input j of vtx[i]. Every transaction is verified
+ * independently, pvValid (if given) receives whether its scripts passed. Returns whether all passed. Does not
+ * require cs_main.
+ */
+bool CheckInputScriptsParallel(const std::vector<CTransactionRef>& vtx, const std::vector<std::vector<CTxOut> >& vSpentOutputs,
+                               unsigned int flags, bool cacheSigStore, std::vector<bool>* pvValid = nullptr);
+
 bool GetUTXOCoin(const COutPoint& outpoint, Coin& coin);
 int GetUTXOHeight(const COutPoint& outpoint);
 int GetUTXOConfirmations(const COutPoint& outpoint);
@@ -394,15 +437,22 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    std::atomic<bool> *pfailed;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), pfailed(nullptr) {}
     CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(scriptPubKeyIn), amount(amountIn),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pfailed(nullptr) { }
 
     bool operator()();
 
+    /**
+     * Report a failure to *pfailedIn instead of failing the check, so that a check queue continues with the other
+     * checks. The check is skipped once *pfailedIn is set, e.g. by another input of the same transaction.
+     */
+    void SetFailureFlag(std::atomic<bool> *pfailedIn) { pfailed = pfailedIn; }
+
     void swap(CScriptCheck &check) {
         scriptPubKey.swap(check.scriptPubKey);
         std::swap(ptxTo, check.ptxTo);
@@ -412,6 +462,7 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pfailed, check.pfailed);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -422,6 +473,21 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+/** Totals of the address index entries of an address. Returns false while they are not available. */
+bool GetAddressAggregate(uint160 addressHash, int type, CAddressAggregate &aggregate);
+/**
+ * Keep the address aggregates up to date with the chain from now on if they are in sync with the tip. Called once
+ * the block chain was loaded, before blocks are connected.
+ */
+void InitAddressAggregates();
+/**
+ * Start keeping the address aggregates up to date with the chain, rebuilding them from the address index if they
+ * aren't in sync with the tip, e.g. after -reindex. Called once the blocks were imported.
+ */
+bool SyncAddressAggregates();
+/** Cursor over the address index entries of an address, see CBlockTreeDB::AddressIndexCursor. nullptr without -addressindex. */
+CAddressIndexCursor* GetAddressIndexCursor(uint160 addressHash, int type, int startHeight,
+                                           unsigned int startTxIndex = 0, int endHeight = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 /** Initializes the script-execution cache */
@@ -431,6 +497,7 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -512,10 +579,13 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
-void DumpMempool();
+/**
+ * Write the mempool entries vInfo and the fee deltas mapDeltas to mempool.dat as the snapshot nSnapshotId, which
+ * the mempool journal continues. Returns false if the snapshot couldn't be written.
+ */
+bool DumpMempool(const std::vector<TxMempoolInfo>& vInfo, std::map<uint256, CAmount> mapDeltas, uint64_t nSnapshotId);
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk, applying the mempool journal. */
 bool LoadMempool();
 
 #endif // BITCOIN_VALIDATION_H
@@ -7,10 +7,12 @@
 
 #include "crypto/aes.h"
 #include "crypto/sha512.h"
+#include "ctpl.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "util.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -189,6 +191,45 @@ static bool DecryptKey(const CKeyingMaterial& vMasterKey, const std::vector<unsi
     return key.VerifyPubKey(vchPubKey);
 }
 
+/** Checks that all keys decrypt with vMasterKey and match their public keys, spread over threads for many keys */
+static bool CheckCryptedKeys(const CKeyingMaterial& vMasterKey, const CryptedKeyMap& mapCryptedKeys)
+{
+    std::vector<const std::pair<CPubKey, std::vector<unsigned char> >*> vKeys;
+    vKeys.reserve(mapCryptedKeys.size());
+    for (const auto& entry : mapCryptedKeys) {
+        vKeys.push_back(&entry.second);
+    }
+
+    std::atomic<bool> fFail(false);
+    auto checkRange = [&vMasterKey, &vKeys, &fFail](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd && !fFail; i++) {
+            CKey key;
+            if (!DecryptKey(vMasterKey, vKeys[i]->second, vKeys[i]->first, key)) {
+                fFail = true;
+            }
+        }
+    };
+
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_UNLOCK_THREADS));
+    if (nThreads == 1 || vKeys.size() < MIN_PARALLEL_UNLOCK_KEYS) {
+        checkRange(0, vKeys.size());
+        return !fFail;
+    }
+
+    ctpl::thread_pool pool(nThreads);
+    RenameThreadPool(pool, "ion-unlock");
+    size_t nChunkSize = (vKeys.size() + nThreads - 1) / nThreads;
+    std::vector<std::future<void>> vFutures;
+    for (size_t nBegin = 0; nBegin < vKeys.size(); nBegin += nChunkSize) {
+        size_t nEnd = std::min(nBegin + nChunkSize, vKeys.size());
+        vFutures.emplace_back(pool.push([&checkRange, nBegin, nEnd](int) { checkRange(nBegin, nEnd); }));
+    }
+    for (auto& future : vFutures) {
+        future.get();
+    }
+    return !fFail;
+}
+
 bool CCryptoKeyStore::SetCrypted()
 {
     LOCK(cs_KeyStore);
@@ -225,19 +266,20 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn, bool fForMixin
         bool keyPass = false;
         bool keyFail = false;
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi)
+        if (mi != mapCryptedKeys.end())
         {
+            // a wrong master key already fails at the first key
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
             CKey key;
             if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
-            {
                 keyFail = true;
-                break;
-            }
-            keyPass = true;
-            if (fDecryptionThoroughlyChecked)
-                break;
+            else
+                keyPass = true;
+
+            // the first unlock checks all keys
+            if (keyPass && !fDecryptionThoroughlyChecked && !CheckCryptedKeys(vMasterKeyIn, mapCryptedKeys))
+                keyFail = true;
         }
         if (keyPass && keyFail)
         {
@@ -13,6 +13,9 @@
 const unsigned int WALLET_CRYPTO_KEY_SIZE = 32;
 const unsigned int WALLET_CRYPTO_SALT_SIZE = 8;
 const unsigned int WALLET_CRYPTO_IV_SIZE = 16;
+//! The first unlock checks all keys, in parallel from this many keys on
+const size_t MIN_PARALLEL_UNLOCK_KEYS = 1000;
+const int MAX_UNLOCK_THREADS = 16;
 
 /**
  * Private key encryption is done based on a CMasterKey,
@@ -280,6 +280,51 @@ public:
         return (ret == 0);
     }
 
+    /** Write/erase/check records which were already serialized, used to apply buffered writes */
+    bool WriteRaw(const CSerializeData& vchKey, const CSerializeData& vchValue, bool fOverwrite = true)
+    {
+        if (!pdb)
+            return true;
+        if (fReadOnly)
+            assert(!"Write called on database in read-only mode");
+
+        Dbt datKey(const_cast<char*>(vchKey.data()), vchKey.size());
+        Dbt datValue(const_cast<char*>(vchValue.data()), vchValue.size());
+        int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        return (ret == 0);
+    }
+
+    bool EraseRaw(const CSerializeData& vchKey)
+    {
+        if (!pdb)
+            return false;
+        if (fReadOnly)
+            assert(!"Erase called on database in read-only mode");
+
+        Dbt datKey(const_cast<char*>(vchKey.data()), vchKey.size());
+        int ret = pdb->del(activeTxn, &datKey, 0);
+        return (ret == 0 || ret == DB_NOTFOUND);
+    }
+
+    bool ExistsRaw(const CSerializeData& vchKey)
+    {
+        if (!pdb)
+            return false;
+
+        Dbt datKey(const_cast<char*>(vchKey.data()), vchKey.size());
+        int ret = pdb->exists(activeTxn, &datKey, 0);
+        return (ret == 0);
+    }
+
+    /** Flush the environment's transaction log to disk. Commits don't sync the log (DB_TXN_WRITE_NOSYNC), this makes
+     *  everything committed so far durable. */
+    bool SyncLog()
+    {
+        if (!pdb)
+            return true;
+        return env->dbenv->log_flush(nullptr) == 0;
+    }
+
     Dbc* GetCursor()
     {
         if (!pdb)
@@ -338,6 +383,11 @@ public:
         return true;
     }
 
+    bool IsTxnActive() const
+    {
+        return activeTxn != nullptr;
+    }
+
     bool TxnCommit()
     {
         if (!pdb || !activeTxn)
@@ -102,9 +102,8 @@ UniValue importprivkey(const JSONRPCRequest& request)
         );
 
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    EnsureWalletIsUnlocked(pwallet);
+    // cs_wallet is not held for the rescan, which takes it chunk by chunk (see ScanForWalletTransactions)
+    LOCK(cs_main);
 
     std::string strSecret = request.params[0].get_str();
     std::string strLabel = "";
@@ -131,6 +130,9 @@ UniValue importprivkey(const JSONRPCRequest& request)
     assert(key.VerifyPubKey(pubkey));
     CKeyID vchAddress = pubkey.GetID();
     {
+        LOCK(pwallet->cs_wallet);
+        EnsureWalletIsUnlocked(pwallet);
+
         pwallet->MarkDirty();
         pwallet->SetAddressBook(vchAddress, strLabel, "receive");
 
@@ -147,11 +149,12 @@ UniValue importprivkey(const JSONRPCRequest& request)
 
         // whenever a key is imported, we need to scan the whole chain
         pwallet->UpdateTimeFirstKey(1);
+    }
 
-        if (fRescan) {
-            pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
-        }
+    if (fRescan) {
+        pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
     }
+    pwallet->ScanWalletUTXOs();
 
     return NullUniValue;
 }
@@ -263,18 +266,22 @@ UniValue importaddress(const JSONRPCRequest& request)
     if (!request.params[3].isNull())
         fP2SH = request.params[3].get_bool();
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    CBitcoinAddress address(request.params[0].get_str());
-    if (address.IsValid()) {
-        if (fP2SH)
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Cannot use the p2sh flag with an address - use a script instead");
-        ImportAddress(pwallet, address, strLabel);
-    } else if (IsHex(request.params[0].get_str())) {
-        std::vector<unsigned char> data(ParseHex(request.params[0].get_str()));
-        ImportScript(pwallet, CScript(data.begin(), data.end()), strLabel, fP2SH);
-    } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Ion address or script");
+    // cs_wallet is not held for the rescan, which takes it chunk by chunk (see ScanForWalletTransactions)
+    LOCK(cs_main);
+    {
+        LOCK(pwallet->cs_wallet);
+
+        CBitcoinAddress address(request.params[0].get_str());
+        if (address.IsValid()) {
+            if (fP2SH)
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Cannot use the p2sh flag with an address - use a script instead");
+            ImportAddress(pwallet, address, strLabel);
+        } else if (IsHex(request.params[0].get_str())) {
+            std::vector<unsigned char> data(ParseHex(request.params[0].get_str()));
+            ImportScript(pwallet, CScript(data.begin(), data.end()), strLabel, fP2SH);
+        } else {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Ion address or script");
+        }
     }
 
     if (fRescan)
@@ -282,6 +289,7 @@ UniValue importaddress(const JSONRPCRequest& request)
         pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
         pwallet->ReacceptWalletTransactions();
     }
+    pwallet->ScanWalletUTXOs();
 
     return NullUniValue;
 }
@@ -430,16 +438,20 @@ UniValue importpubkey(const JSONRPCRequest& request)
     if (!pubKey.IsFullyValid())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Pubkey is not a valid public key");
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    ImportAddress(pwallet, CBitcoinAddress(pubKey.GetID()), strLabel);
-    ImportScript(pwallet, GetScriptForRawPubKey(pubKey), strLabel, false);
+    // cs_wallet is not held for the rescan, which takes it chunk by chunk (see ScanForWalletTransactions)
+    LOCK(cs_main);
+    {
+        LOCK(pwallet->cs_wallet);
+        ImportAddress(pwallet, CBitcoinAddress(pubKey.GetID()), strLabel);
+        ImportScript(pwallet, GetScriptForRawPubKey(pubKey), strLabel, false);
+    }
 
     if (fRescan)
     {
         pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
         pwallet->ReacceptWalletTransactions();
     }
+    pwallet->ScanWalletUTXOs();
 
     return NullUniValue;
 }
@@ -470,75 +482,81 @@ UniValue importwallet(const JSONRPCRequest& request)
     if (fPruneMode)
         throw JSONRPCError(RPC_WALLET_ERROR, "Importing wallets is disabled in pruned mode");
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // cs_wallet is not held for the rescan, which takes it chunk by chunk (see ScanForWalletTransactions)
+    LOCK(cs_main);
 
-    EnsureWalletIsUnlocked(pwallet);
+    int64_t nTimeBegin;
+    bool fGood = true;
+    {
+        LOCK(pwallet->cs_wallet);
 
-    std::ifstream file;
-    file.open(request.params[0].get_str().c_str(), std::ios::in | std::ios::ate);
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
+        EnsureWalletIsUnlocked(pwallet);
 
-    int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
+        std::ifstream file;
+        file.open(request.params[0].get_str().c_str(), std::ios::in | std::ios::ate);
+        if (!file.is_open())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
 
-    bool fGood = true;
+        nTimeBegin = chainActive.Tip()->GetBlockTime();
 
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
-
-    pwallet->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
-    while (file.good()) {
-        pwallet->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
-        std::string line;
-        std::getline(file, line);
-        if (line.empty() || line[0] == '#')
-            continue;
-
-        std::vector<std::string> vstr;
-        boost::split(vstr, line, boost::is_any_of(" "));
-        if (vstr.size() < 2)
-            continue;
-        CBitcoinSecret vchSecret;
-        if (!vchSecret.SetString(vstr[0]))
-            continue;
-        CKey key = vchSecret.GetKey();
-        CPubKey pubkey = key.GetPubKey();
-        assert(key.VerifyPubKey(pubkey));
-        CKeyID keyid = pubkey.GetID();
-        if (pwallet->HaveKey(keyid)) {
-            LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
-            continue;
-        }
-        int64_t nTime = DecodeDumpTime(vstr[1]);
-        std::string strLabel;
-        bool fLabel = true;
-        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-            if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                break;
-            if (vstr[nStr] == "change=1")
-                fLabel = false;
-            if (vstr[nStr] == "reserve=1")
-                fLabel = false;
-            if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                fLabel = true;
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
+
+        pwallet->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
+        while (file.good()) {
+            pwallet->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+            std::string line;
+            std::getline(file, line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::vector<std::string> vstr;
+            boost::split(vstr, line, boost::is_any_of(" "));
+            if (vstr.size() < 2)
+                continue;
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(vstr[0]))
+                continue;
+            CKey key = vchSecret.GetKey();
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID keyid = pubkey.GetID();
+            if (pwallet->HaveKey(keyid)) {
+                LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
+                continue;
             }
+            int64_t nTime = DecodeDumpTime(vstr[1]);
+            std::string strLabel;
+            bool fLabel = true;
+            for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+                if (boost::algorithm::starts_with(vstr[nStr], "#"))
+                    break;
+                if (vstr[nStr] == "change=1")
+                    fLabel = false;
+                if (vstr[nStr] == "reserve=1")
+                    fLabel = false;
+                if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+                    strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                    fLabel = true;
+                }
+            }
+            LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
+            if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                fGood = false;
+                continue;
+            }
+            pwallet->mapKeyMetadata[keyid].nCreateTime = nTime;
+            if (fLabel)
+                pwallet->SetAddressBook(keyid, strLabel, "receive");
+            nTimeBegin = std::min(nTimeBegin, nTime);
         }
-        LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
-        if (!pwallet->AddKeyPubKey(key, pubkey)) {
-            fGood = false;
-            continue;
-        }
-        pwallet->mapKeyMetadata[keyid].nCreateTime = nTime;
-        if (fLabel)
-            pwallet->SetAddressBook(keyid, strLabel, "receive");
-        nTimeBegin = std::min(nTimeBegin, nTime);
-    }
-    file.close();
-    pwallet->ShowProgress("", 100); // hide progress dialog in GUI
+        file.close();
+        pwallet->ShowProgress("", 100); // hide progress dialog in GUI
 
-    pwallet->UpdateTimeFirstKey(nTimeBegin);
+        pwallet->UpdateTimeFirstKey(nTimeBegin);
+    }
     pwallet->RescanFromTime(nTimeBegin, false /* update */);
+    pwallet->ScanWalletUTXOs();
     pwallet->MarkDirty();
 
     if (!fGood)
@@ -572,108 +590,114 @@ UniValue importelectrumwallet(const JSONRPCRequest& request)
     if (fPruneMode)
         throw JSONRPCError(RPC_WALLET_ERROR, "Importing wallets is disabled in pruned mode");
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    EnsureWalletIsUnlocked(pwallet);
-
-    std::ifstream file;
-    std::string strFileName = request.params[0].get_str();
-    size_t nDotPos = strFileName.find_last_of(".");
-    if(nDotPos == std::string::npos)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "File has no extension, should be .json or .csv");
-
-    std::string strFileExt = strFileName.substr(nDotPos+1);
-    if(strFileExt != "json" && strFileExt != "csv")
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "File has wrong extension, should be .json or .csv");
-
-    file.open(strFileName.c_str(), std::ios::in | std::ios::ate);
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open Electrum wallet export file");
+    // cs_wallet is not held for the rescan, which takes it chunk by chunk (see ScanForWalletTransactions)
+    LOCK(cs_main);
 
+    int nStartHeight;
     bool fGood = true;
-
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
-
-    pwallet->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
-
-    if(strFileExt == "csv") {
-        while (file.good()) {
-            pwallet->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
-            std::string line;
-            std::getline(file, line);
-            if (line.empty() || line == "address,private_key")
-                continue;
-            std::vector<std::string> vstr;
-            boost::split(vstr, line, boost::is_any_of(","));
-            if (vstr.size() < 2)
-                continue;
-            CBitcoinSecret vchSecret;
-            if (!vchSecret.SetString(vstr[1]))
-                continue;
-            CKey key = vchSecret.GetKey();
-            CPubKey pubkey = key.GetPubKey();
-            assert(key.VerifyPubKey(pubkey));
-            CKeyID keyid = pubkey.GetID();
-            if (pwallet->HaveKey(keyid)) {
-                LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
-                continue;
-            }
-            LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
-            if (!pwallet->AddKeyPubKey(key, pubkey)) {
-                fGood = false;
-                continue;
-            }
-        }
-    } else {
-        // json
-        char* buffer = new char [nFilesize];
-        file.read(buffer, nFilesize);
-        UniValue data(UniValue::VOBJ);
-        if(!data.read(buffer))
-            throw JSONRPCError(RPC_TYPE_ERROR, "Cannot parse Electrum wallet export file");
-        delete[] buffer;
-
-        std::vector<std::string> vKeys = data.getKeys();
-
-        for (size_t i = 0; i < data.size(); i++) {
-            pwallet->ShowProgress("", std::max(1, std::min(99, int(i*100/data.size()))));
-            if(!data[vKeys[i]].isStr())
-                continue;
-            CBitcoinSecret vchSecret;
-            if (!vchSecret.SetString(data[vKeys[i]].get_str()))
-                continue;
-            CKey key = vchSecret.GetKey();
-            CPubKey pubkey = key.GetPubKey();
-            assert(key.VerifyPubKey(pubkey));
-            CKeyID keyid = pubkey.GetID();
-            if (pwallet->HaveKey(keyid)) {
-                LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
-                continue;
+    {
+        LOCK(pwallet->cs_wallet);
+
+        EnsureWalletIsUnlocked(pwallet);
+
+        std::ifstream file;
+        std::string strFileName = request.params[0].get_str();
+        size_t nDotPos = strFileName.find_last_of(".");
+        if(nDotPos == std::string::npos)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "File has no extension, should be .json or .csv");
+
+        std::string strFileExt = strFileName.substr(nDotPos+1);
+        if(strFileExt != "json" && strFileExt != "csv")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "File has wrong extension, should be .json or .csv");
+
+        file.open(strFileName.c_str(), std::ios::in | std::ios::ate);
+        if (!file.is_open())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open Electrum wallet export file");
+
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
+
+        pwallet->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
+
+        if(strFileExt == "csv") {
+            while (file.good()) {
+                pwallet->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+                std::string line;
+                std::getline(file, line);
+                if (line.empty() || line == "address,private_key")
+                    continue;
+                std::vector<std::string> vstr;
+                boost::split(vstr, line, boost::is_any_of(","));
+                if (vstr.size() < 2)
+                    continue;
+                CBitcoinSecret vchSecret;
+                if (!vchSecret.SetString(vstr[1]))
+                    continue;
+                CKey key = vchSecret.GetKey();
+                CPubKey pubkey = key.GetPubKey();
+                assert(key.VerifyPubKey(pubkey));
+                CKeyID keyid = pubkey.GetID();
+                if (pwallet->HaveKey(keyid)) {
+                    LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
+                    continue;
+                }
+                LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
+                if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                    fGood = false;
+                    continue;
+                }
             }
-            LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
-            if (!pwallet->AddKeyPubKey(key, pubkey)) {
-                fGood = false;
-                continue;
+        } else {
+            // json
+            char* buffer = new char [nFilesize];
+            file.read(buffer, nFilesize);
+            UniValue data(UniValue::VOBJ);
+            if(!data.read(buffer))
+                throw JSONRPCError(RPC_TYPE_ERROR, "Cannot parse Electrum wallet export file");
+            delete[] buffer;
+
+            std::vector<std::string> vKeys = data.getKeys();
+
+            for (size_t i = 0; i < data.size(); i++) {
+                pwallet->ShowProgress("", std::max(1, std::min(99, int(i*100/data.size()))));
+                if(!data[vKeys[i]].isStr())
+                    continue;
+                CBitcoinSecret vchSecret;
+                if (!vchSecret.SetString(data[vKeys[i]].get_str()))
+                    continue;
+                CKey key = vchSecret.GetKey();
+                CPubKey pubkey = key.GetPubKey();
+                assert(key.VerifyPubKey(pubkey));
+                CKeyID keyid = pubkey.GetID();
+                if (pwallet->HaveKey(keyid)) {
+                    LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
+                    continue;
+                }
+                LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
+                if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                    fGood = false;
+                    continue;
+                }
             }
         }
+        file.close();
+        pwallet->ShowProgress("", 100); // hide progress dialog in GUI
+
+        // Whether to perform rescan after import
+        nStartHeight = 0;
+        if (request.params.size() > 1)
+            nStartHeight = request.params[1].get_int();
+        if (chainActive.Height() < nStartHeight)
+            nStartHeight = chainActive.Height();
+
+        // Assume that electrum wallet was created at that block
+        int nTimeBegin = chainActive[nStartHeight]->GetBlockTime();
+        pwallet->UpdateTimeFirstKey(nTimeBegin);
     }
-    file.close();
-    pwallet->ShowProgress("", 100); // hide progress dialog in GUI
-
-    // Whether to perform rescan after import
-    int nStartHeight = 0;
-    if (request.params.size() > 1)
-        nStartHeight = request.params[1].get_int();
-    if (chainActive.Height() < nStartHeight)
-        nStartHeight = chainActive.Height();
-
-    // Assume that electrum wallet was created at that block
-    int nTimeBegin = chainActive[nStartHeight]->GetBlockTime();
-    pwallet->UpdateTimeFirstKey(nTimeBegin);
 
     LogPrintf("Rescanning %i blocks\n", chainActive.Height() - nStartHeight + 1);
     pwallet->ScanForWalletTransactions(chainActive[nStartHeight], true);
+    pwallet->ScanWalletUTXOs();
 
     if (!fGood)
         throw JSONRPCError(RPC_WALLET_ERROR, "Error adding some keys to wallet");
@@ -1301,8 +1325,8 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
         }
     }
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-    EnsureWalletIsUnlocked(pwallet);
+    // cs_wallet is not held for the rescan, which takes it chunk by chunk (see ScanForWalletTransactions)
+    LOCK(cs_main);
 
     // Verify all timestamps are present before importing any keys.
     const int64_t now = chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : 0;
@@ -1322,23 +1346,28 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
 
     UniValue response(UniValue::VARR);
 
-    for (const UniValue& data : requests.getValues()) {
-        const int64_t timestamp = std::max(GetImportTimestamp(data, now), minimumTimestamp);
-        const UniValue result = ProcessImport(pwallet, data, timestamp);
-        response.push_back(result);
+    {
+        LOCK(pwallet->cs_wallet);
+        EnsureWalletIsUnlocked(pwallet);
 
-        if (!fRescan) {
-            continue;
-        }
+        for (const UniValue& data : requests.getValues()) {
+            const int64_t timestamp = std::max(GetImportTimestamp(data, now), minimumTimestamp);
+            const UniValue result = ProcessImport(pwallet, data, timestamp);
+            response.push_back(result);
 
-        // If at least one request was successful then allow rescan.
-        if (result["success"].get_bool()) {
-            fRunScan = true;
-        }
+            if (!fRescan) {
+                continue;
+            }
+
+            // If at least one request was successful then allow rescan.
+            if (result["success"].get_bool()) {
+                fRunScan = true;
+            }
 
-        // Get the lowest timestamp.
-        if (timestamp < nLowestTimestamp) {
-            nLowestTimestamp = timestamp;
+            // Get the lowest timestamp.
+            if (timestamp < nLowestTimestamp) {
+                nLowestTimestamp = timestamp;
+            }
         }
     }
 
@@ -1379,6 +1408,7 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
             }
         }
     }
+    pwallet->ScanWalletUTXOs();
 
     return response;
 }
@@ -2224,15 +2224,24 @@ UniValue keypoolrefill(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() > 1)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "keypoolrefill ( newsize )\n"
+            "keypoolrefill ( newsize verbose )\n"
             "\nFills the keypool."
             + HelpRequiringPassphrase(pwallet) + "\n"
             "\nArguments:\n"
             "1. newsize     (numeric, optional, default=" + itostr(DEFAULT_KEYPOOL_SIZE) + ") The new keypool size\n"
+            "2. verbose     (boolean, optional, default=false) Return how many keys were generated and how fast\n"
+            "\nResult (if verbose is true):\n"
+            "{\n"
+            "  \"keys_added\": xxxx,        (numeric) Number of keys added to the keypool\n"
+            "  \"internal_keys_added\": xxxx, (numeric) How many of them are internal (change) keys\n"
+            "  \"time_ms\": xxxx,           (numeric) Time it took to generate and store the keys in milliseconds\n"
+            "  \"keys_per_second\": x.xxx   (numeric) Number of keys generated per second\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("keypoolrefill", "")
+            + HelpExampleCli("keypoolrefill", "100000 true")
             + HelpExampleRpc("keypoolrefill", "")
         );
 
@@ -2246,14 +2255,30 @@ UniValue keypoolrefill(const JSONRPCRequest& request)
         kpSize = (unsigned int)request.params[0].get_int();
     }
 
+    bool fVerbose = !request.params[1].isNull() && request.params[1].get_bool();
+
     EnsureWalletIsUnlocked(pwallet);
+    size_t nKeysBefore = pwallet->GetKeyPoolSize();
+    size_t nInternalKeysBefore = pwallet->KeypoolCountInternalKeys();
+    int64_t nStartTime = GetTimeMillis();
     pwallet->TopUpKeyPool(kpSize);
+    int64_t nDuration = GetTimeMillis() - nStartTime;
 
     if (pwallet->GetKeyPoolSize() < (pwallet->IsHDEnabled() ? kpSize * 2 : kpSize)) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Error refreshing keypool.");
     }
 
-    return NullUniValue;
+    if (!fVerbose) {
+        return NullUniValue;
+    }
+
+    size_t nKeysAdded = pwallet->GetKeyPoolSize() - nKeysBefore;
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("keys_added", (uint64_t)nKeysAdded));
+    result.push_back(Pair("internal_keys_added", (uint64_t)(pwallet->KeypoolCountInternalKeys() - nInternalKeysBefore)));
+    result.push_back(Pair("time_ms", nDuration));
+    result.push_back(Pair("keys_per_second", nKeysAdded * 1000.0 / std::max(nDuration, (int64_t)1)));
+    return result;
 }
 
 
@@ -2729,10 +2754,10 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "{\n"
             "  \"walletname\": xxxxx,             (string) the wallet name\n"
             "  \"walletversion\": xxxxx,     (numeric) the wallet version\n"
-            "  \"balance\": xxxxxxx,         (numeric) the total confirmed balance of the wallet in " + CURRENCY_UNIT + "\n"
-            "  \"privatesend_balance\": xxxxxx, (numeric) the PrivateSend balance in " + CURRENCY_UNIT + "\n"
-            "  \"unconfirmed_balance\": xxx, (numeric) the total unconfirmed balance of the wallet in " + CURRENCY_UNIT + "\n"
-            "  \"immature_balance\": xxxxxx, (numeric) the total immature balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "  \"balance\": xxxxxxx,         (numeric) the total confirmed balance of the wallet in " + CURRENCY_UNIT + ", null while rescanning\n"
+            "  \"privatesend_balance\": xxxxxx, (numeric) the PrivateSend balance in " + CURRENCY_UNIT + ", null while rescanning\n"
+            "  \"unconfirmed_balance\": xxx, (numeric) the total unconfirmed balance of the wallet in " + CURRENCY_UNIT + ", null while rescanning\n"
+            "  \"immature_balance\": xxxxxx, (numeric) the total immature balance of the wallet in " + CURRENCY_UNIT + ", null while rescanning\n"
             "  \"txcount\": xxxxxxx,         (numeric) the total number of transactions in the wallet\n"
             "  \"keypoololdest\": xxxxxx,    (numeric) the timestamp (seconds since Unix epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated (only counts external keys)\n"
@@ -2750,24 +2775,58 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "      }\n"
             "      ,...\n"
             "    ]\n"
+            "  \"scanning\": {             (json object) only present while the wallet is rescanning the block chain\n"
+            "    \"start_height\": xxxx,       (numeric) height of the first block of the rescan\n"
+            "    \"height\": xxxx,             (numeric) height of the last block applied to the wallet\n"
+            "    \"tip_height\": xxxx,         (numeric) height of the last block which will be scanned\n"
+            "    \"progress\": x.xxx,          (numeric) scanned fraction of the blocks\n"
+            "    \"duration\": xxxx,           (numeric) seconds since the rescan started\n"
+            "    \"blocks_per_second\": x.xxx, (numeric) average number of blocks scanned per second\n"
+            "    \"txs_per_second\": x.xxx,    (numeric) average number of transactions scanned per second\n"
+            "    \"candidate_txs\": xxxx,      (numeric) number of transactions which involve the wallet or had to be checked further\n"
+            "    \"skipped_blocks\": xxxx,     (numeric) number of blocks skipped because of their block filter (-rescanblockfilters)\n"
+            "    \"threads\": xx,              (numeric) number of threads reading and matching blocks\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
             + HelpExampleRpc("getwalletinfo", "")
         );
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("walletname", pwallet->GetName()));
+
+    // Rescans hold cs_main until they are done, but release cs_wallet from time to time. So while the wallet is
+    // rescanning, only wait for cs_wallet and report the balances, which depend on the chain, as unavailable.
+    CWalletScanProgress scanProgress;
+    bool fScanning = pwallet->GetScanProgress(scanProgress);
+    UniValue scanning(UniValue::VOBJ);
+    if (fScanning) {
+        int64_t nDuration = std::max<int64_t>(GetTimeMillis() - scanProgress.nStartTimeMillis, 1);
+        int nBlocksTotal = scanProgress.nTipHeight - scanProgress.nStartHeight + 1;
+        scanning.push_back(Pair("start_height", scanProgress.nStartHeight));
+        scanning.push_back(Pair("height", scanProgress.nHeight));
+        scanning.push_back(Pair("tip_height", scanProgress.nTipHeight));
+        scanning.push_back(Pair("progress", nBlocksTotal > 0 ? (double)scanProgress.nBlocks / nBlocksTotal : 1.0));
+        scanning.push_back(Pair("duration", nDuration / 1000));
+        scanning.push_back(Pair("blocks_per_second", (double)scanProgress.nBlocks * 1000 / nDuration));
+        scanning.push_back(Pair("txs_per_second", (double)scanProgress.nTxs * 1000 / nDuration));
+        scanning.push_back(Pair("candidate_txs", scanProgress.nCandidateTxs));
+        scanning.push_back(Pair("skipped_blocks", scanProgress.nSkippedBlocks));
+        scanning.push_back(Pair("threads", scanProgress.nThreads));
+    }
+
+    CCriticalBlock lockMain(cs_main, "cs_main", __FILE__, __LINE__, fScanning);
+    LOCK(pwallet->cs_wallet);
+    bool fChainAvailable = lockMain;
 
     CHDChain hdChainCurrent;
     bool fHDEnabled = pwallet->GetHDChain(hdChainCurrent);
-    UniValue obj(UniValue::VOBJ);
-
-    obj.push_back(Pair("walletname", pwallet->GetName()));
     obj.push_back(Pair("walletversion", pwallet->GetVersion()));
-    obj.push_back(Pair("balance",       ValueFromAmount(pwallet->GetBalance())));
-    obj.push_back(Pair("privatesend_balance",       ValueFromAmount(pwallet->GetAnonymizedBalance())));
-    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(pwallet->GetUnconfirmedBalance())));
-    obj.push_back(Pair("immature_balance",    ValueFromAmount(pwallet->GetImmatureBalance())));
+    obj.push_back(Pair("balance",       fChainAvailable ? ValueFromAmount(pwallet->GetBalance()) : NullUniValue));
+    obj.push_back(Pair("privatesend_balance",       fChainAvailable ? ValueFromAmount(pwallet->GetAnonymizedBalance()) : NullUniValue));
+    obj.push_back(Pair("unconfirmed_balance", fChainAvailable ? ValueFromAmount(pwallet->GetUnconfirmedBalance()) : NullUniValue));
+    obj.push_back(Pair("immature_balance",    fChainAvailable ? ValueFromAmount(pwallet->GetImmatureBalance()) : NullUniValue));
     obj.push_back(Pair("txcount",       (int)pwallet->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize",   (int64_t)pwallet->KeypoolCountExternalKeys()));
@@ -2797,6 +2856,9 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
         }
         obj.push_back(Pair("hdaccounts", accounts));
     }
+    if (fScanning) {
+        obj.push_back(Pair("scanning", scanning));
+    }
     return obj;
 }
 
@@ -3566,7 +3628,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "importaddress",            &importaddress,            true,   {"address","label","rescan","p2sh"} },
     { "wallet",             "importprunedfunds",        &importprunedfunds,        true,   {"rawtransaction","txoutproof"} },
     { "wallet",             "importpubkey",             &importpubkey,             true,   {"pubkey","label","rescan"} },
-    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,   {"newsize"} },
+    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,   {"newsize","verbose"} },
     { "wallet",             "listaccounts",             &listaccounts,             false,  {"minconf","addlocked","include_watchonly"} },
     { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false,  {} },
     { "wallet",             "listaddressbalances",      &listaddressbalances,      false,  {"minamount"} },
@@ -12,6 +12,7 @@
 
 #include "consensus/validation.h"
 #include "rpc/server.h"
+#include "script/tokengroup.h"
 #include "test/test_ion.h"
 #include "validation.h"
 #include "wallet/coincontrol.h"
@@ -503,6 +504,71 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
     vpwallets.erase(vpwallets.begin());
 }
 
+// Check that the copy of the wallet's keys and scripts which the rescan threads
+// match blocks against sees the same outputs as the wallet itself.
+BOOST_FIXTURE_TEST_CASE(rescan_keystore, TestChain100Setup)
+{
+    CWallet wallet;
+    AddKey(wallet, coinbaseKey);
+
+    CKey multisigKey;
+    multisigKey.MakeNewKey(true);
+    CKey watchKey;
+    watchKey.MakeNewKey(true);
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    CScript multisigScript = GetScriptForMultisig(1, {coinbaseKey.GetPubKey(), multisigKey.GetPubKey()});
+    CScript watchScript = GetScriptForDestination(watchKey.GetPubKey().GetID());
+
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK(wallet.AddCScript(multisigScript));
+    BOOST_CHECK(wallet.AddWatchOnly(watchScript, 0));
+
+    std::shared_ptr<const CKeyStore> keystore = wallet.GetRescanKeyStore();
+    std::vector<CScript> scripts = {
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID()),
+        GetScriptForRawPubKey(coinbaseKey.GetPubKey()),
+        GetScriptForDestination(CScriptID(multisigScript)),
+        watchScript,
+        GetScriptForDestination(otherKey.GetPubKey().GetID()),
+    };
+    for (const CScript& script : scripts) {
+        BOOST_CHECK_EQUAL(::IsMine(*keystore, script), ::IsMine(wallet, script));
+    }
+    BOOST_CHECK_EQUAL(::IsMine(*keystore, scripts[0]), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(::IsMine(*keystore, scripts[3]), ISMINE_WATCH_UNSOLVABLE);
+    BOOST_CHECK_EQUAL(::IsMine(*keystore, scripts[4]), ISMINE_NO);
+
+    // the copy does not change with the wallet
+    BOOST_CHECK(wallet.AddKeyPubKey(otherKey, otherKey.GetPubKey()));
+    BOOST_CHECK_EQUAL(::IsMine(*keystore, scripts[4]), ISMINE_NO);
+}
+
+// Check that a rescan which reads and matches blocks on several threads finds
+// the same transactions as a rescan on a single thread.
+BOOST_FIXTURE_TEST_CASE(rescan_threads, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CWalletBalances balances;
+    for (int nThreads : {1, 2}) {
+        gArgs.ForceSetArg("-rescanthreads", std::to_string(nThreads));
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        BOOST_CHECK(wallet.ScanForWalletTransactions(chainActive.Genesis()) == nullptr);
+        CWalletBalances walletBalances = wallet.GetBalances();
+        BOOST_CHECK(walletBalances.nImmature > 0);
+        if (nThreads == 1) {
+            balances = walletBalances;
+        } else {
+            BOOST_CHECK_EQUAL(walletBalances.nTrusted, balances.nTrusted);
+            BOOST_CHECK_EQUAL(walletBalances.nImmature, balances.nImmature);
+        }
+    }
+    gArgs.ForceSetArg("-rescanthreads", std::to_string(DEFAULT_RESCAN_THREADS));
+}
+
 // Check that GetImmatureCredit() returns a newly calculated value instead of
 // the cached value after a MarkDirty() call.
 //
@@ -594,6 +660,143 @@ BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
     BOOST_CHECK_EQUAL(values[1], "val_rr1");
 }
 
+BOOST_AUTO_TEST_CASE(walletdb_batch)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyPool keypool(key.GetPubKey(), false);
+    CKeyPool keypoolRead;
+
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // a scratch db, so that no records are left behind in the one of pwalletMain
+    CWalletDBWrapper dbw(&bitdb, "wallet_batch_test.dat");
+    {
+        CWalletDB walletdb(dbw, "cr+");
+        walletdb.BeginBatch();
+        BOOST_CHECK(walletdb.WritePool(1000, keypool));
+        BOOST_CHECK(walletdb.WriteCScript(Hash160(script), script));
+        // records which must not be overwritten are checked against the buffer too
+        BOOST_CHECK(!walletdb.WriteCScript(Hash160(script), script));
+
+        // buffered records are not visible to other handles...
+        BOOST_CHECK(!CWalletDB(dbw).ReadPool(1000, keypoolRead));
+        // ...but reads through the same handle write them first
+        BOOST_CHECK(walletdb.ReadPool(1000, keypoolRead));
+        BOOST_CHECK(keypoolRead.vchPubKey == keypool.vchPubKey);
+
+        // the last write of a record wins, an erased record can be written again
+        BOOST_CHECK(walletdb.ErasePool(1000));
+        BOOST_CHECK(walletdb.WritePool(1001, keypool));
+        BOOST_CHECK(walletdb.ErasePool(1001));
+        BOOST_CHECK(walletdb.WritePool(1001, keypool));
+        BOOST_CHECK(!walletdb.WriteCScript(Hash160(script), script));
+        BOOST_CHECK(walletdb.SyncBatch());
+    }
+
+    CWalletDB walletdb(dbw);
+    BOOST_CHECK(!walletdb.ReadPool(1000, keypoolRead));
+    BOOST_CHECK(walletdb.ReadPool(1001, keypoolRead));
+
+    // records written inside a transaction started by the caller are not buffered, they are aborted with it
+    walletdb.BeginBatch();
+    BOOST_CHECK(walletdb.TxnBegin());
+    BOOST_CHECK(walletdb.WritePool(1002, keypool));
+    BOOST_CHECK(walletdb.FlushBatch());
+    BOOST_CHECK(walletdb.TxnAbort());
+    BOOST_CHECK(!walletdb.ReadPool(1002, keypoolRead));
+    BOOST_CHECK(walletdb.TxnBegin());
+    BOOST_CHECK(walletdb.WritePool(1003, keypool));
+    BOOST_CHECK(walletdb.TxnCommit());
+    BOOST_CHECK(walletdb.ReadPool(1003, keypoolRead));
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_load_decoded)
+{
+    std::vector<CPubKey> vPubKeys;
+    std::vector<uint256> vTxHashes;
+    {
+        CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_load_test.dat")));
+        LOCK(wallet.cs_wallet);
+        for (int i = 0; i < 200; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+            vPubKeys.push_back(key.GetPubKey());
+        }
+
+        CWalletDB walletdb(wallet.GetDBHandle());
+        for (int i = 0; i < 50; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = i * COIN;
+            tx.vout[0].scriptPubKey = GetScriptForDestination(vPubKeys[i].GetID());
+            CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+            wtx.nOrderPos = i;
+            BOOST_CHECK(walletdb.WriteTx(wtx));
+            vTxHashes.push_back(wtx.GetHash());
+        }
+    }
+
+    // keys and transactions are decoded ahead of loading them, the result is the same
+    CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_load_test.dat")));
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+
+    LOCK(wallet.cs_wallet);
+    for (const CPubKey& pubkey : vPubKeys) {
+        CKey key;
+        BOOST_CHECK(wallet.GetKey(pubkey.GetID(), key));
+        BOOST_CHECK(key.GetPubKey() == pubkey);
+    }
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), vTxHashes.size());
+    for (size_t i = 0; i < vTxHashes.size(); i++) {
+        BOOST_CHECK(wallet.mapWallet.count(vTxHashes[i]));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.at(vTxHashes[i]).nOrderPos, (int64_t)i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_hd)
+{
+    CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_hd_test.dat")));
+    wallet.SetMinVersion(FEATURE_HD);
+    wallet.GenerateNewHDChain();
+
+    // enough keys to be derived in parallel, and a few more one by one
+    BOOST_CHECK(wallet.TopUpKeyPool(MIN_PARALLEL_KEYPOOL_KEYS * 2));
+    BOOST_CHECK(wallet.TopUpKeyPool(MIN_PARALLEL_KEYPOOL_KEYS * 2 + 3));
+
+    LOCK(wallet.cs_wallet);
+    const unsigned int nKeys = MIN_PARALLEL_KEYPOOL_KEYS * 2 + 3;
+    BOOST_CHECK_EQUAL(wallet.KeypoolCountExternalKeys(), nKeys);
+    BOOST_CHECK_EQUAL(wallet.KeypoolCountInternalKeys(), nKeys);
+
+    CHDChain hdChain;
+    BOOST_CHECK(wallet.GetHDChain(hdChain));
+    CHDAccount acc;
+    BOOST_CHECK(hdChain.GetAccount(0, acc));
+    BOOST_CHECK_EQUAL(acc.nExternalChainCounter, nKeys);
+    BOOST_CHECK_EQUAL(acc.nInternalChainCounter, nKeys);
+
+    // the keys are the same as the ones derived one by one
+    for (unsigned int i = 0; i < nKeys; i++) {
+        CExtKey extKey;
+        hdChain.DeriveChildExtKey(0, false, i, extKey);
+        BOOST_CHECK(wallet.HaveKey(extKey.key.GetPubKey().GetID()));
+        hdChain.DeriveChildExtKey(0, true, i, extKey);
+        BOOST_CHECK(wallet.HaveKey(extKey.key.GetPubKey().GetID()));
+    }
+
+    // the first key handed out is the first one derived
+    CPubKey pubkey;
+    CExtKey extKey;
+    hdChain.DeriveChildExtKey(0, false, 0, extKey);
+    BOOST_CHECK(wallet.GetKeyFromPool(pubkey, false));
+    BOOST_CHECK(pubkey == extKey.key.GetPubKey());
+}
+
 class ListCoinsTestingSetup : public TestChain100Setup
 {
 public:
@@ -681,4 +884,200 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+// Checks that the incrementally maintained balances match balances calculated from scratch
+static CWalletBalances CheckIncrementalBalances(CWallet& wallet)
+{
+    CWalletBalances balances = wallet.GetBalances();
+    wallet.MarkBalancesDirty();
+    BOOST_CHECK_EQUAL(wallet.GetBalances().ToString(), balances.ToString());
+    return balances;
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_balances_incremental, ListCoinsTestingSetup)
+{
+    CWalletBalances balances = CheckIncrementalBalances(*wallet);
+    BOOST_CHECK_EQUAL(balances.nTrusted, 500 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 500 * COIN);
+
+    // spend the coin, which adds a new transaction and marks the spent one dirty
+    CWalletTx& wtx = AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    CWalletBalances balancesAfterTx = CheckIncrementalBalances(*wallet);
+    BOOST_CHECK(balancesAfterTx.nTrusted > balances.nTrusted - 2 * COIN);
+
+    // locking a coin (the change output) moves it from the unlocked to the locked balance
+    unsigned int nChangePos = 0;
+    while (nChangePos < wtx.tx->vout.size() && wallet->IsMine(wtx.tx->vout[nChangePos]) != ISMINE_SPENDABLE) {
+        nChangePos++;
+    }
+    BOOST_REQUIRE(nChangePos < wtx.tx->vout.size());
+    COutPoint outpoint(wtx.GetHash(), nChangePos);
+    CAmount nLockedValue = wtx.tx->vout[nChangePos].nValue;
+    {
+        LOCK(wallet->cs_wallet);
+        wallet->LockCoin(outpoint);
+    }
+    balances = CheckIncrementalBalances(*wallet);
+    BOOST_CHECK_EQUAL(balances.nLocked, balancesAfterTx.nLocked + nLockedValue);
+    BOOST_CHECK_EQUAL(balances.nUnlocked, balancesAfterTx.nUnlocked - nLockedValue);
+    {
+        LOCK(wallet->cs_wallet);
+        wallet->UnlockCoin(outpoint);
+    }
+    balances = CheckIncrementalBalances(*wallet);
+    BOOST_CHECK_EQUAL(balances.ToString(), balancesAfterTx.ToString());
+
+    // a new block matures another coinbase transaction without marking it dirty
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    balances = CheckIncrementalBalances(*wallet);
+    BOOST_CHECK(balances.nTrusted > balancesAfterTx.nTrusted);
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_utxo_abandon, ListCoinsTestingSetup)
+{
+    std::vector<COutput> available;
+    wallet->AvailableCoins(available);
+    BOOST_REQUIRE_EQUAL(available.size(), 1);
+    COutPoint outpoint(available[0].tx->GetHash(), available[0].i);
+
+    // spend the coin with a transaction that never makes it into the mempool
+    CWalletTx wtx;
+    CReserveKey reservekey(wallet.get());
+    CAmount fee;
+    int changePos = -1;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransaction({CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false}}, wtx, reservekey, fee, changePos, error, dummy));
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        BOOST_CHECK(wallet->AddToWallet(wtx));
+    }
+    wallet->AvailableCoins(available);
+    BOOST_CHECK(available.empty());
+
+    // abandoning the spend makes the coin available again
+    BOOST_CHECK(wallet->AbandonTransaction(wtx.GetHash()));
+    wallet->AvailableCoins(available);
+    BOOST_REQUIRE_EQUAL(available.size(), 1);
+    BOOST_CHECK(COutPoint(available[0].tx->GetHash(), available[0].i) == outpoint);
+    BOOST_CHECK_EQUAL(CheckIncrementalBalances(*wallet).nTrusted, 500 * COIN);
+
+    // it's spent again once the transaction is no longer abandoned
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        BOOST_CHECK(wallet->AddToWallet(wtx));
+    }
+    wallet->AvailableCoins(available);
+    BOOST_CHECK(available.empty());
+}
+
+BOOST_AUTO_TEST_CASE(wallet_utxo_index)
+{
+    CWalletUTXOIndex index;
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<COutPoint> vecOutpoints;
+    for (int i = 0; i < 10; i++) {
+        vecOutpoints.emplace_back(GetRandHash(), i);
+        index.Add(vecOutpoints.back(), CTxOut((10 - i) * COIN, scriptPubKey));
+    }
+    // adding an outpoint twice is a no-op
+    index.Add(vecOutpoints[0], CTxOut(10 * COIN, scriptPubKey));
+    BOOST_CHECK_EQUAL(index.Size(), 10);
+
+    // amount ranges are inclusive and visited in ascending order
+    std::vector<COutPoint> vecFound;
+    index.ForEach(false, 3 * COIN, 5 * COIN, [&](const COutPoint& outpoint) {
+        vecFound.emplace_back(outpoint);
+        return true;
+    });
+    BOOST_CHECK(vecFound == std::vector<COutPoint>({vecOutpoints[7], vecOutpoints[6], vecOutpoints[5]}));
+
+    // no grouped outputs
+    size_t nGrouped = 0;
+    index.ForEach(true, 0, MAX_MONEY, [&](const COutPoint& outpoint) {
+        nGrouped++;
+        return true;
+    });
+    BOOST_CHECK_EQUAL(nGrouped, 0);
+
+    index.Remove(vecOutpoints[6]);
+    BOOST_CHECK(!index.Contains(vecOutpoints[6]));
+    vecFound.clear();
+    index.ForEach(false, 3 * COIN, 5 * COIN, [&](const COutPoint& outpoint) {
+        vecFound.emplace_back(outpoint);
+        return true;
+    });
+    BOOST_CHECK(vecFound == std::vector<COutPoint>({vecOutpoints[7], vecOutpoints[5]}));
+
+    // iteration stops when the callback returns false
+    size_t nVisited = 0;
+    index.ForEach([&](const COutPoint& outpoint) {
+        return ++nVisited < 3;
+    });
+    BOOST_CHECK_EQUAL(nVisited, 3);
+
+    index.Clear();
+    BOOST_CHECK_EQUAL(index.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_utxo_index_groups)
+{
+    CWalletUTXOIndex index;
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+    CTokenGroupID grpA(uint256S("aa"));
+    CTokenGroupID grpB(uint256S("bb"));
+
+    COutPoint ungrouped(GetRandHash(), 0);
+    COutPoint tokensA(GetRandHash(), 0);
+    COutPoint authorityA(GetRandHash(), 1);
+    COutPoint tokensB(GetRandHash(), 0);
+    index.Add(ungrouped, CTxOut(1 * COIN, GetScriptForDestination(keyID)));
+    index.Add(tokensA, CTxOut(0, GetScriptForDestination(keyID, grpA, 100)));
+    index.Add(authorityA, CTxOut(0, GetScriptForDestination(keyID, grpA, (CAmount)(GroupAuthorityFlags::CTRL | GroupAuthorityFlags::MINT))));
+    index.Add(tokensB, CTxOut(0, GetScriptForDestination(keyID, grpB, 50)));
+    BOOST_CHECK_EQUAL(index.GroupCount(), 2);
+
+    // the token group info is decoded when the output is added
+    BOOST_CHECK(index.GetGroupInfo(ungrouped) == nullptr);
+    const CTokenGroupInfo* tgInfo = index.GetGroupInfo(tokensA);
+    BOOST_REQUIRE(tgInfo != nullptr);
+    BOOST_CHECK(tgInfo->associatedGroup == grpA);
+    BOOST_CHECK_EQUAL(tgInfo->quantity, 100);
+    BOOST_CHECK(!tgInfo->isAuthority());
+    tgInfo = index.GetGroupInfo(authorityA);
+    BOOST_REQUIRE(tgInfo != nullptr);
+    BOOST_CHECK(tgInfo->isAuthority());
+    BOOST_CHECK(tgInfo->allowsMint());
+
+    // only the outputs of the requested group are visited
+    std::set<COutPoint> setFound;
+    index.ForEachInGroup(grpA, [&](const COutPoint& outpoint) {
+        setFound.insert(outpoint);
+        return true;
+    });
+    BOOST_CHECK(setFound == std::set<COutPoint>({tokensA, authorityA}));
+
+    setFound.clear();
+    index.ForEachGrouped([&](const COutPoint& outpoint) {
+        setFound.insert(outpoint);
+        return true;
+    });
+    BOOST_CHECK(setFound == std::set<COutPoint>({tokensA, authorityA, tokensB}));
+
+    // a group is dropped from the index with its last output
+    index.Remove(tokensB);
+    BOOST_CHECK_EQUAL(index.GroupCount(), 1);
+    BOOST_CHECK(index.GetGroupInfo(tokensB) == nullptr);
+    size_t nVisited = 0;
+    index.ForEachInGroup(grpB, [&](const COutPoint& outpoint) {
+        nVisited++;
+        return true;
+    });
+    BOOST_CHECK_EQUAL(nVisited, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,7 +8,9 @@
 #include "wallet/wallet.h"
 
 #include "base58.h"
+#include "blockfilterindex.h"
 #include "checkpoints.h"
+#include "ctpl.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "wallet/coincontrol.h"
@@ -47,6 +49,7 @@
 #include "llmq/quorums_chainlocks.h"
 
 #include <assert.h>
+#include <future>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -246,6 +249,130 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, const CKeyMetadata& metadat
         throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
 }
 
+/** Derive the extended public keys of the children nFirstChild... of parentKey, split across the threads of pool if given */
+static void DeriveChildPubKeys(const CExtKey& parentKey, uint32_t nFirstChild, std::vector<CExtPubKey>& vChildKeysRet, ctpl::thread_pool* pool)
+{
+    auto deriveRange = [&parentKey, nFirstChild, &vChildKeysRet](size_t nBegin, size_t nEnd) {
+        CExtKey childKey;
+        for (size_t i = nBegin; i < nEnd; i++) {
+            parentKey.Derive(childKey, nFirstChild + i);
+
+            CExtPubKey& childPubKey = vChildKeysRet[i];
+            childPubKey.nDepth = childKey.nDepth;
+            memcpy(&childPubKey.vchFingerprint[0], &childKey.vchFingerprint[0], 4);
+            childPubKey.nChild = childKey.nChild;
+            childPubKey.pubkey = childKey.key.GetPubKey();
+            childPubKey.chaincode = childKey.chaincode;
+            assert(childKey.key.VerifyPubKey(childPubKey.pubkey));
+        }
+    };
+
+    if (!pool) {
+        deriveRange(0, vChildKeysRet.size());
+        return;
+    }
+
+    // a few chunks per thread, so threads which got slowed down don't hold up the others
+    size_t nChunkSize = std::max((size_t)1, vChildKeysRet.size() / (pool->size() * 4));
+    std::vector<std::future<void>> vFutures;
+    for (size_t nBegin = 0; nBegin < vChildKeysRet.size(); nBegin += nChunkSize) {
+        size_t nEnd = std::min(nBegin + nChunkSize, vChildKeysRet.size());
+        vFutures.emplace_back(pool->push([&deriveRange, nBegin, nEnd](int) { deriveRange(nBegin, nEnd); }));
+    }
+    for (auto& future : vFutures) {
+        future.get();
+    }
+}
+
+std::vector<CPubKey> CWallet::DeriveNewChildKeys(CWalletDB &walletdb, uint32_t nAccountIndex, bool fInternal, size_t nCount)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+
+    std::vector<CPubKey> vPubKeys;
+    if (nCount == 0) {
+        return vPubKeys;
+    }
+
+    CHDChain hdChainTmp;
+    if (!GetHDChain(hdChainTmp)) {
+        throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
+    }
+
+    if (!DecryptHDChain(hdChainTmp))
+        throw std::runtime_error(std::string(__func__) + ": DecryptHDChainSeed failed");
+    // make sure seed matches this chain
+    if (hdChainTmp.GetID() != hdChainTmp.GetSeedHash())
+        throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
+
+    CHDAccount acc;
+    if (!hdChainTmp.GetAccount(nAccountIndex, acc))
+        throw std::runtime_error(std::string(__func__) + ": Wrong HD account!");
+
+    // all keys of the chain are children of the same key
+    CExtKey changeKey;
+    hdChainTmp.DeriveChangeExtKey(nAccountIndex, fInternal, changeKey);
+
+    std::unique_ptr<ctpl::thread_pool> pool;
+    int nThreads = gArgs.GetArg("-keypoolthreads", DEFAULT_KEYPOOL_THREADS);
+    if (nThreads <= 0) {
+        nThreads = GetNumCores();
+    }
+    nThreads = std::max(1, std::min(nThreads, MAX_KEYPOOL_THREADS));
+    if (nThreads > 1 && nCount >= MIN_PARALLEL_KEYPOOL_KEYS) {
+        pool.reset(new ctpl::thread_pool(nThreads));
+        RenameThreadPool(*pool, "ion-keypool");
+    }
+
+    CKeyMetadata metadata(GetTime());
+    uint32_t nChildIndex = fInternal ? acc.nInternalChainCounter : acc.nExternalChainCounter;
+    vPubKeys.reserve(nCount);
+    while (vPubKeys.size() < nCount) {
+        std::vector<CExtPubKey> vChildKeys(nCount - vPubKeys.size());
+        DeriveChildPubKeys(changeKey, nChildIndex, vChildKeys, pool.get());
+
+        for (const CExtPubKey& childKey : vChildKeys) {
+            nChildIndex++;
+            // skip keys already known to the wallet, derive replacements in the next round
+            if (HaveKey(childKey.pubkey.GetID())) {
+                continue;
+            }
+
+            // store metadata
+            mapKeyMetadata[childKey.pubkey.GetID()] = metadata;
+
+            if (!AddHDPubKey(walletdb, childKey, fInternal))
+                throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
+            vPubKeys.push_back(childKey.pubkey);
+        }
+    }
+    UpdateTimeFirstKey(metadata.nCreateTime);
+
+    // update the chain model in the database
+    CHDChain hdChainCurrent;
+    GetHDChain(hdChainCurrent);
+
+    if (fInternal) {
+        acc.nInternalChainCounter = nChildIndex;
+    }
+    else {
+        acc.nExternalChainCounter = nChildIndex;
+    }
+
+    if (!hdChainCurrent.SetAccount(nAccountIndex, acc))
+        throw std::runtime_error(std::string(__func__) + ": SetAccount failed");
+
+    if (IsCrypted()) {
+        if (!SetCryptedHDChain(walletdb, hdChainCurrent, false))
+            throw std::runtime_error(std::string(__func__) + ": SetCryptedHDChain failed");
+    }
+    else {
+        if (!SetHDChain(walletdb, hdChainCurrent, false))
+            throw std::runtime_error(std::string(__func__) + ": SetHDChain failed");
+    }
+
+    return vPubKeys;
+}
+
 bool CWallet::GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const
 {
     LOCK(cs_wallet);
@@ -449,6 +576,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
         return false;
     const CKeyMetadata& meta = mapKeyMetadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
+    MarkBalancesDirty();
     NotifyWatchonlyChanged(true);
     return CWalletDB(*dbw).WriteWatchOnly(dest, meta);
 }
@@ -464,6 +592,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    MarkBalancesDirty();
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (!CWalletDB(*dbw).EraseWatchOnly(dest))
@@ -786,7 +915,9 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
-    setWalletUTXO.erase(outpoint);
+    if (EraseWalletUTXO(outpoint)) {
+        MarkTxBalancesDirty(outpoint.hash);
+    }
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -1089,23 +1220,140 @@ bool CWallet::GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bFo
     return true;
 }
 
+bool CWallet::AddWalletUTXO(const COutPoint& outpoint, const CTxOut& txout)
+{
+    AssertLockHeld(cs_wallet);
+    if (!setWalletUTXO.insert(outpoint).second) {
+        return false;
+    }
+    utxoIndex.Add(outpoint, txout);
+    return true;
+}
+
+bool CWallet::EraseWalletUTXO(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    if (!setWalletUTXO.erase(outpoint)) {
+        return false;
+    }
+    utxoIndex.Remove(outpoint);
+    return true;
+}
+
+void CWallet::UpdateWalletUTXO(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end() || outpoint.n >= it->second.tx->vout.size()) {
+        return;
+    }
+    const CTxOut& txout = it->second.tx->vout[outpoint.n];
+    bool fChanged;
+    if (IsMine(txout) && !IsSpent(outpoint.hash, outpoint.n)) {
+        fChanged = AddWalletUTXO(outpoint, txout);
+    } else {
+        fChanged = EraseWalletUTXO(outpoint);
+    }
+    if (fChanged) {
+        MarkTxBalancesDirty(outpoint.hash);
+    }
+}
+
+void CWallet::UpdateWalletUTXOs(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+        UpdateWalletUTXO(COutPoint(wtx.GetHash(), i));
+    }
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            UpdateWalletUTXO(txin.prevout);
+        }
+    }
+}
+
+void CWallet::ScanWalletUTXOs()
+{
+    LOCK2(cs_main, cs_wallet);
+    for (auto& pair : mapWallet) {
+        for(unsigned int i = 0; i < pair.second.tx->vout.size(); ++i) {
+            if (IsMine(pair.second.tx->vout[i]) && !IsSpent(pair.first, i)) {
+                AddWalletUTXO(COutPoint(pair.first, i), pair.second.tx->vout[i]);
+            }
+        }
+    }
+    MarkBalancesDirty();
+}
+
 void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
-            item.second.MarkDirty();
+            item.second.MarkCreditsDirty();
     }
+    MarkBalancesDirty();
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
 }
 
+/** Makes the wallet write transactions through one batching database handle while in scope, requires cs_wallet */
+class CWalletTxBatchScope
+{
+private:
+    CWallet& wallet;
+    bool fOwner;
+
+public:
+    explicit CWalletTxBatchScope(CWallet& walletIn) : wallet(walletIn), fOwner(false)
+    {
+        AssertLockHeld(wallet.cs_wallet);
+        if (!wallet.pwalletdbTxBatch) {
+            // Do not flush the wallet here for performance reasons
+            wallet.pwalletdbTxBatch.reset(new CWalletDB(*wallet.dbw, "r+", false));
+            wallet.pwalletdbTxBatch->BeginBatch();
+            fOwner = true;
+        }
+    }
+
+    ~CWalletTxBatchScope()
+    {
+        if (fOwner && !End()) {
+            LogPrintf("%s: failed to write wallet transactions\n", __func__);
+        }
+    }
+
+    //! Writes the remaining records, returns false if some of the transactions could not be written
+    bool End()
+    {
+        if (!fOwner) {
+            // the outermost scope writes the records
+            return true;
+        }
+        fOwner = false;
+        bool fSuccess = wallet.pwalletdbTxBatch->FlushBatch();
+        wallet.pwalletdbTxBatch.reset();
+        return fSuccess;
+    }
+};
+
+CWalletDB& CWallet::GetTxWalletDB(std::unique_ptr<CWalletDB>& pwalletdbLocal, bool fFlushOnClose)
+{
+    AssertLockHeld(cs_wallet);
+    if (pwalletdbTxBatch) {
+        return *pwalletdbTxBatch;
+    }
+    pwalletdbLocal.reset(new CWalletDB(*dbw, "r+", fFlushOnClose));
+    return *pwalletdbLocal;
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 {
     LOCK(cs_wallet);
 
-    CWalletDB walletdb(*dbw, "r+", fFlushOnClose);
+    std::unique_ptr<CWalletDB> pwalletdbLocal;
+    CWalletDB& walletdb = GetTxWalletDB(pwalletdbLocal, fFlushOnClose);
 
     uint256 hash = wtxIn.GetHash();
 
@@ -1125,7 +1373,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         auto mnList = deterministicMNManager->GetListAtChainTip();
         for(unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
             if (IsMine(wtx.tx->vout[i]) && !IsSpent(hash, i)) {
-                setWalletUTXO.insert(COutPoint(hash, i));
+                AddWalletUTXO(COutPoint(hash, i), wtx.tx->vout[i]);
                 if (deterministicMNManager->IsProTxWithCollateral(wtx.tx, i) || mnList.HasMNByCollateral(COutPoint(hash, i))) {
                     LockCoin(COutPoint(hash, i));
                 }
@@ -1158,6 +1406,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
             wtx.fFromMe = wtxIn.fFromMe;
             fUpdated = true;
         }
+        // Outputs may have become ours (e.g. rescan after an import) and inputs may be spent again
+        UpdateWalletUTXOs(wtx);
     }
 
     //// debug print
@@ -1339,6 +1589,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             {
                 if (mapWallet.count(txin.prevout.hash))
                     mapWallet[txin.prevout.hash].MarkDirty();
+                UpdateWalletUTXO(txin.prevout);
             }
         }
     }
@@ -1368,7 +1619,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
         return;
 
     // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(*dbw, "r+", false);
+    std::unique_ptr<CWalletDB> pwalletdbLocal;
+    CWalletDB& walletdb = GetTxWalletDB(pwalletdbLocal, false);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -1403,6 +1655,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             {
                 if (mapWallet.count(txin.prevout.hash))
                     mapWallet[txin.prevout.hash].MarkDirty();
+                UpdateWalletUTXO(txin.prevout);
             }
         }
     }
@@ -1445,11 +1698,18 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     // to abandon a transaction and then have it inadvertently cleared by
     // the notification that the conflicted transaction was evicted.
 
-    for (const CTransactionRef& ptx : vtxConflicted) {
-        SyncTransaction(ptx);
-    }
-    for (size_t i = 0; i < pblock->vtx.size(); i++) {
-        SyncTransaction(pblock->vtx[i], pindex, i);
+    {
+        CWalletTxBatchScope batchScope(*this);
+        for (const CTransactionRef& ptx : vtxConflicted) {
+            SyncTransaction(ptx);
+        }
+        for (size_t i = 0; i < pblock->vtx.size(); i++) {
+            SyncTransaction(pblock->vtx[i], pindex, i);
+        }
+        if (!batchScope.End()) {
+            LogPrintf("%s: failed to write the wallet transactions of block %s\n", __func__, pindex->GetBlockHash().ToString());
+            uiInterface.ThreadSafeMessageBox(_("Error: Failed to write transactions to the wallet database"), "", CClientUIInterface::MSG_ERROR);
+        }
     }
 
     // The GUI expects a NotifyTransactionChanged when a coinbase tx
@@ -1487,14 +1747,23 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexDisconnected) {
     LOCK2(cs_main, cs_wallet);
 
-    for (const CTransactionRef& ptx : pblock->vtx) {
-        // NOTE: do NOT pass pindex here
-        SyncTransaction(ptx);
+    {
+        CWalletTxBatchScope batchScope(*this);
+        for (const CTransactionRef& ptx : pblock->vtx) {
+            // NOTE: do NOT pass pindex here
+            SyncTransaction(ptx);
+        }
+        if (!batchScope.End()) {
+            LogPrintf("%s: failed to write the wallet transactions of block %s\n", __func__, pindexDisconnected->GetBlockHash().ToString());
+            uiInterface.ThreadSafeMessageBox(_("Error: Failed to write transactions to the wallet database"), "", CClientUIInterface::MSG_ERROR);
+        }
     }
 
     // reset cache to make sure no longer mature coins are excluded
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    // same for balances, which only recheck maturity for immature transactions
+    MarkBalancesDirty();
 }
 
 
@@ -1858,6 +2127,14 @@ CAmount CWallet::GetChange(const CTransaction& tx) const
     return nChange;
 }
 
+void CWalletTx::MarkDirty()
+{
+    MarkCreditsDirty();
+    if (pwallet) {
+        pwallet->MarkTxBalancesDirty(GetHash());
+    }
+}
+
 int64_t CWalletTx::GetTxTime() const
 {
     int64_t n = nTimeSmart;
@@ -2098,7 +2375,6 @@ void CWalletTx::GetAmounts(std::list<CGroupedOutputEntry> &listReceived,
 int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
 {
     AssertLockHeld(cs_main);
-    AssertLockHeld(cs_wallet);
 
     // Find starting block. May be null if nCreateTime is greater than the
     // highest blockchain timestamp, in which case there is nothing that needs
@@ -2115,11 +2391,178 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
     return startTime;
 }
 
+namespace {
+/** A block which was read ahead by a rescan thread, together with the transactions which have outputs to the wallet */
+struct CRescanBlock
+{
+    CBlock block;
+    bool fRead{false};
+    //! the block was not read because its block filter did not match any of the wallet's scripts
+    bool fSkipped{false};
+    std::vector<bool> vOutputMatches;
+    //! the key generation (see ScanForWalletTransactions) the outputs were matched with
+    int nKeyGeneration{0};
+};
+
+/**
+ * Copy of the public keys, redeem scripts and watch-only scripts of a wallet. Rescan threads match outputs against it
+ * with ::IsMine, which gives the same result as for the wallet itself, but does not need cs_wallet.
+ */
+class CRescanKeyStore : public CBasicKeyStore
+{
+private:
+    std::map<CKeyID, CPubKey> mapPubKeys;
+
+public:
+    void AddPubKey(const CKeyID& keyID, const CPubKey& pubKey)
+    {
+        mapPubKeys.emplace(keyID, pubKey);
+    }
+
+    bool HaveKey(const CKeyID& address) const override
+    {
+        return mapPubKeys.count(address) || CBasicKeyStore::HaveKey(address);
+    }
+
+    bool GetPubKey(const CKeyID& address, CPubKey& vchPubKeyOut) const override
+    {
+        auto it = mapPubKeys.find(address);
+        if (it != mapPubKeys.end() && it->second.IsValid()) {
+            vchPubKeyOut = it->second;
+            return true;
+        }
+        return CBasicKeyStore::GetPubKey(address, vchPubKeyOut);
+    }
+};
+} // namespace
+
+static void MatchRescanBlock(const CKeyStore& keystore, CRescanBlock& rescanBlock, int nKeyGeneration)
+{
+    rescanBlock.vOutputMatches.assign(rescanBlock.block.vtx.size(), false);
+    rescanBlock.nKeyGeneration = nKeyGeneration;
+    for (size_t i = 0; i < rescanBlock.block.vtx.size(); i++) {
+        // same as CWallet::IsMine(const CTransaction&)
+        for (const CTxOut& txout : rescanBlock.block.vtx[i]->vout) {
+            if (::IsMine(keystore, txout.scriptPubKey) != ISMINE_NO) {
+                rescanBlock.vOutputMatches[i] = true;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Reads and matches a block, unless pScripts is given and the block filter index shows that the block neither pays
+ * to nor spends from any of these scripts
+ */
+static void ReadRescanBlock(const CKeyStore& keystore, CRescanBlock& rescanBlock, const CBlockIndex* pindex, const CDiskBlockPos& pos,
+                            const GCSFilter::ElementSet* pScripts, int nKeyGeneration, const Consensus::Params& consensusParams)
+{
+    if (pScripts && pblockfilterindex) {
+        BlockFilter filter;
+        if (pblockfilterindex->LookupFilter(pindex, filter) && !filter.GetFilter().MatchAny(*pScripts)) {
+            rescanBlock.fRead = true;
+            rescanBlock.fSkipped = true;
+            rescanBlock.nKeyGeneration = nKeyGeneration;
+            return;
+        }
+    }
+
+    rescanBlock.fSkipped = false;
+    rescanBlock.fRead = ReadBlockFromDisk(rescanBlock.block, pos, consensusParams) && rescanBlock.block.GetHash() == pindex->GetBlockHash();
+    if (rescanBlock.fRead) {
+        MatchRescanBlock(keystore, rescanBlock, nKeyGeneration);
+    }
+}
+
+bool CWallet::GetScanProgress(CWalletScanProgress& progressRet) const
+{
+    if (!fScanningWallet) {
+        return false;
+    }
+    LOCK(cs_scanProgress);
+    progressRet = scanProgress;
+    return true;
+}
+
+GCSFilter::ElementSet CWallet::GetBlockFilterScripts() const
+{
+    AssertLockHeld(cs_wallet);
+    LOCK(cs_KeyStore);
+
+    GCSFilter::ElementSet scripts;
+    auto addScript = [&scripts](const CScript& script) {
+        scripts.emplace(script.begin(), script.end());
+    };
+
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (const auto& pair : mapHdPubKeys) {
+        setKeyIDs.insert(pair.first);
+    }
+    for (const CKeyID& keyID : setKeyIDs) {
+        CPubKey pubKey;
+        if (GetPubKey(keyID, pubKey)) {
+            addScript(GetScriptForRawPubKey(pubKey));
+        }
+        addScript(GetScriptForDestination(keyID));
+    }
+    for (const auto& pair : mapScripts) {
+        addScript(GetScriptForDestination(CScriptID(pair.second)));
+        // redeem scripts might be used as bare scripts too, e.g. multisig
+        addScript(pair.second);
+    }
+    for (const CScript& script : setWatchOnly) {
+        addScript(script);
+    }
+    return scripts;
+}
+
+std::shared_ptr<const CKeyStore> CWallet::GetRescanKeyStore() const
+{
+    AssertLockHeld(cs_wallet);
+    LOCK(cs_KeyStore);
+
+    auto keystore = std::make_shared<CRescanKeyStore>();
+
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (const auto& pair : mapHdPubKeys) {
+        setKeyIDs.insert(pair.first);
+    }
+    for (const CKeyID& keyID : setKeyIDs) {
+        CPubKey pubKey;
+        GetPubKey(keyID, pubKey);
+        keystore->AddPubKey(keyID, pubKey);
+    }
+    for (const auto& pair : mapScripts) {
+        keystore->AddCScript(pair.second);
+    }
+    for (const CScript& script : setWatchOnly) {
+        keystore->AddWatchOnly(script);
+    }
+    return keystore;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * Blocks are read from disk and their outputs matched against a copy of the
+ * wallet's keys by a pool of -rescanthreads threads ahead of the block which
+ * is currently scanned. Transactions are still applied in chain order, and
+ * only those which have outputs to us or which spend known outpoints are
+ * passed to AddToWalletIfInvolvingMe.
+ *
+ * Requires cs_main. cs_wallet is taken for RESCAN_WALLET_LOCK_INTERVAL at a
+ * time, callers should not hold it so that it is available in between.
+ *
+ * With -rescanblockfilters and -blockfilterindex, blocks whose BIP 158 filter
+ * matches none of the wallet's scripts are not read at all. Filters only
+ * contain raw output and prevout scripts, so token group outputs and other
+ * scripts not returned by GetBlockFilterScripts are missed in that mode.
+ *
  * Returns null if scan was successful. Otherwise, if a complete rescan was not
  * possible (due to pruning or corruption), returns pointer to the most recent
  * block that could not be scanned.
@@ -2132,37 +2575,173 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_main);
         fAbortRescan = false;
+
+        int nThreads = gArgs.GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+        if (nThreads <= 0) {
+            nThreads = GetNumCores();
+        }
+        // short rescans are not worth starting many threads
+        int nBlocks = pindex ? chainActive.Height() - pindex->nHeight + 1 : 0;
+        nThreads = std::min(nThreads, nBlocks / MIN_RESCAN_BLOCKS_PER_THREAD);
+        nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
+        {
+            LOCK(cs_scanProgress);
+            scanProgress = CWalletScanProgress();
+            scanProgress.nStartHeight = pindex ? pindex->nHeight : -1;
+            scanProgress.nTipHeight = chainActive.Height();
+            scanProgress.nStartTimeMillis = GetTimeMillis();
+            scanProgress.nThreads = nThreads;
+        }
         fScanningWallet = true;
 
+        ctpl::thread_pool pool(nThreads);
+        RenameThreadPool(pool, "ion-rescan");
+
+        // The read ahead tasks match outputs against a copy of the wallet's keys and scripts. Keys are added while
+        // holding cs_wallet, e.g. by AddToWalletIfInvolvingMe topping up the keypool, which starts a new key generation
+        // with a new copy. Blocks which were matched with an older one are matched again.
+        int nKeyGeneration = 0;
+        int64_t nMaxKeyPoolIndex = 0;
+        std::shared_ptr<const CKeyStore> pKeyStore;
+        // the scripts of the current key generation, shared with the read ahead tasks
+        std::shared_ptr<const GCSFilter::ElementSet> pFilterScripts;
+        bool fUseBlockFilters = pblockfilterindex && gArgs.GetBoolArg("-rescanblockfilters", DEFAULT_RESCAN_BLOCKFILTERS);
+        auto updateKeys = [&]() {
+            AssertLockHeld(cs_wallet);
+            nMaxKeyPoolIndex = m_max_keypool_index;
+            pKeyStore = GetRescanKeyStore();
+            if (fUseBlockFilters) {
+                pFilterScripts = std::make_shared<const GCSFilter::ElementSet>(GetBlockFilterScripts());
+            }
+        };
+        {
+            LOCK(cs_wallet);
+            updateKeys();
+        }
+
+        std::deque<std::pair<CBlockIndex*, std::future<std::shared_ptr<CRescanBlock>>>> readAheadQueue;
+        CBlockIndex* pindexNextRead = pindex;
+        const Consensus::Params& consensusParams = chainParams.GetConsensus();
+        bool fWriteFailed = false;
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
         double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
         while (pindex && !fAbortRescan)
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+            // cs_wallet is only held for RESCAN_WALLET_LOCK_INTERVAL at once, so that e.g. getwalletinfo does not have
+            // to wait for the whole rescan. cs_main is held for the whole scan, so the chain and the block positions
+            // can't change.
+            LOCK(cs_wallet);
+            int64_t nLockTime = GetTimeMillis();
+            if (m_max_keypool_index != nMaxKeyPoolIndex) {
+                nKeyGeneration++;
+                updateKeys();
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+            // found transactions are written in chunks of WALLETDB_BATCH_SIZE records
+            CWalletTxBatchScope batchScope(*this);
+
+            while (pindex && !fAbortRescan && GetTimeMillis() - nLockTime < RESCAN_WALLET_LOCK_INTERVAL)
+            {
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
                 }
-            } else {
-                ret = pindex;
+
+                while (pindexNextRead && readAheadQueue.size() < (size_t)(nThreads * RESCAN_BLOCKS_AHEAD_PER_THREAD)) {
+                    const CBlockIndex* pindexRead = pindexNextRead;
+                    CDiskBlockPos pos = pindexNextRead->GetBlockPos();
+                    int nReadKeyGeneration = nKeyGeneration;
+                    auto future = pool.push([pKeyStore, pindexRead, pos, pFilterScripts, nReadKeyGeneration, &consensusParams](int) {
+                        auto rescanBlock = std::make_shared<CRescanBlock>();
+                        ReadRescanBlock(*pKeyStore, *rescanBlock, pindexRead, pos, pFilterScripts.get(), nReadKeyGeneration, consensusParams);
+                        return rescanBlock;
+                    });
+                    readAheadQueue.emplace_back(pindexNextRead, std::move(future));
+                    pindexNextRead = chainActive.Next(pindexNextRead);
+                }
+
+                assert(!readAheadQueue.empty() && readAheadQueue.front().first == pindex);
+                std::shared_ptr<CRescanBlock> rescanBlock = readAheadQueue.front().second.get();
+                readAheadQueue.pop_front();
+
+                if (rescanBlock->fSkipped && rescanBlock->nKeyGeneration != nKeyGeneration) {
+                    // keys were added since the filter was matched
+                    ReadRescanBlock(*pKeyStore, *rescanBlock, pindex, pindex->GetBlockPos(), pFilterScripts.get(), nKeyGeneration, consensusParams);
+                }
+
+                int64_t nCandidateTxs = 0;
+                if (rescanBlock->fRead && !rescanBlock->fSkipped) {
+                    const CBlock& block = rescanBlock->block;
+                    if (rescanBlock->nKeyGeneration != nKeyGeneration) {
+                        MatchRescanBlock(*pKeyStore, *rescanBlock, nKeyGeneration);
+                    }
+                    for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
+                        const CTransaction& tx = *block.vtx[posInBlock];
+                        // Transactions without outputs to us are only relevant if they already are in the wallet,
+                        // spend one of our transactions (IsFromMe) or conflict with one (mapTxSpends)
+                        bool fCandidate = rescanBlock->vOutputMatches[posInBlock] || mapWallet.count(tx.GetHash());
+                        for (size_t i = 0; i < tx.vin.size() && !fCandidate; i++) {
+                            fCandidate = mapWallet.count(tx.vin[i].prevout.hash) || mapTxSpends.count(tx.vin[i].prevout);
+                        }
+                        if (!fCandidate) {
+                            continue;
+                        }
+                        nCandidateTxs++;
+                        AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                        if (m_max_keypool_index != nMaxKeyPoolIndex) {
+                            nKeyGeneration++;
+                            updateKeys();
+                            MatchRescanBlock(*pKeyStore, *rescanBlock, nKeyGeneration);
+                        }
+                    }
+                } else if (!rescanBlock->fRead) {
+                    ret = pindex;
+                }
+
+                {
+                    LOCK(cs_scanProgress);
+                    scanProgress.nHeight = pindex->nHeight;
+                    scanProgress.nBlocks++;
+                    scanProgress.nTxs += rescanBlock->block.vtx.size();
+                    scanProgress.nCandidateTxs += nCandidateTxs;
+                    scanProgress.nSkippedBlocks += rescanBlock->fSkipped ? 1 : 0;
+                }
+                pindex = chainActive.Next(pindex);
+            }
+
+            if (!batchScope.End()) {
+                fWriteFailed = true;
             }
-            pindex = chainActive.Next(pindex);
         }
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
 
+        // don't wait for blocks which were read ahead after an abort
+        pool.clear_queue();
+        readAheadQueue.clear();
+        pool.stop(true);
+
+        if (fWriteFailed) {
+            // the found transactions are only in memory, report the scan as incomplete
+            LogPrintf("%s: failed to write wallet transactions\n", __func__);
+            ret = chainActive.Tip();
+        }
+
+        {
+            LOCK(cs_scanProgress);
+            int64_t nDuration = GetTimeMillis() - scanProgress.nStartTimeMillis;
+            LogPrint(BCLog::BENCHMARK, "%s: scanned %d blocks (%d skipped by block filters) with %d transactions (%d candidates) in %dms using %d threads\n", __func__,
+                scanProgress.nBlocks, scanProgress.nSkippedBlocks, scanProgress.nTxs, scanProgress.nCandidateTxs, nDuration, scanProgress.nThreads);
+        }
         fScanningWallet = false;
     }
     return ret;
@@ -2662,18 +3241,259 @@ std::unordered_set<const CWalletTx*, WalletTxHasher> CWallet::GetSpendableTXs()
     return ret;
 }
 
-CAmount CWallet::GetBalance() const
+CWalletBalances& CWalletBalances::operator+=(const CWalletBalances& other)
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-
-    return nTotal;
+    nTrusted += other.nTrusted;
+    nUntrustedPending += other.nUntrustedPending;
+    nImmature += other.nImmature;
+    nWatchOnlyTrusted += other.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending += other.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature += other.nWatchOnlyImmature;
+    nUnlocked += other.nUnlocked;
+    nLocked += other.nLocked;
+    nWatchOnlyLocked += other.nWatchOnlyLocked;
+    return *this;
+}
+
+CWalletBalances& CWalletBalances::operator-=(const CWalletBalances& other)
+{
+    nTrusted -= other.nTrusted;
+    nUntrustedPending -= other.nUntrustedPending;
+    nImmature -= other.nImmature;
+    nWatchOnlyTrusted -= other.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending -= other.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature -= other.nWatchOnlyImmature;
+    nUnlocked -= other.nUnlocked;
+    nLocked -= other.nLocked;
+    nWatchOnlyLocked -= other.nWatchOnlyLocked;
+    return *this;
+}
+
+bool CWalletBalances::operator==(const CWalletBalances& other) const
+{
+    return nTrusted == other.nTrusted &&
+           nUntrustedPending == other.nUntrustedPending &&
+           nImmature == other.nImmature &&
+           nWatchOnlyTrusted == other.nWatchOnlyTrusted &&
+           nWatchOnlyUntrustedPending == other.nWatchOnlyUntrustedPending &&
+           nWatchOnlyImmature == other.nWatchOnlyImmature &&
+           nUnlocked == other.nUnlocked &&
+           nLocked == other.nLocked &&
+           nWatchOnlyLocked == other.nWatchOnlyLocked;
+}
+
+std::string CWalletBalances::ToString() const
+{
+    return strprintf("CWalletBalances(trusted=%d, untrustedPending=%d, immature=%d, watchOnlyTrusted=%d, watchOnlyUntrustedPending=%d, "
+                     "watchOnlyImmature=%d, unlocked=%d, locked=%d, watchOnlyLocked=%d)",
+        nTrusted, nUntrustedPending, nImmature, nWatchOnlyTrusted, nWatchOnlyUntrustedPending,
+        nWatchOnlyImmature, nUnlocked, nLocked, nWatchOnlyLocked);
+}
+
+void CWalletUTXOIndex::Add(const COutPoint& outpoint, const CTxOut& txout)
+{
+    if (mapEntries.count(outpoint)) {
+        return;
+    }
+    // decode the script once, same as IsOutputGrouped (invalid group scripts still count as grouped)
+    CTokenGroupInfo tgInfo(txout.scriptPubKey);
+    bool fGrouped = tgInfo.invalid || tgInfo.associatedGroup != NoGroup;
+    const Entry& entry = mapEntries.emplace(outpoint, Entry{txout.nValue, fGrouped, fGrouped ? tgInfo : CTokenGroupInfo()}).first->second;
+    if (entry.fGrouped) {
+        setGroupedByAmount.emplace(entry.nValue, outpoint);
+        mapGroups[entry.tgInfo.associatedGroup].emplace(outpoint);
+    } else {
+        setByAmount.emplace(entry.nValue, outpoint);
+    }
+}
+
+void CWalletUTXOIndex::Remove(const COutPoint& outpoint)
+{
+    auto it = mapEntries.find(outpoint);
+    if (it == mapEntries.end()) {
+        return;
+    }
+    const Entry& entry = it->second;
+    if (entry.fGrouped) {
+        setGroupedByAmount.erase(std::make_pair(entry.nValue, outpoint));
+        auto jt = mapGroups.find(entry.tgInfo.associatedGroup);
+        if (jt != mapGroups.end()) {
+            jt->second.erase(outpoint);
+            if (jt->second.empty()) {
+                mapGroups.erase(jt);
+            }
+        }
+    } else {
+        setByAmount.erase(std::make_pair(entry.nValue, outpoint));
+    }
+    mapEntries.erase(it);
+}
+
+void CWalletUTXOIndex::Clear()
+{
+    mapEntries.clear();
+    setByAmount.clear();
+    setGroupedByAmount.clear();
+    mapGroups.clear();
+}
+
+/** Number of transactions marked dirty after which all balances are recalculated, bounds the dirty set if balances
+ * are not queried for a long time */
+static const size_t MAX_BALANCE_DIRTY_TXS = 10000;
+
+void CWallet::MarkTxBalancesDirty(const uint256& hash) const
+{
+    LOCK(cs_balancesDirty);
+    if (fBalancesFullyDirty) {
+        return;
+    }
+    if (setBalanceDirtyTxs.size() >= MAX_BALANCE_DIRTY_TXS) {
+        setBalanceDirtyTxs.clear();
+        fBalancesFullyDirty = true;
+        return;
+    }
+    setBalanceDirtyTxs.emplace(hash);
+}
+
+void CWallet::MarkBalancesDirty() const
+{
+    LOCK(cs_balancesDirty);
+    setBalanceDirtyTxs.clear();
+    fBalancesFullyDirty = true;
+}
+
+CWalletBalances CWallet::GetTxBalances(const CWalletTx& wtx, bool& fVolatileRet) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CWalletBalances ret;
+    fVolatileRet = false;
+
+    // only transactions with unspent outputs count, see GetSpendableTXs()
+    auto it = setWalletUTXO.lower_bound(COutPoint(wtx.GetHash(), 0));
+    if (it == setWalletUTXO.end() || it->hash != wtx.GetHash()) {
+        return ret;
+    }
+
+    int nDepth = wtx.GetDepthInMainChain();
+    // the state of unconfirmed transactions (mempool, IS locks, finality) and the maturity of generated ones change
+    // without the transaction being marked dirty, so these are recalculated on every balance query
+    fVolatileRet = nDepth == 0 || wtx.GetBlocksToMaturity() > 0;
+
+    bool fTrusted = wtx.IsTrusted();
+    bool fUntrustedPending = !fTrusted && nDepth == 0 && !wtx.IsLockedByInstantSend() && wtx.InMempool();
+
+    if (fTrusted) {
+        ret.nTrusted = wtx.GetAvailableCredit();
+        ret.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    }
+    if (fUntrustedPending) {
+        ret.nUntrustedPending = wtx.GetAvailableCredit();
+        ret.nWatchOnlyUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    ret.nImmature = wtx.GetImmatureCredit();
+    ret.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+    if (fTrusted && nDepth > 0) {
+        ret.nUnlocked = wtx.GetUnlockedCredit();
+        ret.nLocked = wtx.GetLockedCredit();
+        ret.nWatchOnlyLocked = wtx.GetLockedWatchOnlyCredit();
+    }
+    return ret;
+}
+
+void CWallet::UpdateTxBalances(const uint256& hash) const
+{
+    auto it = mapBalanceContributions.find(hash);
+    if (it != mapBalanceContributions.end()) {
+        balancesTotal -= it->second;
+        mapBalanceContributions.erase(it);
+    }
+    setBalanceVolatileTxs.erase(hash);
+
+    auto jt = mapWallet.find(hash);
+    if (jt == mapWallet.end()) {
+        return;
+    }
+
+    bool fVolatile;
+    CWalletBalances balances = GetTxBalances(jt->second, fVolatile);
+    if (fVolatile) {
+        setBalanceVolatileTxs.emplace(hash);
+    }
+    if (!balances.IsNull()) {
+        balancesTotal += balances;
+        mapBalanceContributions.emplace(hash, balances);
+    }
+}
+
+void CWallet::UpdateBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::set<uint256> setDirty;
+    bool fFullyDirty;
+    {
+        LOCK(cs_balancesDirty);
+        setDirty.swap(setBalanceDirtyTxs);
+        fFullyDirty = fBalancesFullyDirty;
+        fBalancesFullyDirty = false;
+    }
+
+    if (fFullyDirty) {
+        int64_t nStart = GetTimeMicros();
+        balancesTotal = CWalletBalances();
+        mapBalanceContributions.clear();
+        setBalanceVolatileTxs.clear();
+        for (auto pcoin : GetSpendableTXs()) {
+            UpdateTxBalances(pcoin->GetHash());
+        }
+        LogPrint(BCLog::BENCHMARK, "CWallet::%s -- recalculated balances of %d transactions in %.2fms\n", __func__,
+            mapBalanceContributions.size(), (GetTimeMicros() - nStart) * 0.001);
+        return;
+    }
+
+    setDirty.insert(setBalanceVolatileTxs.begin(), setBalanceVolatileTxs.end());
+    for (const auto& hash : setDirty) {
+        UpdateTxBalances(hash);
+    }
+}
+
+CWalletBalances CWallet::GetBalancesFullScan() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CWalletBalances ret;
+    for (auto pcoin : GetSpendableTXs()) {
+        bool fVolatile;
+        ret += GetTxBalances(*pcoin, fVolatile);
+    }
+    return ret;
+}
+
+CWalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+
+    if (fCheckBalances) {
+        CWalletBalances balancesFullScan = GetBalancesFullScan();
+        if (balancesTotal != balancesFullScan) {
+            LogPrintf("CWallet::%s -- ERROR: incremental balances %s do not match full scan %s, recalculating\n", __func__,
+                balancesTotal.ToString(), balancesFullScan.ToString());
+            MarkBalancesDirty();
+            UpdateBalances();
+        }
+    }
+
+    return balancesTotal;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
 }
 
 CAmount CWallet::GetAnonymizableBalance(bool fSkipDenominated, bool fSkipUnconfirmed) const
@@ -2776,105 +3596,42 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && !pcoin->IsLockedByInstantSend() && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && !pcoin->IsLockedByInstantSend() && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 CAmount CWallet::GetUnlockedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnlocked;
 }
 
 CAmount CWallet::GetLockedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nLocked;
 }
 
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyLocked;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2935,46 +3692,149 @@ CAmount CWallet::GetAvailableBalance(const CCoinControl* coinControl) const
     return balance;
 }
 
-unsigned int CWallet::FilterCoins(std::vector<COutput> &vCoins,
-    std::function<bool(const CWalletTx *, const CTxOut *)> func) const
+/**
+ * Applies the checks of FilterCoins to the outpoints passed to cb by forEachOutpoint. The outpoints should be
+ * ordered by outpoint, so the checks which only depend on the transaction are done once per transaction.
+ * func is called as func(wtx, txout, outpoint).
+ */
+template<typename ForEachOutpoint, typename Func>
+static unsigned int FilterWalletCoins(const CWallet& wallet, ForEachOutpoint&& forEachOutpoint, std::vector<COutput>& vCoins,
+    Func&& func)
 {
-    vCoins.clear();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(wallet.cs_wallet);
+
     unsigned int ret = 0;
+    uint256 lastHash;
+    const CWalletTx* pcoin = nullptr;
+    int nDepth = 0;
 
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const uint256 &wtxid = it->first;
-            const CWalletTx *pcoin = &(*it).second;
+    forEachOutpoint([&](const COutPoint& outpoint) {
+        if (outpoint.hash != lastHash) {
+            lastHash = outpoint.hash;
+            pcoin = nullptr;
 
-            if (!CheckFinalTx(*pcoin))
-                continue;
+            auto it = wallet.mapWallet.find(outpoint.hash);
+            if (it == wallet.mapWallet.end())
+                return true;
+            const CWalletTx* wtx = &it->second;
 
-            if (pcoin->IsGenerated() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+            if (!CheckFinalTx(*wtx))
+                return true;
 
-            int nDepth = pcoin->GetDepthInMainChain();
+            if (wtx->IsGenerated() && wtx->GetBlocksToMaturity() > 0)
+                return true;
+
+            nDepth = wtx->GetDepthInMainChain();
             if (nDepth < 0)
-                continue;
+                return true;
 
             // We should not consider coins which aren't at least in our mempool
             // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
-                continue;
+            if (nDepth == 0 && !wtx->InMempool())
+                return true;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++)
-            {
-                isminetype mine = IsMine(pcoin->tx->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO && !IsLockedCoin((*it).first, i) &&
-                    func(pcoin, &pcoin->tx->vout[i]))
-                {
-                    // The UTXO is available
-                    COutput outpoint(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO, false, false);
-                    vCoins.push_back(outpoint);
-                    ret++;
-                }
-            }
+            pcoin = wtx;
+        }
+        if (!pcoin) {
+            return true;
+        }
+
+        const CTxOut& txout = pcoin->tx->vout[outpoint.n];
+        isminetype mine = wallet.IsMine(txout);
+        if (!(wallet.IsSpent(outpoint.hash, outpoint.n)) && mine != ISMINE_NO && !wallet.IsLockedCoin(outpoint.hash, outpoint.n) &&
+            func(pcoin, &txout, outpoint))
+        {
+            // The UTXO is available
+            vCoins.emplace_back(pcoin, outpoint.n, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO, false, false);
+            ret++;
+        }
+        return true;
+    });
+    return ret;
+}
+
+unsigned int CWallet::FilterCoins(std::vector<COutput> &vCoins,
+    std::function<bool(const CWalletTx *, const CTxOut *)> func) const
+{
+    vCoins.clear();
+
+    LOCK2(cs_main, cs_wallet);
+    return FilterWalletCoins(*this, [&](std::function<bool(const COutPoint&)> cb) {
+        utxoIndex.ForEach(cb);
+    }, vCoins, [&](const CWalletTx* wtx, const CTxOut* txout, const COutPoint& outpoint) {
+        return func(wtx, txout);
+    });
+}
+
+unsigned int CWallet::FilterCoins(std::vector<COutput> &vCoins, const CTokenGroupID& grpID,
+    std::function<bool(const CWalletTx *, const CTxOut *)> func) const
+{
+    // ungrouped outputs are not indexed by group
+    if (grpID == NoGroup) {
+        return FilterCoins(vCoins, func);
+    }
+
+    vCoins.clear();
+
+    LOCK2(cs_main, cs_wallet);
+    return FilterWalletCoins(*this, [&](std::function<bool(const COutPoint&)> cb) {
+        utxoIndex.ForEachInGroup(grpID, cb);
+    }, vCoins, [&](const CWalletTx* wtx, const CTxOut* txout, const COutPoint& outpoint) {
+        return func(wtx, txout);
+    });
+}
+
+unsigned int CWallet::FilterGroupedCoins(std::vector<COutput> &vCoins, const CTokenGroupID& grpID,
+    std::function<bool(const CWalletTx *, const CTxOut *, const CTokenGroupInfo&)> func) const
+{
+    vCoins.clear();
+
+    LOCK2(cs_main, cs_wallet);
+    return FilterWalletCoins(*this, [&](std::function<bool(const COutPoint&)> cb) {
+        if (grpID == NoGroup) {
+            utxoIndex.ForEachGrouped(cb);
+        } else {
+            utxoIndex.ForEachInGroup(grpID, cb);
+        }
+    }, vCoins, [&](const CWalletTx* wtx, const CTxOut* txout, const COutPoint& outpoint) {
+        const CTokenGroupInfo* tgInfo = utxoIndex.GetGroupInfo(outpoint);
+        return tgInfo && func(wtx, txout, *tgInfo);
+    });
+}
+
+/**
+ * Returns the (disjoint) amount ranges in which outputs of the given coin type can be found. AvailableCoins only looks
+ * at the indexed outputs in these ranges, but still applies the exact filters to them.
+ */
+static std::vector<std::pair<CAmount, CAmount>> GetCandidateAmountRanges(CoinType nCoinType, CAmount nMinimumAmount, CAmount nMaximumAmount)
+{
+    std::vector<std::pair<CAmount, CAmount>> vecRanges;
+    switch (nCoinType) {
+    case CoinType::ONLY_DENOMINATED:
+        for (const auto& nDenomValue : CPrivateSend::GetStandardDenominations()) {
+            vecRanges.emplace_back(nDenomValue, nDenomValue);
+        }
+        break;
+    case CoinType::ONLY_20000:
+        vecRanges.emplace_back(MASTERNODE_COLLATERAL_AMOUNT, MASTERNODE_COLLATERAL_AMOUNT);
+        break;
+    case CoinType::ONLY_PRIVATESEND_COLLATERAL:
+        if (!CPrivateSend::GetStandardDenominations().empty()) {
+            vecRanges.emplace_back(CPrivateSend::GetCollateralAmount(), CPrivateSend::GetMaxCollateralAmount());
+        }
+        break;
+    default:
+        vecRanges.emplace_back(nMinimumAmount, nMaximumAmount);
+        break;
+    }
+
+    std::vector<std::pair<CAmount, CAmount>> ret;
+    for (const auto& range : vecRanges) {
+        CAmount nMin = std::max(range.first, nMinimumAmount);
+        CAmount nMax = std::min(range.second, nMaximumAmount);
+        if (nMin <= nMax) {
+            ret.emplace_back(nMin, nMax);
         }
     }
     return ret;
@@ -2990,97 +3850,178 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
 
         CAmount nTotal = 0;
 
-        for (auto pcoin : GetSpendableTXs()) {
-            const uint256& wtxid = pcoin->GetHash();
+        // Candidates are usually visited by amount, so the outputs of a transaction are not neighbors. The
+        // transaction level checks are cached instead.
+        struct TxStatus
+        {
+            const CWalletTx* pcoin{nullptr};
+            int nDepth{0};
+            bool fSafe{false};
+        };
+        std::unordered_map<uint256, TxStatus, StaticSaltedHasher> mapTxStatus;
+
+        auto getTxStatus = [&](const uint256& wtxid) -> const TxStatus& {
+            auto it = mapTxStatus.find(wtxid);
+            if (it != mapTxStatus.end()) {
+                return it->second;
+            }
+            TxStatus& status = mapTxStatus[wtxid];
+
+            auto jt = mapWallet.find(wtxid);
+            if (jt == mapWallet.end())
+                return status;
+            const CWalletTx* pcoin = &jt->second;
 
             if (!CheckFinalTx(*pcoin))
-                continue;
+                return status;
 
             if (pcoin->IsGenerated() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                return status;
 
             int nDepth = pcoin->GetDepthInMainChain();
 
             // We should not consider coins which aren't at least in our mempool
             // It's possible for these to be conflicted via ancestors which we may never be able to detect
             if (nDepth == 0 && !pcoin->InMempool())
-                continue;
+                return status;
 
             bool safeTx = pcoin->IsTrusted();
 
             if (fOnlySafe && !safeTx) {
-                continue;
+                return status;
             }
 
             if (nDepth < nMinDepth || nDepth > nMaxDepth)
-                continue;
+                return status;
+
+            status.pcoin = pcoin;
+            status.nDepth = nDepth;
+            status.fSafe = safeTx;
+            return status;
+        };
+
+        // returns false when enough coins were found
+        auto addCoin = [&](const COutPoint& outpoint) {
+            const TxStatus& status = getTxStatus(outpoint.hash);
+            const CWalletTx* pcoin = status.pcoin;
+            if (!pcoin) {
+                return true;
+            }
+            const uint256& wtxid = outpoint.hash;
+            unsigned int i = outpoint.n;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                if (!includeGrouped && IsOutputGrouped(pcoin->tx->vout[i]))
-                    continue;
+            if (!includeGrouped && IsOutputGrouped(pcoin->tx->vout[i]))
+                return true;
 
-                bool found = false;
-                if(nCoinType == CoinType::ONLY_DENOMINATED) {
-                    found = CPrivateSend::IsDenominatedAmount(pcoin->tx->vout[i].nValue);
-                } else if(nCoinType == CoinType::ONLY_NONDENOMINATED) {
-                    if (CPrivateSend::IsCollateralAmount(pcoin->tx->vout[i].nValue)) continue; // do not use collateral amounts
-                    found = !CPrivateSend::IsDenominatedAmount(pcoin->tx->vout[i].nValue);
-                } else if(nCoinType == CoinType::ONLY_20000) {
-                    found = pcoin->tx->vout[i].nValue == MASTERNODE_COLLATERAL_AMOUNT;
-                } else if(nCoinType == CoinType::ONLY_PRIVATESEND_COLLATERAL) {
-                    found = CPrivateSend::IsCollateralAmount(pcoin->tx->vout[i].nValue);
-                } else {
-                    found = true;
-                }
-                if(!found) continue;
-
-                if (nCoinType == CoinType::STAKABLE_COINS) {
-                    if (pcoin->tx->vout[i].IsZerocoinMint())
-                        continue;
-                    if (IsOutputGrouped(pcoin->tx->vout[i]))
-                        continue;
-                    if (pcoin->tx->vout[i].nValue == MASTERNODE_COLLATERAL_AMOUNT)
-                        continue;
-                }
+            bool found = false;
+            if(nCoinType == CoinType::ONLY_DENOMINATED) {
+                found = CPrivateSend::IsDenominatedAmount(pcoin->tx->vout[i].nValue);
+            } else if(nCoinType == CoinType::ONLY_NONDENOMINATED) {
+                if (CPrivateSend::IsCollateralAmount(pcoin->tx->vout[i].nValue)) return true; // do not use collateral amounts
+                found = !CPrivateSend::IsDenominatedAmount(pcoin->tx->vout[i].nValue);
+            } else if(nCoinType == CoinType::ONLY_20000) {
+                found = pcoin->tx->vout[i].nValue == MASTERNODE_COLLATERAL_AMOUNT;
+            } else if(nCoinType == CoinType::ONLY_PRIVATESEND_COLLATERAL) {
+                found = CPrivateSend::IsCollateralAmount(pcoin->tx->vout[i].nValue);
+            } else {
+                found = true;
+            }
+            if(!found) return true;
+
+            if (nCoinType == CoinType::STAKABLE_COINS) {
+                if (pcoin->tx->vout[i].IsZerocoinMint())
+                    return true;
+                if (IsOutputGrouped(pcoin->tx->vout[i]))
+                    return true;
+                if (pcoin->tx->vout[i].nValue == MASTERNODE_COLLATERAL_AMOUNT)
+                    return true;
+            }
 
-                if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
-                    continue;
+            if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
+                return true;
 
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
-                    continue;
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
+                return true;
 
-                if (IsLockedCoin(wtxid, i) && nCoinType != CoinType::ONLY_20000)
-                    continue;
+            if (IsLockedCoin(wtxid, i) && nCoinType != CoinType::ONLY_20000)
+                return true;
 
-                if (IsSpent(wtxid, i))
-                    continue;
+            if (IsSpent(wtxid, i))
+                return true;
 
-                isminetype mine = IsMine(pcoin->tx->vout[i]);
+            isminetype mine = IsMine(pcoin->tx->vout[i]);
 
-                if (mine == ISMINE_NO) {
-                    continue;
-                }
+            if (mine == ISMINE_NO) {
+                return true;
+            }
 
-                bool fSpendableIn = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO);
-                bool fSolvableIn = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO;
+            bool fSpendableIn = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO);
+            bool fSolvableIn = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO;
 
-                vCoins.push_back(COutput(pcoin, i, nDepth, fSpendableIn, fSolvableIn, safeTx));
+            vCoins.push_back(COutput(pcoin, i, status.nDepth, fSpendableIn, fSolvableIn, status.fSafe));
 
-                // Checks the sum amount of all UTXO's.
-                if (nMinimumSumAmount != MAX_MONEY) {
-                    nTotal += pcoin->tx->vout[i].nValue;
+            // Checks the sum amount of all UTXO's.
+            if (nMinimumSumAmount != MAX_MONEY) {
+                nTotal += pcoin->tx->vout[i].nValue;
 
-                    if (nTotal >= nMinimumSumAmount) {
-                        return;
-                    }
+                if (nTotal >= nMinimumSumAmount) {
+                    return false;
+                }
+            }
+
+            // Checks the maximum number of UTXO's.
+            if (nMaximumCount > 0 && vCoins.size() >= nMaximumCount) {
+                return false;
+            }
+            return true;
+        };
+
+        if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs) {
+            // only the selected outputs can be used, no need to look at the others
+            std::vector<COutPoint> vSelected;
+            coinControl->ListSelected(vSelected);
+            for (const auto& outpoint : vSelected) {
+                if (utxoIndex.Contains(outpoint) && !addCoin(outpoint)) {
+                    return;
                 }
+            }
+            return;
+        }
 
-                // Checks the maximum number of UTXO's.
-                if (nMaximumCount > 0 && vCoins.size() >= nMaximumCount) {
+        if (nMinimumSumAmount != MAX_MONEY || nMaximumCount > 0) {
+            // Which coins are returned depends on the visiting order when stopping early. Walk them in outpoint
+            // order, so that the result doesn't depend on the hash order of the spendable transactions set that
+            // was walked before the UTXO index existed.
+            for (const auto& outpoint : setWalletUTXO) {
+                if (!addCoin(outpoint)) {
                     return;
                 }
             }
+            return;
         }
+
+        // grouped outputs are never stakable
+        bool fGroupedCandidates = includeGrouped && nCoinType != CoinType::STAKABLE_COINS;
+        for (const auto& range : GetCandidateAmountRanges(nCoinType, nMinimumAmount, nMaximumAmount)) {
+            for (bool fGrouped : {false, true}) {
+                if (fGrouped && !fGroupedCandidates) {
+                    continue;
+                }
+                bool fDone = false;
+                utxoIndex.ForEach(fGrouped, range.first, range.second, [&](const COutPoint& outpoint) {
+                    fDone = !addCoin(outpoint);
+                    return !fDone;
+                });
+                if (fDone) {
+                    return;
+                }
+            }
+        }
+
+        // Return the coins in outpoint order, like the limited walk above
+        std::sort(vCoins.begin(), vCoins.end(), [](const COutput& a, const COutput& b) {
+            return COutPoint(a.tx->GetHash(), a.i) < COutPoint(b.tx->GetHash(), b.i);
+        });
     }
 }
 
@@ -4492,7 +5433,9 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     LOCK2(cs_main, cs_wallet);
 
     fFirstRunRet = false;
+    int64_t nTime1 = GetTimeMicros();
     DBErrors nLoadWalletRet = CWalletDB(*dbw,"cr+").LoadWallet(this);
+    int64_t nTime2 = GetTimeMicros();
     if (nLoadWalletRet == DB_NEED_REWRITE)
     {
         if (dbw->Rewrite("\x04pool"))
@@ -4507,16 +5450,10 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         }
     }
 
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto& pair : mapWallet) {
-            for(unsigned int i = 0; i < pair.second.tx->vout.size(); ++i) {
-                if (IsMine(pair.second.tx->vout[i]) && !IsSpent(pair.first, i)) {
-                    setWalletUTXO.insert(COutPoint(pair.first, i));
-                }
-            }
-        }
-    }
+    ScanWalletUTXOs();
+    int64_t nTime3 = GetTimeMicros();
+    LogPrintf("%s: loaded %u transactions in %.2fms (database %.2fms, UTXOs %.2fms)\n", __func__,
+        mapWallet.size(), (nTime3 - nTime1) * 0.001, (nTime2 - nTime1) * 0.001, (nTime3 - nTime2) * 0.001);
 
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
@@ -4552,6 +5489,15 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
     for (uint256 hash : vHashOut)
         mapWallet.erase(hash);
+    for (auto it = setWalletUTXO.begin(); it != setWalletUTXO.end(); ) {
+        if (!mapWallet.count(it->hash)) {
+            utxoIndex.Remove(*it);
+            it = setWalletUTXO.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    MarkBalancesDirty();
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -4752,19 +5698,16 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         } else {
             nTargetSize *= 2;
         }
-        bool fInternal = false;
         CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                fInternal = true;
-            }
+        // the keys, their metadata, pool entries and the HD chain counter are written in batches, the counter only
+        // once per batch
+        walletdb.BeginBatch();
+        int64_t nStartTime = GetTimeMillis();
 
+        auto addToKeyPool = [&](const CPubKey& pubkey, bool fInternal) {
             assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
             int64_t index = ++m_max_keypool_index;
 
-            // TODO: implement keypools for all accounts?
-            CPubKey pubkey(GenerateNewKey(walletdb, 0, fInternal));
             if (!walletdb.WritePool(index, CKeyPool(pubkey, fInternal))) {
                 throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
             }
@@ -4776,15 +5719,36 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             }
 
             m_pool_key_to_index[pubkey.GetID()] = index;
-            if (missingInternal + missingExternal > 0) {
-                LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n",
-                          missingInternal + missingExternal, missingInternal,
-                          setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
-            }
 
             double dProgress = 100.f * index / (nTargetSize + 1);
             std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
             uiInterface.InitMessage(strMsg);
+        };
+
+        // TODO: implement keypools for all accounts?
+        if (IsHDEnabled()) {
+            // derive the missing keys of each chain at once
+            for (const CPubKey& pubkey : DeriveNewChildKeys(walletdb, 0, false, missingExternal)) {
+                addToKeyPool(pubkey, false);
+            }
+            for (const CPubKey& pubkey : DeriveNewChildKeys(walletdb, 0, true, missingInternal)) {
+                addToKeyPool(pubkey, true);
+            }
+        } else {
+            for (int64_t i = 0; i < missingExternal; i++) {
+                addToKeyPool(GenerateNewKey(walletdb, 0, false), false);
+            }
+        }
+        // the keys must be on disk before any of them is handed out
+        if (!walletdb.SyncBatch()) {
+            throw std::runtime_error(std::string(__func__) + ": writing generated keys failed");
+        }
+        if (missingInternal + missingExternal > 0) {
+            int64_t nDuration = GetTimeMillis() - nStartTime;
+            LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal), %dms (%.1f keys/s)\n",
+                      missingInternal + missingExternal, missingInternal,
+                      setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size(),
+                      nDuration, (missingInternal + missingExternal) * 1000.0 / std::max(nDuration, (int64_t)1));
         }
     }
     return true;
@@ -5189,6 +6153,7 @@ void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkBalancesDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -5402,6 +6367,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     std::string strUsage = HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
+    strUsage += HelpMessageOpt("-keypoolthreads=<n>", strprintf(_("Number of threads deriving HD keys when the key pool is topped up (0 = one per core, up to %d, default: %d)"), MAX_KEYPOOL_THREADS, DEFAULT_KEYPOOL_THREADS));
     strUsage += HelpMessageOpt("-fallbackfee=<amt>", strprintf(_("A fee rate (in %s/kB) that will be used when fee estimation has insufficient data (default: %s)"),
                                                                CURRENCY_UNIT, FormatMoney(DEFAULT_FALLBACK_FEE)));
     strUsage += HelpMessageOpt("-discardfee=<amt>", strprintf(_("The fee rate (in %s/kB) that indicates your tolerance for discarding change by adding it to the fee (default: %s). "
@@ -5412,6 +6378,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                                             CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanblockfilters", strprintf(_("Skip blocks during rescans whose compact block filter matches none of the wallet's scripts, requires -blockfilterindex. Token outputs are not detected in this mode (default: %u)"), DEFAULT_RESCAN_BLOCKFILTERS));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Number of threads reading and matching blocks ahead during rescans (0 = one per core, up to %d, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
@@ -5437,6 +6405,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
 
+        strUsage += HelpMessageOpt("-checkwalletbalances", strprintf("Cross-check the incrementally maintained wallet balances against a full scan on every balance query (default: %u)", DEFAULT_CHECK_WALLET_BALANCES));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf("Flush wallet database activity from memory to disk log every <n> megabytes (default: %u)", DEFAULT_WALLET_DBLOGSIZE));
         strUsage += HelpMessageOpt("-flushwallet", strprintf("Run a thread to flush wallet periodically (default: %u)", DEFAULT_FLUSHWALLET));
         strUsage += HelpMessageOpt("-privdb", strprintf("Sets the DB_PRIVATE flag in the wallet db environment (default: %u)", DEFAULT_WALLET_PRIVDB));
@@ -5651,6 +6620,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
         }
     }
     walletInstance->SetBroadcastTransactions(gArgs.GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
+    walletInstance->SetCheckBalances(gArgs.GetBoolArg("-checkwalletbalances", DEFAULT_CHECK_WALLET_BALANCES));
 
     {
         LOCK(walletInstance->cs_wallet);
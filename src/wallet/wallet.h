@@ -10,6 +10,7 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "blockfilter.h"
 #include "consensus/tokengroups.h"
 #include "policy/feerate.h"
 #include "saltedhasher.h"
@@ -49,6 +50,11 @@ extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! -keypoolthreads default, 0 = one per core
+static const int DEFAULT_KEYPOOL_THREADS = 0;
+static const int MAX_KEYPOOL_THREADS = 16;
+//! HD keys are derived in parallel from this many keys on, for fewer keys starting the threads costs more than it saves
+static const size_t MIN_PARALLEL_KEYPOOL_KEYS = 64;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 //! -fallbackfee default
@@ -67,6 +73,19 @@ static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -walletrejectlongchains
 static const bool DEFAULT_WALLET_REJECT_LONG_CHAINS = false;
+//! -checkwalletbalances default
+static const bool DEFAULT_CHECK_WALLET_BALANCES = false;
+//! -rescanthreads default, 0 = one per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+static const int MAX_RESCAN_THREADS = 16;
+//! how many blocks per rescan thread are read ahead of the block which is currently applied to the wallet
+static const int RESCAN_BLOCKS_AHEAD_PER_THREAD = 4;
+//! rescans start at most one thread per this many blocks
+static const int MIN_RESCAN_BLOCKS_PER_THREAD = 50;
+//! how long (ms) a rescan holds cs_wallet at once, other users of the wallet get it in between
+static const int64_t RESCAN_WALLET_LOCK_INTERVAL = 500;
+//! -rescanblockfilters default
+static const bool DEFAULT_RESCAN_BLOCKFILTERS = false;
 //! -txconfirmtarget default
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 static const bool DEFAULT_WALLETBROADCAST = true;
@@ -476,7 +495,9 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
+    void MarkDirty();
+
+    void MarkCreditsDirty()
     {
         fCreditCached = false;
         fAvailableCreditCached = false;
@@ -557,6 +578,137 @@ public:
     std::set<uint256> GetConflicts() const;
 };
 
+/**
+ * Balances of a wallet (or the contribution of a single transaction), see the CWallet::Get*Balance methods. The
+ * PrivateSend balances are not included, as the rounds of an output change with other wallet transactions.
+ */
+struct CWalletBalances
+{
+    CAmount nTrusted{0};
+    CAmount nUntrustedPending{0};
+    CAmount nImmature{0};
+    CAmount nWatchOnlyTrusted{0};
+    CAmount nWatchOnlyUntrustedPending{0};
+    CAmount nWatchOnlyImmature{0};
+    CAmount nUnlocked{0};
+    CAmount nLocked{0};
+    CAmount nWatchOnlyLocked{0};
+
+    CWalletBalances& operator+=(const CWalletBalances& other);
+    CWalletBalances& operator-=(const CWalletBalances& other);
+    bool operator==(const CWalletBalances& other) const;
+    bool operator!=(const CWalletBalances& other) const { return !(*this == other); }
+    bool IsNull() const { return *this == CWalletBalances(); }
+    std::string ToString() const;
+};
+
+/**
+ * Index of the unspent wallet outputs (the outpoints in CWallet::setWalletUTXO). Outputs are sorted by amount,
+ * separately for grouped and ungrouped outputs, and bucketed by token group, so coin selection only has to look at
+ * the amount ranges which can match (e.g. the PrivateSend denominations) instead of walking all wallet transactions.
+ * Classification by amount is done at query time, as the wallet is loaded before the denominations are initialized.
+ */
+class CWalletUTXOIndex
+{
+private:
+    struct Entry
+    {
+        CAmount nValue;
+        bool fGrouped;
+        //! decoded token group of the script, only set if fGrouped
+        CTokenGroupInfo tgInfo;
+    };
+
+    std::map<COutPoint, Entry> mapEntries;
+    std::set<std::pair<CAmount, COutPoint>> setByAmount;
+    std::set<std::pair<CAmount, COutPoint>> setGroupedByAmount;
+    std::map<CTokenGroupID, std::set<COutPoint>> mapGroups;
+
+public:
+    void Add(const COutPoint& outpoint, const CTxOut& txout);
+    void Remove(const COutPoint& outpoint);
+    void Clear();
+
+    bool Contains(const COutPoint& outpoint) const { return mapEntries.count(outpoint) != 0; }
+    size_t Size() const { return mapEntries.size(); }
+    size_t GroupCount() const { return mapGroups.size(); }
+
+    //! Returns the decoded token group of a grouped output, or nullptr if the output is not indexed or not grouped
+    const CTokenGroupInfo* GetGroupInfo(const COutPoint& outpoint) const
+    {
+        auto it = mapEntries.find(outpoint);
+        return it != mapEntries.end() && it->second.fGrouped ? &it->second.tgInfo : nullptr;
+    }
+
+    //! Calls cb for all outputs, ordered by outpoint, until cb returns false
+    template<typename Callback>
+    void ForEach(Callback&& cb) const
+    {
+        for (const auto& p : mapEntries) {
+            if (!cb(p.first)) {
+                return;
+            }
+        }
+    }
+
+    //! Calls cb for the (un)grouped outputs with nMinAmount <= amount <= nMaxAmount in ascending order of amounts, until cb returns false
+    template<typename Callback>
+    void ForEach(bool fGrouped, CAmount nMinAmount, CAmount nMaxAmount, Callback&& cb) const
+    {
+        const auto& setOutputs = fGrouped ? setGroupedByAmount : setByAmount;
+        for (auto it = setOutputs.lower_bound(std::make_pair(nMinAmount, COutPoint(uint256(), 0))); it != setOutputs.end() && it->first <= nMaxAmount; ++it) {
+            if (!cb(it->second)) {
+                return;
+            }
+        }
+    }
+
+    //! Calls cb for the outputs of a token group, ordered by outpoint, until cb returns false
+    template<typename Callback>
+    void ForEachInGroup(const CTokenGroupID& grpID, Callback&& cb) const
+    {
+        auto it = mapGroups.find(grpID);
+        if (it == mapGroups.end()) {
+            return;
+        }
+        for (const auto& outpoint : it->second) {
+            if (!cb(outpoint)) {
+                return;
+            }
+        }
+    }
+
+    //! Calls cb for the grouped outputs of all token groups, group by group and ordered by outpoint within a group, until cb returns false
+    template<typename Callback>
+    void ForEachGrouped(Callback&& cb) const
+    {
+        for (const auto& p : mapGroups) {
+            for (const auto& outpoint : p.second) {
+                if (!cb(outpoint)) {
+                    return;
+                }
+            }
+        }
+    }
+};
+
+/** Progress of a running ScanForWalletTransactions, see getwalletinfo */
+struct CWalletScanProgress
+{
+    int nStartHeight{-1};
+    //! last block which was applied to the wallet
+    int nHeight{-1};
+    int nTipHeight{-1};
+    int64_t nStartTimeMillis{0};
+    int64_t nBlocks{0};
+    int64_t nTxs{0};
+    //! transactions which were passed to AddToWalletIfInvolvingMe
+    int64_t nCandidateTxs{0};
+    //! blocks which were not read because their block filter did not match any wallet script
+    int64_t nSkippedBlocks{0};
+    int nThreads{0};
+};
+
 struct WalletTxHasher
 {
     StaticSaltedHasher h;
@@ -753,6 +905,8 @@ private:
     static std::atomic<bool> fFlushScheduled;
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet;
+    mutable CCriticalSection cs_scanProgress;
+    CWalletScanProgress scanProgress;
 
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
@@ -789,10 +943,51 @@ private:
     void AddToSpends(const uint256& wtxid);
 
     std::set<COutPoint> setWalletUTXO;
+    //! Same outputs as setWalletUTXO, indexed for coin selection. Only modify both through AddWalletUTXO/EraseWalletUTXO.
+    CWalletUTXOIndex utxoIndex;
+
+    bool AddWalletUTXO(const COutPoint& outpoint, const CTxOut& txout);
+    bool EraseWalletUTXO(const COutPoint& outpoint);
+    //! Adds or removes the outpoint depending on whether it's an unspent output of ours, requires cs_wallet (and
+    //! cs_main if a transaction spending it is in a block, see IsSpent)
+    void UpdateWalletUTXO(const COutPoint& outpoint);
+    //! Updates the outputs of wtx and the outputs it spends
+    void UpdateWalletUTXOs(const CWalletTx& wtx);
+
+    /**
+     * Balances are maintained incrementally: each transaction's contribution is kept in mapBalanceContributions and
+     * only recalculated when the transaction was marked dirty (see CWalletTx::MarkDirty) or when it depends on state
+     * which changes without a wallet event (unconfirmed, immature). Guarded by cs_main and cs_wallet, except for the
+     * dirty state which is guarded by cs_balancesDirty as MarkDirty might be called on transactions outside of mapWallet.
+     */
+    mutable CWalletBalances balancesTotal;
+    mutable std::map<uint256, CWalletBalances> mapBalanceContributions;
+    mutable std::set<uint256> setBalanceVolatileTxs;
+    mutable CCriticalSection cs_balancesDirty;
+    mutable std::set<uint256> setBalanceDirtyTxs;
+    mutable bool fBalancesFullyDirty;
+    bool fCheckBalances;
+
+    CWalletBalances GetTxBalances(const CWalletTx& wtx, bool& fVolatileRet) const;
+    void UpdateTxBalances(const uint256& hash) const;
+    void UpdateBalances() const;
+    //! Calculates the balances from scratch, used to cross-check the incremental balances with -checkwalletbalances
+    CWalletBalances GetBalancesFullScan() const;
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
 
+    /**
+     * Batching database handle through which AddToWallet and MarkConflicted write while a CWalletTxBatchScope is
+     * active, so the transactions of a connected block or of a rescan chunk are written in one database transaction
+     * instead of one each. Guarded by cs_wallet.
+     */
+    std::unique_ptr<CWalletDB> pwalletdbTxBatch;
+    friend class CWalletTxBatchScope;
+
+    //! Returns pwalletdbTxBatch if a batch is active, otherwise a new handle owned by pwalletdbLocal
+    CWalletDB& GetTxWalletDB(std::unique_ptr<CWalletDB>& pwalletdbLocal, bool fFlushOnClose);
+
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected.
@@ -801,6 +996,12 @@ private:
 
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(CWalletDB &walletdb, const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal /*= false*/);
+    /**
+     * HD derive nCount new child keys of the same chain and add them to the wallet, returns their public keys in
+     * derivation order. Unlike calling DeriveNewChildKey repeatedly, the HD chain is decrypted, the chain's parent key
+     * derived and the chain counter written only once, and the keys are derived in parallel (see -keypoolthreads).
+     */
+    std::vector<CPubKey> DeriveNewChildKeys(CWalletDB &walletdb, uint32_t nAccountIndex, bool fInternal, size_t nCount);
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -906,6 +1107,8 @@ public:
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        fBalancesFullyDirty = true;
+        fCheckBalances = false;
 
         // Stake settings
         nStakeSplitThreshold = 2000;
@@ -949,6 +1152,21 @@ public:
     unsigned int FilterCoins(std::vector<COutput> &vCoins,
         std::function<bool(const CWalletTx *, const CTxOut *)>) const;
 
+    /**
+     * Same as above, but only looks at the outputs of the given token group.
+     */
+    unsigned int FilterCoins(std::vector<COutput> &vCoins, const CTokenGroupID& grpID,
+        std::function<bool(const CWalletTx *, const CTxOut *)>) const;
+
+    /**
+     * populate vCoins with the available grouped outputs of the given token group (or of all token groups if grpID is
+     * NoGroup), filtered by the passed lambda function. The lambda gets the token group info which was decoded when
+     * the output was added to the wallet, so the output scripts are not decoded again.
+       Returns the number of matches.
+     */
+    unsigned int FilterGroupedCoins(std::vector<COutput> &vCoins, const CTokenGroupID& grpID,
+        std::function<bool(const CWalletTx *, const CTxOut *, const CTokenGroupInfo&)>) const;
+
     /**
      * Return list of available coins and locked coins grouped by non-change output address.
      */
@@ -1004,6 +1222,18 @@ public:
     void AbortRescan() { fAbortRescan = true; }
     bool IsAbortingRescan() { return fAbortRescan; }
     bool IsScanning() { return fScanningWallet; }
+    //! Returns false if no rescan is running
+    bool GetScanProgress(CWalletScanProgress& progressRet) const;
+    /**
+     * Returns all scripts paying to the wallet's keys (P2PK and P2PKH), P2SH scripts and watch-only scripts, which
+     * are matched against block filters during rescans. Token group and other non-standard scripts are not included.
+     */
+    GCSFilter::ElementSet GetBlockFilterScripts() const;
+    /**
+     * Returns a copy of the wallet's public keys, redeem scripts and watch-only scripts. Rescan threads match outputs
+     * against it without holding cs_wallet.
+     */
+    std::shared_ptr<const CKeyStore> GetRescanKeyStore() const;
 
     /**
      * keystore implementation
@@ -1076,6 +1306,9 @@ public:
     bool GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bForceNew = false);
 
     void MarkDirty();
+    //! Adds the unspent outputs of ours from mapWallet to setWalletUTXO (and the UTXO index), done after loading
+    //! the wallet and after importing keys or scripts
+    void ScanWalletUTXOs();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void TransactionAddedToMempool(const CTransactionRef& tx, int64_t nAcceptTime) override;
@@ -1088,6 +1321,12 @@ public:
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    //! Marks the balance contribution of a transaction for recalculation, called by CWalletTx::MarkDirty
+    void MarkTxBalancesDirty(const uint256& hash) const;
+    //! Marks all balances for recalculation
+    void MarkBalancesDirty() const;
+    void SetCheckBalances(bool fCheck) { fCheckBalances = fCheck; }
+    CWalletBalances GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
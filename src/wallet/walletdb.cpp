@@ -10,6 +10,7 @@
 #include "base58.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
+#include "ctpl.h"
 #include "fs.h"
 #include "protocol.h"
 #include "reward-manager.h"
@@ -28,6 +29,108 @@
 // CWalletDB
 //
 
+CWalletDB::~CWalletDB()
+{
+    if (!FlushBatch()) {
+        LogPrintf("%s: failed to write buffered records to %s\n", __func__, m_dbw.GetName());
+    }
+}
+
+void CWalletDB::BeginBatch()
+{
+    if (!fBatching) {
+        fBatching = true;
+        nBatchStartTime = GetTimeMillis();
+    }
+}
+
+bool CWalletDB::BufferWrite(const CDataStream& ssKey, const CDataStream* pssValue, bool fOverwrite)
+{
+    CSerializeData vchKey(ssKey.begin(), ssKey.end());
+    auto it = mapPendingWrites.find(vchKey);
+
+    if (pssValue && !fOverwrite) {
+        // keep the DB_NOOVERWRITE semantics, the caller expects to learn about an existing record now
+        if (it != mapPendingWrites.end() ? !it->second.fErase : batch.ExistsRaw(vchKey)) {
+            return false;
+        }
+        // a record which is erased in this batch can be overwritten
+        fOverwrite = it != mapPendingWrites.end();
+    }
+
+    CPendingWrite& write = it != mapPendingWrites.end() ? it->second : mapPendingWrites[vchKey];
+    write.fErase = pssValue == nullptr;
+    write.fOverwrite = fOverwrite;
+    write.vchValue = pssValue ? CSerializeData(pssValue->begin(), pssValue->end()) : CSerializeData();
+
+    std::string strType;
+    try {
+        CDataStream ssType(ssKey);
+        ssType >> strType;
+    } catch (const std::exception&) {
+    }
+    if (IsKeyType(strType) || strType == "hdpubkey") {
+        fPendingKeyMaterial = true;
+    }
+
+    m_dbw.IncrementUpdateCounter();
+
+    if (mapPendingWrites.size() >= WALLETDB_BATCH_SIZE || GetTimeMillis() - nBatchStartTime >= WALLETDB_BATCH_INTERVAL) {
+        return FlushBatch();
+    }
+    return true;
+}
+
+bool CWalletDB::FlushBatch()
+{
+    nBatchStartTime = GetTimeMillis();
+    if (mapPendingWrites.empty()) {
+        return true;
+    }
+
+    // Nothing is buffered while the caller has a transaction open (see WriteIC), and TxnBegin() flushes before
+    // starting one, so the records are always written in a transaction of their own
+    assert(!batch.IsTxnActive());
+    bool fWritten = batch.TxnBegin();
+    if (fWritten) {
+        for (const auto& entry : mapPendingWrites) {
+            const CPendingWrite& write = entry.second;
+            if (write.fErase ? !batch.EraseRaw(entry.first) : !batch.WriteRaw(entry.first, write.vchValue, write.fOverwrite)) {
+                fWritten = false;
+                break;
+            }
+        }
+        if (fWritten) {
+            fWritten = batch.TxnCommit();
+        } else {
+            batch.TxnAbort();
+        }
+    }
+    bool fSuccess = fWritten;
+    if (fSuccess && fPendingKeyMaterial) {
+        fSuccess = batch.SyncLog();
+    }
+
+    LogPrint(BCLog::DB, "%s: %s %u records%s\n", __func__, fSuccess ? "wrote" : "failed to write",
+        mapPendingWrites.size(), fPendingKeyMaterial ? " (synced)" : "");
+
+    if (!fWritten) {
+        // None of the records were written, keep them for the next flush
+        return false;
+    }
+    mapPendingWrites.clear();
+    fPendingKeyMaterial = false;
+    return fSuccess;
+}
+
+bool CWalletDB::SyncBatch()
+{
+    if (!FlushBatch()) {
+        return false;
+    }
+    return batch.SyncLog();
+}
+
 bool CWalletDB::WriteName(const std::string& strAddress, const std::string& strName)
 {
     return WriteIC(std::make_pair(std::string("name"), strAddress), strName);
@@ -125,6 +228,7 @@ bool CWalletDB::WriteBestBlock(const CBlockLocator& locator)
 
 bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
 {
+    if (!FlushBatch()) return false;
     if (batch.Read(std::string("bestblock"), locator) && !locator.vHave.empty()) return true;
     return batch.Read(std::string("bestblock_nomerkle"), locator);
 }
@@ -141,6 +245,7 @@ bool CWalletDB::WriteDefaultKey(const CPubKey& vchPubKey)
 
 bool CWalletDB::ReadPool(int64_t nPool, CKeyPool& keypool)
 {
+    if (!FlushBatch()) return false;
     return batch.Read(std::make_pair(std::string("pool"), nPool), keypool);
 }
 
@@ -175,6 +280,7 @@ bool CWalletDB::WriteAutoCombineSettings(bool fEnable, CAmount nCombineThreshold
 bool CWalletDB::ReadAccount(const std::string& strAccount, CAccount& account)
 {
     account.SetNull();
+    if (!FlushBatch()) return false;
     return batch.Read(std::make_pair(std::string("acc"), strAccount), account);
 }
 
@@ -204,6 +310,8 @@ void CWalletDB::ListAccountCreditDebit(const std::string& strAccount, std::list<
 {
     bool fAllAccounts = (strAccount == "*");
 
+    if (!FlushBatch())
+        throw std::runtime_error(std::string(__func__) + ": cannot write buffered records");
     Dbc* pcursor = batch.GetCursor();
     if (!pcursor)
         throw std::runtime_error(std::string(__func__) + ": cannot create DB cursor");
@@ -262,6 +370,112 @@ public:
     }
 };
 
+/**
+ * Decodes the value of a "tx" record (the type was already read from ssKey) and checks it. Doesn't depend on the
+ * wallet, so LoadWallet runs it in parallel for many records.
+ */
+static bool DecodeTxRecord(CDataStream& ssKey, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgradedRet, std::string& strErr)
+{
+    uint256 hash;
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state, true) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    fUpgradedRet = false;
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgradedRet = true;
+    }
+    return true;
+}
+
+static void LoadTxRecord(CWallet* pwallet, const CWalletTx& wtx, bool fUpgraded, CWalletScanState& wss)
+{
+    if (fUpgraded)
+        wss.vWalletUpgrade.push_back(wtx.GetHash());
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->LoadToWallet(wtx);
+}
+
+/** Decodes and checks the value of a "key" or "wkey" record, like DecodeTxRecord it runs in parallel in LoadWallet */
+static bool DecodeKeyRecord(const std::string& strType, CDataStream& ssKey, CDataStream& ssValue, CPubKey& vchPubKey, CKey& key, std::string& strErr)
+{
+    ssKey >> vchPubKey;
+    if (!vchPubKey.IsValid())
+    {
+        strErr = "Error reading wallet database: CPubKey corrupt";
+        return false;
+    }
+    CPrivKey pkey;
+    uint256 hash;
+
+    if (strType == "key")
+    {
+        ssValue >> pkey;
+    } else {
+        CWalletKey wkey;
+        ssValue >> wkey;
+        pkey = wkey.vchPrivKey;
+    }
+
+    // Old wallets store keys as "key" [pubkey] => [privkey]
+    // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
+    // using EC operations as a checksum.
+    // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
+    // remaining backwards-compatible.
+    try
+    {
+        ssValue >> hash;
+    }
+    catch (...) {}
+
+    bool fSkipCheck = false;
+
+    if (!hash.IsNull())
+    {
+        // hash pubkey/privkey to accelerate wallet load
+        std::vector<unsigned char> vchKey;
+        vchKey.reserve(vchPubKey.size() + pkey.size());
+        vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
+        vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
+
+        if (Hash(vchKey.begin(), vchKey.end()) != hash)
+        {
+            strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+            return false;
+        }
+
+        fSkipCheck = true;
+    }
+
+    if (!key.Load(pkey, vchPubKey, fSkipCheck))
+    {
+        strErr = "Error reading wallet database: CPrivKey corrupt";
+        return false;
+    }
+    return true;
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr)
@@ -285,38 +499,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state, true) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgraded;
+            if (!DecodeTxRecord(ssKey, ssValue, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
+            LoadTxRecord(pwallet, wtx, fUpgraded, wss);
         }
         else if (strType == "acentry")
         {
@@ -348,62 +535,12 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "key" || strType == "wkey")
         {
-            CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            if (!vchPubKey.IsValid())
-            {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
-            }
-            CKey key;
-            CPrivKey pkey;
-            uint256 hash;
-
             if (strType == "key")
-            {
                 wss.nKeys++;
-                ssValue >> pkey;
-            } else {
-                CWalletKey wkey;
-                ssValue >> wkey;
-                pkey = wkey.vchPrivKey;
-            }
-
-            // Old wallets store keys as "key" [pubkey] => [privkey]
-            // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
-            // using EC operations as a checksum.
-            // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
-            // remaining backwards-compatible.
-            try
-            {
-                ssValue >> hash;
-            }
-            catch (...) {}
-
-            bool fSkipCheck = false;
-
-            if (!hash.IsNull())
-            {
-                // hash pubkey/privkey to accelerate wallet load
-                std::vector<unsigned char> vchKey;
-                vchKey.reserve(vchPubKey.size() + pkey.size());
-                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
-                vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
-
-                if (Hash(vchKey.begin(), vchKey.end()) != hash)
-                {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
-                }
-
-                fSkipCheck = true;
-            }
-
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
-            {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
+            CPubKey vchPubKey;
+            CKey key;
+            if (!DecodeKeyRecord(strType, ssKey, ssValue, vchPubKey, key, strErr))
                 return false;
-            }
             if (!pwallet->LoadKey(key, vchPubKey))
             {
                 strErr = "Error reading wallet database: LoadKey failed";
@@ -569,6 +706,73 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
     return true;
 }
 
+/**
+ * A record read from the database by LoadWallet. The decoding of "tx", "key" and "wkey" records is the expensive part
+ * of loading a wallet and doesn't depend on the wallet, so it's done ahead in parallel by DecodeLoadRecord. All records
+ * are then applied to the wallet in database order.
+ */
+struct CWalletLoadRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+
+    bool fDecoded;
+    bool fDecodeOk;
+    std::string strType;
+    std::string strErr;
+    std::unique_ptr<CWalletTx> pwtx;
+    bool fTxUpgraded;
+    CPubKey vchPubKey;
+    std::unique_ptr<CKey> pkey;
+
+    CWalletLoadRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), fDecoded(false), fDecodeOk(false), fTxUpgraded(false) {}
+};
+
+static void DecodeLoadRecord(CWalletLoadRecord& record)
+{
+    // keys are short, peek at the type with a copy so other records stay untouched for ReadKeyValue
+    CDataStream ssKey(record.ssKey);
+    std::string strType;
+    try {
+        ssKey >> strType;
+    } catch (...) {
+        return;
+    }
+    if (strType != "tx" && strType != "key" && strType != "wkey") {
+        return;
+    }
+
+    record.fDecoded = true;
+    record.strType = strType;
+    try {
+        if (strType == "tx") {
+            record.pwtx.reset(new CWalletTx());
+            record.fDecodeOk = DecodeTxRecord(ssKey, record.ssValue, *record.pwtx, record.fTxUpgraded, record.strErr);
+        } else {
+            record.pkey.reset(new CKey());
+            record.fDecodeOk = DecodeKeyRecord(strType, ssKey, record.ssValue, record.vchPubKey, *record.pkey, record.strErr);
+        }
+    } catch (...) {
+        record.fDecodeOk = false;
+    }
+}
+
+static bool ApplyDecodedRecord(CWallet* pwallet, CWalletLoadRecord& record, CWalletScanState& wss, std::string& strErr)
+{
+    if (record.strType == "key")
+        wss.nKeys++;
+    if (!record.fDecodeOk)
+        return false;
+
+    if (record.strType == "tx") {
+        LoadTxRecord(pwallet, *record.pwtx, record.fTxUpgraded, wss);
+    } else if (!pwallet->LoadKey(*record.pkey, record.vchPubKey)) {
+        strErr = "Error reading wallet database: LoadKey failed";
+        return false;
+    }
+    return true;
+}
+
 bool CWalletDB::IsKeyType(const std::string& strType)
 {
     return (strType== "key" || strType == "wkey" ||
@@ -582,8 +786,15 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     CWalletScanState wss;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
+    size_t nTotalRecords = 0;
+    size_t nDecodedRecords = 0;
+    int64_t nTimeRead = 0;
+    int64_t nTimeDecode = 0;
+    int64_t nTimeApply = 0;
 
     LOCK2(cs_main, pwallet->cs_wallet);
+    if (!FlushBatch())
+        return DB_LOAD_FAIL;
     try {
         int nMinVersion = 0;
         if (batch.Read((std::string)"minversion", nMinVersion))
@@ -601,42 +812,104 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
-        while (true)
+        int nThreads = std::max(1, std::min(GetNumCores(), MAX_WALLET_LOAD_THREADS));
+        std::unique_ptr<ctpl::thread_pool> pool;
+        if (nThreads > 1) {
+            pool.reset(new ctpl::thread_pool(nThreads));
+            RenameThreadPool(*pool, "ion-walletload");
+        }
+
+        // Records are read in chunks. The records of a chunk are decoded in parallel and then applied in order.
+        bool fEnd = false;
+        while (!fEnd)
         {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
-                break;
-            else if (ret != 0)
+            int64_t nTime1 = GetTimeMicros();
+            std::vector<CWalletLoadRecord> vRecords(WALLET_LOAD_CHUNK_SIZE);
+            size_t nRecords = 0;
+            while (nRecords < vRecords.size())
             {
-                LogPrintf("Error reading next record from wallet database\n");
-                return DB_CORRUPT;
+                // Read next record
+                CWalletLoadRecord& record = vRecords[nRecords];
+                int ret = batch.ReadAtCursor(pcursor, record.ssKey, record.ssValue);
+                if (ret == DB_NOTFOUND) {
+                    fEnd = true;
+                    break;
+                }
+                else if (ret != 0)
+                {
+                    pcursor->close();
+                    LogPrintf("Error reading next record from wallet database\n");
+                    return DB_CORRUPT;
+                }
+                nRecords++;
+            }
+            vRecords.resize(nRecords);
+
+            int64_t nTime2 = GetTimeMicros();
+            if (pool && nRecords >= (size_t)nThreads) {
+                size_t nChunkSize = (nRecords + nThreads - 1) / nThreads;
+                std::vector<std::future<void>> vFutures;
+                for (size_t nBegin = 0; nBegin < nRecords; nBegin += nChunkSize) {
+                    size_t nEnd = std::min(nBegin + nChunkSize, nRecords);
+                    vFutures.emplace_back(pool->push([&vRecords, nBegin, nEnd](int) {
+                        for (size_t i = nBegin; i < nEnd; i++) {
+                            DecodeLoadRecord(vRecords[i]);
+                        }
+                    }));
+                }
+                for (auto& future : vFutures) {
+                    future.get();
+                }
+            } else {
+                for (CWalletLoadRecord& record : vRecords) {
+                    DecodeLoadRecord(record);
+                }
             }
 
-            // Try to be tolerant of single corrupt records:
-            std::string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+            int64_t nTime3 = GetTimeMicros();
+            for (CWalletLoadRecord& record : vRecords)
             {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType))
-                    result = DB_CORRUPT;
-                else
+                // Try to be tolerant of single corrupt records:
+                std::string strType, strErr;
+                bool fOk;
+                if (record.fDecoded) {
+                    strType = record.strType;
+                    strErr = record.strErr;
+                    fOk = ApplyDecodedRecord(pwallet, record, wss, strErr);
+                    nDecodedRecords++;
+                } else {
+                    fOk = ReadKeyValue(pwallet, record.ssKey, record.ssValue, wss, strType, strErr);
+                }
+                if (!fOk)
                 {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        gArgs.SoftSetBoolArg("-rescan", true);
+                    // losing keys is considered a catastrophic error, anything else
+                    // we assume the user can live with:
+                    if (IsKeyType(strType))
+                        result = DB_CORRUPT;
+                    else
+                    {
+                        // Leave other errors alone, if we try to fix them we might make things worse.
+                        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                        if (strType == "tx")
+                            // Rescan if there is a bad transaction record:
+                            gArgs.SoftSetBoolArg("-rescan", true);
+                    }
                 }
+                if (!strErr.empty())
+                    LogPrintf("%s\n", strErr);
             }
-            if (!strErr.empty())
-                LogPrintf("%s\n", strErr);
+            int64_t nTime4 = GetTimeMicros();
+
+            nTotalRecords += nRecords;
+            nTimeRead += nTime2 - nTime1;
+            nTimeDecode += nTime3 - nTime2;
+            nTimeApply += nTime4 - nTime3;
         }
         pcursor->close();
 
+        LogPrintf("%s: read %u records in %.2fms, decoded %u of them in %.2fms using %d threads, applied them in %.2fms\n", __func__,
+            nTotalRecords, nTimeRead * 0.001, nDecodedRecords, nTimeDecode * 0.001, nThreads, nTimeApply * 0.001);
+
         // Store initial external keypool size since we mostly use external keys in mixing
         pwallet->nKeysLeftSinceAutoBackup = pwallet->KeypoolCountExternalKeys();
         LogPrintf("nKeysLeftSinceAutoBackup: %d\n", pwallet->nKeysLeftSinceAutoBackup);
@@ -689,6 +962,8 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 
 DBErrors CWalletDB::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CWalletTx>& vWtx)
 {
+    if (!FlushBatch())
+        return DB_LOAD_FAIL;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
@@ -918,6 +1193,7 @@ bool CWalletDB::WriteHDPubKey(const CHDPubKey& hdPubKey, const CKeyMetadata& key
 
 bool CWalletDB::TxnBegin()
 {
+    if (!FlushBatch()) return false;
     return batch.TxnBegin();
 }
 
@@ -933,10 +1209,12 @@ bool CWalletDB::TxnAbort()
 
 bool CWalletDB::ReadVersion(int& nVersion)
 {
+    if (!FlushBatch()) return false;
     return batch.ReadVersion(nVersion);
 }
 
 bool CWalletDB::WriteVersion(int nVersion)
 {
+    if (!FlushBatch()) return false;
     return batch.WriteVersion(nVersion);
 }
@@ -13,6 +13,7 @@
 #include "key.h"
 
 #include <list>
+#include <map>
 #include <stdint.h>
 #include <string>
 #include <utility>
@@ -34,6 +35,14 @@
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Number of buffered records after which a batching CWalletDB writes them in one database transaction
+static const size_t WALLETDB_BATCH_SIZE = 1000;
+//! Maximum time in milliseconds a batching CWalletDB holds back buffered records
+static const int64_t WALLETDB_BATCH_INTERVAL = 1000;
+//! Number of records LoadWallet reads before decoding them in parallel
+static const size_t WALLET_LOAD_CHUNK_SIZE = 10000;
+//! Maximum number of threads decoding records in LoadWallet
+static const int MAX_WALLET_LOAD_THREADS = 16;
 
 class CAccount;
 class CAccountingEntry;
@@ -93,6 +102,14 @@ public:
  * This should really be named CWalletDBBatch, as it represents a single transaction at the
  * database. It will be committed when the object goes out of scope.
  * Optionally (on by default) it will flush to disk as well.
+ *
+ * After BeginBatch() records are not written one by one (each in its own auto-committed BDB transaction) but
+ * buffered, and written in a single transaction once WALLETDB_BATCH_SIZE records are pending, WALLETDB_BATCH_INTERVAL
+ * passed, the object is destroyed or FlushBatch()/SyncBatch() is called. Reads through the same object flush first.
+ * Batches containing key material are synced to disk when they are written. If a batch can't be written, the write
+ * (or read) triggering the flush fails and the records stay buffered for the next flush.
+ * Records written inside a transaction started with TxnBegin() are not buffered, so they are committed or aborted
+ * together with it.
  */
 class CWalletDB
 {
@@ -100,6 +117,13 @@ private:
     template <typename K, typename T>
     bool WriteIC(const K& key, const T& value, bool fOverwrite = true)
     {
+        if (fBatching && !batch.IsTxnActive()) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey << key;
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            ssValue << value;
+            return BufferWrite(ssKey, &ssValue, fOverwrite);
+        }
         if (!batch.Write(key, value, fOverwrite)) {
             return false;
         }
@@ -110,6 +134,11 @@ private:
     template <typename K>
     bool EraseIC(const K& key)
     {
+        if (fBatching && !batch.IsTxnActive()) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey << key;
+            return BufferWrite(ssKey, nullptr, true);
+        }
         if (!batch.Erase(key)) {
             return false;
         }
@@ -117,12 +146,30 @@ private:
         return true;
     }
 
+    struct CPendingWrite
+    {
+        bool fErase;
+        bool fOverwrite;
+        CSerializeData vchValue;
+    };
+
+    /** Buffers a write (or an erase if pssValue is null), the last write of a key wins */
+    bool BufferWrite(const CDataStream& ssKey, const CDataStream* pssValue, bool fOverwrite);
+
 public:
     CWalletDB(CWalletDBWrapper& dbw, const char* pszMode = "r+", bool _fFlushOnClose = true) :
         batch(dbw, pszMode, _fFlushOnClose),
         m_dbw(dbw)
     {
     }
+    ~CWalletDB();
+
+    //! Start buffering writes, see above
+    void BeginBatch();
+    //! Write all buffered records in one database transaction, returns false if they could not be written
+    bool FlushBatch();
+    //! Write all buffered records and sync the database log, so they survive a crash
+    bool SyncBatch();
 
     bool WriteName(const std::string& strAddress, const std::string& strName);
     bool EraseName(const std::string& strAddress);
@@ -208,6 +255,11 @@ private:
     CDB batch;
     CWalletDBWrapper& m_dbw;
 
+    bool fBatching{false};
+    bool fPendingKeyMaterial{false};
+    int64_t nBatchStartTime{0};
+    std::map<CSerializeData, CPendingWrite> mapPendingWrites;
+
     CWalletDB(const CWalletDB&);
     void operator=(const CWalletDB&);
 };
@@ -117,6 +117,15 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(multitxids[4], txid2)
         assert_equal(multitxids[5], txidb2)
 
+        # Check that paginated queries return the same txids page by page
+        self.log.info("Testing paginated txid queries...")
+        page = self.nodes[1].getaddresstxids({"addresses": ["93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB", "yMNJePdcKvXtWWQnFYHNeJ5u8TF2v1dfK4"], "limit": 4})
+        assert_equal(page["txids"], multitxids[0:4])
+        page = self.nodes[1].getaddresstxids({"addresses": ["93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB", "yMNJePdcKvXtWWQnFYHNeJ5u8TF2v1dfK4"], "limit": 4, "cursor": page["cursor"]})
+        assert_equal(page["txids"], multitxids[4:6])
+        assert("cursor" not in page)
+        assert_raises_rpc_error(-8, "Invalid cursor", self.nodes[1].getaddresstxids, {"addresses": ["93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB"], "cursor": "00"})
+
         # Check that balances are correct
         balance0 = self.nodes[1].getaddressbalance("93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB")
         assert_equal(balance0["balance"], 45 * 100000000)
@@ -145,6 +154,8 @@ class AddressIndexTest(BitcoinTestFramework):
         self.log.info("Testing balances...")
         balance0 = self.nodes[1].getaddressbalance("93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB")
         assert_equal(balance0["balance"], 45 * 100000000 + 21)
+        assert_equal(balance0["txcount"], 4)
+        assert_equal(balance0["utxocount"], 5)
 
         # Check that balances are correct after spending
         self.log.info("Testing balances after spending...")
@@ -182,6 +193,9 @@ class AddressIndexTest(BitcoinTestFramework):
 
         balance2 = self.nodes[1].getaddressbalance(address2)
         assert_equal(balance2["balance"], change_amount)
+        assert_equal(balance2["txcount"], 2)
+        assert_equal(balance2["utxocount"], 1)
+        assert(balance2["lastheight"] > balance1["lastheight"])
 
         # Check that deltas are returned correctly
         deltas = self.nodes[1].getaddressdeltas({"addresses": [address2], "start": 0, "end": 200})
@@ -196,6 +210,20 @@ class AddressIndexTest(BitcoinTestFramework):
         deltasAll = self.nodes[1].getaddressdeltas({"addresses": [address2]})
         assert_equal(len(deltasAll), len(deltas))
 
+        # Check that paginated deltas add up to all deltas
+        pagedDeltas = []
+        cursor = None
+        while True:
+            query = {"addresses": [address2], "limit": 1}
+            if cursor is not None:
+                query["cursor"] = cursor
+            page = self.nodes[1].getaddressdeltas(query)
+            pagedDeltas += page["deltas"]
+            if "cursor" not in page:
+                break
+            cursor = page["cursor"]
+        assert_equal(pagedDeltas, deltasAll)
+
         # Check that deltas can be returned from range of block heights
         deltas = self.nodes[1].getaddressdeltas({"addresses": [address2], "start": 113, "end": 113})
         assert_equal(len(deltas), 1)
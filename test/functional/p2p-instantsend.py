@@ -123,6 +123,12 @@ class InstantSendTest(IonTestFramework):
         for node in self.nodes:
             self.wait_for_instantlock(is_id, node)
         assert_raises_rpc_error(-5, "No such mempool or blockchain transaction", isolated.getrawtransaction, dblspnd_txid)
+        # the unconfirmed lock is held in the in-memory index
+        for node in self.nodes:
+            info = node.getinstantsendinfo()
+            assert info["unconfirmedindex"]["count"] >= 1
+            assert info["unconfirmedindex"]["usage"] <= info["unconfirmedindex"]["maxusage"]
+            assert_equal(info["unconfirmedindex"]["evicted"], 0)
         # send coins back to the controller node without waiting for confirmations
         receiver.sendtoaddress(self.nodes[0].getnewaddress(), 0.9, "", "", True)
         assert_equal(receiver.getwalletinfo()["balance"], 0)